@@ -0,0 +1,84 @@
+/*!
+  \file block_inflater.cc
+  \brief implementation of gzip member inflation
+  \copyright Released under the MIT License. Copyright
+  2023 Lightning Auriga
+ */
+
+#include "imputed-data-dynamic-threshold/block_inflater.h"
+
+namespace iddt = imputed_data_dynamic_threshold;
+
+#ifdef IMPUTED_DATA_DYNAMIC_THRESHOLD_HAVE_LIBDEFLATE
+iddt::block_inflater::block_inflater()
+    : _decompressor(libdeflate_alloc_decompressor()) {
+  if (!_decompressor) {
+    throw std::runtime_error("cannot initialize libdeflate decompressor");
+  }
+}
+
+iddt::block_inflater::~block_inflater() throw() {
+  libdeflate_free_decompressor(_decompressor);
+}
+#else
+iddt::block_inflater::block_inflater() : _strm(z_stream()) {
+  if (inflateInit2(&_strm, 15 + 16) != Z_OK) {
+    throw std::runtime_error("cannot initialize zlib stream");
+  }
+}
+
+iddt::block_inflater::~block_inflater() throw() { inflateEnd(&_strm); }
+#endif
+
+void iddt::block_inflater::inflate_member(const char *data, std::size_t size,
+                                          std::string *buffer) {
+  if (!data || !buffer) {
+    throw std::logic_error("block_inflater::inflate_member: null pointer");
+  }
+  // 10 byte header, at least an empty deflate block, 8 byte trailer
+  if (size < 20) {
+    throw std::runtime_error("block_inflater: truncated gzip member");
+  }
+  // ISIZE, the last four bytes, is the inflated length, little-endian
+  const unsigned char *trailer =
+      reinterpret_cast<const unsigned char *>(data + size - 4);
+  std::size_t inflated_size =
+      static_cast<std::size_t>(trailer[0]) |
+      static_cast<std::size_t>(trailer[1]) << 8 |
+      static_cast<std::size_t>(trailer[2]) << 16 |
+      static_cast<std::size_t>(trailer[3]) << 24;
+  std::size_t offset = buffer->size();
+  buffer->resize(offset + inflated_size);
+  char *out = &(*buffer)[0] + offset;
+#ifdef IMPUTED_DATA_DYNAMIC_THRESHOLD_HAVE_LIBDEFLATE
+  std::size_t actual = 0;
+  if (libdeflate_gzip_decompress(_decompressor, data, size, out,
+                                 inflated_size,
+                                 &actual) != LIBDEFLATE_SUCCESS ||
+      actual != inflated_size) {
+    buffer->resize(offset);
+    throw std::runtime_error("block_inflater: cannot inflate gzip member");
+  }
+#else
+  if (inflateReset(&_strm) != Z_OK) {
+    buffer->resize(offset);
+    throw std::runtime_error("cannot reset zlib stream");
+  }
+  _strm.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+  _strm.avail_in = size;
+  _strm.next_out = reinterpret_cast<Bytef *>(out);
+  _strm.avail_out = inflated_size;
+  if (inflate(&_strm, Z_FINISH) != Z_STREAM_END || _strm.avail_out) {
+    buffer->resize(offset);
+    throw std::runtime_error("block_inflater: cannot inflate gzip member");
+  }
+#endif
+}
+
+std::string iddt::block_inflater::backend() {
+#ifdef IMPUTED_DATA_DYNAMIC_THRESHOLD_HAVE_LIBDEFLATE
+  return "libdeflate";
+#else
+  return "zlib";
+#endif
+}
@@ -0,0 +1,76 @@
+/*!
+  \file block_inflater.h
+  \brief inflate independent gzip members with the fastest available
+  backend
+  \copyright Released under the MIT License. Copyright
+  2023 Lightning Auriga
+ */
+
+#ifndef IMPUTED_DATA_DYNAMIC_THRESHOLD_BLOCK_INFLATER_H_
+#define IMPUTED_DATA_DYNAMIC_THRESHOLD_BLOCK_INFLATER_H_
+
+#include <zlib.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+#include "imputed-data-dynamic-threshold/config.h"
+
+#ifdef IMPUTED_DATA_DYNAMIC_THRESHOLD_HAVE_LIBDEFLATE
+#include <libdeflate.h>
+#endif
+
+namespace imputed_data_dynamic_threshold {
+/*!
+  \brief inflate complete gzip members, such as bgzf blocks
+
+  the backend is chosen at configure time: libdeflate when it is
+  found, and zlib otherwise. libdeflate inflates a whole member in
+  one call into a buffer sized from the member's trailer, which
+  suits bgzf blocks exactly. gzip streams that are not split into
+  blocks are read sequentially with zlib regardless.
+ */
+class block_inflater {
+ public:
+  /*!
+    \brief constructor
+   */
+  block_inflater();
+  /*!
+    \brief destructor
+   */
+  ~block_inflater() throw();
+  /*!
+    \brief inflate a single gzip member and append it to a buffer
+    @param data start of the compressed member
+    @param size number of bytes in the compressed member
+    @param buffer destination for inflated text
+
+    the member's trailer gives its inflated size, which must fit in
+    memory; this holds for bgzf blocks, which are at most 64KB
+   */
+  void inflate_member(const char *data, std::size_t size,
+                      std::string *buffer);
+  /*!
+    \brief get the name of the configured backend
+    \return name of the library inflating members
+   */
+  static std::string backend();
+
+ private:
+  /*!
+    \brief copy constructor; disabled
+    @param obj existing block_inflater object
+   */
+  block_inflater(const block_inflater &obj);
+#ifdef IMPUTED_DATA_DYNAMIC_THRESHOLD_HAVE_LIBDEFLATE
+  libdeflate_decompressor *_decompressor;  //!< reusable libdeflate state
+#else
+  z_stream _strm;  //!< reusable zlib stream for gzip members
+#endif
+};
+}  // namespace imputed_data_dynamic_threshold
+
+#endif  // IMPUTED_DATA_DYNAMIC_THRESHOLD_BLOCK_INFLATER_H_
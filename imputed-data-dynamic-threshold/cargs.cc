@@ -50,7 +50,24 @@ void imputed_data_dynamic_threshold::cargs::initialize_options() {
       "vcf-info-imputed-indicator",
       boost::program_options::value<std::string>()->default_value("IMP"),
       "vcf INFO field tag indicating that a variant was imputed from a "
-      "reference");
+      "reference")(
+      "threads,t", boost::program_options::value<unsigned>()->default_value(1),
+      "number of worker threads for loading and second-pass filtering of "
+      "input files")(
+      "pipeline",
+      "load each input file on separate decompression, parsing and "
+      "aggregation threads, and report how long each stage waited; files "
+      "are loaded one at a time, and --threads only sizes the bcf "
+      "decompression pool (default: no)")(
+      "cache-dir", boost::program_options::value<std::string>(),
+      "(optional) directory of per-file r2 summaries, so that later runs "
+      "with unchanged input files and bins skip loading them; only used "
+      "if second-pass mode is enabled (default: no cache)")(
+      "cache-sites",
+      "also keep a table of the parsed sites of each input file in "
+      "--cache-dir, from which later second passes report passing "
+      "variants without reading input files again; not used with "
+      "--filter-info-files (default: no)");
 }
 
 iddt::cargs::cargs(int argc, const char **const argv)
@@ -72,11 +89,20 @@ bool iddt::cargs::help() const { return compute_flag("help"); }
 
 bool iddt::cargs::second_pass() const { return compute_flag("second-pass"); }
 
+bool iddt::cargs::pipeline() const { return compute_flag("pipeline"); }
+
+bool iddt::cargs::cache_sites() const { return compute_flag("cache-sites"); }
+
 std::string iddt::cargs::get_filter_info_files_dir() const {
   if (_vm.count("filter-info-files"))
     return compute_parameter<std::string>("filter-info-files");
   return "";
 }
+std::string iddt::cargs::get_cache_dir() const {
+  if (_vm.count("cache-dir"))
+    return compute_parameter<std::string>("cache-dir");
+  return "";
+}
 std::vector<double> iddt::cargs::get_maf_bin_boundaries() const {
   std::string tag = "maf-bin-boundaries";
   std::vector<double> res;
@@ -160,6 +186,12 @@ float iddt::cargs::get_baseline_r2() const {
         "--baseline-r2");
   return res;
 }
+unsigned iddt::cargs::get_threads() const {
+  unsigned res = compute_parameter<unsigned>("threads");
+  if (!res)
+    throw std::runtime_error("--threads: at least one thread is required");
+  return res;
+}
 std::string iddt::cargs::get_output_table_filename() const {
   if (_vm.count("output-table"))
     return compute_parameter<std::string>("output-table");
@@ -79,6 +79,26 @@ class cargs {
   */
   bool second_pass() const;
 
+  /*!
+    \brief determine whether the user has requested staged file loading
+    \return whether the user has requested this run mode
+
+    each input file is inflated, parsed and aggregated on three
+    threads at once, and the time each stage spent waiting on
+    the others is reported
+  */
+  bool pipeline() const;
+
+  /*!
+    \brief determine whether the user has requested cached site tables
+    \return whether the user has requested this run mode
+
+    this is an optional mode on top of --cache-dir. the r2, MAF bin
+    and ID of every site of each input file are kept in the cache, and
+    a second pass over an unchanged file reads them instead of the file
+  */
+  bool cache_sites() const;
+
   /*!
     \brief get optional output directory for filtered info files
     \return optional output directory for filtered info files
@@ -88,6 +108,16 @@ class cargs {
     the same filename as input
    */
   std::string get_filter_info_files_dir() const;
+  /*!
+    \brief get optional directory of cached per-file r2 summaries
+    \return optional directory of cached per-file r2 summaries
+
+    this is an optional mode on top of second-pass mode. input files
+    with a summary from an earlier run, made with the same bins and
+    parsing settings, are not loaded again, and summaries of the other
+    files are added to the directory.
+   */
+  std::string get_cache_dir() const;
   /*!
     \brief get boundaries of minor allele frequency bins for r2 calculations
     \return MAF bin boundaries from command line
@@ -156,6 +186,17 @@ class cargs {
    */
   float get_baseline_r2() const;
 
+  /*!
+    \brief get number of worker threads for input parsing
+    \return number of worker threads for input parsing
+
+    input files are distributed across this many workers during
+    loading and during second-pass reporting, and bgzf input read
+    whole is inflated on a pool of this many threads. results are
+    merged in input order, so output does not depend on this setting.
+   */
+  unsigned get_threads() const;
+
   /*!
     \brief get output tabular result filename
     \return output tabular result filename from command line
@@ -0,0 +1,54 @@
+/*!
+  \file decompression_pool.cc
+  \brief implementation of the shared decompression thread pool
+  \copyright Released under the MIT License. Copyright
+  2023 Lightning Auriga
+ */
+
+#include "imputed-data-dynamic-threshold/decompression_pool.h"
+
+namespace iddt = imputed_data_dynamic_threshold;
+
+iddt::decompression_pool::decompression_pool(unsigned n_threads)
+    : _n_threads(n_threads), _pool(0) {
+  if (!_n_threads) {
+    throw std::logic_error(
+        "decompression_pool: at least one thread is required");
+  }
+  _pool = hts_tpool_init(_n_threads);
+  if (!_pool) {
+    throw std::runtime_error(
+        "decompression_pool: cannot start decompression threads");
+  }
+  // htslib's own default: enough queued blocks to keep every thread busy
+  _handle.pool = _pool;
+  _handle.qsize = 2 * _n_threads;
+}
+
+iddt::decompression_pool::~decompression_pool() throw() {
+  if (_pool) hts_tpool_destroy(_pool);
+}
+
+unsigned iddt::decompression_pool::size() const { return _n_threads; }
+
+void iddt::decompression_pool::attach(BGZF *input) const {
+  if (!input) {
+    throw std::logic_error("decompression_pool::attach: null pointer");
+  }
+  // only bgzf input is split into independently inflated blocks
+  if (bgzf_compression(input) != bgzf) return;
+  if (bgzf_thread_pool(input, _pool, _handle.qsize)) {
+    throw std::runtime_error(
+        "decompression_pool::attach: cannot attach reader to pool");
+  }
+}
+
+void iddt::decompression_pool::attach(htsFile *input) const {
+  if (!input) {
+    throw std::logic_error("decompression_pool::attach: null pointer");
+  }
+  if (hts_set_thread_pool(input, &_handle)) {
+    throw std::runtime_error(
+        "decompression_pool::attach: cannot attach reader to pool");
+  }
+}
@@ -0,0 +1,64 @@
+/*!
+  \file decompression_pool.h
+  \brief shared htslib thread pool for block decompression
+  \copyright Released under the MIT License. Copyright
+  2023 Lightning Auriga
+ */
+
+#ifndef IMPUTED_DATA_DYNAMIC_THRESHOLD_DECOMPRESSION_POOL_H_
+#define IMPUTED_DATA_DYNAMIC_THRESHOLD_DECOMPRESSION_POOL_H_
+
+#include <stdexcept>
+
+#include "htslib/bgzf.h"
+#include "htslib/hts.h"
+#include "htslib/thread_pool.h"
+
+namespace imputed_data_dynamic_threshold {
+/*!
+  \brief a single htslib thread pool shared by every open reader
+
+  bgzf blocks of any reader attached to the pool are inflated on the
+  pool's threads, ahead of the thread consuming the text. readers of
+  plain gzip or flat input are unaffected by attachment.
+ */
+class decompression_pool {
+ public:
+  /*!
+    \brief constructor
+    @param n_threads number of decompression threads
+   */
+  explicit decompression_pool(unsigned n_threads);
+  /*!
+    \brief destructor; every attached reader must be closed first
+   */
+  ~decompression_pool() throw();
+  /*!
+    \brief get number of decompression threads
+    \return number of decompression threads
+   */
+  unsigned size() const;
+  /*!
+    \brief inflate the blocks of an open bgzf reader on the pool
+    @param input open bgzf read connection
+   */
+  void attach(BGZF *input) const;
+  /*!
+    \brief inflate the blocks of an open htslib file on the pool
+    @param input open htslib read connection, before its header is read
+   */
+  void attach(htsFile *input) const;
+
+ private:
+  /*!
+    \brief copy constructor; disabled
+    @param obj existing decompression_pool object
+   */
+  decompression_pool(const decompression_pool &obj);
+  unsigned _n_threads;  //!< number of decompression threads
+  hts_tpool *_pool;     //!< underlying htslib pool
+  mutable htsThreadPool _handle;  //!< pool as htslib readers expect it
+};
+}  // namespace imputed_data_dynamic_threshold
+
+#endif  // IMPUTED_DATA_DYNAMIC_THRESHOLD_DECOMPRESSION_POOL_H_
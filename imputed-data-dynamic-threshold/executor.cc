@@ -9,6 +9,28 @@
 
 namespace iddt = imputed_data_dynamic_threshold;
 
+namespace {
+// grid cells per unit r2 when values are counted rather than stored
+const unsigned r2_histogram_scale = 100000;
+
+/*!
+  \brief start fetching the input file after the one about to be read
+  @param info_files names of input minimac info files
+  @param vcf_files names of input vcfs
+  @param current index of the file about to be read, info files first
+ */
+void prefetch_next_file(const std::vector<std::string> &info_files,
+                        const std::vector<std::string> &vcf_files,
+                        unsigned current) {
+  unsigned next = current + 1;
+  if (next < info_files.size()) {
+    iddt::read_ahead_file::prefetch(info_files.at(next));
+  } else if (next - info_files.size() < vcf_files.size()) {
+    iddt::read_ahead_file::prefetch(vcf_files.at(next - info_files.size()));
+  }
+}
+}  // namespace
+
 iddt::executor::executor() {}
 iddt::executor::~executor() throw() {}
 
@@ -19,28 +41,175 @@ void iddt::executor::run(
     const float &baseline_r2, const std::string &output_table_filename,
     const std::string &output_list_filename, bool second_pass,
     const std::string &filter_info_files_dir, const std::string &vcf_r2_tag,
-    const std::string &vcf_af_tag, const std::string &vcf_imp_indicator) {
+    const std::string &vcf_af_tag, const std::string &vcf_imp_indicator,
+    unsigned n_threads, bool pipeline, const std::string &cache_dir,
+    bool cache_sites) {
+  // readers of whole files, including every bcf, inflate bgzf blocks
+  // on one pool shared across all workers
+  std::unique_ptr<decompression_pool> pool;
+  if (n_threads > 1) pool.reset(new decompression_pool(n_threads));
   imputed_data_dynamic_threshold::r2_bins bins;
   bins.set_baseline_r2(baseline_r2);
+  bins.set_decompression_pool(pool.get());
   std::cout << "creating MAF bins" << std::endl;
   bins.set_bin_boundaries(maf_bin_boundaries);
-  if (!info_files.empty()) {
-    std::cout << "iterating through specified info files" << std::endl;
-    for (std::vector<std::string>::const_iterator iter = info_files.begin();
-         iter != info_files.end(); ++iter) {
-      std::cout << "\t" << *iter << std::endl;
-      bins.load_info_file(*iter, !second_pass);
+  if (second_pass) {
+    // without IDs to report, r2 can be counted on the grid of the five
+    // decimals minimac4 and beagle print, rather than stored per variant
+    bins.set_histogram_scale(r2_histogram_scale);
+  }
+  // a parallel second pass splits plain gzip files at seek points
+  // recorded while the first pass inflates them
+  std::vector<std::unique_ptr<gzip_index> > indexes;
+  std::vector<gzip_index *> index_pointers;
+  if (second_pass && n_threads > 1 && !pipeline) {
+    for (unsigned i = 0; i < info_files.size() + vcf_files.size(); ++i) {
+      indexes.push_back(std::unique_ptr<gzip_index>(new gzip_index(1 << 20)));
+      index_pointers.push_back(indexes.back().get());
     }
   }
-  if (!vcf_files.empty()) {
-    std::cout << "iterating through specified vcf files" << std::endl;
-    for (std::vector<std::string>::const_iterator iter = vcf_files.begin();
-         iter != vcf_files.end(); ++iter) {
+  // in a second pass, every file is loaded into its own bins, and the
+  // summaries are added to the shared bins in input order, so that the
+  // thresholds are the same whether or not a cache supplies some of
+  // them; only files without a cached summary are loaded from input
+  std::vector<std::string> load_info_files(info_files);
+  std::vector<std::string> load_vcf_files(vcf_files);
+  std::vector<gzip_index *> load_indexes(index_pointers);
+  std::vector<r2_bins *> file_bins;
+  std::vector<unsigned> loaded;
+  std::unique_ptr<summary_cache> cache;
+  std::vector<std::unique_ptr<r2_bins> > summaries;
+  std::vector<char> ready;
+  std::vector<std::string> settings;
+  // filtered info files need whole lines, which site tables do not hold
+  bool use_sites = second_pass && !cache_dir.empty() && cache_sites &&
+                   filter_info_files_dir.empty();
+  if (second_pass) {
+    if (!cache_dir.empty()) {
+      cache.reset(new summary_cache(cache_dir));
+      std::cout << "checking summary cache \"" << cache_dir << "\""
+                << std::endl;
+    }
+    load_info_files.clear();
+    load_vcf_files.clear();
+    load_indexes.clear();
+    for (unsigned i = 0; i < info_files.size() + vcf_files.size(); ++i) {
+      bool is_info = i < info_files.size();
+      const std::string &filename =
+          is_info ? info_files.at(i) : vcf_files.at(i - info_files.size());
+      settings.push_back(summary_cache::describe_settings(
+          bins, is_info ? "info" : "vcf\t" + vcf_r2_tag + "\t" + vcf_af_tag +
+                                       "\t" + vcf_imp_indicator));
+      summaries.push_back(std::unique_ptr<r2_bins>(
+          new r2_bins(bins.empty_copy())));
+      summaries.back()->set_histogram_scale(r2_histogram_scale);
+      summaries.back()->set_site_recording(use_sites);
+      // a file without a site table is loaded again to record one
+      ready.push_back(
+          cache &&
+          (!use_sites || cache->load_sites(filename, settings.back())) &&
+          cache->load(filename, settings.back(), summaries.back().get()));
+      if (ready.back()) {
+        std::cout << "\t" << filename << " (cached)" << std::endl;
+        continue;
+      }
+      (is_info ? load_info_files : load_vcf_files).push_back(filename);
+      if (!index_pointers.empty()) load_indexes.push_back(index_pointers.at(i));
+      file_bins.push_back(summaries.back().get());
+      loaded.push_back(i);
+    }
+  }
+  // summaries are added as soon as every earlier one is ready, so that
+  // only files still loading hold bins of their own
+  unsigned n_merged = 0;
+  std::function<void()> merge_ready = [&]() {
+    for (; n_merged < summaries.size() && ready.at(n_merged); ++n_merged) {
+      bins.merge_summary(*summaries.at(n_merged));
+      summaries.at(n_merged).reset();
+    }
+  };
+  // entries are stored as soon as each file is loaded, so that the
+  // sites of only one file at a time are held in memory
+  std::function<void(unsigned)> file_loaded = [&](unsigned file) {
+    if (!second_pass) return;
+    unsigned i = loaded.at(file);
+    const std::string &filename = i < info_files.size()
+                                      ? info_files.at(i)
+                                      : vcf_files.at(i - info_files.size());
+    if (cache) cache->store(filename, settings.at(i), *summaries.at(i));
+    if (use_sites) {
+      cache->store_sites(filename, settings.at(i),
+                         summaries.at(i)->get_sites(),
+                         bins.get_bins().size());
+      summaries.at(i)->get_sites().clear();
+    }
+    ready.at(i) = 1;
+    merge_ready();
+  };
+  if (pipeline) {
+    std::cout << "loading input files in stages" << std::endl;
+    pipeline_wait_times times;
+    for (unsigned i = 0; i < load_info_files.size(); ++i) {
+      std::cout << "\t" << load_info_files.at(i) << std::endl;
+      prefetch_next_file(load_info_files, load_vcf_files, i);
+      r2_bins *target = file_bins.empty() ? &bins : file_bins.at(i);
+      target->load_info_file_pipelined(load_info_files.at(i), !second_pass,
+                                       &times);
+      file_loaded(i);
+    }
+    for (unsigned i = 0; i < load_vcf_files.size(); ++i) {
+      unsigned file = load_info_files.size() + i;
+      std::cout << "\t" << load_vcf_files.at(i) << std::endl;
+      prefetch_next_file(load_info_files, load_vcf_files, file);
+      r2_bins *target = file_bins.empty() ? &bins : file_bins.at(file);
+      target->load_vcf_file_pipelined(load_vcf_files.at(i), vcf_r2_tag,
+                                      vcf_af_tag, vcf_imp_indicator,
+                                      !second_pass, &times);
+      file_loaded(file);
+    }
+    std::cout << "time each loading stage spent waiting:" << std::endl;
+    times.report(std::cout);
+  } else if (n_threads > 1) {
+    std::cout << "loading input files with " << n_threads << " threads"
+              << std::endl;
+    for (std::vector<std::string>::const_iterator iter =
+             load_info_files.begin();
+         iter != load_info_files.end(); ++iter) {
       std::cout << "\t" << *iter << std::endl;
-      bins.load_vcf_file(*iter, vcf_r2_tag, vcf_af_tag, vcf_imp_indicator,
-                         !second_pass);
+    }
+    for (std::vector<std::string>::const_iterator iter = load_vcf_files.begin();
+         iter != load_vcf_files.end(); ++iter) {
+      std::cout << "\t" << *iter << std::endl;
+    }
+    load_files_parallel(load_info_files, load_vcf_files, vcf_r2_tag,
+                        vcf_af_tag, vcf_imp_indicator, !second_pass, n_threads,
+                        load_indexes, file_bins, file_loaded, &bins);
+  } else {
+    if (!load_info_files.empty()) {
+      std::cout << "iterating through specified info files" << std::endl;
+      for (unsigned i = 0; i < load_info_files.size(); ++i) {
+        std::cout << "\t" << load_info_files.at(i) << std::endl;
+        prefetch_next_file(load_info_files, load_vcf_files, i);
+        r2_bins *target = file_bins.empty() ? &bins : file_bins.at(i);
+        target->load_info_file(load_info_files.at(i), !second_pass);
+        file_loaded(i);
+      }
+    }
+    if (!load_vcf_files.empty()) {
+      std::cout << "iterating through specified vcf files" << std::endl;
+      for (unsigned i = 0; i < load_vcf_files.size(); ++i) {
+        unsigned file = load_info_files.size() + i;
+        std::cout << "\t" << load_vcf_files.at(i) << std::endl;
+        prefetch_next_file(load_info_files, load_vcf_files, file);
+        r2_bins *target = file_bins.empty() ? &bins : file_bins.at(file);
+        target->load_vcf_file(load_vcf_files.at(i), vcf_r2_tag, vcf_af_tag,
+                              vcf_imp_indicator, !second_pass);
+        file_loaded(file);
+      }
     }
   }
+  // cached summaries after the last loaded file are still waiting
+  merge_ready();
 
   std::cout << "computing bin-specific r2 thresholds" << std::endl;
   bins.compute_thresholds(target_r2);
@@ -65,15 +234,50 @@ void iddt::executor::run(
                                output_list_filename + "\"");
     std::cout << "reporting passing variants to \"" << output_list_filename
               << "\"" << std::endl;
-    if (second_pass) {
+    if (use_sites) {
+      // files are reported from their site tables, and read again only
+      // if a table has gone missing since it was stored
+      for (unsigned i = 0; i < info_files.size() + vcf_files.size(); ++i) {
+        bool is_info = i < info_files.size();
+        const std::string &filename =
+            is_info ? info_files.at(i) : vcf_files.at(i - info_files.size());
+        std::unique_ptr<mapped_site_table> table =
+            cache->load_sites(filename, settings.at(i));
+        std::cout << "\t" << filename << (table ? " (cached)" : "")
+                  << std::endl;
+        if (table) {
+          bins.report_passing_sites(*table, output);
+        } else if (is_info) {
+          bins.report_passing_info_variants(filename, "", output);
+        } else {
+          bins.report_passing_vcf_variants(filename, vcf_r2_tag, vcf_af_tag,
+                                           vcf_imp_indicator, output);
+        }
+      }
+    } else if (second_pass && n_threads > 1 && !pipeline) {
+      for (std::vector<std::string>::const_iterator iter = info_files.begin();
+           iter != info_files.end(); ++iter) {
+        std::cout << "\t" << *iter << std::endl;
+      }
+      for (std::vector<std::string>::const_iterator iter = vcf_files.begin();
+           iter != vcf_files.end(); ++iter) {
+        std::cout << "\t" << *iter << std::endl;
+      }
+      report_files_parallel(bins, info_files, filter_info_files_dir, vcf_files,
+                            vcf_r2_tag, vcf_af_tag, vcf_imp_indicator,
+                            n_threads, index_pointers, output);
+    } else if (second_pass) {
       for (std::vector<std::string>::const_iterator iter = info_files.begin();
            iter != info_files.end(); ++iter) {
         std::cout << "\t" << *iter << std::endl;
+        prefetch_next_file(info_files, vcf_files, iter - info_files.begin());
         bins.report_passing_info_variants(*iter, filter_info_files_dir, output);
       }
       for (std::vector<std::string>::const_iterator iter = vcf_files.begin();
            iter != vcf_files.end(); ++iter) {
         std::cout << "\t" << *iter << std::endl;
+        prefetch_next_file(info_files, vcf_files,
+                           info_files.size() + (iter - vcf_files.begin()));
         bins.report_passing_vcf_variants(*iter, vcf_r2_tag, vcf_af_tag,
                                          vcf_imp_indicator, output);
       }
@@ -84,3 +288,119 @@ void iddt::executor::run(
     output.clear();
   }
 }
+
+void iddt::executor::load_files_parallel(
+    const std::vector<std::string> &info_files,
+    const std::vector<std::string> &vcf_files, const std::string &vcf_r2_tag,
+    const std::string &vcf_af_tag, const std::string &vcf_imp_indicator,
+    bool store_ids, unsigned n_threads,
+    const std::vector<gzip_index *> &indexes,
+    const std::vector<r2_bins *> &file_bins,
+    const std::function<void(unsigned)> &file_loaded, r2_bins *bins) const {
+  if (!bins) {
+    throw std::logic_error("load_files_parallel: null pointer");
+  }
+  if (!file_bins.empty() &&
+      file_bins.size() != info_files.size() + vcf_files.size()) {
+    throw std::logic_error(
+        "load_files_parallel: per-file bins do not match input files");
+  }
+  std::vector<std::string> filenames(info_files);
+  filenames.insert(filenames.end(), vcf_files.begin(), vcf_files.end());
+  unsigned n_files = filenames.size();
+  if (!n_files || !n_threads) return;
+  // bcf cannot be split on line boundaries, and is loaded whole
+  std::vector<char> splittable(n_files, 1);
+  for (unsigned i = info_files.size(); i < n_files; ++i) {
+    splittable.at(i) = vcf_site_reader::is_text_vcf(filenames.at(i));
+  }
+  chunk_scheduler scheduler(filenames, splittable, n_threads, 1 << 20,
+                            indexes);
+  const vcf_info_scanner scanner(vcf_r2_tag, vcf_af_tag, vcf_imp_indicator);
+  // per-file bins share their boundaries and settings, such as site
+  // recording, which chunks must load with
+  const r2_bins empty = file_bins.empty() ? bins->empty_copy()
+                                          : file_bins.front()->empty_copy();
+  // each chunk is loaded into its own bins, which are merged in input
+  // order and released as soon as all preceding chunks are merged
+  scheduler.run<std::unique_ptr<r2_bins> >(
+      [&](const scheduled_chunk &task, std::unique_ptr<r2_bins> *result) {
+        const std::string &filename = filenames.at(task.file);
+        result->reset(new r2_bins(empty));
+        if (task.file < info_files.size()) {
+          (*result)->load_info_chunk(task.chunk, filename, store_ids);
+        } else if (task.whole_file) {
+          (*result)->load_vcf_file(filename, vcf_r2_tag, vcf_af_tag,
+                                   vcf_imp_indicator, store_ids);
+        } else {
+          (*result)->load_vcf_chunk(task.chunk, scanner, filename, store_ids);
+        }
+      },
+      [bins, &file_bins](unsigned file, std::unique_ptr<r2_bins> *result) {
+        (file_bins.empty() ? bins : file_bins.at(file))->merge(**result);
+        result->reset();
+      },
+      file_loaded);
+}
+
+void iddt::executor::report_files_parallel(
+    const r2_bins &bins, const std::vector<std::string> &info_files,
+    const std::string &filter_info_files_dir,
+    const std::vector<std::string> &vcf_files, const std::string &vcf_r2_tag,
+    const std::string &vcf_af_tag, const std::string &vcf_imp_indicator,
+    unsigned n_threads, const std::vector<gzip_index *> &indexes,
+    std::ostream &out) const {
+  std::vector<std::string> filenames(info_files);
+  filenames.insert(filenames.end(), vcf_files.begin(), vcf_files.end());
+  unsigned n_files = filenames.size();
+  if (!n_files || !n_threads) return;
+  std::vector<char> splittable(n_files, 1);
+  for (unsigned i = info_files.size(); i < n_files; ++i) {
+    splittable.at(i) = vcf_site_reader::is_text_vcf(filenames.at(i));
+  }
+  chunk_scheduler scheduler(filenames, splittable, n_threads, 1 << 20,
+                            indexes);
+  const vcf_info_scanner scanner(vcf_r2_tag, vcf_af_tag, vcf_imp_indicator);
+  bool filter_info_files = !filter_info_files_dir.empty();
+  // filtered info files are opened when their first chunk is written,
+  // so that they are created in input order as in the serial pass
+  std::vector<std::unique_ptr<info_file_writer> > writers(info_files.size());
+  std::function<info_file_writer *(unsigned)> get_writer =
+      [&](unsigned file) -> info_file_writer * {
+    if (!filter_info_files || file >= info_files.size()) return 0;
+    if (!writers.at(file)) {
+      writers.at(file).reset(
+          new info_file_writer(filenames.at(file), filter_info_files_dir));
+    }
+    return writers.at(file).get();
+  };
+  // each result holds passing IDs and, for filtered info files, lines;
+  // they are written on this thread while workers move on
+  scheduler.run<std::pair<std::string, std::string> >(
+      [&](const scheduled_chunk &task,
+          std::pair<std::string, std::string> *result) {
+        const std::string &filename = filenames.at(task.file);
+        if (task.file < info_files.size()) {
+          bins.report_passing_info_chunk(
+              task.chunk, filename, &result->first,
+              filter_info_files ? &result->second : 0);
+        } else if (task.whole_file) {
+          std::ostringstream ids;
+          bins.report_passing_vcf_variants(filename, vcf_r2_tag, vcf_af_tag,
+                                           vcf_imp_indicator, ids);
+          result->first = ids.str();
+        } else {
+          bins.report_passing_vcf_chunk(task.chunk, scanner, filename,
+                                        &result->first);
+        }
+      },
+      [&](unsigned file, std::pair<std::string, std::string> *result) {
+        out.write(result->first.data(), result->first.size());
+        info_file_writer *writer = get_writer(file);
+        if (writer) writer->write(result->second);
+      },
+      [&](unsigned file) {
+        info_file_writer *writer = get_writer(file);
+        if (writer) writer->close();
+      });
+}
@@ -9,19 +9,30 @@
 #define IMPUTED_DATA_DYNAMIC_THRESHOLD_EXECUTOR_H_
 
 #include <algorithm>
+#include <atomic>
 #include <cmath>
+#include <exception>
 #include <fstream>
+#include <functional>
 #include <iostream>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <random>
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
 #include "imputed-data-dynamic-threshold/cargs.h"
+#include "imputed-data-dynamic-threshold/decompression_pool.h"
 #include "imputed-data-dynamic-threshold/r2_bins.h"
+#include "imputed-data-dynamic-threshold/read_ahead.h"
+#include "imputed-data-dynamic-threshold/summary_cache.h"
+#include "imputed-data-dynamic-threshold/text_chunks.h"
+#include "imputed-data-dynamic-threshold/vcf_sites.h"
 
 namespace imputed_data_dynamic_threshold {
 /*!
@@ -53,6 +64,14 @@ class executor {
    * \param vcf_af_tag INFO field for allele frequency in input vcf
    * \param vcf_imp_indicator INFO field for whether variant was imputed in
    * input vcf
+   * \param n_threads number of worker threads for loading input files
+   * \param pipeline whether to load each file in overlapping stages,
+   * instead of on n_threads workers
+   * \param cache_dir directory of cached per-file r2 summaries, or
+   * empty; only used in second-pass mode
+   * \param cache_sites whether to also cache a site table of each
+   * file, and report passing variants from it; only used with
+   * cache_dir and without filter_info_files_dir
    */
   void run(const std::vector<double> &maf_bin_boundaries,
            const std::vector<std::string> &info_files,
@@ -61,7 +80,83 @@ class executor {
            const std::string &output_list_filename, bool second_pass,
            const std::string &filter_info_files_dir,
            const std::string &vcf_r2_tag, const std::string &vcf_af_tag,
-           const std::string &vcf_imp_indicator);
+           const std::string &vcf_imp_indicator, unsigned n_threads,
+           bool pipeline, const std::string &cache_dir, bool cache_sites);
+
+ private:
+  /*!
+   * \brief load all input files into bins using a pool of worker threads
+   * \param info_files names of input minimac info files
+   * \param vcf_files names of input vcfs
+   * \param vcf_r2_tag INFO field for R2 in input vcf
+   * \param vcf_af_tag INFO field for allele frequency in input vcf
+   * \param vcf_imp_indicator INFO field for whether variant was imputed in
+   * input vcf
+   * \param store_ids whether to store variant IDs for later reporting
+   * \param n_threads number of worker threads
+   * \param indexes for each file, info files first, null or a
+   * gzip_index to record while plain gzip input is inflated; empty if
+   * no file is indexed
+   * \param file_bins for each file, info files first, initialized
+   * bins into which its data are merged instead of bins; empty to
+   * merge every file into bins
+   * \param file_loaded function called with the index of each file
+   * once all its data are merged
+   * \param bins initialized bins into which all data are merged
+   *
+   * every file is split into chunks, which a chunk_scheduler hands to
+   * the workers; a worker that runs out of its own files steals files
+   * or chunks from the others. each chunk is loaded into its own copy
+   * of the empty bins, and completed chunks are merged into the target
+   * in input order, info files first, so the result is identical to
+   * loading the files one at a time.
+   */
+  void load_files_parallel(const std::vector<std::string> &info_files,
+                           const std::vector<std::string> &vcf_files,
+                           const std::string &vcf_r2_tag,
+                           const std::string &vcf_af_tag,
+                           const std::string &vcf_imp_indicator, bool store_ids,
+                           unsigned n_threads,
+                           const std::vector<gzip_index *> &indexes,
+                           const std::vector<r2_bins *> &file_bins,
+                           const std::function<void(unsigned)> &file_loaded,
+                           r2_bins *bins) const;
+  /*!
+   * \brief report passing variants from all input files using a pool of
+   * worker threads
+   * \param bins bins with computed thresholds
+   * \param info_files names of input minimac info files
+   * \param filter_info_files_dir directory to which to write filtered
+   * info files, or empty
+   * \param vcf_files names of input vcfs
+   * \param vcf_r2_tag INFO field for R2 in input vcf
+   * \param vcf_af_tag INFO field for allele frequency in input vcf
+   * \param vcf_imp_indicator INFO field for whether variant was imputed in
+   * input vcf
+   * \param n_threads number of worker threads
+   * \param indexes for each file, info files first, null or a
+   * gzip_index recorded by load_files_parallel; empty if no file is
+   * indexed
+   * \param out stream to which to write passing variant IDs
+   *
+   * files are split and scheduled as in load_files_parallel, and plain
+   * gzip files with a complete index are split at its checkpoints. the
+   * output of each chunk is held in a reorder buffer until all earlier
+   * chunks are written, so the variant list and filtered info files
+   * match those of the serial second pass byte for byte. workers stop
+   * claiming chunks about two per thread ahead of the writer, so the
+   * buffer stays small however slow the earliest chunk is.
+   */
+  void report_files_parallel(const r2_bins &bins,
+                             const std::vector<std::string> &info_files,
+                             const std::string &filter_info_files_dir,
+                             const std::vector<std::string> &vcf_files,
+                             const std::string &vcf_r2_tag,
+                             const std::string &vcf_af_tag,
+                             const std::string &vcf_imp_indicator,
+                             unsigned n_threads,
+                             const std::vector<gzip_index *> &indexes,
+                             std::ostream &out) const;
 };
 }  // namespace imputed_data_dynamic_threshold
 
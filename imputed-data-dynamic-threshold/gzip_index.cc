@@ -0,0 +1,183 @@
+/*!
+  \file gzip_index.cc
+  \brief implementation of gzip seek points
+  \copyright Released under the MIT License. Copyright
+  2023 Lightning Auriga
+ */
+
+#include "imputed-data-dynamic-threshold/gzip_index.h"
+
+namespace iddt = imputed_data_dynamic_threshold;
+
+iddt::gzip_index::gzip_index(std::uint64_t spacing)
+    : _spacing(spacing ? spacing : 1), _inflated_size(0), _complete(false) {}
+
+iddt::gzip_index::~gzip_index() throw() {}
+
+bool iddt::gzip_index::wants_checkpoint(std::uint64_t bit) const {
+  if (_complete) return false;
+  if (_checkpoints.empty()) return true;
+  return bit >= _checkpoints.back().bit + _spacing * 8;
+}
+
+void iddt::gzip_index::add_checkpoint(std::uint64_t bit,
+                                      std::uint64_t offset,
+                                      const std::string &window) {
+  if (!wants_checkpoint(bit)) return;
+  gzip_checkpoint point;
+  point.bit = bit;
+  point.offset = offset;
+  // windows are mostly repeated text, and deflate to a fraction of 32KB
+  uLongf size = compressBound(window.size());
+  point.window.resize(size);
+  if (compress2(reinterpret_cast<Bytef *>(&point.window[0]), &size,
+                reinterpret_cast<const Bytef *>(window.data()),
+                window.size(), 1) != Z_OK) {
+    throw std::runtime_error("gzip_index: cannot deflate window");
+  }
+  point.window.resize(size);
+  _checkpoints.push_back(point);
+}
+
+void iddt::gzip_index::finish(std::uint64_t inflated_size) {
+  _inflated_size = inflated_size;
+  _complete = true;
+}
+
+bool iddt::gzip_index::is_complete() const { return _complete; }
+
+unsigned iddt::gzip_index::size() const { return _checkpoints.size(); }
+
+const iddt::gzip_checkpoint &iddt::gzip_index::at(unsigned i) const {
+  return _checkpoints.at(i);
+}
+
+void iddt::gzip_index::get_window(unsigned i, std::string *window) const {
+  if (!window) {
+    throw std::logic_error("gzip_index::get_window: null pointer");
+  }
+  const std::string &deflated = _checkpoints.at(i).window;
+  window->resize(32768);
+  uLongf size = window->size();
+  if (uncompress(reinterpret_cast<Bytef *>(&(*window)[0]), &size,
+                 reinterpret_cast<const Bytef *>(deflated.data()),
+                 deflated.size()) != Z_OK) {
+    throw std::runtime_error("gzip_index: cannot inflate window");
+  }
+  window->resize(size);
+}
+
+std::uint64_t iddt::gzip_index::get_inflated_size() const {
+  return _inflated_size;
+}
+
+iddt::indexed_gzip_reader::indexed_gzip_reader(const std::string &filename,
+                                               const gzip_index &index,
+                                               unsigned checkpoint)
+    : _filename(filename),
+      _input(filename.c_str(), std::ios::binary),
+      _buffer(1 << 16),
+      _strm(z_stream()),
+      _raw(true),
+      _done(false) {
+  if (!index.is_complete()) {
+    throw std::logic_error("indexed_gzip_reader: index is incomplete");
+  }
+  if (!_input.is_open()) {
+    throw std::runtime_error("cannot read file \"" + _filename + "\"");
+  }
+  const gzip_checkpoint &point = index.at(checkpoint);
+  std::string window;
+  index.get_window(checkpoint, &window);
+  if (inflateInit2(&_strm, -15) != Z_OK) {
+    throw std::runtime_error("cannot initialize zlib stream");
+  }
+  int ret = Z_OK;
+  char byte = 0;
+  _input.seekg(point.bit >> 3);
+  // a block boundary mid-byte: hand zlib the rest of that byte
+  if (point.bit & 7) {
+    if (!_input.get(byte)) {
+      ret = Z_DATA_ERROR;
+    } else {
+      unsigned skip = point.bit & 7;
+      ret = inflatePrime(&_strm, 8 - skip,
+                         static_cast<unsigned char>(byte) >> skip);
+    }
+  }
+  if (ret == Z_OK && !window.empty()) {
+    ret = inflateSetDictionary(
+        &_strm, reinterpret_cast<const Bytef *>(window.data()),
+        window.size());
+  }
+  if (ret != Z_OK || !_input) {
+    inflateEnd(&_strm);
+    throw std::runtime_error("cannot seek in file \"" + _filename + "\"");
+  }
+}
+
+iddt::indexed_gzip_reader::~indexed_gzip_reader() throw() {
+  inflateEnd(&_strm);
+}
+
+bool iddt::indexed_gzip_reader::fill_input() {
+  if (_strm.avail_in) return true;
+  _input.read(reinterpret_cast<char *>(_buffer.data()), _buffer.size());
+  if (_input.bad()) {
+    throw std::runtime_error("cannot read file \"" + _filename + "\"");
+  }
+  _strm.next_in = _buffer.data();
+  _strm.avail_in = _input.gcount();
+  return _strm.avail_in;
+}
+
+bool iddt::indexed_gzip_reader::next_member() {
+  if (_raw) {
+    // zlib does not see the raw member's trailer, so step over it
+    for (unsigned skipped = 0; skipped < 8;) {
+      if (!fill_input()) return false;
+      unsigned n = _strm.avail_in < 8 - skipped ? _strm.avail_in
+                                                : 8 - skipped;
+      _strm.next_in += n;
+      _strm.avail_in -= n;
+      skipped += n;
+    }
+    if (inflateReset2(&_strm, 15 + 16) != Z_OK) {
+      throw std::runtime_error("cannot reset zlib stream");
+    }
+    _raw = false;
+  } else if (inflateReset(&_strm) != Z_OK) {
+    throw std::runtime_error("cannot reset zlib stream");
+  }
+  // trailing data that is not a gzip member is ignored
+  if (!fill_input() || _strm.next_in[0] != 31) return false;
+  if (_strm.avail_in < 2) {
+    _buffer[0] = _strm.next_in[0];
+    _input.read(reinterpret_cast<char *>(_buffer.data() + 1),
+                _buffer.size() - 1);
+    _strm.next_in = _buffer.data();
+    _strm.avail_in = 1 + _input.gcount();
+  }
+  return _strm.avail_in >= 2 && _strm.next_in[1] == 139;
+}
+
+unsigned iddt::indexed_gzip_reader::read(char *buffer, unsigned size) {
+  if (!buffer) {
+    throw std::logic_error("indexed_gzip_reader::read: null pointer");
+  }
+  _strm.next_out = reinterpret_cast<Bytef *>(buffer);
+  _strm.avail_out = size;
+  while (!_done && _strm.avail_out == size) {
+    if (!fill_input()) {
+      throw std::runtime_error("cannot inflate file \"" + _filename +
+                               "\": truncated gzip member");
+    }
+    int ret = inflate(&_strm, Z_NO_FLUSH);
+    if (ret == Z_STREAM_END) {
+      _done = !next_member();
+    } else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+      throw std::runtime_error("cannot inflate file \"" + _filename + "\"");
+    }
+  }
+  return size - _strm.avail_out;
+}
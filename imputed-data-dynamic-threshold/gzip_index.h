@@ -0,0 +1,171 @@
+/*!
+  \file gzip_index.h
+  \brief seek points into gzip streams that are not split into blocks
+  \copyright Released under the MIT License. Copyright
+  2023 Lightning Auriga
+ */
+
+#ifndef IMPUTED_DATA_DYNAMIC_THRESHOLD_GZIP_INDEX_H_
+#define IMPUTED_DATA_DYNAMIC_THRESHOLD_GZIP_INDEX_H_
+
+#include <zlib.h>
+
+#include <cstdint>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace imputed_data_dynamic_threshold {
+/*!
+  \brief a position from which a gzip stream can be inflated
+ */
+struct gzip_checkpoint {
+  std::uint64_t bit;     //!< file bit offset of a deflate block boundary
+  std::uint64_t offset;  //!< offset of the checkpoint in the inflated text
+  std::string window;    //!< deflated copy of the text before the
+                         //!< checkpoint in its member, at most 32KB
+};
+
+/*!
+  \brief checkpoints recorded while a plain gzip file is inflated
+
+  as in zlib's zran example, a checkpoint pairs a deflate block
+  boundary with the 32KB of text preceding it, which is all that
+  inflation needs to resume there. checkpoints are kept at least a
+  fixed number of compressed bytes apart, and their windows are
+  stored deflated. the index is only usable once the whole file
+  has been read and finish() has been called.
+ */
+class gzip_index {
+ public:
+  /*!
+    \brief constructor
+    @param spacing minimum number of compressed bytes between
+    consecutive checkpoints
+   */
+  explicit gzip_index(std::uint64_t spacing);
+  /*!
+    \brief destructor
+   */
+  ~gzip_index() throw();
+  /*!
+    \brief test whether a checkpoint would be kept at a position
+    @param bit file bit offset of a block boundary
+    \return whether the position is far enough past the last checkpoint
+   */
+  bool wants_checkpoint(std::uint64_t bit) const;
+  /*!
+    \brief record a checkpoint
+    @param bit file bit offset of a block boundary
+    @param offset offset of the boundary in the inflated text
+    @param window up to 32KB of text preceding the boundary within
+    its gzip member
+
+    checkpoints that wants_checkpoint() would reject are ignored
+   */
+  void add_checkpoint(std::uint64_t bit, std::uint64_t offset,
+                      const std::string &window);
+  /*!
+    \brief mark the whole file as indexed
+    @param inflated_size total length of the inflated text
+   */
+  void finish(std::uint64_t inflated_size);
+  /*!
+    \brief test whether the whole file has been indexed
+    \return whether finish() has been called
+   */
+  bool is_complete() const;
+  /*!
+    \brief get the number of checkpoints
+    \return the number of checkpoints
+   */
+  unsigned size() const;
+  /*!
+    \brief get a checkpoint
+    @param i index of checkpoint
+    \return the checkpoint, with its window still deflated
+   */
+  const gzip_checkpoint &at(unsigned i) const;
+  /*!
+    \brief get the inflated window of a checkpoint
+    @param i index of checkpoint
+    @param window destination for the text preceding the checkpoint
+   */
+  void get_window(unsigned i, std::string *window) const;
+  /*!
+    \brief get the total length of the inflated text
+    \return the total length of the inflated text
+   */
+  std::uint64_t get_inflated_size() const;
+
+ private:
+  /*!
+    \brief copy constructor; disabled
+    @param obj existing gzip_index object
+   */
+  gzip_index(const gzip_index &obj);
+
+  std::uint64_t _spacing;  //!< minimum compressed bytes between checkpoints
+  std::vector<gzip_checkpoint> _checkpoints;  //!< checkpoints in file order
+  std::uint64_t _inflated_size;  //!< total inflated length, once complete
+  bool _complete;                //!< whether finish() has been called
+};
+
+/*!
+  \brief inflate a gzip file from one of its checkpoints
+
+  the member containing the checkpoint is inflated as raw deflate
+  data, so its trailer cannot be checked; every later member is
+  inflated and checked as gzip. as with zlib, anything that is not
+  a gzip member following the last one is ignored.
+ */
+class indexed_gzip_reader {
+ public:
+  /*!
+    \brief constructor
+    @param filename name of indexed file
+    @param index complete index of the file
+    @param checkpoint index of the checkpoint from which to start
+   */
+  indexed_gzip_reader(const std::string &filename, const gzip_index &index,
+                      unsigned checkpoint);
+  /*!
+    \brief destructor
+   */
+  ~indexed_gzip_reader() throw();
+  /*!
+    \brief inflate the next text
+    @param buffer destination for text
+    @param size maximum number of bytes to inflate
+    \return number of bytes inflated; 0 only at the end of the file
+   */
+  unsigned read(char *buffer, unsigned size);
+
+ private:
+  /*!
+    \brief copy constructor; disabled
+    @param obj existing indexed_gzip_reader object
+   */
+  indexed_gzip_reader(const indexed_gzip_reader &obj);
+  /*!
+    \brief read more compressed input once the stream has used it all
+    \return whether any input was read
+   */
+  bool fill_input();
+  /*!
+    \brief move to the gzip member following the one that just ended
+    \return whether another member follows
+   */
+  bool next_member();
+
+  std::string _filename;  //!< name of input file
+  std::ifstream _input;   //!< open binary connection to input
+  std::vector<unsigned char> _buffer;  //!< compressed input
+  z_stream _strm;  //!< inflation state
+  bool _raw;       //!< whether the current member is read as raw deflate
+  bool _done;      //!< whether the last member has ended
+};
+}  // namespace imputed_data_dynamic_threshold
+
+#endif  // IMPUTED_DATA_DYNAMIC_THRESHOLD_GZIP_INDEX_H_
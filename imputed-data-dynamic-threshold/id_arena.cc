@@ -0,0 +1,79 @@
+/*!
+  \file id_arena.cc
+  \brief implementation of compact variant ID storage
+  \copyright Released under the MIT License. Copyright
+  2023 Lightning Auriga
+ */
+
+#include "imputed-data-dynamic-threshold/id_arena.h"
+
+namespace iddt = imputed_data_dynamic_threshold;
+
+iddt::id_arena::id_arena() : _chunk_size(1 << 20) {}
+
+iddt::id_arena::id_arena(unsigned chunk_size) : _chunk_size(chunk_size) {
+  if (!_chunk_size) {
+    throw std::logic_error("id_arena: chunk size must be positive");
+  }
+}
+
+iddt::id_arena::id_arena(const id_arena &obj)
+    : _chunk_size(obj._chunk_size), _chunks(obj._chunks) {}
+
+iddt::id_arena::~id_arena() throw() {}
+
+std::uint64_t iddt::id_arena::add(const std::string_view &str) {
+  if (str.size() > UINT32_MAX) {
+    throw std::runtime_error("id_arena::add: string too long");
+  }
+  std::uint64_t key = 0;
+  if (variant_id_codec::encode(str, &key)) return key;
+  std::uint32_t length = str.size();
+  std::size_t needed = str.size() + (length < 255 ? 1 : 5);
+  if (_chunks.empty() || _chunks.back().size() + needed > _chunk_size) {
+    // the top bit of a handle is reserved for packed keys
+    if (_chunks.size() >= (1u << 31)) {
+      throw std::runtime_error("id_arena::add: too many chunks");
+    }
+    _chunks.push_back(std::vector<char>());
+    _chunks.back().reserve(std::max<std::size_t>(_chunk_size, needed));
+  }
+  std::vector<char> &chunk = _chunks.back();
+  std::uint64_t handle =
+      (static_cast<std::uint64_t>(_chunks.size() - 1) << 32) | chunk.size();
+  if (length < 255) {
+    chunk.push_back(static_cast<char>(length));
+  } else {
+    char prefix[5] = {static_cast<char>(255)};
+    memcpy(prefix + 1, &length, 4);
+    chunk.insert(chunk.end(), prefix, prefix + 5);
+  }
+  chunk.insert(chunk.end(), str.begin(), str.end());
+  return handle;
+}
+
+std::string_view iddt::id_arena::get(std::uint64_t handle,
+                                     char *buffer) const {
+  if (variant_id_codec::is_key(handle)) {
+    return variant_id_codec::decode(handle, buffer);
+  }
+  const std::vector<char> &chunk = _chunks.at(handle >> 32);
+  const char *ptr = chunk.data() + (handle & UINT32_MAX);
+  std::uint32_t length = static_cast<unsigned char>(*ptr++);
+  if (length == 255) {
+    memcpy(&length, ptr, 4);
+    ptr += 4;
+  }
+  return std::string_view(ptr, length);
+}
+
+void iddt::id_arena::clear() { _chunks.clear(); }
+
+std::size_t iddt::id_arena::bytes_used() const {
+  std::size_t res = 0;
+  for (std::vector<std::vector<char> >::const_iterator iter = _chunks.begin();
+       iter != _chunks.end(); ++iter) {
+    res += iter->size();
+  }
+  return res;
+}
@@ -0,0 +1,86 @@
+/*!
+  \file id_arena.h
+  \brief compact append-only storage for variant IDs
+  \copyright Released under the MIT License. Copyright
+  2023 Lightning Auriga
+ */
+
+#ifndef IMPUTED_DATA_DYNAMIC_THRESHOLD_ID_ARENA_H_
+#define IMPUTED_DATA_DYNAMIC_THRESHOLD_ID_ARENA_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "imputed-data-dynamic-threshold/id_codec.h"
+
+namespace imputed_data_dynamic_threshold {
+/*!
+  \brief store many short strings back to back in large chunks
+
+  each string costs its length plus a one byte length prefix (five
+  bytes for strings of 255 characters or more), and is referred to by
+  an eight byte handle instead of a std::string with its own heap
+  allocation. strings are never removed or moved between chunks, so
+  handles stay valid for the lifetime of the arena and of its copies.
+
+  strings that variant_id_codec can pack are not stored at all: the
+  handle is the packed key itself.
+ */
+class id_arena {
+ public:
+  /*!
+    \brief default constructor
+   */
+  id_arena();
+  /*!
+    \brief constructor
+    @param chunk_size number of bytes allocated at a time; strings too
+    long for a chunk get a chunk of their own
+   */
+  explicit id_arena(unsigned chunk_size);
+  /*!
+    \brief copy constructor
+    @param obj existing id_arena object
+   */
+  id_arena(const id_arena &obj);
+  /*!
+    \brief destructor
+   */
+  ~id_arena() throw();
+  /*!
+    \brief store a copy of a string
+    @param str string to store
+    \return handle for retrieving the string
+   */
+  std::uint64_t add(const std::string_view &str);
+  /*!
+    \brief retrieve a stored string
+    @param handle handle returned by add on this arena or its source
+    @param buffer scratch space of at least variant_id_codec::max_length
+    bytes, for decoding packed keys
+    \return view of the stored string, in either the arena or buffer;
+    valid until the arena is next modified or buffer is reused
+   */
+  std::string_view get(std::uint64_t handle, char *buffer) const;
+  /*!
+    \brief remove all stored strings
+   */
+  void clear();
+  /*!
+    \brief get number of bytes in use, including length prefixes
+    \return number of bytes in use; packed keys use none
+   */
+  std::size_t bytes_used() const;
+
+ private:
+  unsigned _chunk_size;                    //!< bytes allocated per chunk
+  std::vector<std::vector<char> > _chunks;  //!< stored strings, in order
+};
+}  // namespace imputed_data_dynamic_threshold
+
+#endif  // IMPUTED_DATA_DYNAMIC_THRESHOLD_ID_ARENA_H_
@@ -0,0 +1,161 @@
+/*!
+  \file id_codec.cc
+  \brief implementation of chr:pos:ref:alt variant ID packing
+  \copyright Released under the MIT License. Copyright
+  2023 Lightning Auriga
+ */
+
+#include "imputed-data-dynamic-threshold/id_codec.h"
+
+namespace iddt = imputed_data_dynamic_threshold;
+
+namespace {
+// key layout, from the most significant bit:
+//   1 flag | 1 "chr" prefix | 5 contig | 29 position | 3 ref length - 1 |
+//   3 alt length - 1 | 22 allele bases, ref then alt, 2 bits each,
+//   right-aligned
+const unsigned prefix_shift = 62;
+const unsigned contig_shift = 57;
+const unsigned position_shift = 28;
+const unsigned ref_length_shift = 25;
+const unsigned alt_length_shift = 22;
+const std::uint64_t flag = 1ULL << 63;
+const std::uint64_t max_position = (1ULL << 29) - 1;
+const unsigned max_allele_length = 8;
+const unsigned max_total_bases = 11;
+const char *const nonautosomes[] = {"X", "Y", "M", "MT"};
+const char base_letters[] = {'A', 'C', 'G', 'T'};
+
+/*!
+  \brief get the 2-bit code of a base
+  @param base allele character
+  \return code of base, or 4 if it is not an uppercase ACGT base
+ */
+unsigned base_code(char base) {
+  switch (base) {
+    case 'A':
+      return 0;
+    case 'C':
+      return 1;
+    case 'G':
+      return 2;
+    case 'T':
+      return 3;
+    default:
+      return 4;
+  }
+}
+
+/*!
+  \brief parse a decimal number without leading zeros
+  @param text digits
+  @param max largest acceptable value
+  @param value destination for parsed value
+  \return whether text is a canonical number no larger than max
+ */
+bool parse_canonical(const std::string_view &text, std::uint64_t max,
+                     std::uint64_t *value) {
+  if (text.empty() || text.size() > 10 ||
+      (text.size() > 1 && text[0] == '0')) {
+    return false;
+  }
+  std::uint64_t res = 0;
+  for (std::string_view::const_iterator iter = text.begin();
+       iter != text.end(); ++iter) {
+    if (*iter < '0' || *iter > '9') return false;
+    res = res * 10 + (*iter - '0');
+  }
+  if (res > max) return false;
+  *value = res;
+  return true;
+}
+}  // namespace
+
+bool iddt::variant_id_codec::encode(const std::string_view &id,
+                                    std::uint64_t *key) {
+  if (id.size() > max_length) return false;
+  std::uint64_t res = flag;
+  std::string_view rest = id;
+  if (!rest.substr(0, 3).compare("chr")) {
+    res |= 1ULL << prefix_shift;
+    rest.remove_prefix(3);
+  }
+  std::string_view fields[4];
+  for (unsigned i = 0; i < 3; ++i) {
+    std::string_view::size_type colon = rest.find(':');
+    if (colon == std::string_view::npos) return false;
+    fields[i] = rest.substr(0, colon);
+    rest.remove_prefix(colon + 1);
+  }
+  fields[3] = rest;
+  // contigs are coded 1-22, then X, Y, M, MT as 23-26
+  std::uint64_t contig = 0;
+  for (unsigned i = 0; i < 4; ++i) {
+    if (!fields[0].compare(nonautosomes[i])) contig = 23 + i;
+  }
+  if (!contig && (!parse_canonical(fields[0], 22, &contig) || !contig)) {
+    return false;
+  }
+  res |= contig << contig_shift;
+  std::uint64_t position = 0;
+  if (!parse_canonical(fields[1], max_position, &position)) return false;
+  res |= position << position_shift;
+  const std::string_view &ref = fields[2], &alt = fields[3];
+  if (ref.empty() || alt.empty() || ref.size() > max_allele_length ||
+      alt.size() > max_allele_length ||
+      ref.size() + alt.size() > max_total_bases) {
+    return false;
+  }
+  res |= static_cast<std::uint64_t>(ref.size() - 1) << ref_length_shift;
+  res |= static_cast<std::uint64_t>(alt.size() - 1) << alt_length_shift;
+  std::uint64_t bases = 0;
+  for (unsigned i = 2; i < 4; ++i) {
+    for (std::string_view::const_iterator iter = fields[i].begin();
+         iter != fields[i].end(); ++iter) {
+      unsigned code = base_code(*iter);
+      if (code > 3) return false;
+      bases = (bases << 2) | code;
+    }
+  }
+  *key = res | bases;
+  return true;
+}
+
+std::string_view iddt::variant_id_codec::decode(std::uint64_t key,
+                                                char *buffer) {
+  char *ptr = buffer;
+  if ((key >> prefix_shift) & 1) {
+    memcpy(ptr, "chr", 3);
+    ptr += 3;
+  }
+  unsigned contig = (key >> contig_shift) & 31;
+  if (contig > 22) {
+    const char *name = nonautosomes[contig - 23];
+    while (*name) *ptr++ = *name++;
+  } else {
+    if (contig > 9) *ptr++ = '0' + contig / 10;
+    *ptr++ = '0' + contig % 10;
+  }
+  *ptr++ = ':';
+  std::uint64_t position = (key >> position_shift) & max_position;
+  char digits[10];
+  unsigned n_digits = 0;
+  do {
+    digits[n_digits++] = '0' + position % 10;
+    position /= 10;
+  } while (position);
+  while (n_digits) *ptr++ = digits[--n_digits];
+  *ptr++ = ':';
+  unsigned ref_length = ((key >> ref_length_shift) & 7) + 1;
+  unsigned alt_length = ((key >> alt_length_shift) & 7) + 1;
+  unsigned total = ref_length + alt_length;
+  for (unsigned i = 0; i < total; ++i) {
+    if (i == ref_length) *ptr++ = ':';
+    *ptr++ = base_letters[(key >> (2 * (total - 1 - i))) & 3];
+  }
+  return std::string_view(buffer, ptr - buffer);
+}
+
+bool iddt::variant_id_codec::is_key(std::uint64_t value) {
+  return value & flag;
+}
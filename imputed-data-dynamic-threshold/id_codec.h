@@ -0,0 +1,57 @@
+/*!
+  \file id_codec.h
+  \brief pack chr:pos:ref:alt variant IDs into 64-bit keys
+  \copyright Released under the MIT License. Copyright
+  2023 Lightning Auriga
+ */
+
+#ifndef IMPUTED_DATA_DYNAMIC_THRESHOLD_ID_CODEC_H_
+#define IMPUTED_DATA_DYNAMIC_THRESHOLD_ID_CODEC_H_
+
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+namespace imputed_data_dynamic_threshold {
+/*!
+  \brief encode simple variant IDs as integers and back
+
+  IDs of the form [chr]CONTIG:POS:REF:ALT, as written by the Michigan
+  and TOPMed imputation servers, are packed into 64 bits: a flag bit,
+  whether the "chr" prefix is present, the contig (1-22, X, Y, M or
+  MT), a position below 2^29, and 2-bit codes for ACGT alleles of up
+  to eight bases each and eleven bases combined. IDs with anything
+  else, including leading zeros or lowercase bases, are rejected, so
+  that decoding always reproduces the original text exactly.
+
+  every key has its top bit set, so keys can share a 64-bit field with
+  other handles whose top bit is clear.
+ */
+class variant_id_codec {
+ public:
+  /*!
+    \brief try to pack an ID into a key
+    @param id variant ID
+    @param key destination for packed key
+    \return whether the ID could be packed
+   */
+  static bool encode(const std::string_view &id, std::uint64_t *key);
+  /*!
+    \brief restore the text of a packed ID
+    @param key key from encode
+    @param buffer destination of at least max_length bytes
+    \return view of the ID text in buffer
+   */
+  static std::string_view decode(std::uint64_t key, char *buffer);
+  /*!
+    \brief test whether a 64-bit value is a packed key
+    @param value value to test
+    \return whether value has the packed key flag set
+   */
+  static bool is_key(std::uint64_t value);
+  //! longest ID that can be packed, and minimum size of decode buffers
+  static const unsigned max_length = 32;
+};
+}  // namespace imputed_data_dynamic_threshold
+
+#endif  // IMPUTED_DATA_DYNAMIC_THRESHOLD_ID_CODEC_H_
@@ -0,0 +1,319 @@
+/*!
+  \file info_lines.cc
+  \brief implementation of info file block splitting
+  \copyright Released under the MIT License. Copyright
+  2023 Lightning Auriga
+ */
+
+#include "imputed-data-dynamic-threshold/info_lines.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+namespace iddt = imputed_data_dynamic_threshold;
+
+iddt::info_line_splitter::info_line_splitter() {}
+
+iddt::info_line_splitter::info_line_splitter(const info_line_splitter &obj)
+    : _offsets(obj._offsets) {}
+
+iddt::info_line_splitter::~info_line_splitter() throw() {}
+
+bool iddt::info_line_splitter::avx2_supported() {
+#if defined(__x86_64__) || defined(__i386__)
+  static const bool supported = __builtin_cpu_supports("avx2");
+  return supported;
+#else
+  return false;
+#endif
+}
+
+void iddt::info_line_splitter::find_delimiters(
+    const char *begin, const char *end, std::vector<std::uint32_t> *offsets) {
+  if (avx2_supported()) {
+    find_delimiters_avx2(begin, end, offsets);
+  } else {
+    find_delimiters_sse2(begin, end, offsets);
+  }
+}
+
+void iddt::info_line_splitter::find_delimiters_scalar(
+    const char *begin, const char *end, std::vector<std::uint32_t> *offsets) {
+  for (const char *ptr = begin; ptr < end; ++ptr) {
+    if (*ptr == '\t' || *ptr == '\n') offsets->push_back(ptr - begin);
+  }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("sse2"))) void
+iddt::info_line_splitter::find_delimiters_sse2(
+    const char *begin, const char *end, std::vector<std::uint32_t> *offsets) {
+  const __m128i tabs = _mm_set1_epi8('\t');
+  const __m128i newlines = _mm_set1_epi8('\n');
+  const char *ptr = begin;
+  for (; end - ptr >= 16; ptr += 16) {
+    __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(ptr));
+    unsigned mask = _mm_movemask_epi8(
+        _mm_or_si128(_mm_cmpeq_epi8(block, tabs),
+                     _mm_cmpeq_epi8(block, newlines)));
+    while (mask) {
+      offsets->push_back(ptr - begin + __builtin_ctz(mask));
+      mask &= mask - 1;
+    }
+  }
+  std::size_t n_found = offsets->size();
+  find_delimiters_scalar(ptr, end, offsets);
+  for (; n_found < offsets->size(); ++n_found) {
+    offsets->at(n_found) += ptr - begin;
+  }
+}
+
+__attribute__((target("avx2"))) void
+iddt::info_line_splitter::find_delimiters_avx2(
+    const char *begin, const char *end, std::vector<std::uint32_t> *offsets) {
+  const __m256i tabs = _mm256_set1_epi8('\t');
+  const __m256i newlines = _mm256_set1_epi8('\n');
+  const char *ptr = begin;
+  for (; end - ptr >= 32; ptr += 32) {
+    __m256i block =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(ptr));
+    unsigned mask = _mm256_movemask_epi8(
+        _mm256_or_si256(_mm256_cmpeq_epi8(block, tabs),
+                        _mm256_cmpeq_epi8(block, newlines)));
+    while (mask) {
+      offsets->push_back(ptr - begin + __builtin_ctz(mask));
+      mask &= mask - 1;
+    }
+  }
+  // finish the tail with the narrower method
+  std::size_t n_found = offsets->size();
+  find_delimiters_sse2(ptr, end, offsets);
+  for (; n_found < offsets->size(); ++n_found) {
+    offsets->at(n_found) += ptr - begin;
+  }
+}
+#else
+void iddt::info_line_splitter::find_delimiters_sse2(
+    const char *begin, const char *end, std::vector<std::uint32_t> *offsets) {
+  find_delimiters_scalar(begin, end, offsets);
+}
+
+void iddt::info_line_splitter::find_delimiters_avx2(
+    const char *begin, const char *end, std::vector<std::uint32_t> *offsets) {
+  find_delimiters_scalar(begin, end, offsets);
+}
+#endif
+
+void iddt::info_line_splitter::split(const char *begin, const char *end,
+                                     std::vector<info_record> *records) {
+  if (!records) {
+    throw std::logic_error("info_line_splitter::split: null pointer");
+  }
+  records->clear();
+  if (end - begin > UINT32_MAX) {
+    throw std::runtime_error("info_line_splitter::split: block too large");
+  }
+  _offsets.clear();
+  find_delimiters(begin, end, &_offsets);
+  info_record record = info_record();
+  const char *line_start = begin, *field_start = begin;
+  // a virtual newline at the end closes an unterminated final line
+  bool has_final_line = begin < end && end[-1] != '\n';
+  std::size_t n_delimiters = _offsets.size() + (has_final_line ? 1 : 0);
+  for (std::size_t i = 0; i < n_delimiters; ++i) {
+    const char *delimiter = i < _offsets.size() ? begin + _offsets[i] : end;
+    bool line_end = delimiter == end || *delimiter == '\n';
+    const char *field_end = delimiter;
+    if (line_end && field_end > field_start && field_end[-1] == '\r') {
+      --field_end;
+    }
+    std::string_view field(field_start, field_end - field_start);
+    switch (record.n_fields++) {
+      case 0:
+        record.snp = field;
+        break;
+      case 4:
+        record.maf = field;
+        break;
+      case 6:
+        record.rsq = field;
+        break;
+      case 7:
+        record.genotyped = field;
+        break;
+      default:
+        break;
+    }
+    field_start = delimiter + 1;
+    if (line_end) {
+      record.line = std::string_view(
+          line_start, (delimiter < end ? delimiter + 1 : end) - line_start);
+      records->push_back(record);
+      record = info_record();
+      line_start = field_start;
+    }
+  }
+}
+
+iddt::info_file_reader::info_file_reader(const std::string &filename)
+    : info_file_reader(filename, 0) {}
+
+iddt::info_file_reader::info_file_reader(const std::string &filename,
+                                         const decompression_pool *pool)
+    : _filename(filename),
+      _input(0),
+      _buffer(1 << 20),
+      _begin(0),
+      _end(0),
+      _header_pending(true) {
+  if (mapped_file::is_flat_file(_filename)) {
+    _mapped.reset(new mapped_file(_filename));
+    return;
+  }
+  if (!pool && parallel_gzip_reader::detect_gzip(_filename)) {
+    _stream.reset(new gzip_stream_reader(_filename));
+    return;
+  }
+  _input = bgzf_open(_filename.c_str(), "r");
+  if (!_input) {
+    throw std::runtime_error("info file \"" + _filename +
+                             "\" does not exist");
+  }
+  if (pool) {
+    try {
+      pool->attach(_input);
+    } catch (...) {
+      bgzf_close(_input);
+      throw;
+    }
+  }
+}
+
+iddt::info_file_reader::~info_file_reader() throw() {
+  if (_input) bgzf_close(_input);
+}
+
+bool iddt::info_file_reader::fill() {
+  if (_begin) {
+    std::copy(_buffer.begin() + _begin, _buffer.begin() + _end,
+              _buffer.begin());
+    _end -= _begin;
+    _begin = 0;
+  }
+  // a line longer than the buffer makes it grow
+  if (_end == _buffer.size()) _buffer.resize(_buffer.size() * 2);
+  ssize_t n =
+      _stream ? static_cast<ssize_t>(_stream->read(
+                    _buffer.data() + _end, _buffer.size() - _end))
+              : bgzf_read(_input, _buffer.data() + _end, _buffer.size() - _end);
+  if (n < 0) {
+    throw std::runtime_error("cannot read info file \"" + _filename + "\"");
+  }
+  _end += n;
+  return n > 0;
+}
+
+bool iddt::info_file_reader::next_block(std::vector<info_record> *records) {
+  if (!records) {
+    throw std::logic_error("info_file_reader::next_block: null pointer");
+  }
+  records->clear();
+  if (_mapped) return next_mapped_block(records);
+  while (true) {
+    const char *data = _buffer.data();
+    if (_header_pending) {
+      const char *newline = static_cast<const char *>(
+          memchr(data + _begin, '\n', _end - _begin));
+      if (newline) {
+        _begin = newline - data + 1;
+        _header_pending = false;
+        continue;
+      }
+      _begin = _end;
+      if (!fill()) return false;
+      continue;
+    }
+    std::vector<char>::reverse_iterator last_newline =
+        std::find(_buffer.rbegin() + (_buffer.size() - _end),
+                  _buffer.rbegin() + (_buffer.size() - _begin), '\n');
+    std::size_t block_end = _buffer.rend() - last_newline;
+    if (block_end > _begin) {
+      _splitter.split(data + _begin, data + block_end, records);
+      _begin = block_end;
+      return true;
+    }
+    if (!fill()) {
+      // unterminated final line
+      if (_begin == _end) return false;
+      _splitter.split(_buffer.data() + _begin, _buffer.data() + _end,
+                      records);
+      _begin = _end;
+      return true;
+    }
+  }
+}
+
+bool iddt::info_file_reader::next_mapped_block(
+    std::vector<info_record> *records) {
+  const char *data = _mapped->data();
+  std::size_t size = _mapped->size();
+  if (_header_pending) {
+    const char *newline =
+        size ? static_cast<const char *>(memchr(data, '\n', size)) : 0;
+    _begin = newline ? newline - data + 1 : size;
+    _header_pending = false;
+  }
+  if (_begin >= size) return false;
+  // a block ends at the first newline past a read buffer's worth of text
+  std::size_t end = size;
+  if (size - _begin > _buffer.size()) {
+    std::size_t from = _begin + _buffer.size() - 1;
+    const char *newline =
+        static_cast<const char *>(memchr(data + from, '\n', size - from));
+    if (newline) end = newline - data + 1;
+  }
+  _splitter.split(data + _begin, data + end, records);
+  _begin = end;
+  return true;
+}
+
+iddt::info_file_writer::info_file_writer(const std::string &input_filename,
+                                         const std::string &output_dir)
+    : _output(0) {
+  // output directory need not initially exist
+  boost::filesystem::path output_path(output_dir);
+  boost::filesystem::create_directory(output_path);
+  output_path /=
+      boost::filesystem::canonical(boost::filesystem::path(input_filename))
+          .filename();
+  _output = gzopen(output_path.string().c_str(), "wb");
+  if (!_output) {
+    throw std::runtime_error("cannot report filtered info file in second pass");
+  }
+  write(
+      "SNP\tREF(0)\tALT(1)\tALT_Frq\tMAF\tAvgCall\tRsq\tGenotyped\tLooRsq\t"
+      "EmpR\tEmpRsq\tDose0\tDose1\n");
+}
+
+iddt::info_file_writer::~info_file_writer() throw() {
+  if (_output) gzclose(_output);
+}
+
+void iddt::info_file_writer::write(const std::string_view &lines) {
+  if (!_output) {
+    throw std::logic_error("info_file_writer::write: file is closed");
+  }
+  if (lines.empty()) return;
+  if (gzwrite(_output, lines.data(), lines.size()) <= 0) {
+    throw std::runtime_error("cannot write to output info file, disk full");
+  }
+}
+
+void iddt::info_file_writer::close() {
+  if (_output && gzclose(_output) != Z_OK) {
+    _output = 0;
+    throw std::runtime_error("cannot write to output info file, disk full");
+  }
+  _output = 0;
+}
@@ -0,0 +1,233 @@
+/*!
+  \file info_lines.h
+  \brief split blocks of minimac4 info file text into the fields we use
+  \copyright Released under the MIT License. Copyright
+  2023 Lightning Auriga
+ */
+
+#ifndef IMPUTED_DATA_DYNAMIC_THRESHOLD_INFO_LINES_H_
+#define IMPUTED_DATA_DYNAMIC_THRESHOLD_INFO_LINES_H_
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "boost/filesystem.hpp"
+#include "htslib/bgzf.h"
+#include "htslib/hts.h"
+#include "imputed-data-dynamic-threshold/decompression_pool.h"
+#include "imputed-data-dynamic-threshold/mapped_file.h"
+#include "imputed-data-dynamic-threshold/text_chunks.h"
+
+namespace imputed_data_dynamic_threshold {
+/*!
+  \brief the fields of one info file line used for r2 binning
+
+  views refer to the block the line was split from
+ */
+struct info_record {
+  std::string_view line;       //!< entire line, including its newline
+  std::string_view snp;        //!< column 1: variant ID
+  std::string_view maf;        //!< column 5: minor allele frequency
+  std::string_view rsq;        //!< column 7: estimated r2
+  std::string_view genotyped;  //!< column 8: Imputed/Genotyped indicator
+  unsigned n_fields;           //!< total number of tab-delimited fields
+};
+
+/*!
+  \brief locate tab and newline delimiters in a block with SIMD
+
+  delimiters for a whole block are found in one pass, 32 (AVX2) or
+  16 (SSE2) bytes at a time, and lines are then assembled from the
+  delimiter offsets without revisiting the text. the widest
+  instruction set supported by the running processor is used.
+ */
+class info_line_splitter {
+ public:
+  /*!
+    \brief constructor
+   */
+  info_line_splitter();
+  /*!
+    \brief copy constructor
+    @param obj existing info_line_splitter object
+   */
+  info_line_splitter(const info_line_splitter &obj);
+  /*!
+    \brief destructor
+   */
+  ~info_line_splitter() throw();
+  /*!
+    \brief split a block of lines into records
+    @param begin start of block
+    @param end end of block
+    @param records destination for one record per line
+
+    the final line need not be newline-terminated. a trailing carriage
+    return is excluded from the last field of a line.
+   */
+  void split(const char *begin, const char *end,
+             std::vector<info_record> *records);
+  /*!
+    \brief find tab and newline offsets with the best available method
+    @param begin start of block
+    @param end end of block
+    @param offsets destination for offsets relative to begin, appended
+   */
+  static void find_delimiters(const char *begin, const char *end,
+                              std::vector<std::uint32_t> *offsets);
+  /*!
+    \brief find tab and newline offsets one byte at a time
+    @param begin start of block
+    @param end end of block
+    @param offsets destination for offsets relative to begin, appended
+   */
+  static void find_delimiters_scalar(const char *begin, const char *end,
+                                     std::vector<std::uint32_t> *offsets);
+  /*!
+    \brief find tab and newline offsets with SSE2
+    @param begin start of block
+    @param end end of block
+    @param offsets destination for offsets relative to begin, appended
+
+    falls back to the scalar method on processors without SSE2
+   */
+  static void find_delimiters_sse2(const char *begin, const char *end,
+                                   std::vector<std::uint32_t> *offsets);
+  /*!
+    \brief find tab and newline offsets with AVX2
+    @param begin start of block
+    @param end end of block
+    @param offsets destination for offsets relative to begin, appended
+
+    must only be called when avx2_supported() is true
+   */
+  static void find_delimiters_avx2(const char *begin, const char *end,
+                                   std::vector<std::uint32_t> *offsets);
+  /*!
+    \brief determine whether the running processor supports AVX2
+    \return whether the running processor supports AVX2
+   */
+  static bool avx2_supported();
+
+ private:
+  std::vector<std::uint32_t> _offsets;  //!< reusable delimiter offsets
+};
+
+/*!
+  \brief read a minimac4 info file as blocks of complete lines
+
+  there is no limit on line length: the read buffer grows as needed
+  to hold at least one complete line. uncompressed files are mapped
+  into memory instead, and split in place without being copied.
+  compressed files are read ahead by a gzip_stream_reader, unless
+  bgzf blocks are inflated on a thread pool.
+ */
+class info_file_reader {
+ public:
+  /*!
+    \brief constructor
+    @param filename name of info file, flat or gzipped
+
+    the header line of the file is discarded
+   */
+  explicit info_file_reader(const std::string &filename);
+  /*!
+    \brief constructor, inflating bgzipped input on a thread pool
+    @param filename name of info file, flat, gzipped or bgzipped
+    @param pool shared decompression threads, or null to inflate on
+    the reading thread
+
+    the header line of the file is discarded
+   */
+  info_file_reader(const std::string &filename,
+                   const decompression_pool *pool);
+  /*!
+    \brief destructor
+   */
+  ~info_file_reader() throw();
+  /*!
+    \brief read and split the next block of lines
+    @param records destination for records; views are only valid
+    until the next call
+    \return whether any lines were read
+   */
+  bool next_block(std::vector<info_record> *records);
+
+ private:
+  /*!
+    \brief copy constructor; disabled
+    @param obj existing info_file_reader object
+   */
+  info_file_reader(const info_file_reader &obj);
+  /*!
+    \brief move unread data to the front of the buffer and read more
+    \return whether any data were read
+   */
+  bool fill();
+  /*!
+    \brief split the next block of lines of mapped input
+    @param records destination for records
+    \return whether any lines were left
+   */
+  bool next_mapped_block(std::vector<info_record> *records);
+  std::string _filename;         //!< name of input file
+  BGZF *_input;                  //!< open read connection, if used
+  std::unique_ptr<gzip_stream_reader>
+      _stream;  //!< compressed input read ahead, if used
+  std::unique_ptr<mapped_file> _mapped;  //!< uncompressed input, if mapped
+  std::vector<char> _buffer;     //!< read buffer
+  std::size_t _begin;            //!< offset of first unread byte in buffer
+  std::size_t _end;              //!< offset past last read byte in buffer
+  bool _header_pending;          //!< whether the header is still unread
+  info_line_splitter _splitter;  //!< delimiter scanner
+};
+
+/*!
+  \brief write a filtered copy of a minimac4 info file
+
+  the copy is gzipped, has the same name as its input, and starts
+  with the standard minimac4 header line
+ */
+class info_file_writer {
+ public:
+  /*!
+    \brief constructor
+    @param input_filename name of the info file being filtered
+    @param output_dir directory for the filtered copy, which is created
+    if needed
+   */
+  info_file_writer(const std::string &input_filename,
+                   const std::string &output_dir);
+  /*!
+    \brief destructor
+   */
+  ~info_file_writer() throw();
+  /*!
+    \brief append complete lines to the filtered copy
+    @param lines newline-terminated lines
+   */
+  void write(const std::string_view &lines);
+  /*!
+    \brief finish and close the filtered copy
+   */
+  void close();
+
+ private:
+  /*!
+    \brief copy constructor; disabled
+    @param obj existing info_file_writer object
+   */
+  info_file_writer(const info_file_writer &obj);
+  gzFile _output;  //!< open write connection
+};
+}  // namespace imputed_data_dynamic_threshold
+
+#endif  // IMPUTED_DATA_DYNAMIC_THRESHOLD_INFO_LINES_H_
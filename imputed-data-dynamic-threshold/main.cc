@@ -43,17 +43,24 @@ int main(int argc, const char** const argv) {
   std::string output_list_filename = ap.get_output_list_filename();
   bool second_pass = ap.second_pass();
   std::string filter_info_files_dir = "";
+  std::string cache_dir = "";
+  bool cache_sites = false;
   float baseline_r2 = ap.get_baseline_r2();
   if (second_pass) {
     filter_info_files_dir = ap.get_filter_info_files_dir();
+    cache_dir = ap.get_cache_dir();
+    cache_sites = ap.cache_sites();
   }
   std::string vcf_r2_tag = ap.get_vcf_info_r2_tag();
   std::string vcf_af_tag = ap.get_vcf_info_af_tag();
   std::string vcf_imp_indicator = ap.get_vcf_info_imputed_indicator();
+  unsigned n_threads = ap.get_threads();
+  bool pipeline = ap.pipeline();
   imputed_data_dynamic_threshold::executor ex;
   ex.run(maf_bin_boundaries, info_files, vcf_files, target_r2, baseline_r2,
          output_table_filename, output_list_filename, second_pass,
-         filter_info_files_dir, vcf_r2_tag, vcf_af_tag, vcf_imp_indicator);
+         filter_info_files_dir, vcf_r2_tag, vcf_af_tag, vcf_imp_indicator,
+         n_threads, pipeline, cache_dir, cache_sites);
 
   std::cout << "all done woo!" << std::endl;
   return 0;
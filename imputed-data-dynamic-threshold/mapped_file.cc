@@ -0,0 +1,52 @@
+/*!
+  \file mapped_file.cc
+  \brief implementation of read-only memory mapping
+  \copyright Released under the MIT License. Copyright
+  2023 Lightning Auriga
+ */
+
+#include "imputed-data-dynamic-threshold/mapped_file.h"
+
+namespace iddt = imputed_data_dynamic_threshold;
+
+iddt::mapped_file::mapped_file(const std::string &filename)
+    : _data(0), _size(0) {
+  int fd = open(filename.c_str(), O_RDONLY);
+  struct stat info;
+  if (fd < 0 || fstat(fd, &info) || !S_ISREG(info.st_mode)) {
+    if (fd >= 0) close(fd);
+    throw std::runtime_error("cannot read file \"" + filename + "\"");
+  }
+  _size = info.st_size;
+  // mmap rejects empty mappings, and an empty file needs none
+  if (_size) {
+    void *ptr = mmap(0, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (ptr == MAP_FAILED) {
+      close(fd);
+      throw std::runtime_error("cannot map file \"" + filename + "\"");
+    }
+    // the advice is only a hint, and failing to take it is harmless
+    madvise(ptr, _size, MADV_SEQUENTIAL);
+    _data = static_cast<const char *>(ptr);
+  }
+  // the mapping holds its own reference to the file
+  close(fd);
+}
+
+iddt::mapped_file::~mapped_file() throw() {
+  if (_data) munmap(const_cast<char *>(_data), _size);
+}
+
+const char *iddt::mapped_file::data() const { return _data; }
+
+std::size_t iddt::mapped_file::size() const { return _size; }
+
+bool iddt::mapped_file::is_flat_file(const std::string &filename) {
+  struct stat info;
+  if (stat(filename.c_str(), &info) || !S_ISREG(info.st_mode)) return false;
+  std::ifstream input(filename.c_str(), std::ios::binary);
+  if (!input.is_open()) return false;
+  unsigned char magic[2] = {0, 0};
+  input.read(reinterpret_cast<char *>(magic), 2);
+  return input.gcount() < 2 || magic[0] != 31 || magic[1] != 139;
+}
@@ -0,0 +1,69 @@
+/*!
+  \file mapped_file.h
+  \brief read-only memory mapping of uncompressed input
+  \copyright Released under the MIT License. Copyright
+  2023 Lightning Auriga
+ */
+
+#ifndef IMPUTED_DATA_DYNAMIC_THRESHOLD_MAPPED_FILE_H_
+#define IMPUTED_DATA_DYNAMIC_THRESHOLD_MAPPED_FILE_H_
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+namespace imputed_data_dynamic_threshold {
+/*!
+  \brief map a whole uncompressed file into memory for reading
+
+  the mapping is advised for sequential access, so the kernel reads
+  ahead aggressively, and text is parsed in place without being
+  copied out of the page cache.
+ */
+class mapped_file {
+ public:
+  /*!
+    \brief constructor
+    @param filename name of regular file to map
+   */
+  explicit mapped_file(const std::string &filename);
+  /*!
+    \brief destructor
+   */
+  ~mapped_file() throw();
+  /*!
+    \brief get the start of the mapped contents
+    \return the start of the mapped contents; null if the file is empty
+   */
+  const char *data() const;
+  /*!
+    \brief get the length of the mapped contents
+    \return the length of the file in bytes
+   */
+  std::size_t size() const;
+  /*!
+    \brief test whether a file is uncompressed and can be mapped
+    @param filename name of file to test
+    \return whether the file is a regular file without a gzip header
+   */
+  static bool is_flat_file(const std::string &filename);
+
+ private:
+  /*!
+    \brief copy constructor; disabled
+    @param obj existing mapped_file object
+   */
+  mapped_file(const mapped_file &obj);
+
+  const char *_data;  //!< start of mapping, or null for an empty file
+  std::size_t _size;  //!< length of mapping
+};
+}  // namespace imputed_data_dynamic_threshold
+
+#endif  // IMPUTED_DATA_DYNAMIC_THRESHOLD_MAPPED_FILE_H_
@@ -0,0 +1,724 @@
+/*!
+  \file parallel_gzip.cc
+  \brief implementation of multithreaded single-stream gzip inflation
+  \copyright Released under the MIT License. Copyright
+  2023 Lightning Auriga
+ */
+
+#include "imputed-data-dynamic-threshold/parallel_gzip.h"
+
+namespace iddt = imputed_data_dynamic_threshold;
+
+namespace {
+// RFC 1951 section 3.2.5: base values and extra bits of length
+// symbols 257..285 and distance symbols 0..29
+const unsigned length_base[] = {3,  4,  5,  6,   7,   8,   9,   10,
+                                11, 13, 15, 17,  19,  23,  27,  31,
+                                35, 43, 51, 59,  67,  83,  99,  115,
+                                131, 163, 195, 227, 258};
+const unsigned length_extra[] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1,
+                                 1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+                                 4, 4, 4, 4, 5, 5, 5, 5, 0};
+const unsigned distance_base[] = {
+    1,    2,    3,    4,    5,    7,     9,     13,    17,  25,
+    33,   49,   65,   97,   129,  193,   257,   385,   513, 769,
+    1025, 1537, 2049, 3073, 4097, 6145,  8193,  12289, 16385, 24577};
+const unsigned distance_extra[] = {0, 0, 0, 0, 1, 1, 2, 2,  3,  3,
+                                   4, 4, 5, 5, 6, 6, 7, 7,  8,  8,
+                                   9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+// order in which code length code lengths are stored
+const unsigned code_length_order[] = {16, 17, 18, 0, 8,  7, 9,  6, 10, 5,
+                                      11, 4,  12, 3, 13, 2, 14, 1, 15};
+// longest match, and so the most symbols a single code can add
+const unsigned max_match = 258;
+
+/*!
+  \brief test whether a decoded byte could appear in line-based text
+  @param c decoded byte
+  \return whether the byte is printable, a tab, or a line ending
+ */
+bool is_text(unsigned c) {
+  return (c >= 32 && c < 127) || c == '\t' || c == '\n' || c == '\r';
+}
+
+/*!
+  \brief keep the last window_size bytes of a member's text
+  @param window bytes preceding the text
+  @param begin start of new text
+  @param size number of bytes of new text
+ */
+void advance_window(std::string *window, const char *begin,
+                    std::size_t size) {
+  const std::size_t limit = iddt::speculative_inflater::window_size;
+  if (size >= limit) {
+    window->assign(begin + size - limit, limit);
+    return;
+  }
+  window->append(begin, size);
+  if (window->size() > limit) window->erase(0, window->size() - limit);
+}
+}  // namespace
+
+iddt::speculative_inflater::speculative_inflater()
+    : _length_bits(0), _distance_bits(0) {
+  std::uint8_t lengths[288];
+  for (unsigned i = 0; i < 288; ++i) {
+    lengths[i] = i < 144 ? 8 : i < 256 ? 9 : i < 280 ? 7 : 8;
+  }
+  unsigned bits = 0;
+  build_table(lengths, 288, &_fixed_lengths, &bits, false);
+  for (unsigned i = 0; i < 32; ++i) lengths[i] = 5;
+  build_table(lengths, 32, &_fixed_distances, &bits, false);
+}
+
+iddt::speculative_inflater::~speculative_inflater() throw() {}
+
+bool iddt::speculative_inflater::build_table(const std::uint8_t *lengths,
+                                             unsigned n_symbols,
+                                             std::vector<std::uint16_t> *table,
+                                             unsigned *bits,
+                                             bool allow_incomplete) {
+  unsigned count[16] = {0};
+  for (unsigned i = 0; i < n_symbols; ++i) ++count[lengths[i]];
+  count[0] = 0;
+  unsigned max_length = 15;
+  while (max_length && !count[max_length]) --max_length;
+  if (!max_length) {
+    // a block without distance codes: any lookup is an error
+    table->assign(2, 0);
+    *bits = 1;
+    return true;
+  }
+  int left = 1;
+  for (unsigned len = 1; len <= 15; ++len) {
+    left = (left << 1) - static_cast<int>(count[len]);
+    if (left < 0) return false;
+  }
+  if (left > 0 && !(allow_incomplete && max_length == 1)) return false;
+  unsigned next_code[16] = {0};
+  unsigned code = 0;
+  for (unsigned len = 1; len <= 15; ++len) {
+    code = (code + count[len - 1]) << 1;
+    next_code[len] = code;
+  }
+  const unsigned table_size = 1u << max_length;
+  table->assign(table_size, 0);
+  for (unsigned sym = 0; sym < n_symbols; ++sym) {
+    unsigned len = lengths[sym];
+    if (!len) continue;
+    // codes are packed most significant bit first, so the table is
+    // indexed by the reversed code
+    unsigned value = next_code[len]++, reversed = 0;
+    for (unsigned i = 0; i < len; ++i) {
+      reversed = (reversed << 1) | ((value >> i) & 1);
+    }
+    for (unsigned fill = reversed; fill < table_size; fill += 1u << len) {
+      (*table)[fill] = static_cast<std::uint16_t>(sym << 4 | len);
+    }
+  }
+  *bits = max_length;
+  return true;
+}
+
+bool iddt::speculative_inflater::read_dynamic_tables(const unsigned char *data,
+                                                     std::size_t size,
+                                                     std::uint64_t *bit) {
+  const std::uint64_t limit = static_cast<std::uint64_t>(size) * 8;
+  std::uint64_t pos = *bit;
+  std::uint64_t word = peek(data, pos);
+  unsigned n_lengths = (word & 31) + 257;
+  unsigned n_distances = ((word >> 5) & 31) + 1;
+  unsigned n_code_lengths = ((word >> 10) & 15) + 4;
+  pos += 14;
+  if (n_lengths > 286 || n_distances > 30 ||
+      pos + 3 * n_code_lengths > limit) {
+    return false;
+  }
+  std::uint8_t code_lengths[19] = {0};
+  for (unsigned i = 0; i < n_code_lengths; ++i, pos += 3) {
+    code_lengths[code_length_order[i]] = peek(data, pos) & 7;
+  }
+  unsigned code_bits = 0;
+  if (!build_table(code_lengths, 19, &_code_lengths, &code_bits, false)) {
+    return false;
+  }
+  const std::uint64_t code_mask = (1u << code_bits) - 1;
+  std::uint8_t lengths[320] = {0};
+  unsigned n_total = n_lengths + n_distances, i = 0;
+  while (i < n_total) {
+    if (pos > limit) return false;
+    word = peek(data, pos);
+    std::uint16_t entry = _code_lengths[word & code_mask];
+    unsigned len = entry & 15, sym = entry >> 4;
+    if (!len) return false;
+    pos += len;
+    word >>= len;
+    if (sym < 16) {
+      lengths[i++] = sym;
+      continue;
+    }
+    std::uint8_t value = 0;
+    unsigned repeat = 0;
+    if (sym == 16) {
+      if (!i) return false;
+      value = lengths[i - 1];
+      repeat = 3 + (word & 3);
+      pos += 2;
+    } else if (sym == 17) {
+      repeat = 3 + (word & 7);
+      pos += 3;
+    } else {
+      repeat = 11 + (word & 127);
+      pos += 7;
+    }
+    if (i + repeat > n_total) return false;
+    while (repeat--) lengths[i++] = value;
+  }
+  if (pos > limit || !lengths[256]) return false;
+  if (!build_table(lengths, n_lengths, &_lengths, &_length_bits, true) ||
+      !build_table(lengths + n_lengths, n_distances, &_distances,
+                   &_distance_bits, true)) {
+    return false;
+  }
+  *bit = pos;
+  return true;
+}
+
+bool iddt::speculative_inflater::decode_block(
+    const unsigned char *data, std::size_t size, std::uint64_t *bit,
+    std::vector<std::uint16_t> *symbols, std::size_t *n_symbols,
+    bool *final_block, bool text_only) {
+  const std::uint64_t limit = static_cast<std::uint64_t>(size) * 8;
+  std::uint64_t pos = *bit;
+  if (pos + 3 > limit) return false;
+  std::uint64_t word = peek(data, pos);
+  bool final = word & 1;
+  unsigned type = (word >> 1) & 3;
+  pos += 3;
+  std::size_t n = *n_symbols;
+  if (!type) {
+    // stored block: byte-aligned length and its complement
+    pos = (pos + 7) & ~static_cast<std::uint64_t>(7);
+    if (pos + 32 > limit) return false;
+    const unsigned char *ptr = data + (pos >> 3);
+    unsigned len = ptr[0] | ptr[1] << 8;
+    unsigned complement = ptr[2] | ptr[3] << 8;
+    if (len != (~complement & 0xffff)) return false;
+    pos += 32 + static_cast<std::uint64_t>(len) * 8;
+    if (pos > limit) return false;
+    if (symbols->size() < n + len) symbols->resize(2 * (n + len));
+    std::uint16_t *out = symbols->data();
+    for (unsigned i = 0; i < len; ++i) {
+      if (text_only && !is_text(ptr[4 + i])) return false;
+      out[n++] = ptr[4 + i];
+    }
+  } else {
+    const std::vector<std::uint16_t> *lengths = &_fixed_lengths;
+    const std::vector<std::uint16_t> *distances = &_fixed_distances;
+    unsigned length_bits = 9, distance_bits = 5;
+    if (type == 2) {
+      if (!read_dynamic_tables(data, size, &pos)) return false;
+      lengths = &_lengths;
+      distances = &_distances;
+      length_bits = _length_bits;
+      distance_bits = _distance_bits;
+    } else if (type == 3) {
+      return false;
+    }
+    const std::uint16_t *length_table = lengths->data();
+    const std::uint16_t *distance_table = distances->data();
+    const std::uint64_t length_mask = (1u << length_bits) - 1;
+    const std::uint64_t distance_mask = (1u << distance_bits) - 1;
+    std::uint16_t *out = symbols->data();
+    while (true) {
+      if (pos > limit) return false;
+      if (n + max_match > symbols->size()) {
+        symbols->resize(2 * symbols->size() + max_match);
+        out = symbols->data();
+      }
+      // one read covers the longest length code, distance code and
+      // their extra bits: 15 + 5 + 15 + 13 bits
+      word = peek(data, pos);
+      std::uint16_t entry = length_table[word & length_mask];
+      unsigned len = entry & 15, sym = entry >> 4;
+      if (!len) return false;
+      pos += len;
+      if (sym < 256) {
+        if (text_only && !is_text(sym)) return false;
+        out[n++] = sym;
+        continue;
+      }
+      if (sym == 256) break;
+      sym -= 257;
+      if (sym >= 29) return false;
+      word >>= len;
+      unsigned extra = length_extra[sym];
+      unsigned length = length_base[sym] + (word & ((1u << extra) - 1));
+      word >>= extra;
+      pos += extra;
+      entry = distance_table[word & distance_mask];
+      len = entry & 15;
+      sym = entry >> 4;
+      if (!len || sym >= 30) return false;
+      word >>= len;
+      pos += len;
+      extra = distance_extra[sym];
+      std::size_t distance = distance_base[sym] + (word & ((1u << extra) - 1));
+      pos += extra;
+      // the window markers make every distance up to window_size valid
+      if (distance > n) return false;
+      const std::uint16_t *from = out + n - distance;
+      for (unsigned i = 0; i < length; ++i) out[n + i] = from[i];
+      n += length;
+    }
+    if (pos > limit) return false;
+  }
+  *bit = pos;
+  *n_symbols = n;
+  *final_block = final;
+  return true;
+}
+
+bool iddt::speculative_inflater::find_block(const unsigned char *data,
+                                            std::size_t size,
+                                            std::uint64_t from_bit,
+                                            std::uint64_t to_bit,
+                                            std::uint64_t *start_bit) {
+  if (!data || !start_bit) {
+    throw std::logic_error("speculative_inflater::find_block: null pointer");
+  }
+  const std::uint64_t limit = static_cast<std::uint64_t>(size) * 8;
+  if (to_bit > limit) to_bit = limit;
+  if (_scratch.size() < window_size) {
+    _scratch.resize(4 * window_size);
+    for (unsigned i = 0; i < window_size; ++i) _scratch[i] = 256 + i;
+  }
+  for (std::uint64_t bit = from_bit; bit < to_bit; ++bit) {
+    // a non-final dynamic block, with header counts in range
+    std::uint64_t word = peek(data, bit);
+    if ((word & 7) != 4 || ((word >> 3) & 31) > 29 || ((word >> 8) & 31) > 29) {
+      continue;
+    }
+    std::uint64_t pos = bit;
+    std::size_t n = window_size;
+    bool final = false;
+    if (decode_block(data, size, &pos, &_scratch, &n, &final, true)) {
+      *start_bit = bit;
+      return true;
+    }
+  }
+  return false;
+}
+
+std::uint64_t iddt::speculative_inflater::decode(
+    const unsigned char *data, std::size_t size, std::uint64_t start_bit,
+    std::uint64_t stop_bit, std::vector<std::uint16_t> *symbols,
+    bool *final_block,
+    std::vector<std::pair<std::uint64_t, std::size_t> > *boundaries) {
+  if (!data || !symbols || !final_block) {
+    throw std::logic_error("speculative_inflater::decode: null pointer");
+  }
+  if (symbols->size() < 4 * window_size) symbols->resize(4 * window_size);
+  for (unsigned i = 0; i < window_size; ++i) (*symbols)[i] = 256 + i;
+  std::size_t n = window_size;
+  std::uint64_t bit = start_bit;
+  *final_block = false;
+  if (boundaries) boundaries->clear();
+  while (bit < stop_bit) {
+    if (boundaries) boundaries->push_back(std::make_pair(bit, n - window_size));
+    if (!decode_block(data, size, &bit, symbols, &n, final_block, false) ||
+        *final_block) {
+      break;
+    }
+  }
+  symbols->resize(n);
+  return bit;
+}
+
+void iddt::speculative_inflater::resolve(const std::uint16_t *begin,
+                                         const std::uint16_t *end,
+                                         const std::string &window,
+                                         std::string *text) {
+  if (!text) {
+    throw std::logic_error("speculative_inflater::resolve: null pointer");
+  }
+  text->resize(end - begin);
+  if (begin == end) return;
+  // marker i stands for the byte window_size - i before the first
+  // block, which is only known if the window reaches back that far
+  const std::size_t missing =
+      window.size() < window_size ? window_size - window.size() : 0;
+  const char *known = window.data() + window.size() - (window_size - missing);
+  char *out = &(*text)[0];
+  for (const std::uint16_t *ptr = begin; ptr != end; ++ptr, ++out) {
+    unsigned value = *ptr;
+    if (value < 256) {
+      *out = static_cast<char>(value);
+    } else if (value - 256 >= missing) {
+      *out = known[value - 256 - missing];
+    } else {
+      throw std::runtime_error(
+          "speculative_inflater: reference before start of stream");
+    }
+  }
+}
+
+iddt::parallel_gzip_reader::parallel_gzip_reader(const std::string &filename,
+                                                 unsigned n_threads,
+                                                 std::size_t segment_size)
+    : parallel_gzip_reader(filename, n_threads, segment_size, 0) {}
+
+iddt::parallel_gzip_reader::parallel_gzip_reader(const std::string &filename,
+                                                 unsigned n_threads,
+                                                 std::size_t segment_size,
+                                                 gzip_index *index)
+    : _filename(filename),
+      _input(filename, 1 << 22, 4),
+      _n_threads(n_threads),
+      _segment_size(segment_size),
+      _slack(segment_size > (1 << 20) ? segment_size : 1 << 20),
+      _buffer_size(0),
+      _buffer_offset(0),
+      _eof(false),
+      _bit(0),
+      _in_member(false),
+      _n_members(0),
+      _crc(0),
+      _member_size(0),
+      _confirmed(0),
+      _inflated_size(0),
+      _index(index),
+      _results(n_threads) {
+  if (!_n_threads || !_segment_size) {
+    throw std::logic_error(
+        "parallel_gzip_reader: thread count and segment size must be "
+        "positive");
+  }
+  for (unsigned i = 1; i < _n_threads; ++i) {
+    _inflaters.push_back(
+        std::unique_ptr<speculative_inflater>(new speculative_inflater));
+  }
+}
+
+iddt::parallel_gzip_reader::~parallel_gzip_reader() throw() {}
+
+bool iddt::parallel_gzip_reader::detect_gzip(const std::string &filename) {
+  std::ifstream input(filename.c_str(), std::ios::binary);
+  unsigned char header[3];
+  if (!input.read(reinterpret_cast<char *>(header), 3)) return false;
+  return header[0] == 31 && header[1] == 139 && header[2] == 8;
+}
+
+std::uint64_t iddt::parallel_gzip_reader::confirmed_guesses() const {
+  return _confirmed;
+}
+
+void iddt::parallel_gzip_reader::fill_buffer(std::size_t n_bytes) {
+  const std::size_t padding = speculative_inflater::input_padding;
+  std::size_t consumed = (_bit >> 3) - _buffer_offset;
+  if (consumed) {
+    _buffer_size -= consumed;
+    std::memmove(_buffer.data(), _buffer.data() + consumed, _buffer_size);
+    _buffer_offset += consumed;
+  }
+  if (_buffer.size() < n_bytes + padding) _buffer.resize(n_bytes + padding);
+  if (_buffer_size < n_bytes && !_eof) {
+    _buffer_size +=
+        _input.read(reinterpret_cast<char *>(_buffer.data() + _buffer_size),
+                    n_bytes - _buffer_size);
+    _eof = _buffer_size < n_bytes;
+  }
+  std::memset(_buffer.data() + _buffer_size, 0, padding);
+}
+
+bool iddt::parallel_gzip_reader::read_header() {
+  fill_buffer(_slack);
+  if (!_buffer_size) return false;
+  const unsigned char *ptr = _buffer.data();
+  if (_buffer_size < 10 || ptr[0] != 31 || ptr[1] != 139 || ptr[2] != 8 ||
+      (ptr[3] & 0xe0)) {
+    // data after the last member is ignored, as zlib does
+    if (_n_members) return false;
+    throw std::runtime_error("file \"" + _filename + "\" is not gzip format");
+  }
+  unsigned flags = ptr[3];
+  std::size_t pos = 10;
+  if ((flags & 4) && pos + 2 <= _buffer_size) {
+    pos += 2 + (ptr[pos] | ptr[pos + 1] << 8);
+  }
+  // zero-terminated name, then comment
+  for (unsigned flag = 8; flag <= 16; flag <<= 1) {
+    if (!(flags & flag)) continue;
+    while (pos < _buffer_size && ptr[pos]) ++pos;
+    ++pos;
+  }
+  if (flags & 2) pos += 2;
+  if (pos > _buffer_size) {
+    throw std::runtime_error("cannot inflate file \"" + _filename +
+                             "\": truncated gzip header");
+  }
+  _bit += static_cast<std::uint64_t>(pos) * 8;
+  _in_member = true;
+  ++_n_members;
+  _window.clear();
+  _crc = crc32(0, Z_NULL, 0);
+  _member_size = 0;
+  return true;
+}
+
+void iddt::parallel_gzip_reader::read_trailer() {
+  // the trailer starts at the byte after the end of the final block
+  _bit = (_bit + 7) & ~static_cast<std::uint64_t>(7);
+  fill_buffer(8);
+  if (_buffer_size < 8) {
+    throw std::runtime_error("cannot inflate file \"" + _filename +
+                             "\": truncated gzip member");
+  }
+  const unsigned char *ptr = _buffer.data();
+  std::uint32_t crc = ptr[0] | ptr[1] << 8 | ptr[2] << 16 |
+                      static_cast<std::uint32_t>(ptr[3]) << 24;
+  std::uint32_t size = ptr[4] | ptr[5] << 8 | ptr[6] << 16 |
+                       static_cast<std::uint32_t>(ptr[7]) << 24;
+  if (crc != _crc || size != static_cast<std::uint32_t>(_member_size)) {
+    throw std::runtime_error("cannot inflate file \"" + _filename +
+                             "\": gzip member fails integrity check");
+  }
+  _bit += 64;
+  _in_member = false;
+}
+
+bool iddt::parallel_gzip_reader::inflate_known(std::uint64_t start_bit,
+                                               std::uint64_t stop_bit,
+                                               segment_result *result) const {
+  z_stream strm = z_stream();
+  if (inflateInit2(&strm, -15) != Z_OK) {
+    throw std::runtime_error("cannot initialize zlib stream");
+  }
+  const unsigned char *data = _buffer.data();
+  std::size_t byte = start_bit >> 3;
+  unsigned skip = start_bit & 7;
+  int ret = Z_OK;
+  // a block boundary mid-byte: hand zlib the rest of that byte
+  if (skip) ret = inflatePrime(&strm, 8 - skip, data[byte++] >> skip);
+  if (ret == Z_OK && !_window.empty()) {
+    ret = inflateSetDictionary(
+        &strm, reinterpret_cast<const Bytef *>(_window.data()),
+        _window.size());
+  }
+  if (ret != Z_OK) {
+    inflateEnd(&strm);
+    throw std::runtime_error("cannot initialize zlib stream");
+  }
+  strm.next_in = const_cast<Bytef *>(data + byte);
+  strm.avail_in = _buffer_size - byte;
+  std::string &text = result->text;
+  std::size_t used = 0;
+  bool complete = false;
+  result->start = start_bit;
+  result->final_block = false;
+  result->boundaries.clear();
+  if (_index) result->boundaries.push_back(std::make_pair(start_bit, 0));
+  while (true) {
+    if (text.size() - used < (1 << 16)) {
+      text.resize(used + (used > (1 << 20) ? used : 1 << 20));
+    }
+    strm.next_out = reinterpret_cast<Bytef *>(&text[used]);
+    strm.avail_out = text.size() - used;
+    // Z_BLOCK returns at each block boundary, where data_type holds
+    // the count of unused bits in the last byte read
+    ret = inflate(&strm, Z_BLOCK);
+    used = text.size() - strm.avail_out;
+    std::uint64_t position =
+        static_cast<std::uint64_t>(strm.next_in - data) * 8 -
+        (strm.data_type & 7);
+    if (ret == Z_STREAM_END) {
+      result->final_block = true;
+      result->end = position;
+      complete = true;
+      break;
+    }
+    if (ret != Z_OK && ret != Z_BUF_ERROR) {
+      inflateEnd(&strm);
+      throw std::runtime_error("cannot inflate file \"" + _filename + "\"");
+    }
+    if ((strm.data_type & 128) && !(strm.data_type & 64)) {
+      if (position >= stop_bit) {
+        result->end = position;
+        complete = true;
+        break;
+      }
+      if (_index && position > result->boundaries.back().first) {
+        result->boundaries.push_back(std::make_pair(position, used));
+      }
+    }
+    if (!strm.avail_in) break;
+  }
+  inflateEnd(&strm);
+  text.resize(used);
+  return complete;
+}
+
+void iddt::parallel_gzip_reader::read_round(std::string *text) {
+  const std::uint64_t segment_bits =
+      static_cast<std::uint64_t>(_segment_size) * 8;
+  fill_buffer((_n_threads + 1) * _segment_size + _slack);
+  const unsigned char *data = _buffer.data();
+  const std::size_t size = _buffer_size;
+  const std::uint64_t start = _bit - _buffer_offset * 8;
+  // zlib inflates about twice as fast as speculative_inflater, so
+  // the first thread takes two segments. each guess is made within
+  // its own segment, so only segments wholly in the buffer are used.
+  unsigned n = _n_threads;
+  const std::uint64_t available = static_cast<std::uint64_t>(size) * 8;
+  while (n > 1 && start + (n + 1) * segment_bits > available) --n;
+  std::vector<std::thread> threads;
+  for (unsigned k = 1; k < n; ++k) {
+    threads.push_back(std::thread([this, data, size, start, segment_bits, k]() {
+      segment_result &result = _results.at(k);
+      speculative_inflater &inflater = *_inflaters.at(k - 1);
+      result.error = std::exception_ptr();
+      try {
+        std::uint64_t from = start + (k + 1) * segment_bits;
+        result.found = inflater.find_block(data, size, from,
+                                           from + segment_bits, &result.start);
+        if (result.found) {
+          result.end = inflater.decode(
+              data, size, result.start, from + segment_bits, &result.symbols,
+              &result.final_block, _index ? &result.boundaries : 0);
+        }
+      } catch (...) {
+        result.error = std::current_exception();
+      }
+    }));
+  }
+  segment_result &first = _results.at(0);
+  bool complete = false;
+  first.error = std::exception_ptr();
+  try {
+    complete = inflate_known(start, start + 2 * segment_bits, &first);
+  } catch (...) {
+    first.error = std::current_exception();
+  }
+  for (std::vector<std::thread>::iterator iter = threads.begin();
+       iter != threads.end(); ++iter) {
+    iter->join();
+  }
+  for (unsigned k = 0; k < n; ++k) {
+    if (_results.at(k).error) std::rethrow_exception(_results.at(k).error);
+  }
+  if (!complete) {
+    if (_eof) {
+      throw std::runtime_error("cannot inflate file \"" + _filename +
+                               "\": truncated gzip member");
+    }
+    // a single block runs past the buffered input: read further
+    _slack *= 2;
+    return;
+  }
+  // a guess is confirmed when the segment before it, itself known to
+  // be correct, stops at exactly the guessed offset
+  unsigned n_kept = 1;
+  std::uint64_t end = first.end;
+  bool final_block = first.final_block;
+  while (n_kept < n && !final_block && _results.at(n_kept).found &&
+         _results.at(n_kept).start == end) {
+    end = _results.at(n_kept).end;
+    final_block = _results.at(n_kept).final_block;
+    ++n_kept;
+  }
+  _confirmed += n_kept - 1;
+  // each segment's window is the end of the text before it, so only
+  // the last window_size symbols of each need resolving in order
+  std::vector<std::string> windows(n_kept);
+  std::string window = _window, tail;
+  advance_window(&window, first.text.data(), first.text.size());
+  for (unsigned k = 1; k < n_kept; ++k) {
+    windows.at(k) = window;
+    const std::vector<std::uint16_t> &symbols = _results.at(k).symbols;
+    std::size_t from = symbols.size() - speculative_inflater::window_size;
+    if (from < speculative_inflater::window_size) {
+      from = speculative_inflater::window_size;
+    }
+    speculative_inflater::resolve(symbols.data() + from,
+                                  symbols.data() + symbols.size(), window,
+                                  &tail);
+    advance_window(&window, tail.data(), tail.size());
+  }
+  threads.clear();
+  for (unsigned k = 1; k < n_kept; ++k) {
+    threads.push_back(std::thread([this, &windows, k]() {
+      segment_result &result = _results.at(k);
+      try {
+        const std::vector<std::uint16_t> &symbols = result.symbols;
+        speculative_inflater::resolve(
+            symbols.data() + speculative_inflater::window_size,
+            symbols.data() + symbols.size(), windows.at(k), &result.text);
+        result.crc = crc32(crc32(0, Z_NULL, 0),
+                           reinterpret_cast<const Bytef *>(result.text.data()),
+                           result.text.size());
+      } catch (...) {
+        result.error = std::current_exception();
+      }
+    }));
+  }
+  first.crc =
+      crc32(crc32(0, Z_NULL, 0),
+            reinterpret_cast<const Bytef *>(first.text.data()),
+            first.text.size());
+  for (std::vector<std::thread>::iterator iter = threads.begin();
+       iter != threads.end(); ++iter) {
+    iter->join();
+  }
+  for (unsigned k = 0; k < n_kept; ++k) {
+    segment_result &result = _results.at(k);
+    if (result.error) std::rethrow_exception(result.error);
+    if (_index) record_checkpoints(result, k ? windows.at(k) : _window,
+                                   _inflated_size);
+    _inflated_size += result.text.size();
+    text->append(result.text);
+    _crc = crc32_combine(_crc, result.crc, result.text.size());
+    _member_size += result.text.size();
+  }
+  _window.swap(window);
+  _bit = _buffer_offset * 8 + end;
+  if (final_block) read_trailer();
+}
+
+void iddt::parallel_gzip_reader::record_checkpoints(
+    const segment_result &result, const std::string &window,
+    std::uint64_t offset) {
+  const std::size_t limit = speculative_inflater::window_size;
+  for (std::vector<std::pair<std::uint64_t, std::size_t> >::const_iterator
+           iter = result.boundaries.begin();
+       iter != result.boundaries.end(); ++iter) {
+    std::uint64_t bit = _buffer_offset * 8 + iter->first;
+    if (!_index->wants_checkpoint(bit)) continue;
+    // the checkpoint's window may reach back into the preceding text
+    std::size_t used = iter->second;
+    std::string preceding = "";
+    if (used < limit) {
+      std::size_t from = window.size() > limit - used
+                             ? window.size() - (limit - used)
+                             : 0;
+      preceding = window.substr(from) + result.text.substr(0, used);
+    } else {
+      preceding = result.text.substr(used - limit, limit);
+    }
+    _index->add_checkpoint(bit, offset + used, preceding);
+  }
+}
+
+bool iddt::parallel_gzip_reader::read(std::string *text) {
+  if (!text) {
+    throw std::logic_error("parallel_gzip_reader::read: null pointer");
+  }
+  text->clear();
+  while (text->empty()) {
+    if (!_in_member && !read_header()) {
+      if (_index) _index->finish(_inflated_size);
+      return false;
+    }
+    read_round(text);
+  }
+  return true;
+}
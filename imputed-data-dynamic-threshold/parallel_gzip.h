@@ -0,0 +1,329 @@
+/*!
+  \file parallel_gzip.h
+  \brief inflate single-stream gzip text on several threads at once
+  \copyright Released under the MIT License. Copyright
+  2023 Lightning Auriga
+ */
+
+#ifndef IMPUTED_DATA_DYNAMIC_THRESHOLD_PARALLEL_GZIP_H_
+#define IMPUTED_DATA_DYNAMIC_THRESHOLD_PARALLEL_GZIP_H_
+
+#include <zlib.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "imputed-data-dynamic-threshold/gzip_index.h"
+#include "imputed-data-dynamic-threshold/read_ahead.h"
+
+namespace imputed_data_dynamic_threshold {
+/*!
+  \brief decode raw deflate blocks whose preceding window is unknown
+
+  output symbols are 16 bits wide. values below 256 are literal
+  bytes; a back-reference into the 32KB before the starting block
+  copies a marker instead, 256 plus the marker's position in that
+  window, to be replaced by resolve() once the window is known.
+  the first window_size entries of every decoded buffer hold these
+  markers, so that back-references never need a bounds check.
+
+  compressed data passed to any member must be followed by at least
+  input_padding readable bytes, so that bits can be read a whole
+  word at a time. an object holds decoding tables and is not safe
+  to share between threads.
+ */
+class speculative_inflater {
+ public:
+  static const unsigned window_size = 32768;  //!< deflate window size
+  static const unsigned input_padding = 16;  //!< readable bytes past input
+  /*!
+    \brief constructor
+   */
+  speculative_inflater();
+  /*!
+    \brief destructor
+   */
+  ~speculative_inflater() throw();
+  /*!
+    \brief find the first dynamic block in a range of bit offsets
+    that decodes cleanly into text
+    @param data start of compressed data
+    @param size number of bytes of compressed data
+    @param from_bit first bit offset to try
+    @param to_bit bit offset past the last to try
+    @param start_bit destination for the offset found
+    \return whether a block was found
+
+    a candidate must have a valid header, complete Huffman codes,
+    and decode to completion with every literal a printable
+    character, tab or newline. a match is only a guess: callers
+    confirm it by checking that decoding the preceding data ends
+    at exactly the same offset.
+   */
+  bool find_block(const unsigned char *data, std::size_t size,
+                  std::uint64_t from_bit, std::uint64_t to_bit,
+                  std::uint64_t *start_bit);
+  /*!
+    \brief decode whole blocks from a block boundary
+    @param data start of compressed data
+    @param size number of bytes of compressed data
+    @param start_bit offset of the first block
+    @param stop_bit decoding stops at the first block boundary at or
+    past this offset
+    @param symbols destination for window markers and decoded symbols
+    @param final_block destination for whether decoding stopped at
+    the end of the final block of the stream
+    @param boundaries if not null, destination for the offset of
+    each block boundary reached before the final block, paired with
+    the number of symbols decoded before it
+    \return offset of the block boundary where decoding stopped
+
+    decoding also stops early, at the last complete block, if the
+    data run out or are invalid
+   */
+  std::uint64_t decode(
+      const unsigned char *data, std::size_t size, std::uint64_t start_bit,
+      std::uint64_t stop_bit, std::vector<std::uint16_t> *symbols,
+      bool *final_block,
+      std::vector<std::pair<std::uint64_t, std::size_t> > *boundaries);
+  /*!
+    \brief replace window markers with bytes and narrow to text
+    @param begin first symbol to resolve
+    @param end symbol past the last to resolve
+    @param window up to window_size bytes preceding the starting block
+    @param text destination for resolved text
+   */
+  static void resolve(const std::uint16_t *begin, const std::uint16_t *end,
+                      const std::string &window, std::string *text);
+
+ private:
+  /*!
+    \brief copy constructor; disabled
+    @param obj existing speculative_inflater object
+   */
+  speculative_inflater(const speculative_inflater &obj);
+  /*!
+    \brief read the next bits of the stream, least significant first
+    @param data start of compressed data
+    @param bit offset of the first bit to read
+    \return at least 56 valid bits
+   */
+  static std::uint64_t peek(const unsigned char *data, std::uint64_t bit) {
+    std::uint64_t word = 0;
+    std::memcpy(&word, data + (bit >> 3), sizeof(word));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    word = __builtin_bswap64(word);
+#endif
+    return word >> (bit & 7);
+  }
+  /*!
+    \brief build a lookup table for a canonical Huffman code
+    @param lengths code length of each symbol
+    @param n_symbols number of symbols
+    @param table destination for entries of symbol << 4 | length,
+    indexed by the next bits of the stream
+    @param bits destination for number of bits indexing the table
+    @param allow_incomplete whether a single code of length 1 may
+    leave the code incomplete, as zlib allows for literal/length
+    and distance codes
+    \return whether the lengths describe a valid code
+   */
+  static bool build_table(const std::uint8_t *lengths, unsigned n_symbols,
+                          std::vector<std::uint16_t> *table, unsigned *bits,
+                          bool allow_incomplete);
+  /*!
+    \brief read the code tables of a dynamic block
+    @param data start of compressed data
+    @param size number of bytes of compressed data
+    @param bit offset just past the block type; advanced past the tables
+    \return whether the tables are valid
+   */
+  bool read_dynamic_tables(const unsigned char *data, std::size_t size,
+                           std::uint64_t *bit);
+  /*!
+    \brief decode a single block
+    @param data start of compressed data
+    @param size number of bytes of compressed data
+    @param bit offset of the block; advanced past it on success
+    @param symbols buffer of decoded symbols
+    @param n_symbols number of valid entries in the buffer; advanced
+    on success
+    @param final_block destination for whether this is the final block
+    @param text_only whether to reject literals that are not text
+    \return whether a complete, valid block was decoded
+   */
+  bool decode_block(const unsigned char *data, std::size_t size,
+                    std::uint64_t *bit, std::vector<std::uint16_t> *symbols,
+                    std::size_t *n_symbols, bool *final_block,
+                    bool text_only);
+
+  std::vector<std::uint16_t> _fixed_lengths;  //!< fixed literal/length table
+  std::vector<std::uint16_t> _fixed_distances;  //!< fixed distance table
+  std::vector<std::uint16_t> _lengths;     //!< dynamic literal/length table
+  std::vector<std::uint16_t> _distances;   //!< dynamic distance table
+  std::vector<std::uint16_t> _code_lengths;  //!< code length code table
+  unsigned _length_bits;    //!< bits indexing the dynamic length table
+  unsigned _distance_bits;  //!< bits indexing the dynamic distance table
+  std::vector<std::uint16_t> _scratch;  //!< trial output of find_block
+};
+
+/*!
+  \brief read gzip text that is not split into bgzf blocks on several
+  threads
+
+  the compressed input is read in rounds of one segment per thread,
+  plus one. the first thread inflates two segments with zlib from
+  the known position and window where the last round stopped. each
+  other thread guesses where a deflate block starts in its own
+  segment, decodes from there with speculative_inflater, and stops
+  at the first block boundary past the start of the next segment.
+  a guess is kept only if the preceding thread stopped at exactly
+  the guessed offset; the round's text ends at the first wrong
+  guess, and the next round starts where that text ends, so a bad
+  guess costs time but never changes the output. markers are
+  resolved against the text of the preceding segment, and each
+  member's CRC32 and length are checked against its trailer. the
+  compressed input is fetched by a read_ahead_file, so the reads
+  for later rounds are already under way while a round is inflated.
+
+  guesses rely on the text being printable, which holds for the
+  line-based input this program reads. concatenated gzip members
+  are supported; anything that is not a gzip member following the
+  last one is ignored, as zlib does.
+ */
+class parallel_gzip_reader {
+ public:
+  /*!
+    \brief constructor
+    @param filename name of gzip-compressed input file
+    @param n_threads number of threads inflating each round
+    @param segment_size compressed bytes handed to each thread per round
+   */
+  parallel_gzip_reader(const std::string &filename, unsigned n_threads,
+                       std::size_t segment_size);
+  /*!
+    \brief constructor
+    @param filename name of gzip-compressed input file
+    @param n_threads number of threads inflating each round
+    @param segment_size compressed bytes handed to each thread per round
+    @param index if not null, index to which checkpoints are added as
+    the file is read, and which is completed at the end of the file
+   */
+  parallel_gzip_reader(const std::string &filename, unsigned n_threads,
+                       std::size_t segment_size, gzip_index *index);
+  /*!
+    \brief destructor
+   */
+  ~parallel_gzip_reader() throw();
+  /*!
+    \brief inflate the next round of text
+    @param text destination for inflated text, replacing its contents
+    \return whether any text was left
+   */
+  bool read(std::string *text);
+  /*!
+    \brief test whether a file starts with a gzip member header
+    @param filename name of file to test
+    \return whether the file starts with a gzip member header
+   */
+  static bool detect_gzip(const std::string &filename);
+  /*!
+    \brief get the number of guessed segments that were kept
+    \return number of segments decoded from a confirmed guess
+   */
+  std::uint64_t confirmed_guesses() const;
+
+ private:
+  /*!
+    \brief the outcome of one thread's part of a round
+   */
+  struct segment_result {
+    bool found;        //!< speculative only: whether a block was found
+    std::uint64_t start;  //!< bit offset of the first decoded block
+    std::uint64_t end;    //!< bit offset where decoding stopped
+    bool final_block;     //!< whether decoding ended the member
+    std::vector<std::uint16_t> symbols;  //!< speculative decoder output
+    std::string text;                    //!< resolved text
+    uLong crc;                           //!< CRC32 of resolved text
+    std::exception_ptr error;            //!< failure on a worker thread
+    std::vector<std::pair<std::uint64_t, std::size_t> >
+        boundaries;  //!< with an index: block boundaries and text offsets
+  };
+  /*!
+    \brief copy constructor; disabled
+    @param obj existing parallel_gzip_reader object
+   */
+  parallel_gzip_reader(const parallel_gzip_reader &obj);
+  /*!
+    \brief drop consumed input and read ahead from the file
+    @param n_bytes number of bytes wanted past the current position
+   */
+  void fill_buffer(std::size_t n_bytes);
+  /*!
+    \brief parse the header of the gzip member at the current position
+    \return whether a member was found
+   */
+  bool read_header();
+  /*!
+    \brief check the trailer of the member that just ended
+   */
+  void read_trailer();
+  /*!
+    \brief inflate the first segment of a round with zlib
+    @param start_bit offset of the first block, relative to the buffer
+    @param stop_bit inflation stops at the first block boundary at
+    or past this offset
+    @param result destination for inflated text and stopping point
+    \return whether a block boundary or the end of the member was
+    reached before the buffered input ran out
+   */
+  bool inflate_known(std::uint64_t start_bit, std::uint64_t stop_bit,
+                     segment_result *result) const;
+  /*!
+    \brief inflate one round and append its text
+    @param text destination for inflated text
+   */
+  void read_round(std::string *text);
+  /*!
+    \brief add the block boundaries of a segment to the index
+    @param result decoded segment
+    @param window text preceding the segment within its member
+    @param offset offset of the segment in the file's inflated text
+   */
+  void record_checkpoints(const segment_result &result,
+                          const std::string &window, std::uint64_t offset);
+
+  std::string _filename;   //!< name of input file
+  read_ahead_file _input;  //!< input, read several buffers ahead
+  unsigned _n_threads;     //!< threads inflating each round
+  std::size_t _segment_size;  //!< compressed bytes per thread per round
+  std::size_t _slack;  //!< extra bytes read so a segment can end its block
+  std::vector<unsigned char> _buffer;  //!< compressed input, plus padding
+  std::size_t _buffer_size;     //!< valid bytes in _buffer
+  std::uint64_t _buffer_offset;  //!< file offset of _buffer[0]
+  bool _eof;                     //!< whether the file is fully read
+  std::uint64_t _bit;  //!< file bit offset of next block or member
+  bool _in_member;     //!< whether _bit is inside a member's deflate data
+  unsigned _n_members;  //!< number of members started
+  std::string _window;  //!< last inflated bytes of the current member
+  uLong _crc;           //!< CRC32 of the current member so far
+  std::uint64_t _member_size;  //!< inflated bytes of the current member
+  std::uint64_t _confirmed;  //!< number of guessed segments kept
+  std::uint64_t _inflated_size;  //!< bytes of text inflated so far
+  gzip_index *_index;  //!< index recording checkpoints, if any
+  std::vector<segment_result> _results;  //!< per-thread round state
+  std::vector<std::unique_ptr<speculative_inflater> >
+      _inflaters;  //!< per-thread speculative decoders
+};
+}  // namespace imputed_data_dynamic_threshold
+
+#endif  // IMPUTED_DATA_DYNAMIC_THRESHOLD_PARALLEL_GZIP_H_
@@ -0,0 +1,53 @@
+/*!
+  \file pipeline.cc
+  \brief implementation of staged input loading support
+  \copyright Released under the MIT License. Copyright
+  2023 Lightning Auriga
+ */
+
+#include "imputed-data-dynamic-threshold/pipeline.h"
+
+namespace iddt = imputed_data_dynamic_threshold;
+
+iddt::stage_wait_times::stage_wait_times() : starved(0.0), blocked(0.0) {}
+
+void iddt::pipeline_wait_times::merge(const pipeline_wait_times &obj) {
+  decompress.starved += obj.decompress.starved;
+  decompress.blocked += obj.decompress.blocked;
+  parse.starved += obj.parse.starved;
+  parse.blocked += obj.parse.blocked;
+  aggregate.starved += obj.aggregate.starved;
+  aggregate.blocked += obj.aggregate.blocked;
+}
+
+void iddt::pipeline_wait_times::report(std::ostream &out) const {
+  // decompression reads straight from disk and aggregation writes
+  // nowhere, so each end of the pipeline can only wait one way
+  if (!(out << "\tdecompress: blocked " << decompress.blocked << "s\n"
+            << "\tparse: starved " << parse.starved << "s, blocked "
+            << parse.blocked << "s\n"
+            << "\taggregate: starved " << aggregate.starved << "s"
+            << std::endl)) {
+    throw std::runtime_error(
+        "pipeline_wait_times::report: unable to write to stream");
+  }
+}
+
+iddt::queue_wait::queue_wait(double *waited) : _waited(waited), _pauses(0) {}
+
+iddt::queue_wait::~queue_wait() throw() {
+  if (_waited && _pauses) {
+    *_waited += std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - _start)
+                    .count();
+  }
+}
+
+void iddt::queue_wait::pause() {
+  if (!_pauses++) _start = std::chrono::steady_clock::now();
+  if (_pauses < 64) {
+    std::this_thread::yield();
+  } else {
+    std::this_thread::sleep_for(std::chrono::microseconds(50));
+  }
+}
@@ -0,0 +1,164 @@
+/*!
+  \file pipeline.h
+  \brief bounded queues and wait accounting for staged input loading
+  \copyright Released under the MIT License. Copyright
+  2023 Lightning Auriga
+ */
+
+#ifndef IMPUTED_DATA_DYNAMIC_THRESHOLD_PIPELINE_H_
+#define IMPUTED_DATA_DYNAMIC_THRESHOLD_PIPELINE_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace imputed_data_dynamic_threshold {
+/*!
+  \brief time a pipeline stage spent waiting on its neighbours
+ */
+struct stage_wait_times {
+  stage_wait_times();
+  double starved;  //!< seconds spent waiting for input from upstream
+  double blocked;  //!< seconds spent waiting for downstream to free a buffer
+};
+
+/*!
+  \brief wait times of each stage of a staged file load
+ */
+struct pipeline_wait_times {
+  stage_wait_times decompress;  //!< reading and inflating text
+  stage_wait_times parse;       //!< splitting text into variant batches
+  stage_wait_times aggregate;   //!< adding batches to bins
+  /*!
+    \brief add the wait times of another load to these
+    @param obj wait times of another load
+   */
+  void merge(const pipeline_wait_times &obj);
+  /*!
+    \brief report wait times of each stage
+    @param out stream to which to write the report
+   */
+  void report(std::ostream &out) const;
+};
+
+/*!
+  \brief back off while a queue is full or empty, and time the wait
+
+  the waiting thread first yields, and then sleeps for short
+  intervals, so that a stalled stage does not take a core from
+  the stage it is waiting on.
+ */
+class queue_wait {
+ public:
+  /*!
+    \brief constructor
+    @param waited accumulator for seconds spent waiting, or null
+   */
+  explicit queue_wait(double *waited);
+  /*!
+    \brief destructor; adds any time spent waiting to the accumulator
+   */
+  ~queue_wait() throw();
+  /*!
+    \brief give up the processor before trying again
+   */
+  void pause();
+
+ private:
+  double *_waited;  //!< accumulator for seconds spent waiting
+  unsigned _pauses;  //!< number of times pause() has been called
+  std::chrono::steady_clock::time_point _start;  //!< time of first pause
+};
+
+/*!
+  \brief fixed-capacity queue between exactly one producer thread
+  and exactly one consumer thread
+  @tparam value_type class of queued values, typically a pointer to
+  a reusable buffer
+
+  the queue is a ring buffer with atomic head and tail indices, so
+  neither side ever takes a lock. push and pop wait while the queue
+  is full or empty, respectively, until cancel() is called.
+ */
+template <class value_type>
+class bounded_queue {
+ public:
+  /*!
+    \brief constructor
+    @param capacity maximum number of queued values
+   */
+  explicit bounded_queue(unsigned capacity)
+      : _slots(capacity + 1), _head(0), _tail(0), _cancelled(false) {
+    if (!capacity) {
+      throw std::logic_error("bounded_queue: capacity must be positive");
+    }
+  }
+  /*!
+    \brief destructor
+   */
+  ~bounded_queue() throw() {}
+  /*!
+    \brief add a value, waiting while the queue is full
+    @param value value to add
+    @param waited accumulator for seconds spent waiting, or null
+    \return whether the value was added before the queue was cancelled
+
+    only one thread may push to a queue
+   */
+  bool push(const value_type &value, double *waited) {
+    std::size_t tail = _tail.load(std::memory_order_relaxed);
+    std::size_t next = (tail + 1) % _slots.size();
+    queue_wait wait(waited);
+    while (next == _head.load(std::memory_order_acquire)) {
+      if (_cancelled.load(std::memory_order_relaxed)) return false;
+      wait.pause();
+    }
+    if (_cancelled.load(std::memory_order_relaxed)) return false;
+    _slots[tail] = value;
+    _tail.store(next, std::memory_order_release);
+    return true;
+  }
+  /*!
+    \brief remove the oldest value, waiting while the queue is empty
+    @param value destination for the removed value
+    @param waited accumulator for seconds spent waiting, or null
+    \return whether a value was removed before the queue was cancelled
+
+    only one thread may pop from a queue
+   */
+  bool pop(value_type *value, double *waited) {
+    if (!value) {
+      throw std::logic_error("bounded_queue::pop: null pointer");
+    }
+    std::size_t head = _head.load(std::memory_order_relaxed);
+    queue_wait wait(waited);
+    while (head == _tail.load(std::memory_order_acquire)) {
+      if (_cancelled.load(std::memory_order_relaxed)) return false;
+      wait.pause();
+    }
+    if (_cancelled.load(std::memory_order_relaxed)) return false;
+    *value = _slots[head];
+    _head.store((head + 1) % _slots.size(), std::memory_order_release);
+    return true;
+  }
+  /*!
+    \brief make all current and future calls to push and pop fail
+
+    this is used to release the other stages of a pipeline when
+    one of them fails. it is safe to call from any thread.
+   */
+  void cancel() { _cancelled.store(true); }
+
+ private:
+  std::vector<value_type> _slots;  //!< ring buffer, with one slot unused
+  alignas(64) std::atomic<std::size_t> _head;  //!< next slot to pop
+  alignas(64) std::atomic<std::size_t> _tail;  //!< next slot to push
+  std::atomic<bool> _cancelled;  //!< whether the queue has been cancelled
+};
+}  // namespace imputed_data_dynamic_threshold
+
+#endif  // IMPUTED_DATA_DYNAMIC_THRESHOLD_PIPELINE_H_
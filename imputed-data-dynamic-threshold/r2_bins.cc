@@ -7,8 +7,45 @@
 
 #include "imputed-data-dynamic-threshold/r2_bins.h"
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
 namespace iddt = imputed_data_dynamic_threshold;
 
+namespace {
+// number of variants parsed before each call to r2_bins::add_batch
+const unsigned batch_size = 4096;
+// number of chunks and of batches in flight in r2_bins::load_pipelined
+const unsigned pipeline_depth = 4;
+// largest histogram scale accepted from a saved summary
+const std::uint32_t max_summary_scale = 1u << 24;
+
+/*!
+  \brief write a value to a binary summary in native byte order
+  @param out open binary output stream
+  @param val value to write
+ */
+template <class value_type>
+void write_binary(std::ostream &out, const value_type &val) {
+  out.write(reinterpret_cast<const char *>(&val), sizeof(value_type));
+}
+
+/*!
+  \brief read a value written by write_binary
+  @param in open binary input stream
+  \return value read from the stream
+ */
+template <class value_type>
+value_type read_binary(std::istream &in) {
+  value_type val;
+  if (!in.read(reinterpret_cast<char *>(&val), sizeof(value_type))) {
+    throw std::runtime_error("r2 summary ends unexpectedly");
+  }
+  return val;
+}
+}  // namespace
+
 iddt::r2_bin::r2_bin()
     : _bin_min(0.0),
       _bin_max(0.0),
@@ -16,47 +53,376 @@ iddt::r2_bin::r2_bin()
       _total_count(0u),
       _filtered_count(0u),
       _threshold(0.0f),
-      _baseline(0.3f) {}
+      _baseline(0.3f),
+      _histogram_scale(0u) {}
 iddt::r2_bin::r2_bin(const r2_bin &obj)
     : _bin_min(obj._bin_min),
       _bin_max(obj._bin_max),
-      _data(obj._data),
+      _values(obj._values),
+      _ids(obj._ids),
+      _id_storage(obj._id_storage),
       _total(obj._total),
       _total_count(obj._total_count),
       _filtered_count(obj._filtered_count),
       _threshold(obj._threshold),
-      _baseline(obj._baseline) {}
+      _baseline(obj._baseline),
+      _histogram_scale(obj._histogram_scale),
+      _histogram_counts(obj._histogram_counts),
+      _histogram_values(obj._histogram_values) {}
 iddt::r2_bin::~r2_bin() throw() {}
 
-void imputed_data_dynamic_threshold::r2_bin::add_value(const std::string &id,
-                                                       const float &val) {
-  _data.push_back(std::pair<std::string, float>(id, val));
+void imputed_data_dynamic_threshold::r2_bin::add_value(
+    const std::string_view &id, const float &val) {
+  store_value(id, val);
   _total += val;
   ++_total_count;
   ++_filtered_count;
 }
 
+void iddt::r2_bin::store_value(const std::string_view &id, const float &val) {
+  if (_histogram_scale) {
+    unsigned cell = id.empty() ? find_histogram_cell(val)
+                               : _histogram_counts.size();
+    if (cell < _histogram_counts.size()) {
+      _histogram_values.at(cell) = val;
+      ++_histogram_counts.at(cell);
+    } else {
+      spill_histogram();
+    }
+  }
+  if (!_histogram_scale) {
+    // IDs are only stored once one has been seen
+    if (!id.empty() && _ids.size() < _values.size()) {
+      _ids.resize(_values.size(), _id_storage.add(std::string_view()));
+    }
+    if (!id.empty() || !_ids.empty()) _ids.push_back(_id_storage.add(id));
+    _values.push_back(val);
+  }
+}
+
+void imputed_data_dynamic_threshold::r2_bin::merge(const r2_bin &obj) {
+  if (fabs(_bin_min - obj._bin_min) > DBL_EPSILON ||
+      fabs(_bin_max - obj._bin_max) > DBL_EPSILON) {
+    throw std::logic_error("r2_bin::merge: bin bounds do not match");
+  }
+  if (obj._histogram_scale) {
+    throw std::logic_error(
+        "r2_bin::merge: cannot merge from a bin that counts values");
+  }
+  if (!_histogram_scale) {
+    _values.reserve(_values.size() + obj._values.size());
+    if (!obj._ids.empty()) _ids.reserve(_values.size() + obj._values.size());
+  }
+  char buffer[variant_id_codec::max_length];
+  for (unsigned i = 0; i < obj._values.size(); ++i) {
+    add_value(obj.get_id(i, buffer), obj._values[i]);
+  }
+}
+
+void iddt::r2_bin::merge_summary(const r2_bin &obj) {
+  if (fabs(_bin_min - obj._bin_min) > DBL_EPSILON ||
+      fabs(_bin_max - obj._bin_max) > DBL_EPSILON) {
+    throw std::logic_error("r2_bin::merge_summary: bin bounds do not match");
+  }
+  if (!obj._ids.empty()) {
+    throw std::logic_error(
+        "r2_bin::merge_summary: cannot merge from a bin that stores IDs");
+  }
+  // cells can be added directly unless the same cell saw two values
+  bool by_cell = _histogram_scale && _histogram_scale == obj._histogram_scale;
+  for (unsigned i = 0; by_cell && i < obj._histogram_counts.size(); ++i) {
+    by_cell = !obj._histogram_counts[i] || !_histogram_counts[i] ||
+              obj._histogram_values[i] == _histogram_values[i];
+  }
+  if (by_cell) {
+    for (unsigned i = 0; i < obj._histogram_counts.size(); ++i) {
+      if (!obj._histogram_counts[i]) continue;
+      _histogram_values[i] = obj._histogram_values[i];
+      _histogram_counts[i] += obj._histogram_counts[i];
+    }
+  } else {
+    for (unsigned i = 0; i < obj._histogram_counts.size(); ++i) {
+      for (unsigned j = 0; j < obj._histogram_counts[i]; ++j) {
+        store_value(std::string_view(), obj._histogram_values[i]);
+      }
+    }
+    for (unsigned i = 0; i < obj._values.size(); ++i) {
+      store_value(std::string_view(), obj._values[i]);
+    }
+  }
+  _total += obj._total;
+  _total_count += obj._total_count;
+  _filtered_count += obj._filtered_count;
+}
+
+void iddt::r2_bin::save_summary(std::ostream &out) const {
+  if (!_ids.empty()) {
+    throw std::logic_error(
+        "r2_bin::save_summary: variant IDs cannot be summarized");
+  }
+  write_binary<double>(out, _bin_min);
+  write_binary<double>(out, _bin_max);
+  write_binary<std::uint32_t>(out, _total_count);
+  write_binary<double>(out, _total);
+  write_binary<std::uint32_t>(out, _histogram_scale);
+  if (_histogram_scale) {
+    std::uint32_t occupied = _histogram_counts.size() -
+                             std::count(_histogram_counts.begin(),
+                                        _histogram_counts.end(), 0u);
+    write_binary<std::uint32_t>(out, occupied);
+    for (unsigned i = 0; i < _histogram_counts.size(); ++i) {
+      if (!_histogram_counts[i]) continue;
+      write_binary<std::uint32_t>(out, i);
+      write_binary<float>(out, _histogram_values[i]);
+      write_binary<std::uint32_t>(out, _histogram_counts[i]);
+    }
+  } else {
+    write_binary<std::uint32_t>(out, _values.size());
+    out.write(reinterpret_cast<const char *>(_values.data()),
+              _values.size() * sizeof(float));
+  }
+}
+
+void iddt::r2_bin::load_summary(std::istream &in) {
+  if (_total_count) {
+    throw std::logic_error(
+        "r2_bin::load_summary: called after values were added");
+  }
+  double bin_min = read_binary<double>(in);
+  double bin_max = read_binary<double>(in);
+  if (fabs(_bin_min - bin_min) > DBL_EPSILON ||
+      fabs(_bin_max - bin_max) > DBL_EPSILON) {
+    throw std::runtime_error("r2 summary is for different bin bounds");
+  }
+  std::uint32_t total_count = read_binary<std::uint32_t>(in);
+  double total = read_binary<double>(in);
+  std::uint32_t scale = read_binary<std::uint32_t>(in);
+  if (scale > max_summary_scale) {
+    throw std::runtime_error("r2 summary has an invalid histogram scale");
+  }
+  std::vector<unsigned> counts(scale ? scale + 1 : 0, 0u);
+  std::vector<float> cell_values(counts.size(), 0.0f);
+  std::vector<float> values;
+  std::uint64_t n_loaded = 0;
+  std::uint32_t n = read_binary<std::uint32_t>(in);
+  if (scale) {
+    for (std::uint32_t i = 0; i < n; ++i) {
+      std::uint32_t cell = read_binary<std::uint32_t>(in);
+      float val = read_binary<float>(in);
+      std::uint32_t count = read_binary<std::uint32_t>(in);
+      if (cell >= counts.size() || counts[cell]) {
+        throw std::runtime_error("r2 summary has an invalid histogram cell");
+      }
+      cell_values[cell] = val;
+      counts[cell] = count;
+      n_loaded += count;
+    }
+  } else {
+    // read in pieces, so that a damaged length fails at the end of
+    // the input rather than in one huge allocation
+    while (values.size() < n) {
+      std::size_t used = values.size();
+      std::size_t piece = std::min<std::size_t>(n - used, 1 << 16);
+      values.resize(used + piece);
+      if (!in.read(reinterpret_cast<char *>(&values[used]),
+                   piece * sizeof(float))) {
+        throw std::runtime_error("r2 summary ends unexpectedly");
+      }
+    }
+    n_loaded = n;
+  }
+  if (n_loaded != total_count) {
+    throw std::runtime_error("r2 summary has inconsistent counts");
+  }
+  _values.swap(values);
+  _histogram_scale = scale;
+  _histogram_counts.swap(counts);
+  _histogram_values.swap(cell_values);
+  _total = total;
+  _total_count = total_count;
+  _filtered_count = total_count;
+}
+
+void iddt::r2_bin::set_histogram_scale(unsigned scale) {
+  if (_total_count) {
+    throw std::logic_error(
+        "r2_bin::set_histogram_scale: called after values were added");
+  }
+  _histogram_scale = scale;
+  _histogram_counts.assign(scale ? scale + 1 : 0, 0u);
+  _histogram_values.assign(scale ? scale + 1 : 0, 0.0f);
+}
+
+unsigned iddt::r2_bin::get_histogram_scale() const { return _histogram_scale; }
+
+unsigned iddt::r2_bin::find_histogram_cell(const float &val) const {
+  // also rejects nan
+  if (!(val >= 0.0f && val <= 1.0f)) return _histogram_counts.size();
+  double scaled = static_cast<double>(val) * _histogram_scale;
+  unsigned cell = static_cast<unsigned>(scaled + 0.5);
+  // values must sit on the grid, and each cell must only ever see one
+  // value, so that distinct cells never compare as ties
+  if (fabs(scaled - cell) > 0.01 ||
+      (_histogram_counts.at(cell) && _histogram_values.at(cell) != val)) {
+    return _histogram_counts.size();
+  }
+  return cell;
+}
+
+void iddt::r2_bin::spill_histogram() {
+  _values.reserve(_total_count);
+  for (unsigned i = 0; i < _histogram_counts.size(); ++i) {
+    _values.insert(_values.end(), _histogram_counts.at(i),
+                   _histogram_values.at(i));
+  }
+  _histogram_scale = 0;
+  _histogram_counts.clear();
+  _histogram_values.clear();
+}
+
+void iddt::r2_bin::compute_histogram_threshold(const double &target) {
+  // replay the removals of the sorted path one value at a time, so that
+  // the running total is rounded exactly as it would be there
+  double target_sum = _total_count * target;
+  unsigned cell = 0, removed = _total_count - _filtered_count;
+  unsigned cell_remaining = _histogram_counts.at(0);
+  // skip anything removed by an earlier call
+  while (removed) {
+    if (!cell_remaining) {
+      cell_remaining = _histogram_counts.at(++cell);
+      continue;
+    }
+    unsigned n = std::min(removed, cell_remaining);
+    cell_remaining -= n;
+    removed -= n;
+  }
+  bool removed_any = false;
+  while (_filtered_count && _total < target_sum) {
+    while (!cell_remaining) cell_remaining = _histogram_counts.at(++cell);
+    _total -= _histogram_values.at(cell);
+    --cell_remaining;
+    --_filtered_count;
+    target_sum -= target;
+    removed_any = true;
+  }
+  // remaining values tying the last removed one share its cell
+  if (removed_any && _filtered_count < _total_count) {
+    while (_filtered_count && cell_remaining) {
+      _total -= _histogram_values.at(cell);
+      --cell_remaining;
+      --_filtered_count;
+    }
+  }
+}
+
+float iddt::r2_bin::lowest_remaining_value() const {
+  if (!_histogram_scale) return _values.at(_total_count - _filtered_count);
+  unsigned removed = _total_count - _filtered_count;
+  for (unsigned i = 0; i < _histogram_counts.size(); ++i) {
+    if (_histogram_counts.at(i) > removed) return _histogram_values.at(i);
+    removed -= _histogram_counts.at(i);
+  }
+  throw std::logic_error("r2_bin::lowest_remaining_value: no values remain");
+}
+
 void imputed_data_dynamic_threshold::r2_bin::compute_threshold(
     const double &target) {
-  std::sort(_data.begin(), _data.end(), string_float_less_than);
+  if (_histogram_scale) {
+    compute_histogram_threshold(target);
+    return;
+  }
+  unsigned first = _total_count - _filtered_count;
+  unsigned sorted_end = first;
+  // IDs are reported in r2 order, so they need a full sort regardless
+  if (!_ids.empty()) {
+    sort_ids_by_value(first);
+    sorted_end = _total_count;
+  }
   double target_sum = _total_count * target;
+  // bisect for the cut with selection instead of sorting everything: the
+  // average of what remains only grows as low values are removed
+  unsigned lo = first, hi = _total_count;
+  long double removed = 0.0L;
+  while (sorted_end < _total_count && hi - lo > 16) {
+    unsigned mid = lo + (hi - lo) / 2;
+    std::nth_element(_values.begin() + lo, _values.begin() + mid,
+                     _values.begin() + hi);
+    long double part = 0.0L;
+    for (unsigned i = lo; i < mid; ++i) part += _values[i];
+    if (_total - (removed + part) >= target_sum - (mid - first) * target) {
+      hi = mid;
+    } else {
+      lo = mid;
+      removed += part;
+    }
+  }
+  // only the removed values need ordering, so that they are subtracted
+  // exactly as a full sort would; the loops below extend the sorted
+  // prefix if rounding puts the cut a little past the estimate
+  sort_data_prefix(std::min(hi + 2, _total_count), first, &sorted_end);
   while (_filtered_count && _total < target_sum) {
-    _total -= _data.at(_total_count - _filtered_count).second;
+    sort_data_prefix(_total_count - _filtered_count + 1, first, &sorted_end);
+    _total -= _values.at(_total_count - _filtered_count);
     --_filtered_count;
     target_sum -= target;
   }
   if (_filtered_count < _total_count && _filtered_count) {
     // check to be sure that reporting a particular filter doesn't imply
     // removing a few more variants that exactly tie that value
-    while (fabs(_data.at(_total_count - _filtered_count).second -
-                _data.at(_total_count - _filtered_count - 1).second) <
+    sort_data_prefix(_total_count - _filtered_count + 1, first, &sorted_end);
+    while (fabs(_values.at(_total_count - _filtered_count) -
+                _values.at(_total_count - _filtered_count - 1)) <
            DBL_EPSILON) {
-      _total -= _data.at(_total_count - _filtered_count).second;
+      _total -= _values.at(_total_count - _filtered_count);
       --_filtered_count;
+      sort_data_prefix(_total_count - _filtered_count + 1, first,
+                       &sorted_end);
     }
   }
 }
 
+void iddt::r2_bin::sort_data_prefix(unsigned end, unsigned first,
+                                    unsigned *sorted_end) {
+  if (end <= *sorted_end) return;
+  // grow geometrically, as each extension partitions the whole tail
+  unsigned step = std::max(64u, *sorted_end - first);
+  unsigned new_end =
+      std::min(_total_count, std::max(end, *sorted_end + step));
+  if (new_end < _total_count) {
+    std::nth_element(_values.begin() + *sorted_end, _values.begin() + new_end,
+                     _values.end());
+  }
+  std::sort(_values.begin() + *sorted_end, _values.begin() + new_end);
+  *sorted_end = new_end;
+}
+
+void iddt::r2_bin::sort_ids_by_value(unsigned first) {
+  // sort an index permutation, then apply it to both arrays; IDs move
+  // as handles, and their text stays where it is
+  std::vector<unsigned> order(_total_count - first);
+  for (unsigned i = 0; i < order.size(); ++i) order[i] = first + i;
+  std::stable_sort(order.begin(), order.end(),
+                   [this](unsigned lhs, unsigned rhs) {
+                     return _values[lhs] < _values[rhs];
+                   });
+  std::vector<float> values;
+  std::vector<std::uint64_t> ids;
+  values.reserve(order.size());
+  ids.reserve(order.size());
+  for (std::vector<unsigned>::const_iterator iter = order.begin();
+       iter != order.end(); ++iter) {
+    values.push_back(_values[*iter]);
+    ids.push_back(_ids[*iter]);
+  }
+  std::copy(values.begin(), values.end(), _values.begin() + first);
+  std::copy(ids.begin(), ids.end(), _ids.begin() + first);
+}
+
+std::string_view iddt::r2_bin::get_id(unsigned i, char *buffer) const {
+  return _ids.empty() ? std::string_view()
+                      : _id_storage.get(_ids.at(i), buffer);
+}
+
 float imputed_data_dynamic_threshold::r2_bin::report_stored_threshold() const {
   if (_threshold != _threshold || _threshold >= get_baseline_r2())
     return _threshold;
@@ -69,8 +435,7 @@ void imputed_data_dynamic_threshold::r2_bin::report_threshold(
   // threshold defaults to 0.3; may be higher if anything was removed
   _threshold = get_baseline_r2();
   if (_filtered_count) {
-    _threshold = std::max<float>(
-        _threshold, _data.at(_total_count - _filtered_count).second);
+    _threshold = std::max<float>(_threshold, lowest_remaining_value());
   } else {
     // if everything is filtered, there is no threshold that attains the desired
     // average, alas
@@ -88,8 +453,11 @@ void imputed_data_dynamic_threshold::r2_bin::report_threshold(
 
 void imputed_data_dynamic_threshold::r2_bin::report_passing_variants(
     std::ostream &out) const {
+  char buffer[variant_id_codec::max_length];
   for (unsigned i = _total_count - _filtered_count; i < _total_count; ++i) {
-    out << _data.at(i).first << '\n';
+    std::string_view id = get_id(i, buffer);
+    out.write(id.data(), id.size());
+    out.put('\n');
   }
 }
 
@@ -97,11 +465,12 @@ bool imputed_data_dynamic_threshold::r2_bin::operator==(
     const r2_bin &obj) const {
   if (fabs(_bin_max - obj._bin_max) > DBL_EPSILON) return false;
   if (fabs(_bin_min - obj._bin_min) > DBL_EPSILON) return false;
-  if (_data.size() != obj._data.size()) return false;
-  for (unsigned i = 0; i < _data.size(); ++i) {
-    if (_data.at(i).first.compare(obj._data.at(i).first)) return false;
-    if (fabs(_data.at(i).second - obj._data.at(i).second) > FLT_EPSILON)
-      return false;
+  if (_values.size() != obj._values.size()) return false;
+  char buffer[variant_id_codec::max_length];
+  char obj_buffer[variant_id_codec::max_length];
+  for (unsigned i = 0; i < _values.size(); ++i) {
+    if (get_id(i, buffer).compare(obj.get_id(i, obj_buffer))) return false;
+    if (fabs(_values.at(i) - obj._values.at(i)) > FLT_EPSILON) return false;
   }
   if (fabs(_total - obj._total) > DBL_EPSILON) return false;
   if (_total_count != obj._total_count) return false;
@@ -112,6 +481,9 @@ bool imputed_data_dynamic_threshold::r2_bin::operator==(
   if (!(fabs(_baseline - obj._baseline) < FLT_EPSILON ||
         (_baseline != _baseline && obj._baseline != obj._baseline)))
     return false;
+  if (_histogram_scale != obj._histogram_scale) return false;
+  if (_histogram_counts != obj._histogram_counts) return false;
+  if (_histogram_values != obj._histogram_values) return false;
   return true;
 }
 
@@ -126,23 +498,36 @@ void iddt::r2_bin::set_bin_bounds(const double &minimum,
 }
 const double &iddt::r2_bin::get_bin_min() const { return _bin_min; }
 const double &iddt::r2_bin::get_bin_max() const { return _bin_max; }
-const std::vector<std::pair<std::string, float> > &iddt::r2_bin::get_data()
-    const {
-  return _data;
+std::vector<std::pair<std::string, float> > iddt::r2_bin::get_data() const {
+  std::vector<std::pair<std::string, float> > res;
+  res.reserve(_values.size());
+  char buffer[variant_id_codec::max_length];
+  for (unsigned i = 0; i < _values.size(); ++i) {
+    res.push_back(std::pair<std::string, float>(std::string(get_id(i, buffer)),
+                                                _values.at(i)));
+  }
+  return res;
 }
+const std::vector<float> &iddt::r2_bin::get_values() const { return _values; }
 const double &iddt::r2_bin::get_total() const { return _total; }
 unsigned iddt::r2_bin::get_total_count() const { return _total_count; }
 unsigned iddt::r2_bin::get_filtered_count() const { return _filtered_count; }
 void iddt::r2_bin::set_baseline_r2(const float &r2) { _baseline = r2; }
 const float &iddt::r2_bin::get_baseline_r2() const { return _baseline; }
 
-iddt::r2_bins::r2_bins() : _baseline_r2(0.3f) {}
+iddt::r2_bins::r2_bins()
+    : _baseline_r2(0.3f), _decompression_pool(0), _record_sites(false) {}
 iddt::r2_bins::r2_bins(const r2_bins &obj)
     : _bins(obj._bins),
       _bin_lower_bounds(obj._bin_lower_bounds),
       _bin_upper_bounds(obj._bin_upper_bounds),
+      _maf_bin_boundaries(obj._maf_bin_boundaries),
       _typed_variants(obj._typed_variants),
-      _baseline_r2(obj._baseline_r2) {}
+      _typed_variant_storage(obj._typed_variant_storage),
+      _baseline_r2(obj._baseline_r2),
+      _decompression_pool(obj._decompression_pool),
+      _record_sites(obj._record_sites),
+      _sites(obj._sites) {}
 iddt::r2_bins::~r2_bins() throw() {}
 void imputed_data_dynamic_threshold::r2_bins::set_bin_boundaries(
     const std::vector<double> &boundaries) {
@@ -159,10 +544,87 @@ void imputed_data_dynamic_threshold::r2_bins::set_bin_boundaries(
     bin.set_baseline_r2(get_baseline_r2());
     _bins.push_back(bin);
   }
+  update_maf_bin_lookup();
+}
+
+void iddt::r2_bins::update_maf_bin_lookup() {
+  _maf_bin_boundaries.clear();
+  if (_bin_lower_bounds.empty() ||
+      _bin_lower_bounds.size() != _bin_upper_bounds.size()) {
+    return;
+  }
+  std::vector<double> boundaries;
+  std::map<double, unsigned>::const_iterator lower_iter, upper_iter;
+  unsigned i = 0;
+  for (lower_iter = _bin_lower_bounds.begin(),
+      upper_iter = _bin_upper_bounds.begin();
+       lower_iter != _bin_lower_bounds.end(); ++lower_iter, ++upper_iter, ++i) {
+    if (lower_iter->second != i || upper_iter->second != i ||
+        !(lower_iter->first < upper_iter->first) ||
+        (i && lower_iter->first != boundaries.back())) {
+      return;
+    }
+    if (!i) boundaries.push_back(lower_iter->first);
+    boundaries.push_back(upper_iter->first);
+  }
+  _maf_bin_boundaries = boundaries;
 }
 
 unsigned imputed_data_dynamic_threshold::r2_bins::find_maf_bin(
     const double &maf) const {
+  unsigned index = 0;
+  assign_maf_bins(&maf, 1, &index);
+  return index;
+}
+
+void iddt::r2_bins::assign_maf_bins(const double *mafs, unsigned n,
+                                    unsigned *indices) const {
+  if (_maf_bin_boundaries.empty()) {
+    for (unsigned i = 0; i < n; ++i) indices[i] = find_maf_bin_by_map(mafs[i]);
+    return;
+  }
+  const double *bounds = _maf_bin_boundaries.data();
+  unsigned n_bounds = _maf_bin_boundaries.size();
+  // the number of bounds at or below a MAF identifies its bin without
+  // branching; nan is at or above nothing
+  unsigned i = 0;
+#if defined(__x86_64__) || defined(__i386__)
+  for (; i + 2 <= n; i += 2) {
+    __m128d values = _mm_loadu_pd(mafs + i);
+    __m128i counts = _mm_setzero_si128();
+    for (unsigned j = 0; j < n_bounds; ++j) {
+      // a passing comparison sets its lane to all ones, or -1
+      __m128d mask = _mm_cmpge_pd(values, _mm_set1_pd(bounds[j]));
+      counts = _mm_sub_epi64(counts, _mm_castpd_si128(mask));
+    }
+    indices[i] = _mm_cvtsi128_si32(counts);
+    indices[i + 1] = _mm_cvtsi128_si32(_mm_unpackhi_epi64(counts, counts));
+  }
+#endif
+  for (; i < n; ++i) {
+    unsigned n_below = 0;
+    for (unsigned j = 0; j < n_bounds; ++j) n_below += mafs[i] >= bounds[j];
+    indices[i] = n_below;
+  }
+  unsigned invalid = _bins.size();
+  for (i = 0; i < n; ++i) {
+    unsigned n_below = indices[i];
+    if (!n_below) {
+      indices[i] = invalid;
+      continue;
+    }
+    // values that match a bound within epsilon belong to the bin below
+    // it, as in find_maf_bin_by_map
+    unsigned index = n_below - 1;
+    if (fabs(mafs[i] - bounds[index]) < DBL_EPSILON) {
+      indices[i] = index ? index - 1 : invalid;
+    } else {
+      indices[i] = n_below == n_bounds ? invalid : index;
+    }
+  }
+}
+
+unsigned iddt::r2_bins::find_maf_bin_by_map(const double &maf) const {
   std::map<double, unsigned>::const_iterator lower_finder, upper_finder;
   lower_finder = _bin_lower_bounds.upper_bound(maf);
   upper_finder = _bin_upper_bounds.upper_bound(maf);
@@ -204,56 +666,163 @@ unsigned imputed_data_dynamic_threshold::r2_bins::find_maf_bin(
 
 void imputed_data_dynamic_threshold::r2_bins::load_info_file(
     const std::string &filename, bool store_ids) {
-  gzFile input = 0;
-  char *buffer = 0;
-  unsigned buffer_size = 100000, index = 0;
-  std::string line = "", id = "", a0 = "", a1 = "", catcher = "", imputed = "",
-              maf = "", r2 = "";
-  float r2f = 0.0;
-  try {
-    input = gzopen(filename.c_str(), "rb");
-    if (!input) {
-      throw std::runtime_error("info file \"" + filename + "\" does not exist");
-    }
-    buffer = new char[buffer_size];
-    gzgets(input, buffer, buffer_size - 1);
-    while (gzgets(input, buffer, buffer_size - 1) != Z_NULL) {
-      line = std::string(buffer);
-      if (*line.rbegin() != '\n' && !gzeof(input)) {
-        throw std::runtime_error(
-            "load_info_file: line is longer than supported "
-            "lazy buffer of 100KB: \"" +
-            line + "\"; file bug report");
-      }
-      std::istringstream strm1(line);
-      if (!(strm1 >> id >> a0 >> a1 >> catcher >> maf >> catcher >> r2 >>
-            imputed)) {
-        throw std::runtime_error("cannot parse info file \"" + filename +
-                                 "\" line \"" + line + "\"");
-      }
-      if (imputed.compare("Imputed")) {
-        if (store_ids) {
-          _typed_variants.push_back(id);
-        }
-        continue;
-      }
-      r2f = from_string<float>(r2);
-      if (r2f < get_baseline_r2()) continue;
-      index = find_maf_bin(from_string<double>(maf));
-      if (index < _bins.size()) {
-        _bins.at(index).add_value(store_ids ? id : "", r2f);
-      }
+  info_file_reader reader(filename, _decompression_pool);
+  std::vector<info_record> records;
+  while (reader.next_block(&records)) {
+    for (std::vector<info_record>::const_iterator iter = records.begin();
+         iter != records.end(); ++iter) {
+      add_info_record(*iter, filename, store_ids);
     }
-    gzclose(input);
-    input = 0;
-    delete[] buffer;
-    buffer = 0;
-  } catch (...) {
-    if (input) {
-      gzclose(input);
+  }
+}
+
+void imputed_data_dynamic_threshold::r2_bins::load_info_file(
+    const std::string &filename, bool store_ids, unsigned n_threads) {
+  if (n_threads < 2) {
+    load_info_file(filename, store_ids);
+    return;
+  }
+  text_chunk_reader reader(filename, 1 << 20, n_threads);
+  load_chunks(&reader, n_threads,
+              [&filename, store_ids](const text_chunk &chunk, r2_bins *bins) {
+                bins->load_info_chunk(chunk, filename, store_ids);
+              });
+}
+
+void iddt::r2_bins::load_info_chunk(const text_chunk &chunk,
+                                    const std::string &filename,
+                                    bool store_ids) {
+  variant_batch batch(batch_size);
+  parse_info_chunk(chunk, filename, store_ids, &batch,
+                   [this](variant_batch *full) { add_batch(full, false); });
+  add_batch(&batch, false);
+}
+
+void iddt::r2_bins::load_info_file_pipelined(const std::string &filename,
+                                             bool store_ids,
+                                             pipeline_wait_times *times) {
+  text_chunk_reader reader(filename, 1 << 20);
+  load_pipelined(
+      &reader,
+      [this, &filename, store_ids](
+          const text_chunk &chunk, variant_batch *batch,
+          const std::function<void(variant_batch *)> &flush) {
+        parse_info_chunk(chunk, filename, store_ids, batch, flush);
+      },
+      false, times);
+}
+
+void iddt::r2_bins::parse_info_chunk(
+    const text_chunk &chunk, const std::string &filename, bool store_ids,
+    variant_batch *batch,
+    const std::function<void(variant_batch *)> &flush) const {
+  info_line_splitter splitter;
+  std::vector<info_record> records;
+  std::string_view text = chunk.get_text();
+  splitter.split(text.data(), text.data() + text.size(), &records);
+  // the first line of the file is the header
+  std::vector<info_record>::const_iterator iter = records.begin();
+  if (chunk.starts_file && iter != records.end()) ++iter;
+  for (; iter != records.end(); ++iter) {
+    add_info_record(*iter, filename, store_ids, batch);
+    if (batch->full()) flush(batch);
+  }
+}
+
+void iddt::r2_bins::add_info_record(const info_record &record,
+                                    const std::string &filename,
+                                    bool store_ids) {
+  if (record.n_fields < 8) {
+    throw std::runtime_error("cannot parse info file \"" + filename +
+                             "\" line \"" + std::string(record.line) + "\"");
+  }
+  bool keep_ids = store_ids || _record_sites;
+  if (record.genotyped.compare("Imputed")) {
+    if (keep_ids) add_variant(0.0f, _bins.size(), false, record.snp, false);
+    return;
+  }
+  float r2f = from_string_view<float>(record.rsq);
+  unsigned index =
+      r2f < get_baseline_r2()
+          ? _bins.size()
+          : find_maf_bin(from_string_view<double>(record.maf));
+  add_variant(r2f, index, true, keep_ids ? record.snp : std::string_view(),
+              false);
+}
+
+void imputed_data_dynamic_threshold::r2_bins::add_info_record(
+    const info_record &record, const std::string &filename, bool store_ids,
+    variant_batch *batch) const {
+  if (record.n_fields < 8) {
+    throw std::runtime_error("cannot parse info file \"" + filename +
+                             "\" line \"" + std::string(record.line) + "\"");
+  }
+  // recorded sites need their IDs even when bins do not
+  bool keep_ids = store_ids || _record_sites;
+  if (record.genotyped.compare("Imputed")) {
+    if (keep_ids) batch->add_typed(record.snp);
+    return;
+  }
+  float r2f = from_string_view<float>(record.rsq);
+  // the frequency of a variant that add_batch will drop is never parsed
+  batch->add_imputed(
+      r2f,
+      r2f < get_baseline_r2() ? 0.0 : from_string_view<double>(record.maf),
+      keep_ids ? record.snp : std::string_view());
+}
+
+void iddt::r2_bins::add_batch(variant_batch *batch, bool fold_maf) {
+  if (!batch) {
+    throw std::logic_error("r2_bins::add_batch: null pointer");
+  }
+  unsigned n = batch->size();
+  if (!n) return;
+  const float *r2 = batch->get_r2();
+  const double *mafs = batch->get_frequencies();
+  const std::uint64_t *imputed = batch->get_imputed();
+  // each step is a loop over whole columns, so that the compiler can
+  // vectorize them; only the final appends are done per variant
+  std::vector<double> folded;
+  if (fold_maf) {
+    folded.resize(n);
+    for (unsigned i = 0; i < n; ++i) {
+      folded[i] = mafs[i] > 0.5 ? 1.0 - mafs[i] : mafs[i];
+    }
+    mafs = folded.data();
+  }
+  std::vector<unsigned> indices(n);
+  assign_maf_bins(mafs, n, indices.data());
+  // nan r2 is not below the baseline, and is kept
+  float baseline = get_baseline_r2();
+  unsigned invalid = _bins.size();
+  for (unsigned i = 0; i < n; ++i) {
+    bool is_imputed = (imputed[i / 64] >> (i % 64)) & 1;
+    indices[i] = is_imputed && r2[i] < baseline ? invalid : indices[i];
+  }
+  // vcf input comes with allele frequencies, and rejects nan r2
+  for (unsigned i = 0; i < n; ++i) {
+    add_variant(r2[i], indices[i], (imputed[i / 64] >> (i % 64)) & 1,
+                batch->get_id(i), fold_maf);
+  }
+  batch->clear();
+}
+
+void iddt::r2_bins::add_variant(const float &r2, unsigned index,
+                                bool imputed, const std::string_view &id,
+                                bool reject_nan) {
+  unsigned invalid = _bins.size();
+  if (_record_sites) {
+    // reports from vcf reject nan r2, while those from info files
+    // keep it like any other value
+    bool rejected = !imputed || (reject_nan && std::isnan(r2));
+    _sites.add(r2, rejected ? invalid : index, imputed, id);
+    if (imputed && index < invalid) {
+      _bins[index].add_value(std::string_view(), r2);
     }
-    if (buffer) delete[] buffer;
-    throw;
+  } else if (!imputed) {
+    add_typed_variant(id);
+  } else if (index < invalid) {
+    _bins[index].add_value(id, r2);
   }
 }
 
@@ -261,64 +830,348 @@ void imputed_data_dynamic_threshold::r2_bins::load_vcf_file(
     const std::string &filename, const std::string &r2_info_field,
     const std::string &maf_info_field, const std::string &imputed_info_field,
     bool store_ids) {
-  bcf_srs_t *sr = 0;
-  std::string varid = "";
-  float *ptr_r2 = 0, *ptr_maf = 0;
-  int n_r2 = 0, n_maf = 0, n_imputed = 0;
-  unsigned index = 0;
-  bool is_imputed = false;
-  try {
-    sr = bcf_sr_init();
-    hts_set_log_level(HTS_LOG_OFF);
-    if (!bcf_sr_add_reader(sr, filename.c_str())) {
-      throw std::runtime_error("r2_bins::load_vcf_file: " +
-                               std::string(bcf_sr_strerror(sr->errnum)));
-    }
-    hts_set_log_level(HTS_LOG_WARNING);
-    ptr_r2 = new float;
-    ptr_maf = new float;
-    while (bcf_sr_next_line(sr)) {
-      bcf_get_info_float(bcf_sr_get_header(sr, 0), bcf_sr_get_line(sr, 0),
-                         r2_info_field.c_str(), &ptr_r2, &n_r2);
-      bcf_get_info_float(bcf_sr_get_header(sr, 0), bcf_sr_get_line(sr, 0),
-                         maf_info_field.c_str(), &ptr_maf, &n_maf);
-      is_imputed =
-          bcf_get_info_flag(bcf_sr_get_header(sr, 0), bcf_sr_get_line(sr, 0),
-                            imputed_info_field.c_str(), NULL, &n_imputed);
-      if (store_ids) {
-        bcf_unpack(bcf_sr_get_line(sr, 0), BCF_UN_STR);
-        varid = std::string(bcf_sr_get_line(sr, 0)->d.id);
-      }
-      if (!is_imputed) {
-        if (store_ids) {
-          _typed_variants.push_back(varid);
+  if (vcf_site_reader::is_text_vcf(filename)) {
+    vcf_site_reader reader(
+        filename,
+        vcf_info_scanner(r2_info_field, maf_info_field, imputed_info_field),
+        _decompression_pool);
+    vcf_site site;
+    while (reader.next_site(&site)) add_vcf_site(site, filename, store_ids);
+    return;
+  }
+  bcf_site_reader reader(filename, r2_info_field, maf_info_field,
+                         imputed_info_field, _decompression_pool);
+  vcf_site site;
+  while (reader.next_site(&site)) add_vcf_site(site, filename, store_ids);
+}
+
+void imputed_data_dynamic_threshold::r2_bins::load_vcf_file(
+    const std::string &filename, const std::string &r2_info_field,
+    const std::string &maf_info_field, const std::string &imputed_info_field,
+    bool store_ids, unsigned n_threads) {
+  if (n_threads < 2 || !vcf_site_reader::is_text_vcf(filename)) {
+    load_vcf_file(filename, r2_info_field, maf_info_field, imputed_info_field,
+                  store_ids);
+    return;
+  }
+  const vcf_info_scanner scanner(r2_info_field, maf_info_field,
+                                 imputed_info_field);
+  text_chunk_reader reader(filename, 1 << 20, n_threads);
+  load_chunks(&reader, n_threads,
+              [&](const text_chunk &chunk, r2_bins *bins) {
+                bins->load_vcf_chunk(chunk, scanner, filename, store_ids);
+              });
+}
+
+void iddt::r2_bins::load_vcf_chunk(const text_chunk &chunk,
+                                   const vcf_info_scanner &scanner,
+                                   const std::string &filename,
+                                   bool store_ids) {
+  variant_batch batch(batch_size);
+  parse_vcf_chunk(chunk, scanner, filename, store_ids, &batch,
+                  [this](variant_batch *full) { add_batch(full, true); });
+  add_batch(&batch, true);
+}
+
+void iddt::r2_bins::load_vcf_file_pipelined(
+    const std::string &filename, const std::string &r2_info_field,
+    const std::string &maf_info_field, const std::string &imputed_info_field,
+    bool store_ids, pipeline_wait_times *times) {
+  if (!vcf_site_reader::is_text_vcf(filename)) {
+    load_vcf_file(filename, r2_info_field, maf_info_field, imputed_info_field,
+                  store_ids);
+    return;
+  }
+  const vcf_info_scanner scanner(r2_info_field, maf_info_field,
+                                 imputed_info_field);
+  text_chunk_reader reader(filename, 1 << 20);
+  load_pipelined(
+      &reader,
+      [&](const text_chunk &chunk, variant_batch *batch,
+          const std::function<void(variant_batch *)> &flush) {
+        parse_vcf_chunk(chunk, scanner, filename, store_ids, batch, flush);
+      },
+      true, times);
+}
+
+void iddt::r2_bins::parse_vcf_chunk(
+    const text_chunk &chunk, const vcf_info_scanner &scanner,
+    const std::string &filename, bool store_ids, variant_batch *batch,
+    const std::function<void(variant_batch *)> &flush) const {
+  std::string_view text = chunk.get_text();
+  const char *ptr = text.data();
+  const char *end = ptr + text.size();
+  vcf_site site;
+  while (ptr < end) {
+    if (*ptr != '#' && *ptr != '\n') {
+      const char *info_end = vcf_info_scanner::find_info_end(ptr, end);
+      if (!info_end) info_end = end;
+      scanner.scan(ptr, info_end, &site);
+      add_vcf_site(site, filename, store_ids, batch);
+      if (batch->full()) flush(batch);
+      ptr = info_end;
+    }
+    ptr = static_cast<const char *>(memchr(ptr, '\n', end - ptr));
+    if (!ptr) break;
+    ++ptr;
+  }
+}
+
+void iddt::r2_bins::add_vcf_site(const vcf_site &site,
+                                 const std::string &filename,
+                                 bool store_ids) {
+  bool keep_ids = store_ids || _record_sites;
+  if (!site.imputed) {
+    if (keep_ids) add_variant(0.0f, _bins.size(), false, site.id, true);
+    return;
+  }
+  if (!site.has_r2 || !site.has_af) {
+    throw std::runtime_error("r2_bins::add_vcf_site: imputed variant \"" +
+                             std::string(site.id) + "\" in \"" + filename +
+                             "\" is missing r2 or allele frequency");
+  }
+  unsigned index = site.r2 < get_baseline_r2()
+                       ? _bins.size()
+                       : find_maf_bin(site.af > 0.5 ? 1.0 - site.af : site.af);
+  add_variant(site.r2, index, true, keep_ids ? site.id : std::string_view(),
+              true);
+}
+
+void imputed_data_dynamic_threshold::r2_bins::add_vcf_site(
+    const vcf_site &site, const std::string &filename, bool store_ids,
+    variant_batch *batch) const {
+  // recorded sites need their IDs even when bins do not
+  bool keep_ids = store_ids || _record_sites;
+  if (!site.imputed) {
+    if (keep_ids) batch->add_typed(site.id);
+    return;
+  }
+  if (!site.has_r2 || !site.has_af) {
+    throw std::runtime_error("r2_bins::add_vcf_site: imputed variant \"" +
+                             std::string(site.id) + "\" in \"" + filename +
+                             "\" is missing r2 or allele frequency");
+  }
+  batch->add_imputed(site.r2, site.af,
+                     keep_ids ? site.id : std::string_view());
+}
+
+iddt::r2_bins iddt::r2_bins::empty_copy() const {
+  r2_bins res;
+  res._bin_lower_bounds = _bin_lower_bounds;
+  res._bin_upper_bounds = _bin_upper_bounds;
+  res._maf_bin_boundaries = _maf_bin_boundaries;
+  res._baseline_r2 = _baseline_r2;
+  res._decompression_pool = _decompression_pool;
+  res._record_sites = _record_sites;
+  for (std::vector<r2_bin>::const_iterator iter = _bins.begin();
+       iter != _bins.end(); ++iter) {
+    r2_bin bin;
+    bin.set_bin_bounds(iter->get_bin_min(), iter->get_bin_max());
+    bin.set_baseline_r2(iter->get_baseline_r2());
+    res._bins.push_back(bin);
+  }
+  return res;
+}
+
+void iddt::r2_bins::load_chunks(
+    text_chunk_reader *reader, unsigned n_threads,
+    const std::function<void(const text_chunk &, r2_bins *)> &parse_chunk) {
+  if (!reader) {
+    throw std::logic_error("r2_bins::load_chunks: null pointer");
+  }
+  if (!n_threads) n_threads = 1;
+  const r2_bins empty = empty_copy();
+  std::map<unsigned, std::unique_ptr<r2_bins> > pending;
+  unsigned next_merge = 0;
+  std::mutex merge_lock;
+  std::atomic<bool> failed(false);
+  std::vector<std::exception_ptr> errors(n_threads);
+  std::function<void(unsigned)> work = [&](unsigned t) {
+    try {
+      text_chunk chunk;
+      while (!failed && reader->next_chunk(&chunk)) {
+        reader->fill_chunk(&chunk);
+        std::unique_ptr<r2_bins> local(new r2_bins(empty));
+        parse_chunk(chunk, local.get());
+        std::lock_guard<std::mutex> guard(merge_lock);
+        pending[chunk.ordinal].swap(local);
+        std::map<unsigned, std::unique_ptr<r2_bins> >::iterator finder;
+        while ((finder = pending.find(next_merge)) != pending.end()) {
+          merge(*finder->second);
+          pending.erase(finder);
+          ++next_merge;
         }
-        continue;
-      }
-      if (*ptr_r2 < get_baseline_r2()) continue;
-      index = find_maf_bin(*ptr_maf > 0.5 ? 1.0 - *ptr_maf : *ptr_maf);
-      if (index < _bins.size()) {
-        _bins.at(index).add_value(store_ids ? varid : "", *ptr_r2);
       }
+    } catch (...) {
+      errors.at(t) = std::current_exception();
+      failed = true;
     }
-    delete ptr_r2;
-    ptr_r2 = 0;
-    delete ptr_maf;
-    ptr_maf = 0;
-    bcf_sr_destroy(sr);
-    sr = 0;
-  } catch (...) {
-    if (sr) {
-      bcf_sr_destroy(sr);
+  };
+  if (n_threads == 1) {
+    work(0);
+  } else {
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < n_threads; ++t) {
+      workers.push_back(std::thread(work, t));
     }
-    if (ptr_r2) {
-      delete ptr_r2;
+    for (std::vector<std::thread>::iterator iter = workers.begin();
+         iter != workers.end(); ++iter) {
+      iter->join();
     }
-    if (ptr_maf) {
-      delete ptr_maf;
+  }
+  for (std::vector<std::exception_ptr>::const_iterator iter = errors.begin();
+       iter != errors.end(); ++iter) {
+    if (*iter) std::rethrow_exception(*iter);
+  }
+}
+
+void iddt::r2_bins::load_pipelined(text_chunk_reader *reader,
+                                   const chunk_parser &parse_chunk,
+                                   bool fold_maf,
+                                   pipeline_wait_times *times) {
+  if (!reader || !times) {
+    throw std::logic_error("r2_bins::load_pipelined: null pointer");
+  }
+  // a fixed set of buffers circulates between neighbouring stages, so
+  // memory use is bounded however far apart the stages drift. each
+  // queue can hold every buffer plus the end of input marker, so
+  // returning a buffer or passing it on never waits.
+  std::vector<text_chunk> chunks(pipeline_depth);
+  std::vector<variant_batch> batches(pipeline_depth,
+                                     variant_batch(batch_size));
+  bounded_queue<text_chunk *> free_chunks(pipeline_depth + 1),
+      full_chunks(pipeline_depth + 1);
+  bounded_queue<variant_batch *> free_batches(pipeline_depth + 1),
+      full_batches(pipeline_depth + 1);
+  for (unsigned i = 0; i < pipeline_depth; ++i) {
+    free_chunks.push(&chunks.at(i), 0);
+    free_batches.push(&batches.at(i), 0);
+  }
+  pipeline_wait_times local;
+  std::exception_ptr error;
+  std::mutex error_lock;
+  // keep the first error, and release every stage that is waiting
+  std::function<void()> fail = [&]() {
+    std::lock_guard<std::mutex> guard(error_lock);
+    if (!error) error = std::current_exception();
+    free_chunks.cancel();
+    full_chunks.cancel();
+    free_batches.cancel();
+    full_batches.cancel();
+  };
+  std::thread decompressor([&]() {
+    try {
+      text_chunk *chunk = 0;
+      while (free_chunks.pop(&chunk, &local.decompress.blocked)) {
+        if (!reader->next_chunk(chunk)) {
+          full_chunks.push(0, 0);
+          return;
+        }
+        reader->fill_chunk(chunk);
+        if (!full_chunks.push(chunk, 0)) return;
+      }
+    } catch (...) {
+      fail();
     }
-    throw;
+  });
+  std::thread parser([&]() {
+    try {
+      variant_batch *batch = 0;
+      if (!free_batches.pop(&batch, &local.parse.blocked)) return;
+      // hand off the filled batch and keep filling an empty one
+      std::function<void(variant_batch *)> flush = [&](variant_batch *full) {
+        variant_batch *next = 0;
+        if (!free_batches.pop(&next, &local.parse.blocked)) {
+          throw std::runtime_error("r2_bins::load_pipelined: cancelled");
+        }
+        next->swap(*full);
+        full_batches.push(next, 0);
+      };
+      text_chunk *chunk = 0;
+      while (full_chunks.pop(&chunk, &local.parse.starved)) {
+        if (!chunk) {
+          full_batches.push(batch, 0);
+          full_batches.push(0, 0);
+          return;
+        }
+        parse_chunk(*chunk, batch, flush);
+        if (!free_chunks.push(chunk, 0)) return;
+      }
+    } catch (...) {
+      fail();
+    }
+  });
+  try {
+    variant_batch *batch = 0;
+    while (full_batches.pop(&batch, &local.aggregate.starved) && batch) {
+      add_batch(batch, fold_maf);
+      if (!free_batches.push(batch, 0)) break;
+    }
+  } catch (...) {
+    fail();
   }
+  decompressor.join();
+  parser.join();
+  if (error) std::rethrow_exception(error);
+  times->merge(local);
+}
+
+void imputed_data_dynamic_threshold::r2_bins::merge(const r2_bins &obj) {
+  if (_bins.size() != obj._bins.size()) {
+    throw std::logic_error("r2_bins::merge: bin counts do not match");
+  }
+  for (unsigned i = 0; i < _bins.size(); ++i) {
+    _bins.at(i).merge(obj._bins.at(i));
+  }
+  _typed_variants.reserve(_typed_variants.size() + obj._typed_variants.size());
+  char buffer[variant_id_codec::max_length];
+  for (std::vector<std::uint64_t>::const_iterator iter =
+           obj._typed_variants.begin();
+       iter != obj._typed_variants.end(); ++iter) {
+    add_typed_variant(obj._typed_variant_storage.get(*iter, buffer));
+  }
+  _sites.append(obj._sites);
+}
+
+void iddt::r2_bins::merge_summary(const r2_bins &obj) {
+  if (_bins.size() != obj._bins.size()) {
+    throw std::logic_error("r2_bins::merge_summary: bin counts do not match");
+  }
+  if (!obj._typed_variants.empty()) {
+    throw std::logic_error(
+        "r2_bins::merge_summary: cannot merge from bins with typed variants");
+  }
+  for (unsigned i = 0; i < _bins.size(); ++i) {
+    _bins.at(i).merge_summary(obj._bins.at(i));
+  }
+}
+
+void iddt::r2_bins::save_summary(std::ostream &out) const {
+  if (!_typed_variants.empty()) {
+    throw std::logic_error(
+        "r2_bins::save_summary: typed variants cannot be summarized");
+  }
+  write_binary<std::uint32_t>(out, _bins.size());
+  for (std::vector<r2_bin>::const_iterator iter = _bins.begin();
+       iter != _bins.end(); ++iter) {
+    iter->save_summary(out);
+  }
+  if (!out) {
+    throw std::runtime_error("cannot write r2 summary; out of disk space?");
+  }
+}
+
+void iddt::r2_bins::load_summary(std::istream &in) {
+  if (read_binary<std::uint32_t>(in) != _bins.size()) {
+    throw std::runtime_error("r2 summary is for a different number of bins");
+  }
+  // bins are loaded into a copy, so that a failure changes nothing
+  std::vector<r2_bin> bins(_bins);
+  for (std::vector<r2_bin>::iterator iter = bins.begin(); iter != bins.end();
+       ++iter) {
+    iter->load_summary(in);
+  }
+  _bins.swap(bins);
 }
 
 void imputed_data_dynamic_threshold::r2_bins::compute_thresholds(
@@ -348,9 +1201,13 @@ void imputed_data_dynamic_threshold::r2_bins::report_passing_variants(
        iter != _bins.end(); ++iter) {
     iter->report_passing_variants(out);
   }
-  for (std::vector<std::string>::const_iterator iter = _typed_variants.begin();
+  char buffer[variant_id_codec::max_length];
+  for (std::vector<std::uint64_t>::const_iterator iter =
+           _typed_variants.begin();
        iter != _typed_variants.end(); ++iter) {
-    out << *iter << '\n';
+    std::string_view id = _typed_variant_storage.get(*iter, buffer);
+    out.write(id.data(), id.size());
+    out.put('\n');
   }
 }
 
@@ -358,143 +1215,162 @@ void imputed_data_dynamic_threshold::r2_bins::report_passing_vcf_variants(
     const std::string &filename, const std::string &r2_info_field,
     const std::string &maf_info_field, const std::string &imputed_info_field,
     std::ostream &out) const {
-  bcf_srs_t *sr = 0;
-  std::string varid = "";
-  float *ptr_r2 = 0, *ptr_maf = 0;
-  int n_r2 = 0, n_maf = 0, n_imputed = 0;
-  bool is_imputed = false;
-  try {
-    sr = bcf_sr_init();
-    hts_set_log_level(HTS_LOG_OFF);
-    if (!bcf_sr_add_reader(sr, filename.c_str())) {
-      throw std::runtime_error("r2_bins::report_passing_vcf_variants: " +
-                               std::string(bcf_sr_strerror(sr->errnum)));
-    }
-    hts_set_log_level(HTS_LOG_WARNING);
-    ptr_r2 = new float;
-    ptr_maf = new float;
-    while (bcf_sr_next_line(sr)) {
-      bcf_get_info_float(bcf_sr_get_header(sr, 0), bcf_sr_get_line(sr, 0),
-                         r2_info_field.c_str(), &ptr_r2, &n_r2);
-      bcf_get_info_float(bcf_sr_get_header(sr, 0), bcf_sr_get_line(sr, 0),
-                         maf_info_field.c_str(), &ptr_maf, &n_maf);
-      is_imputed =
-          bcf_get_info_flag(bcf_sr_get_header(sr, 0), bcf_sr_get_line(sr, 0),
-                            imputed_info_field.c_str(), NULL, &n_imputed);
-      if ((is_imputed && *ptr_r2 >= get_baseline_r2() &&
-           *ptr_r2 >=
-               _bins
-                   .at(find_maf_bin(*ptr_maf > 0.5 ? 1.0 - *ptr_maf : *ptr_maf))
-                   .report_stored_threshold()) ||
-          !is_imputed) {
-        bcf_unpack(bcf_sr_get_line(sr, 0), BCF_UN_STR);
-        varid = std::string(bcf_sr_get_line(sr, 0)->d.id);
-        out << varid << '\n';
-      }
+  if (vcf_site_reader::is_text_vcf(filename)) {
+    vcf_site_reader reader(
+        filename,
+        vcf_info_scanner(r2_info_field, maf_info_field, imputed_info_field),
+        _decompression_pool);
+    vcf_site site;
+    while (reader.next_site(&site)) {
+      if (vcf_site_passes(site, filename)) out << site.id << '\n';
     }
-    delete ptr_r2;
-    ptr_r2 = 0;
-    delete ptr_maf;
-    ptr_maf = 0;
-    bcf_sr_destroy(sr);
-    sr = 0;
-  } catch (...) {
-    if (sr) {
-      bcf_sr_destroy(sr);
+    return;
+  }
+  bcf_site_reader reader(filename, r2_info_field, maf_info_field,
+                         imputed_info_field, _decompression_pool);
+  vcf_site site;
+  while (reader.next_site(&site)) {
+    if (vcf_site_passes(site, filename)) out << site.id << '\n';
+  }
+}
+
+void iddt::r2_bins::report_passing_vcf_chunk(const text_chunk &chunk,
+                                             const vcf_info_scanner &scanner,
+                                             const std::string &filename,
+                                             std::string *ids) const {
+  if (!ids) {
+    throw std::logic_error("r2_bins::report_passing_vcf_chunk: null pointer");
+  }
+  std::string_view text = chunk.get_text();
+  const char *ptr = text.data();
+  const char *end = ptr + text.size();
+  vcf_site site;
+  while (ptr < end) {
+    if (*ptr != '#' && *ptr != '\n') {
+      const char *info_end = vcf_info_scanner::find_info_end(ptr, end);
+      if (!info_end) info_end = end;
+      scanner.scan(ptr, info_end, &site);
+      if (vcf_site_passes(site, filename)) {
+        ids->append(site.id.data(), site.id.size());
+        ids->push_back('\n');
+      }
+      ptr = info_end;
     }
-    if (ptr_r2) {
-      delete ptr_r2;
+    ptr = static_cast<const char *>(memchr(ptr, '\n', end - ptr));
+    if (!ptr) break;
+    ++ptr;
+  }
+}
+
+void iddt::r2_bins::report_passing_sites(const mapped_site_table &table,
+                                         std::ostream &out) const {
+  if (table.get_bin_count() != _bins.size()) {
+    throw std::runtime_error(
+        "r2_bins::report_passing_sites: site table has " +
+        std::to_string(table.get_bin_count()) + " bins, not " +
+        std::to_string(_bins.size()));
+  }
+  std::vector<float> thresholds;
+  for (std::vector<r2_bin>::const_iterator iter = _bins.begin();
+       iter != _bins.end(); ++iter) {
+    thresholds.push_back(iter->report_stored_threshold());
+  }
+  const float *r2 = table.get_r2();
+  const std::uint16_t *bins = table.get_bins();
+  const std::uint8_t *imputed = table.get_imputed();
+  std::string ids;
+  for (std::uint64_t i = 0; i < table.size(); ++i) {
+    // sites below the baseline r2 or outside every bin have no bin
+    if (imputed[i] &&
+        (bins[i] >= thresholds.size() || r2[i] < thresholds[bins[i]])) {
+      continue;
     }
-    if (ptr_maf) {
-      delete ptr_maf;
+    std::string_view id = table.get_id(i);
+    ids.append(id.data(), id.size());
+    ids.push_back('\n');
+    if (ids.size() >= 1 << 20) {
+      out.write(ids.data(), ids.size());
+      ids.clear();
     }
-    throw;
   }
+  out.write(ids.data(), ids.size());
+}
+
+bool iddt::r2_bins::vcf_site_passes(const vcf_site &site,
+                                    const std::string &filename) const {
+  if (!site.imputed) return true;
+  if (!site.has_r2 || !site.has_af) {
+    throw std::runtime_error(
+        "r2_bins::report_passing_vcf_variants: imputed variant \"" +
+        std::string(site.id) + "\" in \"" + filename +
+        "\" is missing r2 or allele frequency");
+  }
+  return site.r2 >= get_baseline_r2() &&
+         site.r2 >=
+             _bins.at(find_maf_bin(site.af > 0.5 ? 1.0 - site.af : site.af))
+                 .report_stored_threshold();
 }
 
 void imputed_data_dynamic_threshold::r2_bins::report_passing_info_variants(
     const std::string &filename, const std::string &filter_info_files_dir,
     std::ostream &out) const {
-  gzFile input = 0;
-  gzFile output = 0;
-  char *buffer = 0;
-  unsigned buffer_size = 100000;
-  std::string line = "", id = "", catcher = "", r2 = "", out_line = "";
-  double maf = 0.0;
-  float r2f = 0.0f;
-  unsigned bin_index = 0u;
-
-  bool emit_output = !filter_info_files_dir.empty();
-  boost::filesystem::path output_dir;
-  if (emit_output) {
-    // output directory need not initially exist
-    output_dir = boost::filesystem::path(filter_info_files_dir);
-    boost::filesystem::create_directory(output_dir);
+  info_file_reader input(filename, _decompression_pool);
+  std::unique_ptr<info_file_writer> output;
+  if (!filter_info_files_dir.empty()) {
+    output.reset(new info_file_writer(filename, filter_info_files_dir));
   }
-  try {
-    input = gzopen(filename.c_str(), "rb");
-    if (!input)
-      throw std::runtime_error("cannot read file \"" + filename + "\"");
-    if (emit_output) {
-      output_dir = output_dir / boost::filesystem::canonical(
-                                    boost::filesystem::path(filename))
-                                    .filename();
-      output = gzopen(output_dir.string().c_str(), "wb");
-      if (!output) {
-        throw std::runtime_error(
-            "cannot report filtered info file in second pass");
-      }
-      out_line =
-          "SNP\tREF(0)\tALT(1)\tALT_"
-          "Frq\tMAF\tAvgCall\tRsq\tGenotyped\tLooRsq\tEmpR\tEmpRsq\tDose0\tDose"
-          "1"
-          "\n";
-      if (gzputs(output, out_line.c_str()) < 0) {
-        throw std::runtime_error("cannot write to output info file, disk full");
-      }
-    }
-    buffer = new char[buffer_size];
-    gzgets(input, buffer, buffer_size - 1);
-    while (gzgets(input, buffer, buffer_size - 1) != Z_NULL) {
-      line = std::string(buffer);
-      std::istringstream strm1(line);
-      if (!(strm1 >> id >> catcher >> catcher >> catcher >> maf >> catcher >>
-            r2 >> catcher))
-        throw std::runtime_error("cannot parse info file \"" + filename +
-                                 "\" line \"" + line + "\"");
-      if (!catcher.compare("Imputed")) {
-        r2f = from_string<float>(r2);
-        if (r2f < get_baseline_r2()) continue;
-        bin_index = find_maf_bin(maf);
-        if (bin_index < _bins.size()) {
-          if (r2f >= _bins.at(bin_index).report_stored_threshold()) {
-            out << id << '\n';
-            if (output && gzputs(output, line.c_str()) < 0) {
-              throw std::runtime_error(
-                  "cannot write to output info file, disk full");
-            }
-          }
-        }
-      } else {
-        out << id << '\n';
-        if (output && gzputs(output, line.c_str()) < 0) {
-          throw std::runtime_error(
-              "cannot write to output info file, disk full");
-        }
+  std::vector<info_record> records;
+  std::string ids = "", lines = "";
+  while (input.next_block(&records)) {
+    ids.clear();
+    lines.clear();
+    select_passing_info_records(records.begin(), records.end(), filename,
+                                &ids, output ? &lines : 0);
+    out.write(ids.data(), ids.size());
+    if (output) output->write(lines);
+  }
+  if (output) output->close();
+}
+
+void iddt::r2_bins::report_passing_info_chunk(const text_chunk &chunk,
+                                              const std::string &filename,
+                                              std::string *ids,
+                                              std::string *lines) const {
+  if (!ids) {
+    throw std::logic_error("r2_bins::report_passing_info_chunk: null pointer");
+  }
+  info_line_splitter splitter;
+  std::vector<info_record> records;
+  std::string_view text = chunk.get_text();
+  splitter.split(text.data(), text.data() + text.size(), &records);
+  // the first line of the file is the header
+  std::vector<info_record>::const_iterator iter = records.begin();
+  if (chunk.starts_file && iter != records.end()) ++iter;
+  select_passing_info_records(iter, records.end(), filename, ids, lines);
+}
+
+void iddt::r2_bins::select_passing_info_records(
+    std::vector<info_record>::const_iterator begin,
+    std::vector<info_record>::const_iterator end, const std::string &filename,
+    std::string *ids, std::string *lines) const {
+  for (std::vector<info_record>::const_iterator iter = begin; iter != end;
+       ++iter) {
+    if (iter->n_fields < 8)
+      throw std::runtime_error("cannot parse info file \"" + filename +
+                               "\" line \"" + std::string(iter->line) +
+                               "\"");
+    if (!iter->genotyped.compare("Imputed")) {
+      float r2f = from_string_view<float>(iter->rsq);
+      if (r2f < get_baseline_r2()) continue;
+      unsigned bin_index = find_maf_bin(from_string_view<double>(iter->maf));
+      if (bin_index >= _bins.size() ||
+          r2f < _bins.at(bin_index).report_stored_threshold()) {
+        continue;
       }
     }
-    gzclose(input);
-    input = 0;
-    if (output) {
-      gzclose(output);
-      output = 0;
-    }
-    delete[] buffer;
-    buffer = 0;
-  } catch (...) {
-    if (input) gzclose(input);
-    if (output) gzclose(output);
-    if (buffer) delete[] buffer;
+    ids->append(iter->snp.data(), iter->snp.size());
+    ids->push_back('\n');
+    if (lines) lines->append(iter->line.data(), iter->line.size());
   }
 }
 
@@ -538,19 +1414,26 @@ const std::map<double, unsigned> &iddt::r2_bins::get_bin_lower_bounds() const {
   return _bin_lower_bounds;
 }
 std::map<double, unsigned> &iddt::r2_bins::get_bin_lower_bounds() {
+  _maf_bin_boundaries.clear();
   return _bin_lower_bounds;
 }
 const std::map<double, unsigned> &iddt::r2_bins::get_bin_upper_bounds() const {
   return _bin_upper_bounds;
 }
 std::map<double, unsigned> &iddt::r2_bins::get_bin_upper_bounds() {
+  _maf_bin_boundaries.clear();
   return _bin_upper_bounds;
 }
-const std::vector<std::string> &iddt::r2_bins::get_typed_variants() const {
-  return _typed_variants;
-}
-std::vector<std::string> &iddt::r2_bins::get_typed_variants() {
-  return _typed_variants;
+std::vector<std::string> iddt::r2_bins::get_typed_variants() const {
+  std::vector<std::string> res;
+  res.reserve(_typed_variants.size());
+  char buffer[variant_id_codec::max_length];
+  for (std::vector<std::uint64_t>::const_iterator iter =
+           _typed_variants.begin();
+       iter != _typed_variants.end(); ++iter) {
+    res.push_back(std::string(_typed_variant_storage.get(*iter, buffer)));
+  }
+  return res;
 }
 void iddt::r2_bins::set_bin_data(
     const std::vector<iddt::r2_bin> &bins,
@@ -559,9 +1442,22 @@ void iddt::r2_bins::set_bin_data(
   _bins = bins;
   _bin_lower_bounds = bin_lower_bounds;
   _bin_upper_bounds = bin_upper_bounds;
+  update_maf_bin_lookup();
 }
-void iddt::r2_bins::add_typed_variant(const std::string &str) {
-  _typed_variants.push_back(str);
+void iddt::r2_bins::add_typed_variant(const std::string_view &str) {
+  _typed_variants.push_back(_typed_variant_storage.add(str));
 }
 void iddt::r2_bins::set_baseline_r2(const float &r2) { _baseline_r2 = r2; }
 const float &iddt::r2_bins::get_baseline_r2() const { return _baseline_r2; }
+void iddt::r2_bins::set_histogram_scale(unsigned scale) {
+  for (std::vector<r2_bin>::iterator iter = _bins.begin(); iter != _bins.end();
+       ++iter) {
+    iter->set_histogram_scale(scale);
+  }
+}
+void iddt::r2_bins::set_decompression_pool(const decompression_pool *pool) {
+  _decompression_pool = pool;
+}
+void iddt::r2_bins::set_site_recording(bool record) { _record_sites = record; }
+const iddt::site_table &iddt::r2_bins::get_sites() const { return _sites; }
+iddt::site_table &iddt::r2_bins::get_sites() { return _sites; }
@@ -11,19 +11,35 @@
 #include <zlib.h>
 
 #include <algorithm>
+#include <atomic>
 #include <cfloat>
 #include <cmath>
+#include <cstdint>
+#include <exception>
 #include <fstream>
+#include <functional>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <utility>
 #include <vector>
 
 #include "boost/filesystem.hpp"
-#include "htslib/synced_bcf_reader.h"
+#include "htslib/vcf.h"
+#include "imputed-data-dynamic-threshold/decompression_pool.h"
+#include "imputed-data-dynamic-threshold/id_arena.h"
+#include "imputed-data-dynamic-threshold/info_lines.h"
+#include "imputed-data-dynamic-threshold/pipeline.h"
+#include "imputed-data-dynamic-threshold/site_table.h"
+#include "imputed-data-dynamic-threshold/text_chunks.h"
 #include "imputed-data-dynamic-threshold/utilities.h"
+#include "imputed-data-dynamic-threshold/variant_batch.h"
+#include "imputed-data-dynamic-threshold/vcf_sites.h"
 
 namespace imputed_data_dynamic_threshold {
 /*!
@@ -59,10 +75,74 @@ class r2_bin {
     @param id variant ID
     @param val r2 from a variant fitting into this bin
    */
-  void add_value(const std::string &id, const float &val);
+  void add_value(const std::string_view &id, const float &val);
+  /*!
+    \brief append the contents of another bin to this one
+    @param obj bin with the same MAF bounds, loaded from later input
+
+    values are appended in the order they were added to obj, and the
+    running sum is accumulated one value at a time, so merging per-file
+    bins in input order reproduces a serial load exactly. this should
+    only be called before compute_threshold.
+   */
+  void merge(const r2_bin &obj);
+  /*!
+    \brief append the contents of a bin loaded without variant IDs
+    @param obj bin with the same MAF bounds, loaded from later input,
+    which may count its values
+
+    histogram counts are added cell by cell when both bins count
+    values on the same grid. unlike merge, the running sum of obj is
+    added as a whole, so the sum only matches that of a serial load to
+    within rounding. this should only be called before
+    compute_threshold.
+   */
+  void merge_summary(const r2_bin &obj);
+  /*!
+    \brief write the loaded values of this bin in compact binary form
+    @param out open binary output stream
+
+    a bin that counts values writes only its occupied cells. this
+    should only be called before compute_threshold, and rejects bins
+    that store variant IDs.
+   */
+  void save_summary(std::ostream &out) const;
+  /*!
+    \brief load values into an empty bin from a saved summary
+    @param in binary input stream positioned at output of save_summary
+
+    the summary must have been saved from a bin with the same MAF
+    bounds. input that cannot be read as such a summary throws
+    std::runtime_error and leaves the bin unchanged.
+   */
+  void load_summary(std::istream &in);
+  /*!
+    \brief count r2 values on a fixed decimal grid instead of storing them
+    @param scale number of grid cells per unit r2, e.g. 100000 for values
+    printed with five decimals; 0 returns to per-variant storage
+
+    values are only counted when variant IDs are not stored, and are
+    otherwise stored individually. memory use is then constant in
+    the number of variants, and compute_threshold scans the grid instead
+    of sorting. the exact float seen in each grid cell is kept, so
+    thresholds and totals are identical to per-variant storage. a value
+    off the grid moves all counts back to individual storage. this must
+    be called before any values are added.
+   */
+  void set_histogram_scale(unsigned scale);
+  /*!
+    \brief get number of histogram grid cells per unit r2
+    \return number of grid cells per unit r2, or 0 if values are stored
+   */
+  unsigned get_histogram_scale() const;
   /*!
     \brief compute r2 threshold required to meet a given average r2 target
     @param target desired average r2 after additional filtering is applied
+
+    the cut is located by selection, and only the removed values are
+    sorted, so this is expected linear time when IDs are not stored.
+    when IDs are stored, the passing values are also sorted for
+    reporting.
    */
   void compute_threshold(const double &target);
   /*!
@@ -107,10 +187,17 @@ class r2_bin {
    */
   const double &get_bin_max() const;
   /*!
-    \brief get stored r2 data vector
-    \return stored r2 data vector
+    \brief get stored r2 data as (ID, r2) pairs
+    \return stored r2 data, with empty IDs if none were stored
+
+    this builds a new vector on each call; see get_values
    */
-  const std::vector<std::pair<std::string, float> > &get_data() const;
+  std::vector<std::pair<std::string, float> > get_data() const;
+  /*!
+    \brief get stored r2 values
+    \return stored r2 values
+   */
+  const std::vector<float> &get_values() const;
   /*!
     \brief get stored running r2 sum
     \return stored running r2 sum
@@ -140,12 +227,73 @@ class r2_bin {
  protected:
   double _bin_min;  //!< minimum MAF in this bin, exclusive
   double _bin_max;  //!< maximum MAF in this bin, inclusive
-  std::vector<std::pair<std::string, float> > _data;  //!< aggregated r2 data
+  std::vector<float> _values;  //!< aggregated r2 data
+  std::vector<std::uint64_t> _ids;  //!< ID handles parallel to _values, if any
+  id_arena _id_storage;             //!< text of stored IDs
   double _total;             //!< running sum of all loaded r2 at current filter
   unsigned _total_count;     //!< total number of loaded variants
   unsigned _filtered_count;  //!< number of variants left with current filter
   float _threshold;          //!< stored r2 threshold to meet target
   float _baseline;           //!< minimum permissible r2 for any variant
+  unsigned _histogram_scale;  //!< grid cells per unit r2; 0 if unused
+  std::vector<unsigned> _histogram_counts;  //!< number of values per cell
+  std::vector<float> _histogram_values;     //!< exact value seen per cell
+
+  /*!
+    \brief place a value in the histogram or in stored values
+    @param id variant ID, or empty
+    @param val r2 value
+
+    counts and the running sum are left to the caller
+   */
+  void store_value(const std::string_view &id, const float &val);
+  /*!
+    \brief find the histogram cell for a value
+    @param val r2 value
+    \return cell index, or the number of cells if val is off the grid
+   */
+  unsigned find_histogram_cell(const float &val) const;
+  /*!
+    \brief move histogram counts into stored values and stop counting
+   */
+  void spill_histogram();
+  /*!
+    \brief compute threshold by replaying removals over histogram cells
+    @param target desired average r2 after additional filtering is applied
+   */
+  void compute_histogram_threshold(const double &target);
+  /*!
+    \brief sort stored values up to at least a given position
+    @param end position through which data must be sorted
+    @param first start of the data not removed by earlier filters
+    @param sorted_end end of the currently sorted prefix; updated
+
+    data from first to sorted_end must already be sorted, and must not
+    exceed anything after sorted_end
+   */
+  void sort_data_prefix(unsigned end, unsigned first, unsigned *sorted_end);
+  /*!
+    \brief sort values and IDs together by value
+    @param first start of the data not removed by earlier filters
+
+    ties keep the order in which they were added
+   */
+  void sort_ids_by_value(unsigned first);
+  /*!
+    \brief get the ID of a stored value
+    @param i index of value
+    @param buffer scratch space of at least variant_id_codec::max_length
+    bytes, for IDs stored as packed keys
+    \return ID of value, or an empty string if no IDs are stored
+   */
+  std::string_view get_id(unsigned i, char *buffer) const;
+  /*!
+    \brief get the smallest r2 remaining after the current filter
+    \return smallest remaining r2
+
+    this requires at least one value to remain
+   */
+  float lowest_remaining_value() const;
 };
 /*!
   \brief dispatch variants to bins by MAF and handle I/O
@@ -171,18 +319,90 @@ class r2_bins {
    */
   void set_bin_boundaries(const std::vector<double> &boundaries);
   /*!
-    \brief using boundary maps, find appropriate bin for a MAF
+    \brief find appropriate bin for a MAF
     @param maf query MAF
     \return index of target bin, or invalid index if MAF doesn't fit
     in a generated bin
+
+    bins are found by counting boundaries at or below the MAF in a flat
+    array, which gives the same result as find_maf_bin_by_map without
+    tree lookups. the boundary maps are searched instead if they have
+    been modified since set_bin_boundaries or set_bin_data, or if they
+    do not describe consecutive bins.
    */
   unsigned find_maf_bin(const double &maf) const;
+  /*!
+    \brief using boundary maps, find appropriate bin for a MAF
+    @param maf query MAF
+    \return index of target bin, or invalid index if MAF doesn't fit
+    in a generated bin
+   */
+  unsigned find_maf_bin_by_map(const double &maf) const;
+  /*!
+    \brief find appropriate bins for many MAFs at once
+    @param mafs query MAFs
+    @param n number of query MAFs
+    @param indices destination for n bin indices, as from find_maf_bin
+   */
+  void assign_maf_bins(const double *mafs, unsigned n,
+                       unsigned *indices) const;
+  /*!
+    \brief filter, bin and store a batch of parsed variants
+    @param batch parsed variants; cleared on return
+    @param fold_maf whether frequencies above 0.5 are allele frequencies
+    to be folded to MAF
+
+    imputed variants below the baseline r2 or outside every bin are
+    dropped, and typed variants are added with add_typed_variant.
+    variants are stored in batch order, exactly as if they had been
+    added one at a time. while sites are recorded, every variant also
+    gets a row in the site table, and bins and typed variants get no
+    IDs.
+   */
+  void add_batch(variant_batch *batch, bool fold_maf);
   /*!
     \brief load r2 and MAF data from minimac4 info.gz file
     @param filename name of info.gz file to load
     @param store_ids whether to store variant IDs for later reporting
    */
   void load_info_file(const std::string &filename, bool store_ids);
+  /*!
+    \brief load r2 and MAF data from minimac4 info.gz file on multiple threads
+    @param filename name of info.gz file to load
+    @param store_ids whether to store variant IDs for later reporting
+    @param n_threads number of worker threads parsing the file
+
+    the file is split into line-aligned chunks: on BGZF block boundaries
+    for bgzipped input, or after sequential inflation otherwise. the
+    same threads inflate plain gzip input in parallel rounds. chunks
+    are parsed into separate bins and merged in file order, so the
+    result is identical to the single-threaded load.
+   */
+  void load_info_file(const std::string &filename, bool store_ids,
+                      unsigned n_threads);
+  /*!
+    \brief load r2 and MAF data from minimac4 info.gz file in stages
+    @param filename name of info.gz file to load
+    @param store_ids whether to store variant IDs for later reporting
+    @param times accumulator for the time each stage spent waiting
+
+    the file is inflated, parsed and aggregated on three threads
+    connected by bounded queues, so that inflation and parsing
+    overlap even for a single file. batches are aggregated in file
+    order, so the result is identical to the single-threaded load.
+   */
+  void load_info_file_pipelined(const std::string &filename, bool store_ids,
+                                pipeline_wait_times *times);
+  /*!
+    \brief load r2 and MAF data from one chunk of a minimac4 info file
+    @param chunk line-aligned text from the file
+    @param filename name of source file, for error reporting
+    @param store_ids whether to store variant IDs for later reporting
+
+    the header line is skipped if the chunk starts the file
+   */
+  void load_info_chunk(const text_chunk &chunk, const std::string &filename,
+                       bool store_ids);
   /*!
     \brief load r2 and MAF data from VCF
     @param filename name of vcf file to load
@@ -192,11 +412,100 @@ class r2_bins {
     @param imputed_info_field name of info indicator of whether variant is
     imputed
     @param store_ids whether to store variant IDs for later reporting
+
+    text vcf is read with a sites-only scanner that never parses sample
+    columns; bcf is read with htslib.
    */
   void load_vcf_file(const std::string &filename,
                      const std::string &r2_info_field,
                      const std::string &maf_info_field,
                      const std::string &imputed_info_field, bool store_ids);
+  /*!
+    \brief load r2 and MAF data from VCF on multiple threads
+    @param filename name of vcf file to load
+    @param r2_info_field name of info field containing estimated r2
+    @param maf_info_field name of info field containing estimated allele
+    frequency; the frequency will automatically be adjusted to MAF if required
+    @param imputed_info_field name of info indicator of whether variant is
+    imputed
+    @param store_ids whether to store variant IDs for later reporting
+    @param n_threads number of worker threads parsing the file
+
+    text vcf input is split into chunks as with load_info_file. binary
+    bcf input cannot be split on line boundaries, and is loaded on
+    the calling thread.
+   */
+  void load_vcf_file(const std::string &filename,
+                     const std::string &r2_info_field,
+                     const std::string &maf_info_field,
+                     const std::string &imputed_info_field, bool store_ids,
+                     unsigned n_threads);
+  /*!
+    \brief load r2 and MAF data from VCF in stages
+    @param filename name of vcf file to load
+    @param r2_info_field name of info field containing estimated r2
+    @param maf_info_field name of info field containing estimated allele
+    frequency; the frequency will automatically be adjusted to MAF if required
+    @param imputed_info_field name of info indicator of whether variant is
+    imputed
+    @param store_ids whether to store variant IDs for later reporting
+    @param times accumulator for the time each stage spent waiting
+
+    text vcf input is staged as with load_info_file_pipelined. binary
+    bcf input is loaded on the calling thread, and adds no wait times.
+   */
+  void load_vcf_file_pipelined(const std::string &filename,
+                               const std::string &r2_info_field,
+                               const std::string &maf_info_field,
+                               const std::string &imputed_info_field,
+                               bool store_ids, pipeline_wait_times *times);
+  /*!
+    \brief load r2 and MAF data from one chunk of a text vcf
+    @param chunk line-aligned text from the file
+    @param scanner INFO scanner for the configured tags
+    @param filename name of source file, for error reporting
+    @param store_ids whether to store variant IDs for later reporting
+   */
+  void load_vcf_chunk(const text_chunk &chunk, const vcf_info_scanner &scanner,
+                      const std::string &filename, bool store_ids);
+  /*!
+    \brief get a copy of this object with the same bins but no loaded data
+    \return empty copy of this object
+   */
+  r2_bins empty_copy() const;
+  /*!
+    \brief append the loaded contents of another set of bins to this one
+    @param obj bins with identical boundaries, loaded from later input
+
+    typed variants and per-bin values are appended in order; see
+    r2_bin::merge for the requirements on the bins themselves.
+   */
+  void merge(const r2_bins &obj);
+  /*!
+    \brief append bins loaded without variant IDs to this one
+    @param obj bins with identical boundaries, loaded from later input
+
+    see r2_bin::merge_summary. obj cannot hold typed variants, which
+    are only stored along with IDs.
+   */
+  void merge_summary(const r2_bins &obj);
+  /*!
+    \brief write the loaded values of all bins in compact binary form
+    @param out open binary output stream
+
+    see r2_bin::save_summary; typed variants are not written, and
+    bins that hold any are rejected
+   */
+  void save_summary(std::ostream &out) const;
+  /*!
+    \brief load values into empty bins from a saved summary
+    @param in binary input stream positioned at output of save_summary
+
+    the summary must have been saved from bins with the same
+    boundaries. input that cannot be read as such a summary throws
+    std::runtime_error and leaves all bins unchanged.
+   */
+  void load_summary(std::istream &in);
   /*!
     \brief compute bin-specific r2 thresholds
     @param target desired final per-bin average r2
@@ -229,6 +538,20 @@ class r2_bins {
   void report_passing_info_variants(const std::string &filename,
                                     const std::string &filter_info_files_dir,
                                     std::ostream &out) const;
+  /*!
+    \brief select variants passing threshold from one chunk of an info file
+    @param chunk line-aligned text from the file
+    @param filename name of source file, for error reporting
+    @param ids destination to which passing IDs are appended, one per line
+    @param lines destination to which passing lines are appended for a
+    filtered info file, or null
+
+    this is the per-chunk form of report_passing_info_variants; the
+    header line is skipped if the chunk starts the file
+   */
+  void report_passing_info_chunk(const text_chunk &chunk,
+                                 const std::string &filename,
+                                 std::string *ids, std::string *lines) const;
   /*!
     \brief report variants from a vcf file passing threshold
     @param filename name of vcf file
@@ -241,13 +564,36 @@ class r2_bins {
 
     this function assumes variant IDs have not been stored during first
     pass, so it needs to process the vcf file again but this time
-    simply report IDs that already pass the filters in the relevant bins
+    simply report IDs that already pass the filters in the relevant bins.
+    as with load_vcf_file, sample columns of text vcf are not parsed.
    */
   void report_passing_vcf_variants(const std::string &filename,
                                    const std::string &r2_info_field,
                                    const std::string &maf_info_field,
                                    const std::string &imputed_info_field,
                                    std::ostream &out) const;
+  /*!
+    \brief select variants passing threshold from one chunk of a text vcf
+    @param chunk line-aligned text from the file
+    @param scanner INFO scanner for the configured tags
+    @param filename name of source file, for error reporting
+    @param ids destination to which passing IDs are appended, one per line
+   */
+  void report_passing_vcf_chunk(const text_chunk &chunk,
+                                const vcf_info_scanner &scanner,
+                                const std::string &filename,
+                                std::string *ids) const;
+  /*!
+    \brief report variants passing threshold from a saved site table
+    @param table sites of one input file, recorded while loading it
+    into bins with the same boundaries and baseline r2
+    @param out output stream for data reporting
+
+    this gives the same IDs, in the same order, as reporting from the
+    input file itself, without reading or parsing it again
+   */
+  void report_passing_sites(const mapped_site_table &table,
+                            std::ostream &out) const;
   /*!
     \brief test for equality between objects of this class
     @param obj object to compare to *this
@@ -286,7 +632,8 @@ class r2_bins {
     \brief get mapping structure for bin lower bounds
     \return mapping structure for bin lower bounds
 
-    non-const version
+    non-const version. this disables the flat MAF bin lookup until
+    the next call to set_bin_data.
    */
   std::map<double, unsigned> &get_bin_lower_bounds();
   /*!
@@ -300,23 +647,17 @@ class r2_bins {
     \brief get mapping structure for bin upper bounds
     \return mapping structure for bin upper bounds
 
-    non-const version
+    non-const version. this disables the flat MAF bin lookup until
+    the next call to set_bin_data.
   */
   std::map<double, unsigned> &get_bin_upper_bounds();
   /*!
    * \brief get vector of typed variants
    * \return vector of typed variants, as strings
    *
-   * const version
+   * the strings are copied out of arena storage on each call
    */
-  const std::vector<std::string> &get_typed_variants() const;
-  /*!
-   * \brief get vector of typed variants
-   * \return vector of typed variants, as strings
-   *
-   * non-const version
-   */
-  std::vector<std::string> &get_typed_variants();
+  std::vector<std::string> get_typed_variants() const;
   /*!
    * \brief set bin data
    * \param bins vector of precomputed r2_bin objects
@@ -332,7 +673,7 @@ class r2_bins {
    * \brief add a typed variant to this object's storage
    * \param str new variant to add
    */
-  void add_typed_variant(const std::string &str);
+  void add_typed_variant(const std::string_view &str);
   /*!
    * \brief set the minimum permissible r2 for all variants
    * \param r2 the minimum permissible r2 for all variants
@@ -343,13 +684,201 @@ class r2_bins {
    * \return the minimum permissible r2 for all variants
    */
   const float &get_baseline_r2() const;
+  /*!
+    \brief count r2 values in every bin on a fixed decimal grid
+    @param scale number of grid cells per unit r2; 0 to store values
+
+    see r2_bin::set_histogram_scale. this must be called after
+    set_bin_boundaries and before any data are loaded. bins from
+    empty_copy store their values, so they can be merged back exactly.
+   */
+  void set_histogram_scale(unsigned scale);
+  /*!
+    \brief inflate bgzipped input of whole-file loads and reports on a
+    shared thread pool
+    @param pool shared decompression threads, or null to inflate on
+    the reading thread
+
+    the pool is not owned, and must outlive any load or report.
+    copies, including those from empty_copy, share the pool.
+   */
+  void set_decompression_pool(const decompression_pool *pool);
+  /*!
+    \brief record a row for every loaded site in a site table
+    @param record whether to record sites
+
+    copies, including those from empty_copy, record as well, and merge
+    appends their rows. recording is for loads without variant IDs.
+   */
+  void set_site_recording(bool record);
+  /*!
+    \brief get the sites recorded while loading
+    \return table of recorded sites, in load order
+   */
+  const site_table &get_sites() const;
+  /*!
+    \brief get the sites recorded while loading
+    \return table of recorded sites, in load order
+   */
+  site_table &get_sites();
 
  private:
+  /*!
+    \brief function parsing a chunk of text input into a batch
+
+    the function is given the chunk, the batch to fill, and a function
+    to call whenever the batch is full, which leaves the batch empty.
+   */
+  typedef std::function<void(const text_chunk &, variant_batch *,
+                             const std::function<void(variant_batch *)> &)>
+      chunk_parser;
+  /*!
+    \brief parse a line from a minimac4 info file and bin it directly
+    @param record split info file line
+    @param filename name of source file, for error reporting
+    @param store_ids whether to store variant IDs for later reporting
+
+    serial loads bin each line as it is parsed, which skips the copy
+    into a batch; the result is the same as through add_batch
+   */
+  void add_info_record(const info_record &record, const std::string &filename,
+                       bool store_ids);
+  /*!
+    \brief parse a line from a minimac4 info file into a batch
+    @param record split info file line
+    @param filename name of source file, for error reporting
+    @param store_ids whether to store variant IDs for later reporting
+    @param batch destination batch, which must not be full
+   */
+  void add_info_record(const info_record &record, const std::string &filename,
+                       bool store_ids, variant_batch *batch) const;
+  /*!
+    \brief bin a site from vcf or bcf directly
+    @param site INFO data for the site
+    @param filename name of source file, for error reporting
+    @param store_ids whether to store variant IDs for later reporting
+   */
+  void add_vcf_site(const vcf_site &site, const std::string &filename,
+                    bool store_ids);
+  /*!
+    \brief add a site from vcf or bcf to a batch
+    @param site INFO data for the site
+    @param filename name of source file, for error reporting
+    @param store_ids whether to store variant IDs for later reporting
+    @param batch destination batch, which must not be full
+   */
+  void add_vcf_site(const vcf_site &site, const std::string &filename,
+                    bool store_ids, variant_batch *batch) const;
+  /*!
+    \brief store one filtered variant in its bin, the typed variants
+    or the site table
+    @param r2 imputation r2; ignored for typed variants
+    @param index bin of the variant, or the number of bins if it is
+    dropped by MAF or baseline r2
+    @param imputed whether the variant was imputed
+    @param id variant ID, or empty if IDs are not kept
+    @param reject_nan whether a nan r2 is recorded as rejected, as it
+    is for vcf input
+
+    typed variants must only be passed when their IDs are kept
+   */
+  void add_variant(const float &r2, unsigned index, bool imputed,
+                   const std::string_view &id, bool reject_nan);
+  /*!
+    \brief append info file records that pass threshold to output buffers
+    @param begin first record to test
+    @param end record past the last one to test
+    @param filename name of source file, for error reporting
+    @param ids destination to which passing IDs are appended, one per line
+    @param lines destination to which passing lines are appended, or null
+
+    typed variants always pass
+   */
+  void select_passing_info_records(
+      std::vector<info_record>::const_iterator begin,
+      std::vector<info_record>::const_iterator end,
+      const std::string &filename, std::string *ids,
+      std::string *lines) const;
+  /*!
+    \brief test whether a text vcf site passes threshold
+    @param site INFO data for the site
+    @param filename name of source file, for error reporting
+    \return whether the site is typed, or imputed and passing threshold
+   */
+  bool vcf_site_passes(const vcf_site &site,
+                       const std::string &filename) const;
+  /*!
+    \brief parse the lines of a chunk of a minimac4 info file into a batch
+    @param chunk line-aligned text from the file
+    @param filename name of source file, for error reporting
+    @param store_ids whether to store variant IDs for later reporting
+    @param batch destination batch
+    @param flush function called with the batch whenever it is full,
+    which must leave the batch empty
+   */
+  void parse_info_chunk(
+      const text_chunk &chunk, const std::string &filename, bool store_ids,
+      variant_batch *batch,
+      const std::function<void(variant_batch *)> &flush) const;
+  /*!
+    \brief parse the sites of a chunk of text vcf into a batch
+    @param chunk line-aligned text from the file
+    @param scanner INFO scanner for the configured tags
+    @param filename name of source file, for error reporting
+    @param store_ids whether to store variant IDs for later reporting
+    @param batch destination batch
+    @param flush function called with the batch whenever it is full,
+    which must leave the batch empty
+   */
+  void parse_vcf_chunk(
+      const text_chunk &chunk, const vcf_info_scanner &scanner,
+      const std::string &filename, bool store_ids, variant_batch *batch,
+      const std::function<void(variant_batch *)> &flush) const;
+  /*!
+    \brief parse chunks of an input file on worker threads and merge them
+    @param reader source of line-aligned chunks
+    @param n_threads number of worker threads
+    @param parse_chunk function loading a single chunk into empty bins
+
+    chunk results are merged into this object in file order as soon
+    as all preceding chunks are complete.
+   */
+  void load_chunks(
+      text_chunk_reader *reader, unsigned n_threads,
+      const std::function<void(const text_chunk &, r2_bins *)> &parse_chunk);
+  /*!
+    \brief rebuild the flat MAF bin lookup from the boundary maps
+
+    the lookup is left empty, so that find_maf_bin searches the maps,
+    unless bin i runs from lower bound i to upper bound i and each
+    upper bound is the next lower bound
+   */
+  void update_maf_bin_lookup();
+  /*!
+    \brief inflate, parse and aggregate an input file on separate threads
+    @param reader source of line-aligned chunks
+    @param parse_chunk function parsing a single chunk into a batch
+    @param fold_maf whether batch frequencies must be folded to MAF
+    @param times accumulator for the time each stage spent waiting
+
+    the calling thread aggregates batches in file order. if any stage
+    fails, the others are released and the first error is rethrown.
+   */
+  void load_pipelined(text_chunk_reader *reader,
+                      const chunk_parser &parse_chunk, bool fold_maf,
+                      pipeline_wait_times *times);
+
   std::vector<r2_bin> _bins;                     //!< MAF bins for aggregation
   std::map<double, unsigned> _bin_lower_bounds;  //!< MAF lower bound lookup
   std::map<double, unsigned> _bin_upper_bounds;  //!< MAF upper bound lookup
-  std::vector<std::string> _typed_variants;  //!< typed variants for reporting
-  float _baseline_r2;                        //!< hard minimum permissible r2
+  std::vector<double> _maf_bin_boundaries;  //!< sorted bounds of all bins
+  std::vector<std::uint64_t> _typed_variants;  //!< typed variant ID handles
+  id_arena _typed_variant_storage;  //!< text of typed variant IDs
+  float _baseline_r2;               //!< hard minimum permissible r2
+  const decompression_pool
+      *_decompression_pool;  //!< shared inflation threads, if any
+  bool _record_sites;        //!< whether to record loaded sites
+  site_table _sites;         //!< sites recorded while loading
 };
 }  // namespace imputed_data_dynamic_threshold
 
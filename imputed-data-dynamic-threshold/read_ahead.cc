@@ -0,0 +1,297 @@
+/*!
+  \file read_ahead.cc
+  \brief implementation of sequential input with reads in flight
+  \copyright Released under the MIT License. Copyright
+  2023 Lightning Auriga
+ */
+
+#include "imputed-data-dynamic-threshold/read_ahead.h"
+
+namespace iddt = imputed_data_dynamic_threshold;
+
+iddt::read_ahead_file::read_ahead_file(const std::string &filename,
+                                       std::size_t buffer_size,
+                                       unsigned depth)
+    : _filename(filename),
+      _fd(-1),
+      _file_size(0),
+      _next_offset(0),
+      _slots(depth ? depth : 1),
+      _current(0),
+      _current_used(0),
+      _uring(false),
+      _stop(false) {
+  if (!buffer_size) {
+    throw std::logic_error("read_ahead_file: buffer size must be positive");
+  }
+  _fd = open(_filename.c_str(), O_RDONLY);
+  struct stat info;
+  if (_fd < 0 || fstat(_fd, &info)) {
+    if (_fd >= 0) close(_fd);
+    throw std::runtime_error("cannot read file \"" + _filename + "\"");
+  }
+  // the length of a pipe is only known once it has been read
+  _file_size = S_ISREG(info.st_mode) ? info.st_size : UINT64_MAX;
+  for (std::vector<slot>::iterator iter = _slots.begin();
+       iter != _slots.end(); ++iter) {
+    iter->data.resize(buffer_size);
+  }
+#ifdef IMPUTED_DATA_DYNAMIC_THRESHOLD_HAVE_LIBURING
+  // io_uring can still be missing or blocked at run time, for example
+  // by the seccomp filters of some container runtimes
+  _in_flight = 0;
+  _uring_verified = false;
+  _uring = S_ISREG(info.st_mode) &&
+           !io_uring_queue_init(_slots.size(), &_ring, 0);
+  // kernels before 5.6 set up rings that cannot read files
+  if (_uring && !read_supported()) exit_ring();
+  if (_uring) {
+    try {
+      for (unsigned i = 0; i < _slots.size(); ++i) {
+        if (claim_range(i)) submit(i);
+      }
+      return;
+    } catch (const std::exception &) {
+      // the destructor will not run, so reads already submitted must
+      // finish before their buffers are freed
+      exit_ring();
+    }
+  }
+#endif
+  try {
+    start_thread();
+  } catch (...) {
+    close(_fd);
+    throw;
+  }
+}
+
+iddt::read_ahead_file::~read_ahead_file() throw() {
+#ifdef IMPUTED_DATA_DYNAMIC_THRESHOLD_HAVE_LIBURING
+  if (_uring) exit_ring();
+#endif
+  if (_prefetcher.joinable()) {
+    {
+      std::lock_guard<std::mutex> guard(_lock);
+      _stop = true;
+    }
+    _changed.notify_all();
+    _prefetcher.join();
+  }
+  close(_fd);
+}
+
+bool iddt::read_ahead_file::claim_range(unsigned i) {
+  slot &s = _slots.at(i);
+  s.offset = _next_offset;
+  s.length = 0;
+  if (_next_offset < _file_size) {
+    s.length = _file_size - _next_offset < s.data.size()
+                   ? _file_size - _next_offset
+                   : s.data.size();
+  }
+  _next_offset += s.length;
+  s.size = 0;
+  s.error = 0;
+  s.pending = s.length;
+  // a buffer past the end of the file is complete, and empty
+  s.ready = !s.length;
+  return s.length;
+}
+
+void iddt::read_ahead_file::wait_for(unsigned i) {
+  slot &s = _slots.at(i);
+#ifdef IMPUTED_DATA_DYNAMIC_THRESHOLD_HAVE_LIBURING
+  // a completion can move reads to the thread while this waits
+  while (_uring && !s.ready) reap();
+  if (_uring) return;
+#endif
+  std::unique_lock<std::mutex> guard(_lock);
+  _changed.wait(guard, [&s]() { return s.ready; });
+}
+
+void iddt::read_ahead_file::release(unsigned i) {
+#ifdef IMPUTED_DATA_DYNAMIC_THRESHOLD_HAVE_LIBURING
+  if (_uring) {
+    if (claim_range(i)) submit(i);
+    return;
+  }
+#endif
+  {
+    std::lock_guard<std::mutex> guard(_lock);
+    claim_range(i);
+  }
+  _changed.notify_all();
+}
+
+void iddt::read_ahead_file::prefetch_loop() {
+  // buffers are claimed in ring order, so reading them in the same
+  // order never needs to seek, which also lets pipes be read ahead
+  for (unsigned i = 0;; i = (i + 1) % _slots.size()) {
+    slot &s = _slots.at(i);
+    {
+      std::unique_lock<std::mutex> guard(_lock);
+      _changed.wait(guard, [this, &s]() { return _stop || s.pending; });
+      if (_stop) return;
+    }
+    int error = 0;
+    while (s.size < s.length) {
+      ssize_t n = ::read(_fd, s.data.data() + s.size, s.length - s.size);
+      if (n > 0) {
+        s.size += n;
+      } else if (!n) {
+        break;
+      } else if (errno != EINTR) {
+        error = errno;
+        break;
+      }
+    }
+    {
+      std::lock_guard<std::mutex> guard(_lock);
+      s.error = error;
+      if (!error && s.size < s.length) _file_size = s.offset + s.size;
+      s.pending = false;
+      s.ready = true;
+    }
+    _changed.notify_all();
+  }
+}
+
+void iddt::read_ahead_file::start_thread() {
+  // nothing has been consumed yet, so the file is read from the start
+  _next_offset = 0;
+  _current = 0;
+  _current_used = 0;
+  for (unsigned i = 0; i < _slots.size(); ++i) claim_range(i);
+  _prefetcher = std::thread(&read_ahead_file::prefetch_loop, this);
+}
+
+bool iddt::read_ahead_file::fall_back_to_thread() {
+#ifdef IMPUTED_DATA_DYNAMIC_THRESHOLD_HAVE_LIBURING
+  if (_uring) {
+    if (_uring_verified) return false;
+    exit_ring();
+    start_thread();
+  }
+#endif
+  return true;
+}
+
+#ifdef IMPUTED_DATA_DYNAMIC_THRESHOLD_HAVE_LIBURING
+bool iddt::read_ahead_file::read_supported() {
+  io_uring_probe *probe = io_uring_get_probe_ring(&_ring);
+  if (!probe) return false;
+  bool res = io_uring_opcode_supported(probe, IORING_OP_READ);
+  io_uring_free_probe(probe);
+  return res;
+}
+
+void iddt::read_ahead_file::exit_ring() {
+  while (_in_flight) {
+    io_uring_cqe *cqe = 0;
+    int ret = io_uring_wait_cqe(&_ring, &cqe);
+    if (!ret) {
+      io_uring_cqe_seen(&_ring, cqe);
+      --_in_flight;
+    } else if (ret != -EINTR) {
+      break;
+    }
+  }
+  io_uring_queue_exit(&_ring);
+  _uring = false;
+}
+
+void iddt::read_ahead_file::submit(unsigned i) {
+  slot &s = _slots.at(i);
+  // the queue has an entry for every buffer, so it is never full
+  io_uring_sqe *sqe = io_uring_get_sqe(&_ring);
+  if (!sqe) {
+    throw std::logic_error("read_ahead_file: io_uring queue is full");
+  }
+  io_uring_prep_read(sqe, _fd, s.data.data() + s.size, s.length - s.size,
+                     s.offset + s.size);
+  io_uring_sqe_set_data(sqe, &s);
+  int ret = io_uring_submit(&_ring);
+  if (ret < 0) {
+    throw std::runtime_error("cannot read file \"" + _filename +
+                             "\": io_uring submission failed");
+  }
+  ++_in_flight;
+  s.pending = true;
+}
+
+void iddt::read_ahead_file::reap() {
+  io_uring_cqe *cqe = 0;
+  int ret = io_uring_wait_cqe(&_ring, &cqe);
+  if (ret == -EINTR) return;
+  if (ret < 0) {
+    throw std::runtime_error("cannot read file \"" + _filename + "\"");
+  }
+  slot *s = static_cast<slot *>(io_uring_cqe_get_data(cqe));
+  int res = cqe->res;
+  io_uring_cqe_seen(&_ring, cqe);
+  --_in_flight;
+  unsigned i = s - _slots.data();
+  if (res >= 0) _uring_verified = true;
+  if (res == -EINTR || res == -EAGAIN) {
+    submit(i);
+  } else if ((res == -EINVAL || res == -EOPNOTSUPP) && !_uring_verified) {
+    // a kernel that passed the probe can still refuse the reads
+    fall_back_to_thread();
+  } else if (res < 0) {
+    s->error = -res;
+    s->pending = false;
+    s->ready = true;
+  } else {
+    // reads can return short, and only one that returns nothing
+    // marks the end of the file
+    s->size += res;
+    if (res && s->size < s->length) {
+      submit(i);
+    } else {
+      if (s->size < s->length) _file_size = s->offset + s->size;
+      s->pending = false;
+      s->ready = true;
+    }
+  }
+}
+#endif
+
+std::size_t iddt::read_ahead_file::read(char *buffer, std::size_t size) {
+  if (!buffer && size) {
+    throw std::logic_error("read_ahead_file::read: null pointer");
+  }
+  std::size_t n = 0;
+  while (n < size) {
+    slot &s = _slots.at(_current);
+    wait_for(_current);
+    if (s.error) {
+      throw std::runtime_error("cannot read file \"" + _filename + "\"");
+    }
+    std::size_t available = s.size - _current_used;
+    std::size_t k = size - n < available ? size - n : available;
+    std::memcpy(buffer + n, s.data.data() + _current_used, k);
+    n += k;
+    _current_used += k;
+    if (_current_used < s.size) break;
+    // a buffer that was not filled holds the end of the file
+    if (s.size < s.length || !s.length) break;
+    release(_current);
+    _current = (_current + 1) % _slots.size();
+    _current_used = 0;
+  }
+  return n;
+}
+
+std::string iddt::read_ahead_file::backend() const {
+  return _uring ? "io_uring" : "thread";
+}
+
+void iddt::read_ahead_file::prefetch(const std::string &filename) {
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) return;
+#ifdef POSIX_FADV_WILLNEED
+  posix_fadvise(fd, 0, 1 << 26, POSIX_FADV_WILLNEED);
+#endif
+  close(fd);
+}
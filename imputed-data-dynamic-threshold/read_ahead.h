@@ -0,0 +1,182 @@
+/*!
+  \file read_ahead.h
+  \brief sequential file input with several large reads in flight
+  \copyright Released under the MIT License. Copyright
+  2023 Lightning Auriga
+ */
+
+#ifndef IMPUTED_DATA_DYNAMIC_THRESHOLD_READ_AHEAD_H_
+#define IMPUTED_DATA_DYNAMIC_THRESHOLD_READ_AHEAD_H_
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "imputed-data-dynamic-threshold/config.h"
+
+#ifdef IMPUTED_DATA_DYNAMIC_THRESHOLD_HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+namespace imputed_data_dynamic_threshold {
+/*!
+  \brief read a file front to back while later parts are already
+  being fetched
+
+  the file is read into a ring of equally sized buffers, each of
+  which is refilled as soon as its contents have been consumed, so
+  that up to one read per buffer is outstanding at any time. on
+  network filesystems this hides the latency of each read behind
+  the work done on the previous ones.
+
+  reads are issued through io_uring when liburing was found at
+  configure time and the running kernel allows it, and otherwise by
+  a prefetching thread that reads each buffer in turn. a kernel that
+  sets up a ring but cannot read through it, or fails the first
+  submission, also leaves reads to the thread.
+ */
+class read_ahead_file {
+ public:
+  /*!
+    \brief constructor
+    @param filename name of input file
+    @param buffer_size number of bytes fetched by each read
+    @param depth number of buffers, and so of reads in flight
+   */
+  read_ahead_file(const std::string &filename, std::size_t buffer_size,
+                  unsigned depth);
+  /*!
+    \brief destructor
+
+    outstanding reads are waited for before their buffers are freed
+   */
+  ~read_ahead_file() throw();
+  /*!
+    \brief copy the next bytes of the file
+    @param buffer destination for data
+    @param size number of bytes wanted
+    \return number of bytes copied; less than size only at end of file
+   */
+  std::size_t read(char *buffer, std::size_t size);
+  /*!
+    \brief get the name of the backend issuing reads
+    \return "io_uring" or "thread"
+   */
+  std::string backend() const;
+  /*!
+    \brief move reads from io_uring to the prefetching thread
+    \return whether reads now go through the thread
+
+    this only succeeds before any read through io_uring has completed,
+    as every buffer is fetched again from the start of the file. it is
+    done automatically when the first read is rejected as unsupported.
+   */
+  bool fall_back_to_thread();
+  /*!
+    \brief ask the kernel to start reading the front of a file into
+    the page cache
+    @param filename name of file that will be read soon
+
+    only the first 64MB are requested, which is enough for a reader
+    to start from the cache while its own reads catch up, without
+    evicting much of the file being read now. this is only advice,
+    and any failure is ignored.
+   */
+  static void prefetch(const std::string &filename);
+
+ private:
+  /*!
+    \brief one buffer of the ring
+   */
+  struct slot {
+    std::vector<char> data;  //!< fetched bytes
+    std::uint64_t offset;    //!< file offset of data[0]
+    std::size_t length;      //!< number of bytes requested
+    std::size_t size;        //!< number of bytes fetched so far
+    bool pending;            //!< whether the range is still being fetched
+    bool ready;              //!< whether the read has completed
+    int error;               //!< errno of a failed read, or 0
+  };
+  /*!
+    \brief copy constructor; disabled
+    @param obj existing read_ahead_file object
+   */
+  read_ahead_file(const read_ahead_file &obj);
+  /*!
+    \brief claim the next unread range of the file for a buffer
+    @param i index of buffer
+    \return whether any of the file was left to claim
+   */
+  bool claim_range(unsigned i);
+  /*!
+    \brief block until a buffer has been filled
+    @param i index of buffer
+   */
+  void wait_for(unsigned i);
+  /*!
+    \brief hand a consumed buffer back to be refilled
+    @param i index of buffer
+   */
+  void release(unsigned i);
+  /*!
+    \brief fill buffers in ring order until the file or the object ends
+   */
+  void prefetch_loop();
+  /*!
+    \brief claim every buffer from the start of the file and start the
+    prefetching thread
+   */
+  void start_thread();
+#ifdef IMPUTED_DATA_DYNAMIC_THRESHOLD_HAVE_LIBURING
+  /*!
+    \brief queue a read of the unfetched part of a buffer's range
+    @param i index of buffer
+   */
+  void submit(unsigned i);
+  /*!
+    \brief wait for and record the next completed read
+   */
+  void reap();
+  /*!
+    \brief test whether the kernel can read files through the ring
+    \return whether IORING_OP_READ is supported
+   */
+  bool read_supported();
+  /*!
+    \brief wait for all reads in flight and tear down the ring
+   */
+  void exit_ring();
+#endif
+
+  std::string _filename;          //!< name of input file
+  int _fd;                        //!< open file descriptor
+  std::uint64_t _file_size;       //!< length of file, once known
+  std::uint64_t _next_offset;     //!< file offset of next range to claim
+  std::vector<slot> _slots;       //!< ring of buffers
+  unsigned _current;              //!< buffer being consumed
+  std::size_t _current_used;      //!< bytes of current buffer consumed
+  bool _uring;                    //!< whether reads go through io_uring
+  std::thread _prefetcher;        //!< thread backend: reading thread
+  std::mutex _lock;               //!< thread backend: guards slot state
+  std::condition_variable _changed;  //!< thread backend: slot state change
+  bool _stop;                     //!< thread backend: whether to exit
+#ifdef IMPUTED_DATA_DYNAMIC_THRESHOLD_HAVE_LIBURING
+  io_uring _ring;        //!< submission and completion queues
+  unsigned _in_flight;   //!< reads submitted and not yet reaped
+  bool _uring_verified;  //!< whether any read through the ring completed
+#endif
+};
+}  // namespace imputed_data_dynamic_threshold
+
+#endif  // IMPUTED_DATA_DYNAMIC_THRESHOLD_READ_AHEAD_H_
@@ -0,0 +1,246 @@
+/*!
+  \file site_table.cc
+  \brief implementation of columnar tables of parsed sites
+  \copyright Released under the MIT License. Copyright
+  2023 Lightning Auriga
+ */
+
+#include "imputed-data-dynamic-threshold/site_table.h"
+
+namespace iddt = imputed_data_dynamic_threshold;
+
+namespace {
+// first bytes of every table; changed whenever the format changes
+const char table_magic[] = "iddt site table 1\n";
+// bytes of row count, ID text length, bin count and padding
+const std::uint64_t counts_size = 24;
+
+/*!
+  \brief round a byte offset up to the next multiple of 8
+  @param offset byte offset
+  \return aligned offset
+ */
+std::uint64_t align8(std::uint64_t offset) { return (offset + 7) & ~7ull; }
+
+/*!
+  \brief byte offsets of the parts of a saved table
+ */
+struct table_layout {
+  std::uint64_t counts;   //!< row count, ID text length and bin count
+  std::uint64_t r2;       //!< r2 column
+  std::uint64_t bins;     //!< bin index column
+  std::uint64_t imputed;  //!< imputation indicator column
+  std::uint64_t id_ends;  //!< ID end column
+  std::uint64_t ids;      //!< ID text
+  std::uint64_t end;      //!< end of the table
+};
+
+/*!
+  \brief compute where each part of a saved table starts
+  @param key_length length of the key stored in the table
+  @param n number of rows
+  @param id_length length of all ID text
+  \return offsets of the parts of the table
+ */
+table_layout get_layout(std::uint64_t key_length, std::uint64_t n,
+                        std::uint64_t id_length) {
+  table_layout res;
+  res.counts = align8(sizeof(table_magic) - 1 + sizeof(std::uint32_t) +
+                      key_length);
+  res.r2 = res.counts + counts_size;
+  res.bins = align8(res.r2 + n * sizeof(float));
+  res.imputed = align8(res.bins + n * sizeof(std::uint16_t));
+  res.id_ends = align8(res.imputed + n * sizeof(std::uint8_t));
+  res.ids = res.id_ends + n * sizeof(std::uint64_t);
+  res.end = res.ids + id_length;
+  return res;
+}
+
+/*!
+  \brief write zeros up to an aligned offset
+  @param out open binary output stream
+  @param written number of bytes already written
+  @param target offset to pad to, at most 7 bytes past written
+ */
+void write_padding(std::ostream &out, std::uint64_t written,
+                   std::uint64_t target) {
+  const char zeros[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+  out.write(zeros, target - written);
+}
+}  // namespace
+
+iddt::site_table::site_table() {}
+iddt::site_table::site_table(const site_table &obj)
+    : _r2(obj._r2),
+      _bins(obj._bins),
+      _imputed(obj._imputed),
+      _id_ends(obj._id_ends),
+      _ids(obj._ids) {}
+iddt::site_table::~site_table() throw() {}
+
+void iddt::site_table::add(const float &r2, unsigned bin, bool imputed,
+                           const std::string_view &id) {
+  if (bin > UINT16_MAX) {
+    throw std::logic_error("site_table::add: bin index out of range");
+  }
+  _r2.push_back(r2);
+  _bins.push_back(bin);
+  _imputed.push_back(imputed);
+  _ids.append(id.data(), id.size());
+  _id_ends.push_back(_ids.size());
+}
+
+void iddt::site_table::append(const site_table &obj) {
+  std::uint64_t offset = _ids.size();
+  _r2.insert(_r2.end(), obj._r2.begin(), obj._r2.end());
+  _bins.insert(_bins.end(), obj._bins.begin(), obj._bins.end());
+  _imputed.insert(_imputed.end(), obj._imputed.begin(), obj._imputed.end());
+  _ids.append(obj._ids);
+  _id_ends.reserve(_id_ends.size() + obj._id_ends.size());
+  for (std::vector<std::uint64_t>::const_iterator iter = obj._id_ends.begin();
+       iter != obj._id_ends.end(); ++iter) {
+    _id_ends.push_back(offset + *iter);
+  }
+}
+
+void iddt::site_table::clear() {
+  std::vector<float>().swap(_r2);
+  std::vector<std::uint16_t>().swap(_bins);
+  std::vector<std::uint8_t>().swap(_imputed);
+  std::vector<std::uint64_t>().swap(_id_ends);
+  std::string().swap(_ids);
+}
+
+std::uint64_t iddt::site_table::size() const { return _r2.size(); }
+
+float iddt::site_table::get_r2(std::uint64_t i) const { return _r2.at(i); }
+
+unsigned iddt::site_table::get_bin(std::uint64_t i) const {
+  return _bins.at(i);
+}
+
+bool iddt::site_table::is_imputed(std::uint64_t i) const {
+  return _imputed.at(i);
+}
+
+std::string_view iddt::site_table::get_id(std::uint64_t i) const {
+  std::uint64_t begin = i ? _id_ends.at(i - 1) : 0;
+  return std::string_view(_ids.data() + begin, _id_ends.at(i) - begin);
+}
+
+void iddt::site_table::save(std::ostream &out, const std::string &key,
+                            unsigned n_bins) const {
+  if (n_bins > UINT16_MAX) {
+    throw std::logic_error("site_table::save: too many bins");
+  }
+  std::uint64_t n = size();
+  table_layout layout = get_layout(key.size(), n, _ids.size());
+  std::uint32_t key_length = key.size();
+  out.write(table_magic, sizeof(table_magic) - 1);
+  out.write(reinterpret_cast<const char *>(&key_length), sizeof(key_length));
+  out.write(key.data(), key.size());
+  write_padding(out, sizeof(table_magic) - 1 + sizeof(key_length) + key.size(),
+                layout.counts);
+  std::uint64_t id_length = _ids.size();
+  std::uint32_t bin_count = n_bins, unused = 0;
+  out.write(reinterpret_cast<const char *>(&n), sizeof(n));
+  out.write(reinterpret_cast<const char *>(&id_length), sizeof(id_length));
+  out.write(reinterpret_cast<const char *>(&bin_count), sizeof(bin_count));
+  out.write(reinterpret_cast<const char *>(&unused), sizeof(unused));
+  out.write(reinterpret_cast<const char *>(_r2.data()), n * sizeof(float));
+  write_padding(out, layout.r2 + n * sizeof(float), layout.bins);
+  out.write(reinterpret_cast<const char *>(_bins.data()),
+            n * sizeof(std::uint16_t));
+  write_padding(out, layout.bins + n * sizeof(std::uint16_t), layout.imputed);
+  out.write(reinterpret_cast<const char *>(_imputed.data()), n);
+  write_padding(out, layout.imputed + n, layout.id_ends);
+  out.write(reinterpret_cast<const char *>(_id_ends.data()),
+            n * sizeof(std::uint64_t));
+  out.write(_ids.data(), _ids.size());
+  if (!out) {
+    throw std::runtime_error("cannot write site table; out of disk space?");
+  }
+}
+
+iddt::mapped_site_table::mapped_site_table(const std::string &filename,
+                                           const std::string &key)
+    : _file(filename),
+      _size(0),
+      _bin_count(0),
+      _r2(0),
+      _bins(0),
+      _imputed(0),
+      _id_ends(0),
+      _ids(0) {
+  const char *data = _file.data();
+  std::uint64_t file_size = _file.size();
+  std::uint64_t magic_length = sizeof(table_magic) - 1;
+  std::uint32_t key_length = 0;
+  if (file_size < magic_length + sizeof(key_length) ||
+      memcmp(data, table_magic, magic_length)) {
+    throw std::runtime_error("\"" + filename + "\" is not a site table");
+  }
+  memcpy(&key_length, data + magic_length, sizeof(key_length));
+  if (key_length != key.size() ||
+      file_size < magic_length + sizeof(key_length) + key_length ||
+      key.compare(0, key.size(), data + magic_length + sizeof(key_length),
+                  key_length)) {
+    throw std::runtime_error("site table \"" + filename +
+                             "\" is for another file or other settings");
+  }
+  std::uint64_t counts = get_layout(key_length, 0, 0).counts;
+  std::uint64_t id_length = 0;
+  std::uint32_t bin_count = 0;
+  if (file_size >= counts + counts_size) {
+    memcpy(&_size, data + counts, sizeof(_size));
+    memcpy(&id_length, data + counts + 8, sizeof(id_length));
+    memcpy(&bin_count, data + counts + 16, sizeof(bin_count));
+  }
+  // counts beyond the file cannot be used to compute a layout without
+  // overflowing
+  if (file_size < counts + counts_size || _size > file_size ||
+      id_length > file_size ||
+      get_layout(key_length, _size, id_length).end != file_size) {
+    throw std::runtime_error("site table \"" + filename + "\" is truncated");
+  }
+  table_layout layout = get_layout(key_length, _size, id_length);
+  _bin_count = bin_count;
+  _r2 = reinterpret_cast<const float *>(data + layout.r2);
+  _bins = reinterpret_cast<const std::uint16_t *>(data + layout.bins);
+  _imputed = reinterpret_cast<const std::uint8_t *>(data + layout.imputed);
+  _id_ends = reinterpret_cast<const std::uint64_t *>(data + layout.id_ends);
+  _ids = data + layout.ids;
+  // IDs are checked once here, so that get_id can trust them
+  std::uint64_t previous = 0;
+  for (std::uint64_t i = 0; i < _size; ++i) {
+    if (_id_ends[i] < previous || _id_ends[i] > id_length) {
+      throw std::runtime_error("site table \"" + filename +
+                               "\" has invalid IDs");
+    }
+    previous = _id_ends[i];
+  }
+}
+
+iddt::mapped_site_table::~mapped_site_table() throw() {}
+
+std::uint64_t iddt::mapped_site_table::size() const { return _size; }
+
+unsigned iddt::mapped_site_table::get_bin_count() const { return _bin_count; }
+
+const float *iddt::mapped_site_table::get_r2() const { return _r2; }
+
+const std::uint16_t *iddt::mapped_site_table::get_bins() const {
+  return _bins;
+}
+
+const std::uint8_t *iddt::mapped_site_table::get_imputed() const {
+  return _imputed;
+}
+
+std::string_view iddt::mapped_site_table::get_id(std::uint64_t i) const {
+  if (i >= _size) {
+    throw std::out_of_range("mapped_site_table::get_id: row out of range");
+  }
+  std::uint64_t begin = i ? _id_ends[i - 1] : 0;
+  return std::string_view(_ids + begin, _id_ends[i] - begin);
+}
@@ -0,0 +1,184 @@
+/*!
+  \file site_table.h
+  \brief columnar tables of the parsed sites of an input file
+  \copyright Released under the MIT License. Copyright
+  2023 Lightning Auriga
+ */
+
+#ifndef IMPUTED_DATA_DYNAMIC_THRESHOLD_SITE_TABLE_H_
+#define IMPUTED_DATA_DYNAMIC_THRESHOLD_SITE_TABLE_H_
+
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "imputed-data-dynamic-threshold/mapped_file.h"
+
+namespace imputed_data_dynamic_threshold {
+/*!
+  \brief collect one row per parsed site of an input file, in file
+  order, for saving as a table that can be mapped back into memory
+
+  each row holds the r2 of the site, the index of the MAF bin it was
+  added to, whether it was imputed, and its variant ID. the row index
+  is the ordinal of the record in the file. sites that were not added
+  to any bin, including typed sites, have the number of bins as their
+  bin index.
+ */
+class site_table {
+ public:
+  /*!
+    \brief default constructor
+   */
+  site_table();
+  /*!
+    \brief copy constructor
+    @param obj existing site_table object
+   */
+  site_table(const site_table &obj);
+  /*!
+    \brief destructor
+   */
+  ~site_table() throw();
+  /*!
+    \brief add a row for the next site
+    @param r2 r2 of the site
+    @param bin index of the MAF bin the site was added to
+    @param imputed whether the site was imputed
+    @param id variant ID of the site
+   */
+  void add(const float &r2, unsigned bin, bool imputed,
+           const std::string_view &id);
+  /*!
+    \brief append the rows of a table of later sites of the same file
+    @param obj table to append
+   */
+  void append(const site_table &obj);
+  /*!
+    \brief remove all rows and release their memory
+   */
+  void clear();
+  /*!
+    \brief get the number of rows
+    \return number of rows
+   */
+  std::uint64_t size() const;
+  /*!
+    \brief get the r2 of a row
+    @param i index of row
+    \return r2 of the site
+   */
+  float get_r2(std::uint64_t i) const;
+  /*!
+    \brief get the bin index of a row
+    @param i index of row
+    \return index of the MAF bin the site was added to
+   */
+  unsigned get_bin(std::uint64_t i) const;
+  /*!
+    \brief test whether the site of a row was imputed
+    @param i index of row
+    \return whether the site was imputed
+   */
+  bool is_imputed(std::uint64_t i) const;
+  /*!
+    \brief get the variant ID of a row
+    @param i index of row
+    \return variant ID of the site
+   */
+  std::string_view get_id(std::uint64_t i) const;
+  /*!
+    \brief write the table in the format read by mapped_site_table
+    @param out open binary output stream
+    @param key text identifying the input file and loading settings,
+    which mapped_site_table checks
+    @param n_bins number of MAF bins sites were assigned to
+
+    each column is written whole and aligned to 8 bytes, in native
+    byte order, so that a mapped table is used without being copied
+   */
+  void save(std::ostream &out, const std::string &key, unsigned n_bins) const;
+
+ private:
+  std::vector<float> _r2;               //!< r2 of each site
+  std::vector<std::uint16_t> _bins;     //!< MAF bin of each site
+  std::vector<std::uint8_t> _imputed;   //!< whether each site was imputed
+  std::vector<std::uint64_t> _id_ends;  //!< end of each ID in _ids
+  std::string _ids;                     //!< text of all IDs
+};
+
+/*!
+  \brief read-only view of a table saved by site_table::save
+
+  the file is mapped into memory, and its columns are read in place
+ */
+class mapped_site_table {
+ public:
+  /*!
+    \brief constructor
+    @param filename name of saved table
+    @param key key the table must have been saved with
+
+    a file that is not a complete table saved with this key throws
+    std::runtime_error
+   */
+  mapped_site_table(const std::string &filename, const std::string &key);
+  /*!
+    \brief destructor
+   */
+  ~mapped_site_table() throw();
+  /*!
+    \brief get the number of rows
+    \return number of rows
+   */
+  std::uint64_t size() const;
+  /*!
+    \brief get the number of MAF bins sites were assigned to
+    \return number of MAF bins
+   */
+  unsigned get_bin_count() const;
+  /*!
+    \brief get the r2 column
+    \return r2 of each of the size() sites
+   */
+  const float *get_r2() const;
+  /*!
+    \brief get the bin index column
+    \return MAF bin of each of the size() sites
+   */
+  const std::uint16_t *get_bins() const;
+  /*!
+    \brief get the imputation indicator column
+    \return for each of the size() sites, 1 if imputed and 0 otherwise
+   */
+  const std::uint8_t *get_imputed() const;
+  /*!
+    \brief get the variant ID of a row
+    @param i index of row
+    \return variant ID of the site
+   */
+  std::string_view get_id(std::uint64_t i) const;
+
+ private:
+  /*!
+    \brief copy constructor; disabled
+    @param obj existing mapped_site_table object
+   */
+  mapped_site_table(const mapped_site_table &obj);
+
+  mapped_file _file;              //!< mapping of the whole table
+  std::uint64_t _size;            //!< number of rows
+  unsigned _bin_count;            //!< number of MAF bins
+  const float *_r2;               //!< r2 column
+  const std::uint16_t *_bins;     //!< bin index column
+  const std::uint8_t *_imputed;   //!< imputation indicator column
+  const std::uint64_t *_id_ends;  //!< end of each ID in _ids
+  const char *_ids;               //!< text of all IDs
+};
+}  // namespace imputed_data_dynamic_threshold
+
+#endif  // IMPUTED_DATA_DYNAMIC_THRESHOLD_SITE_TABLE_H_
@@ -0,0 +1,188 @@
+/*!
+  \file summary_cache.cc
+  \brief implementation of per-file r2 summaries kept between runs
+  \copyright Released under the MIT License. Copyright
+  2023 Lightning Auriga
+ */
+
+#include "imputed-data-dynamic-threshold/summary_cache.h"
+
+namespace iddt = imputed_data_dynamic_threshold;
+
+namespace {
+// first bytes of every entry; changed whenever the format changes
+const char summary_magic[] = "iddt r2 summary 1\n";
+
+/*!
+  \brief hash text with 64-bit FNV-1a
+  @param text text to hash
+  \return hash value
+
+  unlike std::hash, this is the same for every build, so entries can
+  be shared between builds of the program
+ */
+std::uint64_t fnv1a(const std::string &text) {
+  std::uint64_t res = 14695981039346656037ull;
+  for (std::string::const_iterator iter = text.begin(); iter != text.end();
+       ++iter) {
+    res ^= static_cast<unsigned char>(*iter);
+    res *= 1099511628211ull;
+  }
+  return res;
+}
+}  // namespace
+
+iddt::summary_cache::summary_cache(const std::string &directory)
+    : _directory(directory) {
+  boost::system::error_code ec;
+  boost::filesystem::create_directories(_directory, ec);
+  if (ec || !boost::filesystem::is_directory(_directory)) {
+    throw std::runtime_error("cannot create summary cache directory \"" +
+                             directory + "\"");
+  }
+}
+
+iddt::summary_cache::~summary_cache() throw() {}
+
+bool iddt::summary_cache::load(const std::string &filename,
+                               const std::string &settings,
+                               r2_bins *bins) const {
+  if (!bins) {
+    throw std::logic_error("summary_cache::load: null pointer");
+  }
+  std::string key = get_key(filename, settings);
+  std::ifstream input(get_entry_path(key, ".summary").c_str(),
+                      std::ios::binary);
+  if (!input.is_open()) return false;
+  // entries name the key they hold, so a hash collision is a miss
+  std::string magic(sizeof(summary_magic) - 1, '\0');
+  std::uint32_t key_length = 0;
+  if (!input.read(&magic[0], magic.size()) || magic != summary_magic ||
+      !input.read(reinterpret_cast<char *>(&key_length), sizeof(key_length)) ||
+      key_length != key.size()) {
+    return false;
+  }
+  std::string stored_key(key_length, '\0');
+  if (!input.read(&stored_key[0], key_length) || stored_key != key) {
+    return false;
+  }
+  try {
+    bins->load_summary(input);
+  } catch (const std::runtime_error &) {
+    return false;
+  }
+  return true;
+}
+
+void iddt::summary_cache::store(const std::string &filename,
+                                const std::string &settings,
+                                const r2_bins &bins) const {
+  std::string key = get_key(filename, settings);
+  write_entry(get_entry_path(key, ".summary"), [&](std::ostream &output) {
+    std::uint32_t key_length = key.size();
+    output.write(summary_magic, sizeof(summary_magic) - 1);
+    output.write(reinterpret_cast<const char *>(&key_length),
+                 sizeof(key_length));
+    output.write(key.data(), key.size());
+    bins.save_summary(output);
+  });
+}
+
+std::unique_ptr<iddt::mapped_site_table> iddt::summary_cache::load_sites(
+    const std::string &filename, const std::string &settings) const {
+  std::string key = get_key(filename, settings);
+  std::string entry = get_entry_path(key, ".sites");
+  std::unique_ptr<mapped_site_table> res;
+  if (!boost::filesystem::is_regular_file(entry)) return res;
+  try {
+    res.reset(new mapped_site_table(entry, key));
+  } catch (const std::runtime_error &) {
+    // a damaged table is left for the next store to replace
+  }
+  return res;
+}
+
+void iddt::summary_cache::store_sites(const std::string &filename,
+                                      const std::string &settings,
+                                      const site_table &sites,
+                                      unsigned n_bins) const {
+  std::string key = get_key(filename, settings);
+  write_entry(get_entry_path(key, ".sites"), [&](std::ostream &output) {
+    sites.save(output, key, n_bins);
+  });
+}
+
+void iddt::summary_cache::write_entry(
+    const boost::filesystem::path &entry,
+    const std::function<void(std::ostream &)> &write) const {
+  boost::filesystem::path tmp =
+      _directory / boost::filesystem::unique_path("%%%%-%%%%-%%%%.tmp");
+  try {
+    std::ofstream output(tmp.c_str(), std::ios::binary);
+    if (!output.is_open()) {
+      throw std::runtime_error("cannot write to file \"" + tmp.string() +
+                               "\"");
+    }
+    write(output);
+    output.close();
+    if (!output) {
+      throw std::runtime_error("cannot write to file \"" + tmp.string() +
+                               "\"; out of disk space?");
+    }
+    boost::filesystem::rename(tmp, entry);
+  } catch (...) {
+    boost::system::error_code ec;
+    boost::filesystem::remove(tmp, ec);
+    throw;
+  }
+}
+
+std::string iddt::summary_cache::get_key(const std::string &filename,
+                                         const std::string &settings) const {
+  struct stat info;
+  if (stat(filename.c_str(), &info)) {
+    throw std::runtime_error("cannot read file \"" + filename + "\"");
+  }
+#ifdef __APPLE__
+  long nanoseconds = info.st_mtimespec.tv_nsec;
+#else
+  long nanoseconds = info.st_mtim.tv_nsec;
+#endif
+  char modified[64];
+  snprintf(modified, sizeof(modified), "%lld.%09ld",
+           static_cast<long long>(info.st_mtime), nanoseconds);
+  std::ostringstream out;
+  out << "file " << boost::filesystem::canonical(filename).string() << '\n'
+      << "size " << info.st_size << '\n'
+      << "modified " << modified << '\n'
+      << settings;
+  return out.str();
+}
+
+std::string iddt::summary_cache::get_entry_path(
+    const std::string &key, const std::string &suffix) const {
+  char name[17];
+  snprintf(name, sizeof(name), "%016llx",
+           static_cast<unsigned long long>(fnv1a(key)));
+  return (_directory / (name + suffix)).string();
+}
+
+std::string iddt::summary_cache::describe_settings(const r2_bins &bins,
+                                                   const std::string &format) {
+  // floating point settings are written exactly
+  std::ostringstream out;
+  out << std::hexfloat << "baseline r2 " << bins.get_baseline_r2() << '\n'
+      << "bins";
+  for (std::vector<r2_bin>::const_iterator iter = bins.get_bins().begin();
+       iter != bins.get_bins().end(); ++iter) {
+    out << ' ' << iter->get_bin_min() << ' ' << iter->get_bin_max();
+  }
+  out << '\n'
+      << "histogram scale "
+      << (bins.get_bins().empty()
+              ? 0u
+              : bins.get_bins().front().get_histogram_scale())
+      << '\n'
+      << "format " << format << '\n';
+  return out.str();
+}
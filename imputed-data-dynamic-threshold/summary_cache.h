@@ -0,0 +1,143 @@
+/*!
+  \file summary_cache.h
+  \brief per-file r2 summaries kept between runs
+  \copyright Released under the MIT License. Copyright
+  2023 Lightning Auriga
+ */
+
+#ifndef IMPUTED_DATA_DYNAMIC_THRESHOLD_SUMMARY_CACHE_H_
+#define IMPUTED_DATA_DYNAMIC_THRESHOLD_SUMMARY_CACHE_H_
+
+#include <sys/stat.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "boost/filesystem.hpp"
+#include "imputed-data-dynamic-threshold/r2_bins.h"
+#include "imputed-data-dynamic-threshold/site_table.h"
+
+namespace imputed_data_dynamic_threshold {
+/*!
+  \brief directory of r2 summaries of input files, so that files that
+  have not changed since an earlier run need not be loaded again
+
+  each entry holds the binned r2 values of one file, as loaded without
+  variant IDs, and is keyed by the path, size and modification time of
+  the file and by every setting that changes which values are loaded
+  into which bin. the target average r2 is not part of the key, so a
+  rerun with a new target only reads the summaries. a file may also
+  have a site table under the same key, from which a second pass can
+  report passing variants without reading the file again.
+ */
+class summary_cache {
+ public:
+  /*!
+    \brief constructor
+    @param directory directory holding summaries; created if missing
+   */
+  explicit summary_cache(const std::string &directory);
+  /*!
+    \brief destructor
+   */
+  ~summary_cache() throw();
+  /*!
+    \brief load the summary of an input file, if one is cached
+    @param filename name of input file
+    @param settings description of the settings the file is loaded
+    with, from describe_settings
+    @param bins empty bins, with the boundaries the file is loaded into
+    \return whether a summary of the file as it is now, loaded with
+    these settings, was found and loaded
+
+    a missing, stale or damaged entry is not an error, and leaves bins
+    unchanged
+   */
+  bool load(const std::string &filename, const std::string &settings,
+            r2_bins *bins) const;
+  /*!
+    \brief store the summary of an input file
+    @param filename name of input file
+    @param settings description of the settings the file was loaded
+    with, from describe_settings
+    @param bins bins holding only the data of the file
+   */
+  void store(const std::string &filename, const std::string &settings,
+             const r2_bins &bins) const;
+  /*!
+    \brief map the site table of an input file, if one is cached
+    @param filename name of input file
+    @param settings description of the settings the file is loaded
+    with, from describe_settings
+    \return the table of the file as it is now, loaded with these
+    settings, or null if there is none
+
+    as with load, a missing, stale or damaged table is not an error
+   */
+  std::unique_ptr<mapped_site_table> load_sites(
+      const std::string &filename, const std::string &settings) const;
+  /*!
+    \brief store the site table of an input file
+    @param filename name of input file
+    @param settings description of the settings the file was loaded
+    with, from describe_settings
+    @param sites sites recorded while loading only this file
+    @param n_bins number of MAF bins the file was loaded into
+   */
+  void store_sites(const std::string &filename, const std::string &settings,
+                   const site_table &sites, unsigned n_bins) const;
+  /*!
+    \brief get the key identifying a file and the settings it is
+    loaded with
+    @param filename name of input file
+    @param settings description of loading settings
+    \return key text
+   */
+  std::string get_key(const std::string &filename,
+                      const std::string &settings) const;
+  /*!
+    \brief get the name of an entry holding a key
+    @param key key text from get_key
+    @param suffix extension naming the kind of entry, such as
+    ".summary" or ".sites"
+    \return path of entry within the cache directory
+   */
+  std::string get_entry_path(const std::string &key,
+                             const std::string &suffix) const;
+  /*!
+    \brief describe the settings that change the summary of a file
+    @param bins empty bins files are loaded into
+    @param format description of the input format, including any
+    format-specific settings such as vcf INFO tags
+    \return description of settings, for load and store
+   */
+  static std::string describe_settings(const r2_bins &bins,
+                                       const std::string &format);
+
+ private:
+  /*!
+    \brief copy constructor; disabled
+    @param obj existing summary_cache object
+   */
+  summary_cache(const summary_cache &obj);
+  /*!
+    \brief write an entry under a temporary name and rename it into
+    place, so that concurrent runs never see a partial entry
+    @param entry final path of entry
+    @param write function writing the contents of the entry
+   */
+  void write_entry(const boost::filesystem::path &entry,
+                   const std::function<void(std::ostream &)> &write) const;
+
+  boost::filesystem::path _directory;  //!< directory holding entries
+};
+}  // namespace imputed_data_dynamic_threshold
+
+#endif  // IMPUTED_DATA_DYNAMIC_THRESHOLD_SUMMARY_CACHE_H_
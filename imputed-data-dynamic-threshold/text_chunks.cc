@@ -0,0 +1,514 @@
+/*!
+  \file text_chunks.cc
+  \brief implementation of line-aligned chunked text input
+  \copyright Released under the MIT License. Copyright
+  2023 Lightning Auriga
+ */
+
+#include "imputed-data-dynamic-threshold/text_chunks.h"
+
+namespace iddt = imputed_data_dynamic_threshold;
+
+iddt::text_chunk_reader::text_chunk_reader(const std::string &filename,
+                                           std::size_t chunk_size)
+    : text_chunk_reader(filename, chunk_size, 1) {}
+
+iddt::text_chunk_reader::text_chunk_reader(const std::string &filename,
+                                           std::size_t chunk_size,
+                                           unsigned inflate_threads)
+    : text_chunk_reader(filename, chunk_size, inflate_threads, 0) {}
+
+iddt::text_chunk_reader::text_chunk_reader(const std::string &filename,
+                                           std::size_t chunk_size,
+                                           unsigned inflate_threads,
+                                           gzip_index *index)
+    : _filename(filename),
+      _chunk_size(chunk_size ? chunk_size : 1),
+      _bgzf(detect_bgzf(filename)),
+      _next_block(0),
+      _index(0),
+      _mapped_offset(0),
+      _input(0),
+      _inflated_used(0),
+      _next_ordinal(0) {
+  if (_bgzf) {
+    index_bgzf_blocks();
+  } else if (index && index->is_complete()) {
+    _index = index;
+  } else if (parallel_gzip_reader::detect_gzip(filename)) {
+    // with one thread, this is zlib fed by read-ahead of the input
+    _parallel.reset(new parallel_gzip_reader(
+        filename, inflate_threads ? inflate_threads : 1, 4 * _chunk_size,
+        index));
+  } else if (mapped_file::is_flat_file(filename)) {
+    _mapped.reset(new mapped_file(filename));
+  } else {
+    _input = gzopen(_filename.c_str(), "rb");
+    if (!_input) {
+      throw std::runtime_error("cannot read file \"" + _filename + "\"");
+    }
+  }
+}
+
+iddt::text_chunk_reader::~text_chunk_reader() throw() {
+  if (_input) gzclose(_input);
+}
+
+bool iddt::text_chunk_reader::detect_bgzf(const std::string &filename) {
+  std::ifstream input(filename.c_str(), std::ios::binary);
+  unsigned char header[18];
+  if (!input.read(reinterpret_cast<char *>(header), 18)) return false;
+  // gzip member with FEXTRA set, carrying the 'BC' subfield
+  return header[0] == 31 && header[1] == 139 && header[2] == 8 &&
+         (header[3] & 4) && header[10] == 6 && header[11] == 0 &&
+         header[12] == 'B' && header[13] == 'C' && header[14] == 2 &&
+         header[15] == 0;
+}
+
+bool iddt::text_chunk_reader::is_bgzf() const { return _bgzf; }
+
+void iddt::text_chunk_reader::index_bgzf_blocks() {
+  std::ifstream input(_filename.c_str(), std::ios::binary);
+  if (!input.is_open()) {
+    throw std::runtime_error("cannot read file \"" + _filename + "\"");
+  }
+  unsigned char header[18];
+  std::uint64_t offset = 0;
+  while (input.seekg(offset) &&
+         input.read(reinterpret_cast<char *>(header), 18)) {
+    if (header[0] != 31 || header[1] != 139 || header[12] != 'B' ||
+        header[13] != 'C') {
+      throw std::runtime_error("invalid BGZF block in file \"" + _filename +
+                               "\" at offset " + std::to_string(offset));
+    }
+    _block_offsets.push_back(offset);
+    offset += static_cast<std::uint64_t>(header[16] | (header[17] << 8)) + 1;
+  }
+  if (input.gcount()) {
+    throw std::runtime_error("truncated BGZF block in file \"" + _filename +
+                             "\"");
+  }
+  _block_offsets.push_back(offset);
+}
+
+bool iddt::text_chunk_reader::next_chunk(text_chunk *chunk) {
+  if (!chunk) {
+    throw std::logic_error("text_chunk_reader::next_chunk: null pointer");
+  }
+  std::lock_guard<std::mutex> guard(_lock);
+  chunk->text.clear();
+  chunk->mapped = std::string_view();
+  chunk->mapping.reset();
+  chunk->starts_file = !_next_ordinal;
+  chunk->first_block = chunk->last_block = 0;
+  if (_bgzf) {
+    unsigned n_blocks = _block_offsets.size() - 1;
+    if (_next_block >= n_blocks) return false;
+    chunk->first_block = _next_block;
+    while (_next_block < n_blocks &&
+           _block_offsets.at(_next_block) - _block_offsets.at(
+                                                chunk->first_block) <
+               _chunk_size) {
+      ++_next_block;
+    }
+    chunk->last_block = _next_block;
+  } else if (_index) {
+    // checkpoints are already about a chunk's worth of input apart
+    if (_next_block >= _index->size()) return false;
+    chunk->first_block = _next_block++;
+    chunk->last_block = _next_block;
+  } else if (_mapped) {
+    if (!claim_mapped_chunk(chunk)) return false;
+  } else if (!read_sequential_chunk(chunk)) {
+    return false;
+  }
+  chunk->ordinal = _next_ordinal++;
+  return true;
+}
+
+bool iddt::text_chunk_reader::read_sequential_chunk(text_chunk *chunk) {
+  std::string buffer;
+  buffer.swap(_carry);
+  std::vector<char> block(_chunk_size);
+  int n = 0;
+  // the carried partial line never contains a newline, so the first
+  // newline found here always ends a line begun in this chunk
+  while ((n = read_sequential_text(block.data(), block.size())) > 0) {
+    buffer.append(block.data(), n);
+    std::string::size_type pos = buffer.rfind('\n');
+    if (pos != std::string::npos) {
+      _carry = buffer.substr(pos + 1);
+      buffer.resize(pos + 1);
+      chunk->text.swap(buffer);
+      return true;
+    }
+  }
+  if (n < 0) {
+    throw std::runtime_error("cannot inflate file \"" + _filename + "\"");
+  }
+  // end of file: whatever remains is the final line
+  chunk->text.swap(buffer);
+  return !chunk->text.empty();
+}
+
+int iddt::text_chunk_reader::read_sequential_text(char *buffer,
+                                                  unsigned size) {
+  if (!_parallel) return gzread(_input, buffer, size);
+  if (_inflated_used == _inflated.size()) {
+    _inflated_used = 0;
+    if (!_parallel->read(&_inflated)) return 0;
+  }
+  std::size_t n = _inflated.size() - _inflated_used;
+  if (n > size) n = size;
+  std::memcpy(buffer, _inflated.data() + _inflated_used, n);
+  _inflated_used += n;
+  return static_cast<int>(n);
+}
+
+void iddt::text_chunk_reader::inflate_bgzf_block(std::ifstream *input,
+                                                 unsigned block,
+                                                 block_inflater *inflater,
+                                                 std::string *buffer) const {
+  std::vector<char> compressed(_block_offsets.at(block + 1) -
+                               _block_offsets.at(block));
+  input->clear();
+  if (!input->seekg(_block_offsets.at(block)) ||
+      !input->read(compressed.data(), compressed.size())) {
+    throw std::runtime_error("cannot read BGZF block from \"" + _filename +
+                             "\"");
+  }
+  try {
+    inflater->inflate_member(compressed.data(), compressed.size(), buffer);
+  } catch (const std::runtime_error &) {
+    throw std::runtime_error("cannot inflate BGZF block from \"" + _filename +
+                             "\"");
+  }
+}
+
+void iddt::text_chunk_reader::fill_chunk(text_chunk *chunk) const {
+  if (!chunk) {
+    throw std::logic_error("text_chunk_reader::fill_chunk: null pointer");
+  }
+  if (_index) {
+    fill_indexed_chunk(chunk);
+    return;
+  }
+  if (!_bgzf) return;
+  std::ifstream input(_filename.c_str(), std::ios::binary);
+  if (!input.is_open()) {
+    throw std::runtime_error("cannot read file \"" + _filename + "\"");
+  }
+  block_inflater inflater;
+  std::string &text = chunk->text;
+  text.clear();
+  for (unsigned i = chunk->first_block; i < chunk->last_block; ++i) {
+    inflate_bgzf_block(&input, i, &inflater, &text);
+  }
+  bool owns_lines = drop_unowned_text(chunk);
+  // the last owned line runs past the end of the chunk's blocks
+  std::string extra;
+  for (unsigned i = chunk->last_block;
+       owns_lines && i + 1 < _block_offsets.size(); ++i) {
+    extra.clear();
+    inflate_bgzf_block(&input, i, &inflater, &extra);
+    std::string::size_type pos = extra.find('\n');
+    if (pos == std::string::npos) {
+      text += extra;
+    } else {
+      text.append(extra, 0, pos + 1);
+      break;
+    }
+  }
+}
+
+bool iddt::text_chunk_reader::claim_mapped_chunk(text_chunk *chunk) {
+  std::uint64_t size = _mapped->size();
+  if (_mapped_offset >= size) return false;
+  const char *data = _mapped->data();
+  // the chunk runs on to the end of the line it stops in
+  std::uint64_t end = size;
+  if (_mapped_offset + _chunk_size < size) {
+    std::uint64_t from = _mapped_offset + _chunk_size - 1;
+    const char *newline =
+        static_cast<const char *>(std::memchr(data + from, '\n', size - from));
+    if (newline) end = newline + 1 - data;
+  }
+  chunk->mapped = std::string_view(data + _mapped_offset, end - _mapped_offset);
+  chunk->mapping = _mapped;
+  _mapped_offset = end;
+  return true;
+}
+
+void iddt::text_chunk_reader::fill_indexed_chunk(text_chunk *chunk) const {
+  indexed_gzip_reader input(_filename, *_index, chunk->first_block);
+  std::uint64_t begin = _index->at(chunk->first_block).offset;
+  std::uint64_t end = chunk->last_block < _index->size()
+                          ? _index->at(chunk->last_block).offset
+                          : _index->get_inflated_size();
+  std::string &text = chunk->text;
+  text.resize(end - begin);
+  for (std::size_t used = 0; used < text.size();) {
+    std::size_t n = text.size() - used;
+    n = input.read(&text[used], n < (1 << 20) ? n : 1 << 20);
+    if (!n) {
+      throw std::runtime_error("file \"" + _filename +
+                               "\" is shorter than its index");
+    }
+    used += n;
+  }
+  bool owns_lines = drop_unowned_text(chunk);
+  // the last owned line runs past the next checkpoint
+  std::vector<char> extra(1 << 16);
+  unsigned n = 0;
+  while (owns_lines && (n = input.read(extra.data(), extra.size()))) {
+    const char *newline =
+        static_cast<const char *>(std::memchr(extra.data(), '\n', n));
+    if (newline) {
+      text.append(extra.data(), newline + 1 - extra.data());
+      break;
+    }
+    text.append(extra.data(), n);
+  }
+}
+
+bool iddt::text_chunk_reader::drop_unowned_text(text_chunk *chunk) {
+  // the text before the first newline belongs to an earlier chunk
+  if (chunk->starts_file) return true;
+  std::string &text = chunk->text;
+  std::string::size_type pos = text.find('\n');
+  if (pos == std::string::npos) {
+    text.clear();
+    return false;
+  }
+  text.erase(0, pos + 1);
+  return true;
+}
+
+unsigned iddt::text_chunk_reader::chunks_claimed() {
+  std::lock_guard<std::mutex> guard(_lock);
+  return _next_ordinal;
+}
+
+iddt::gzip_stream_reader::gzip_stream_reader(const std::string &filename)
+    : _filename(filename), _text_used(0) {
+  if (text_chunk_reader::detect_bgzf(_filename)) {
+    _input.reset(new read_ahead_file(_filename, 1 << 22, 4));
+  } else {
+    _gzip.reset(new parallel_gzip_reader(_filename, 1, 1 << 22));
+  }
+}
+
+iddt::gzip_stream_reader::~gzip_stream_reader() throw() {}
+
+std::size_t iddt::gzip_stream_reader::read(char *buffer, std::size_t size) {
+  std::size_t n = 0;
+  while (n < size) {
+    if (_text_used == _text.size()) {
+      _text_used = 0;
+      if (!(_input ? inflate_bgzf_blocks() : _gzip->read(&_text))) {
+        _text.clear();
+        break;
+      }
+      continue;
+    }
+    std::size_t m = std::min(size - n, _text.size() - _text_used);
+    std::memcpy(buffer + n, _text.data() + _text_used, m);
+    n += m;
+    _text_used += m;
+  }
+  return n;
+}
+
+bool iddt::gzip_stream_reader::inflate_bgzf_blocks() {
+  _text.clear();
+  unsigned char header[18];
+  while (_text.size() < (1u << 20)) {
+    std::size_t n = _input->read(reinterpret_cast<char *>(header), 18);
+    if (!n) break;
+    std::size_t block_size = (header[16] | (header[17] << 8)) + 1;
+    // a block holds at least its header and the gzip trailer
+    if (n < 18 || header[0] != 31 || header[1] != 139 || header[12] != 'B' ||
+        header[13] != 'C' || block_size < 26) {
+      throw std::runtime_error("invalid BGZF block in file \"" + _filename +
+                               "\"");
+    }
+    _block.resize(block_size);
+    std::memcpy(_block.data(), header, 18);
+    if (_input->read(_block.data() + 18, block_size - 18) !=
+        block_size - 18) {
+      throw std::runtime_error("truncated BGZF block in file \"" + _filename +
+                               "\"");
+    }
+    try {
+      _inflater.inflate_member(_block.data(), block_size, &_text);
+    } catch (const std::runtime_error &) {
+      throw std::runtime_error("cannot inflate BGZF block from \"" +
+                               _filename + "\"");
+    }
+  }
+  return !_text.empty();
+}
+
+iddt::chunk_scheduler::file_state::file_state()
+    : assigned(false), exhausted(false), n_chunks(0), outstanding(0) {}
+
+iddt::chunk_scheduler::chunk_scheduler(
+    const std::vector<std::string> &filenames,
+    const std::vector<char> &splittable, unsigned n_workers,
+    std::size_t chunk_size)
+    : chunk_scheduler(filenames, splittable, n_workers, chunk_size,
+                      std::vector<gzip_index *>()) {}
+
+iddt::chunk_scheduler::chunk_scheduler(
+    const std::vector<std::string> &filenames,
+    const std::vector<char> &splittable, unsigned n_workers,
+    std::size_t chunk_size, const std::vector<gzip_index *> &indexes)
+    : _filenames(filenames),
+      _splittable(splittable),
+      _chunk_size(chunk_size),
+      _indexes(indexes),
+      _queues(n_workers),
+      _current(n_workers, filenames.size()),
+      _cursor_file(0),
+      _outstanding(0),
+      _max_outstanding(0),
+      _stopping(false) {
+  if (!n_workers) {
+    throw std::logic_error("chunk_scheduler: at least one worker is required");
+  }
+  if (_splittable.size() != _filenames.size() ||
+      (!_indexes.empty() && _indexes.size() != _filenames.size())) {
+    throw std::logic_error("chunk_scheduler: file counts do not match");
+  }
+  _indexes.resize(_filenames.size(), 0);
+  for (unsigned i = 0; i < _filenames.size(); ++i) {
+    _queues.at(i % n_workers).push_back(i);
+    _files.push_back(std::unique_ptr<file_state>(new file_state));
+  }
+}
+
+iddt::chunk_scheduler::~chunk_scheduler() throw() {}
+
+bool iddt::chunk_scheduler::next(unsigned worker, scheduled_chunk *task) {
+  if (!task) {
+    throw std::logic_error("chunk_scheduler::next: null pointer");
+  }
+  if (worker >= _current.size()) {
+    throw std::logic_error("chunk_scheduler::next: invalid worker");
+  }
+  while (true) {
+    std::unique_lock<std::mutex> guard(_lock);
+    unsigned file = _current.at(worker);
+    if (file == _filenames.size()) {
+      if (!assign(worker, &file)) return false;
+      _current.at(worker) = file;
+    }
+    // when nothing of the earliest unfinished file is in flight, the
+    // chunk run is waiting for has not been claimed, so it must not be
+    // held back
+    file_state &state = *_files.at(file);
+    _changed.wait(guard, [this, file, &state]() {
+      return _stopping || !_max_outstanding || file < _cursor_file ||
+             (file == _cursor_file && !state.outstanding) ||
+             _outstanding < _max_outstanding;
+    });
+    if (_stopping) return false;
+    ++_outstanding;
+    ++state.outstanding;
+    guard.unlock();
+    if (claim(file, task)) return true;
+    guard.lock();
+    --_outstanding;
+    --state.outstanding;
+    _current.at(worker) = _filenames.size();
+    _changed.notify_all();
+  }
+}
+
+bool iddt::chunk_scheduler::assign(unsigned worker, unsigned *file) {
+  std::deque<unsigned> *queue = &_queues.at(worker);
+  if (queue->empty()) {
+    for (std::vector<std::deque<unsigned> >::iterator iter = _queues.begin();
+         iter != _queues.end(); ++iter) {
+      if (iter->size() > queue->size()) queue = &*iter;
+    }
+  }
+  if (!queue->empty()) {
+    // a worker works through its own files from the front, while
+    // thieves take from the back, away from files it will reach soon
+    if (queue == &_queues.at(worker)) {
+      *file = queue->front();
+      queue->pop_front();
+    } else {
+      *file = queue->back();
+      queue->pop_back();
+    }
+    _files.at(*file)->assigned = true;
+    return true;
+  }
+  // nothing is left unstarted, so share the earliest file in progress
+  for (unsigned i = 0; i < _files.size(); ++i) {
+    if (_splittable.at(i) && _files.at(i)->assigned &&
+        !_files.at(i)->exhausted) {
+      *file = i;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool iddt::chunk_scheduler::claim(unsigned file, scheduled_chunk *task) {
+  file_state &state = *_files.at(file);
+  task->file = file;
+  if (!_splittable.at(file)) {
+    std::lock_guard<std::mutex> guard(_lock);
+    if (state.exhausted) return false;
+    state.exhausted = true;
+    state.n_chunks = 1;
+    task->whole_file = true;
+    task->chunk = text_chunk();
+    task->chunk.ordinal = 0;
+    task->chunk.starts_file = true;
+    return true;
+  }
+  std::call_once(state.opened, [this, &state, file]() {
+    // plain gzip inflation only gets spare threads when there are
+    // fewer files than workers to keep the workers busy
+    unsigned inflate_threads = _current.size() / _filenames.size();
+    state.reader.reset(new text_chunk_reader(_filenames.at(file),
+                                             _chunk_size, inflate_threads,
+                                             _indexes.at(file)));
+  });
+  std::shared_ptr<text_chunk_reader> reader;
+  {
+    std::lock_guard<std::mutex> guard(_lock);
+    if (state.exhausted) return false;
+    reader = state.reader;
+  }
+  task->whole_file = false;
+  if (reader->next_chunk(&task->chunk)) {
+    reader->fill_chunk(&task->chunk);
+    return true;
+  }
+  // the reader is closed once the last worker using it lets it go
+  std::lock_guard<std::mutex> guard(_lock);
+  if (!state.exhausted) {
+    state.exhausted = true;
+    state.n_chunks = reader->chunks_claimed();
+    state.reader.reset();
+    _changed.notify_all();
+  }
+  return false;
+}
+
+bool iddt::chunk_scheduler::get_chunk_count(unsigned file,
+                                            unsigned *count) const {
+  if (!count) {
+    throw std::logic_error("chunk_scheduler::get_chunk_count: null pointer");
+  }
+  std::lock_guard<std::mutex> guard(_lock);
+  const file_state &state = *_files.at(file);
+  if (!state.exhausted) return false;
+  *count = state.n_chunks;
+  return true;
+}
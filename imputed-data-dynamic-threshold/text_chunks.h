@@ -0,0 +1,527 @@
+/*!
+  \file text_chunks.h
+  \brief split compressed or flat text input into runs of complete lines
+  \copyright Released under the MIT License. Copyright
+  2023 Lightning Auriga
+ */
+
+#ifndef IMPUTED_DATA_DYNAMIC_THRESHOLD_TEXT_CHUNKS_H_
+#define IMPUTED_DATA_DYNAMIC_THRESHOLD_TEXT_CHUNKS_H_
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "imputed-data-dynamic-threshold/block_inflater.h"
+#include "imputed-data-dynamic-threshold/gzip_index.h"
+#include "imputed-data-dynamic-threshold/mapped_file.h"
+#include "imputed-data-dynamic-threshold/parallel_gzip.h"
+#include "imputed-data-dynamic-threshold/read_ahead.h"
+
+namespace imputed_data_dynamic_threshold {
+/*!
+  \brief a run of complete lines from a text input
+
+  chunks are numbered in file order. for bgzipped input, a chunk
+  is first handed out as a range of compressed blocks, and its text
+  is only inflated once a worker calls text_chunk_reader::fill_chunk.
+  for uncompressed input, a chunk is a view of the mapped file, and
+  its text is never copied.
+ */
+struct text_chunk {
+  unsigned ordinal;       //!< position of this chunk within its file
+  unsigned first_block;   //!< bgzf or indexed gzip: index of first
+                          //!< compressed block or checkpoint
+  unsigned last_block;    //!< bgzf or indexed gzip: index past last
+                          //!< compressed block or checkpoint
+  std::string text;       //!< newline-terminated lines
+  bool starts_file;       //!< whether text begins at the start of the file
+  std::string_view mapped;  //!< uncompressed input: lines in the mapping
+  std::shared_ptr<const mapped_file>
+      mapping;  //!< uncompressed input: keeps the mapping alive
+  /*!
+    \brief get the lines of the chunk, wherever they are held
+    \return view of the chunk's lines
+   */
+  std::string_view get_text() const {
+    return mapping ? mapped : std::string_view(text);
+  }
+};
+
+/*!
+  \brief hand out chunks of line-aligned text from a single input file
+
+  bgzipped input is split on BGZF block boundaries so that chunks can
+  be inflated independently on separate threads. uncompressed files
+  are mapped into memory, and each chunk is a view of the mapping
+  that costs nothing to claim. plain gzip files are read sequentially
+  by whichever thread requests the next chunk, which still leaves
+  parsing free to run in parallel; plain gzip can additionally be
+  inflated by parallel_gzip_reader, whose threads are busy only while
+  the requesting thread waits on them. once a plain gzip file has
+  been read with a gzip_index, a reader given the complete index
+  splits the file at its checkpoints and inflates chunks
+  independently, as for bgzf input.
+ */
+class text_chunk_reader {
+ public:
+  /*!
+    \brief constructor
+    @param filename name of input file
+    @param chunk_size approximate number of bytes per chunk; for bgzf
+    input this is measured in compressed bytes
+   */
+  text_chunk_reader(const std::string &filename, std::size_t chunk_size);
+  /*!
+    \brief constructor
+    @param filename name of input file
+    @param chunk_size approximate number of bytes per chunk; for bgzf
+    input this is measured in compressed bytes
+    @param inflate_threads number of threads inflating plain gzip
+    input; 1 inflates it with zlib alone
+   */
+  text_chunk_reader(const std::string &filename, std::size_t chunk_size,
+                    unsigned inflate_threads);
+  /*!
+    \brief constructor
+    @param filename name of input file
+    @param chunk_size approximate number of bytes per chunk; for bgzf
+    input this is measured in compressed bytes
+    @param inflate_threads number of threads inflating plain gzip
+    input; 1 inflates it with zlib alone
+    @param index if not null, seek points into plain gzip input. a
+    complete index splits the input at its checkpoints, as bgzf input
+    is split on blocks; otherwise checkpoints are recorded into it
+    as the input is read sequentially.
+   */
+  text_chunk_reader(const std::string &filename, std::size_t chunk_size,
+                    unsigned inflate_threads, gzip_index *index);
+  /*!
+    \brief destructor
+   */
+  ~text_chunk_reader() throw();
+  /*!
+    \brief claim the next chunk of the file
+    @param chunk destination for the claimed chunk
+    \return whether a chunk was available
+
+    this function is safe to call from multiple threads
+   */
+  bool next_chunk(text_chunk *chunk);
+  /*!
+    \brief inflate the text of a chunk claimed from bgzf or indexed
+    gzip input
+    @param chunk claimed chunk
+
+    text that begins mid-line is dropped, and text is read past the
+    end of the chunk's blocks to complete its final line. this is
+    a no-op for chunks from sequential input, which already carry
+    their text. this function is safe to call from multiple threads.
+   */
+  void fill_chunk(text_chunk *chunk) const;
+  /*!
+    \brief get the number of chunks claimed so far
+    \return the number of chunks claimed so far
+
+    once next_chunk has returned false, this is the number of chunks
+    in the file. this function is safe to call from multiple threads.
+   */
+  unsigned chunks_claimed();
+  /*!
+    \brief determine whether the input is split on bgzf blocks
+    \return whether the input is split on bgzf blocks
+   */
+  bool is_bgzf() const;
+  /*!
+    \brief test whether a file starts with a BGZF block header
+    @param filename name of file to test
+    \return whether the file starts with a BGZF block header
+   */
+  static bool detect_bgzf(const std::string &filename);
+
+ private:
+  /*!
+    \brief record the offsets of all BGZF blocks in the input
+   */
+  void index_bgzf_blocks();
+  /*!
+    \brief inflate a single BGZF block and append it to a buffer
+    @param input open binary connection to the input file
+    @param block index of block to inflate
+    @param inflater reusable gzip member inflater
+    @param buffer destination for inflated text
+   */
+  void inflate_bgzf_block(std::ifstream *input, unsigned block,
+                          block_inflater *inflater,
+                          std::string *buffer) const;
+  /*!
+    \brief read the next line-aligned chunk from sequential input
+    @param chunk destination for the chunk
+    \return whether any text was read
+   */
+  bool read_sequential_chunk(text_chunk *chunk);
+  /*!
+    \brief claim the next line-aligned chunk of mapped input
+    @param chunk destination for the chunk
+    \return whether any text was left
+   */
+  bool claim_mapped_chunk(text_chunk *chunk);
+  /*!
+    \brief inflate the text of a chunk claimed from indexed gzip input
+    @param chunk claimed chunk
+   */
+  void fill_indexed_chunk(text_chunk *chunk) const;
+  /*!
+    \brief drop the text before a chunk's first owned line
+    @param chunk chunk holding the text of its blocks
+    \return whether the chunk owns any line
+
+    a chunk owns each line that starts after a newline inside its
+    blocks, and the whole text of the first chunk of the file
+   */
+  static bool drop_unowned_text(text_chunk *chunk);
+  /*!
+    \brief read inflated text from sequential input
+    @param buffer destination for text
+    @param size maximum number of bytes to read
+    \return number of bytes read, 0 at end of file, or negative on error
+   */
+  int read_sequential_text(char *buffer, unsigned size);
+
+  std::string _filename;  //!< name of input file
+  std::size_t _chunk_size;  //!< approximate bytes per chunk
+  bool _bgzf;               //!< whether input is split on bgzf blocks
+  std::vector<std::uint64_t>
+      _block_offsets;     //!< bgzf block start offsets, plus file size
+  unsigned _next_block;   //!< bgzf or indexed gzip: next unclaimed block
+                          //!< or checkpoint
+  const gzip_index *_index;  //!< complete index of gzip input, if used
+  std::shared_ptr<const mapped_file>
+      _mapped;            //!< uncompressed input: mapping of whole file
+  std::uint64_t _mapped_offset;  //!< uncompressed: offset of next chunk
+  gzFile _input;          //!< sequential: open read connection
+  std::unique_ptr<parallel_gzip_reader>
+      _parallel;          //!< plain gzip: multithreaded inflater, if used
+  std::string _inflated;  //!< plain gzip: last text from _parallel
+  std::size_t _inflated_used;  //!< plain gzip: bytes of _inflated read
+  std::string _carry;     //!< sequential: partial line from last read
+  unsigned _next_ordinal;  //!< ordinal of next claimed chunk
+  std::mutex _lock;        //!< serializes chunk claims
+};
+
+/*!
+  \brief read gzip or bgzf text front to back, with the compressed
+  input fetched ahead
+
+  bgzf blocks are read through a read_ahead_file and inflated one at
+  a time by block_inflater, and so by libdeflate when it was found.
+  other gzip files are inflated by a single-threaded
+  parallel_gzip_reader, which is zlib fed by its own read_ahead_file.
+  either way, the reads of later input are under way while earlier
+  text is parsed, which is what the single-threaded loaders need on
+  network filesystems.
+ */
+class gzip_stream_reader {
+ public:
+  /*!
+    \brief constructor
+    @param filename name of gzip-compressed or bgzipped input file
+   */
+  explicit gzip_stream_reader(const std::string &filename);
+  /*!
+    \brief destructor
+   */
+  ~gzip_stream_reader() throw();
+  /*!
+    \brief copy the next inflated bytes of the file
+    @param buffer destination for text
+    @param size maximum number of bytes to copy
+    \return number of bytes copied; less than size only at end of file
+   */
+  std::size_t read(char *buffer, std::size_t size);
+
+ private:
+  /*!
+    \brief copy constructor; disabled
+    @param obj existing gzip_stream_reader object
+   */
+  gzip_stream_reader(const gzip_stream_reader &obj);
+  /*!
+    \brief inflate about a megabyte of bgzf blocks, replacing the text
+    held from the last call
+    \return whether any text was left
+   */
+  bool inflate_bgzf_blocks();
+
+  std::string _filename;  //!< name of input file
+  std::unique_ptr<read_ahead_file> _input;  //!< bgzf: compressed input
+  std::unique_ptr<parallel_gzip_reader> _gzip;  //!< plain gzip: inflater
+  block_inflater _inflater;  //!< bgzf: reusable block inflater
+  std::vector<char> _block;  //!< bgzf: compressed bytes of one block
+  std::string _text;         //!< inflated text not yet copied out
+  std::size_t _text_used;    //!< bytes of _text already copied out
+};
+
+/*!
+  \brief a unit of work handed out by chunk_scheduler
+ */
+struct scheduled_chunk {
+  unsigned file;    //!< index of source file
+  bool whole_file;  //!< whether the task is an entire unsplittable file
+  text_chunk chunk;  //!< claimed and filled chunk; ordinal 0 for whole files
+};
+
+/*!
+  \brief hand out chunks of many input files to a pool of workers
+
+  files are dealt to the workers in input order. each worker claims
+  chunks from one file at a time, taking the next of its own files
+  when that one runs out. a worker whose own files are all started
+  steals the last unstarted file of the worker with the most left,
+  and once no file is unstarted, joins the earliest file that still
+  has chunks. files that cannot be split on lines are handed out
+  whole. readers are opened on first use and closed once exhausted,
+  so only files in progress hold open connections.
+ */
+class chunk_scheduler {
+ public:
+  /*!
+    \brief constructor
+    @param filenames names of input files
+    @param splittable for each file, whether it is line-based text that
+    text_chunk_reader can split
+    @param n_workers number of workers that will request chunks
+    @param chunk_size approximate number of bytes per chunk
+   */
+  chunk_scheduler(const std::vector<std::string> &filenames,
+                  const std::vector<char> &splittable, unsigned n_workers,
+                  std::size_t chunk_size);
+  /*!
+    \brief constructor
+    @param filenames names of input files
+    @param splittable for each file, whether it is line-based text that
+    text_chunk_reader can split
+    @param n_workers number of workers that will request chunks
+    @param chunk_size approximate number of bytes per chunk
+    @param indexes for each file, null or a gzip_index given to its
+    text_chunk_reader; empty if no file has one
+   */
+  chunk_scheduler(const std::vector<std::string> &filenames,
+                  const std::vector<char> &splittable, unsigned n_workers,
+                  std::size_t chunk_size,
+                  const std::vector<gzip_index *> &indexes);
+  /*!
+    \brief destructor
+   */
+  ~chunk_scheduler() throw();
+  /*!
+    \brief claim the next unit of work for a worker
+    @param worker index of requesting worker
+    @param task destination for the claimed work
+    \return whether any work was left
+
+    chunk text is inflated before this returns. each worker index
+    must only be used by one thread at a time. while run is in
+    progress, this waits for earlier results to be consumed rather
+    than claim too far ahead of them.
+   */
+  bool next(unsigned worker, scheduled_chunk *task);
+  /*!
+    \brief get the number of chunks in a file, once it is known
+    @param file index of file
+    @param count destination for number of chunks
+    \return whether every chunk of the file has been claimed, so that
+    the count is final
+   */
+  bool get_chunk_count(unsigned file, unsigned *count) const;
+  /*!
+    \brief process every chunk on worker threads, and consume the
+    results in input order
+    @tparam result_type class of per-chunk results
+    @param process function computing the result of one chunk
+    @param consume function given each result in file and then chunk
+    order, with the index of its file
+    @param finish_file function called with the index of each file
+    once all of its results have been consumed
+
+    one worker thread is started per worker given to the constructor,
+    and consume and finish_file are called on the calling thread, so
+    slow consumers never hold up workers between chunks. completed
+    results wait in a reorder buffer until all earlier results have
+    been consumed. workers stop claiming once twice as many chunks as
+    there are workers are claimed and not yet consumed, unless the
+    next chunk to be consumed is still unclaimed, which bounds the
+    buffer. if any call
+    fails, the remaining workers stop and the first error is rethrown.
+   */
+  template <class result_type>
+  void run(
+      const std::function<void(const scheduled_chunk &, result_type *)>
+          &process,
+      const std::function<void(unsigned, result_type *)> &consume,
+      const std::function<void(unsigned)> &finish_file) {
+    unsigned n_files = _filenames.size();
+    std::map<std::pair<unsigned, unsigned>, result_type> pending;
+    std::pair<unsigned, unsigned> cursor(0, 0);
+    unsigned n_running = _current.size();
+    std::vector<std::exception_ptr> errors(_current.size() + 1);
+    {
+      std::lock_guard<std::mutex> guard(_lock);
+      _cursor_file = 0;
+      _outstanding = 0;
+      _max_outstanding = 2 * _current.size();
+      _stopping = false;
+      for (unsigned i = 0; i < n_files; ++i) _files.at(i)->outstanding = 0;
+    }
+    std::function<void()> stop = [&]() {
+      std::lock_guard<std::mutex> guard(_lock);
+      _stopping = true;
+      _changed.notify_all();
+    };
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < _current.size(); ++t) {
+      workers.push_back(std::thread([&, t]() {
+        try {
+          scheduled_chunk task;
+          while (next(t, &task)) {
+            result_type result = result_type();
+            process(task, &result);
+            std::lock_guard<std::mutex> guard(_lock);
+            pending[std::make_pair(task.file, task.chunk.ordinal)].swap(
+                result);
+            _changed.notify_all();
+          }
+        } catch (...) {
+          errors.at(t) = std::current_exception();
+          stop();
+        }
+        std::lock_guard<std::mutex> guard(_lock);
+        --n_running;
+        _changed.notify_all();
+      }));
+    }
+    try {
+      while (cursor.first < n_files) {
+        result_type result = result_type();
+        bool found = false, finished = false;
+        {
+          std::unique_lock<std::mutex> guard(_lock);
+          const file_state &state = *_files.at(cursor.first);
+          typename std::map<std::pair<unsigned, unsigned>,
+                            result_type>::iterator finder;
+          _changed.wait(guard, [&]() {
+            finder = pending.find(cursor);
+            found = finder != pending.end();
+            // the last chunk of a file can be consumed before its count
+            // is known
+            finished = state.exhausted && cursor.second >= state.n_chunks;
+            return _stopping || found || finished || !n_running;
+          });
+          if (_stopping || (!found && !finished)) break;
+          if (found) {
+            result.swap(finder->second);
+            pending.erase(finder);
+          }
+        }
+        if (found) {
+          consume(cursor.first, &result);
+          ++cursor.second;
+        } else {
+          finish_file(cursor.first);
+          ++cursor.first;
+          cursor.second = 0;
+        }
+        std::lock_guard<std::mutex> guard(_lock);
+        if (found) {
+          --_outstanding;
+          --_files.at(cursor.first)->outstanding;
+        } else {
+          _cursor_file = cursor.first;
+        }
+        _changed.notify_all();
+      }
+    } catch (...) {
+      errors.back() = std::current_exception();
+      stop();
+    }
+    for (std::vector<std::thread>::iterator iter = workers.begin();
+         iter != workers.end(); ++iter) {
+      iter->join();
+    }
+    {
+      std::lock_guard<std::mutex> guard(_lock);
+      _max_outstanding = 0;
+    }
+    for (std::vector<std::exception_ptr>::const_iterator iter =
+             errors.begin();
+         iter != errors.end(); ++iter) {
+      if (*iter) std::rethrow_exception(*iter);
+    }
+    if (cursor.first < n_files) {
+      throw std::logic_error("chunk_scheduler::run: chunks were lost");
+    }
+  }
+
+ private:
+  /*!
+    \brief claiming state of a single input file
+   */
+  struct file_state {
+    file_state();
+    std::once_flag opened;  //!< guards opening the reader
+    std::shared_ptr<text_chunk_reader> reader;  //!< open reader, if any
+    bool assigned;   //!< whether a worker has taken the file from a queue
+    bool exhausted;  //!< whether every chunk has been claimed
+    unsigned n_chunks;  //!< number of chunks, once exhausted
+    unsigned outstanding;  //!< chunks claimed and not yet consumed by run
+  };
+  /*!
+    \brief choose the next file for a worker
+    @param worker index of requesting worker
+    @param file destination for chosen file index
+    \return whether any file has work left
+
+    this must be called with the scheduler lock held
+   */
+  bool assign(unsigned worker, unsigned *file);
+  /*!
+    \brief claim the next chunk of a file
+    @param file index of file
+    @param task destination for the claimed work
+    \return whether the file had a chunk left
+   */
+  bool claim(unsigned file, scheduled_chunk *task);
+
+  std::vector<std::string> _filenames;  //!< names of input files
+  std::vector<char> _splittable;  //!< whether each file can be chunked
+  std::size_t _chunk_size;        //!< approximate bytes per chunk
+  std::vector<gzip_index *> _indexes;  //!< gzip index of each file, if any
+  std::vector<std::deque<unsigned> > _queues;  //!< unstarted files per worker
+  std::vector<unsigned> _current;  //!< file each worker is claiming from
+  std::vector<std::unique_ptr<file_state> > _files;  //!< per-file state
+  mutable std::mutex _lock;  //!< guards queues and file states
+  std::condition_variable _changed;  //!< signals progress of run
+  unsigned _cursor_file;  //!< earliest file run has not finished
+  unsigned _outstanding;  //!< chunks claimed and not yet consumed by run
+  unsigned _max_outstanding;  //!< limit on outstanding chunks; 0 if none
+  bool _stopping;  //!< whether run is abandoning the remaining work
+};
+}  // namespace imputed_data_dynamic_threshold
+
+#endif  // IMPUTED_DATA_DYNAMIC_THRESHOLD_TEXT_CHUNKS_H_
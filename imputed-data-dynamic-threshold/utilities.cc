@@ -7,6 +7,59 @@
 
 #include "imputed-data-dynamic-threshold/utilities.h"
 
+#ifndef IMPUTED_DATA_DYNAMIC_THRESHOLD_HAVE_FLOAT_FROM_CHARS
+namespace {
+/*!
+  \brief parse a floating point value with a strtod-like function in
+  the C locale
+  @tparam value_type floating point type
+  @param s string representation
+  @param convert strtof_l or strtod_l
+  @param res destination for parsed value
+  \return whether the entire view was a valid value
+ */
+template <class value_type>
+bool parse_c_locale(const std::string_view &s,
+                    value_type (*convert)(const char *, char **, locale_t),
+                    value_type *res) {
+  static const locale_t c_locale = newlocale(LC_ALL_MASK, "C", 0);
+  // std::from_chars takes no leading space, plus sign or hex prefix
+  std::string_view digits = s.substr(!s.empty() && s[0] == '-');
+  if (!c_locale || digits.empty() || isspace(digits[0]) ||
+      digits[0] == '+' ||
+      (digits.size() > 1 && digits[0] == '0' &&
+       (digits[1] == 'x' || digits[1] == 'X'))) {
+    return false;
+  }
+  // the text must be terminated, which fields of a line are not
+  char buffer[64];
+  std::string copy;
+  const char *text = buffer;
+  if (s.size() < sizeof(buffer)) {
+    memcpy(buffer, s.data(), s.size());
+    buffer[s.size()] = '\0';
+  } else {
+    copy.assign(s.data(), s.size());
+    text = copy.c_str();
+  }
+  char *end = 0;
+  errno = 0;
+  *res = convert(text, &end, c_locale);
+  return errno != ERANGE && end == text + s.size();
+}
+}  // namespace
+
+bool imputed_data_dynamic_threshold::parse_number(const std::string_view &s,
+                                                  float *res) {
+  return parse_c_locale<float>(s, strtof_l, res);
+}
+
+bool imputed_data_dynamic_threshold::parse_number(const std::string_view &s,
+                                                  double *res) {
+  return parse_c_locale<double>(s, strtod_l, res);
+}
+#endif
+
 bool imputed_data_dynamic_threshold::string_float_vector_equals(
     const std::vector<std::pair<std::string, float> > &v1,
     const std::vector<std::pair<std::string, float> > &v2) {
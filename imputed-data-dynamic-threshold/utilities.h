@@ -8,15 +8,27 @@
 #ifndef IMPUTED_DATA_DYNAMIC_THRESHOLD_UTILITIES_H_
 #define IMPUTED_DATA_DYNAMIC_THRESHOLD_UTILITIES_H_
 
+#include <locale.h>
+#include <stdlib.h>
+
+#include <cctype>
+#include <cerrno>
 #include <cfloat>
+#include <charconv>
 #include <cmath>
+#include <cstring>
 #include <fstream>
 #include <iterator>
 #include <sstream>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <system_error>
 #include <utility>
 #include <vector>
 
+#include "imputed-data-dynamic-threshold/config.h"
+
 namespace imputed_data_dynamic_threshold {
 /*!
   \brief convert object string representation to object
@@ -36,6 +48,61 @@ value_type from_string(const std::string &s) {
   return res;
 }
 
+/*!
+  \brief convert a numeric string view to a number without allocating
+  @tparam value_type arithmetic type
+  @param s string representation
+  \return numeric version of string
+
+  unlike from_string, parsing is locale-independent and the entire
+  view must be consumed
+ */
+/*!
+  \brief parse a numeric string view with std::from_chars
+  @tparam value_type arithmetic type
+  @param s string representation
+  @param res destination for parsed value
+  \return whether the entire view was a valid value
+ */
+template <class value_type>
+bool parse_number(const std::string_view &s, value_type *res) {
+  std::from_chars_result parsed =
+      std::from_chars(s.data(), s.data() + s.size(), *res);
+  return parsed.ec == std::errc() && parsed.ptr == s.data() + s.size();
+}
+
+#ifndef IMPUTED_DATA_DYNAMIC_THRESHOLD_HAVE_FLOAT_FROM_CHARS
+/*!
+  \brief parse a float in the C locale, for standard libraries whose
+  std::from_chars only handles integers
+  @param s string representation
+  @param res destination for parsed value
+  \return whether the entire view was a valid value, in the format
+  std::from_chars accepts
+ */
+bool parse_number(const std::string_view &s, float *res);
+/*!
+  \brief parse a double in the C locale, for standard libraries whose
+  std::from_chars only handles integers
+  @param s string representation
+  @param res destination for parsed value
+  \return whether the entire view was a valid value, in the format
+  std::from_chars accepts
+ */
+bool parse_number(const std::string_view &s, double *res);
+#endif
+
+template <class value_type>
+value_type from_string_view(const std::string_view &s) {
+  value_type res = value_type();
+  if (!parse_number(s, &res))
+    throw std::runtime_error(
+        "cannot convert string "
+        "to object: \"" +
+        std::string(s) + "\"");
+  return res;
+}
+
 /*!
   \brief compare two pair(string, float) vectors for approximate equality
   @param v1 first vector for comparison
@@ -0,0 +1,103 @@
+/*!
+  \file variant_batch.cc
+  \brief implementation of columnar variant batches
+  \copyright Released under the MIT License. Copyright
+  2023 Lightning Auriga
+ */
+
+#include "imputed-data-dynamic-threshold/variant_batch.h"
+
+namespace iddt = imputed_data_dynamic_threshold;
+
+iddt::variant_batch::variant_batch(unsigned capacity)
+    : _capacity(capacity),
+      _size(0),
+      _r2(capacity),
+      _frequencies(capacity),
+      _imputed((capacity + 63) / 64),
+      _id_ends(capacity) {
+  if (!_capacity) {
+    throw std::logic_error("variant_batch: capacity must be positive");
+  }
+}
+
+iddt::variant_batch::variant_batch(const variant_batch &obj)
+    : _capacity(obj._capacity),
+      _size(obj._size),
+      _r2(obj._r2),
+      _frequencies(obj._frequencies),
+      _imputed(obj._imputed),
+      _id_ends(obj._id_ends),
+      _id_text(obj._id_text) {}
+
+iddt::variant_batch::~variant_batch() throw() {}
+
+void iddt::variant_batch::add_imputed(const float &r2, const double &frequency,
+                                      const std::string_view &id) {
+  if (full()) {
+    throw std::logic_error("variant_batch::add_imputed: batch is full");
+  }
+  // columns are preallocated, and the bitmap is cleared by clear()
+  _imputed[_size / 64] |= 1ULL << (_size % 64);
+  _r2[_size] = r2;
+  _frequencies[_size] = frequency;
+  if (!id.empty()) _id_text.append(id.data(), id.size());
+  _id_ends[_size++] = _id_text.size();
+}
+
+void iddt::variant_batch::add_typed(const std::string_view &id) {
+  if (full()) {
+    throw std::logic_error("variant_batch::add_typed: batch is full");
+  }
+  _r2[_size] = 0.0f;
+  _frequencies[_size] = 0.0;
+  if (!id.empty()) _id_text.append(id.data(), id.size());
+  _id_ends[_size++] = _id_text.size();
+}
+
+void iddt::variant_batch::clear() {
+  std::fill(_imputed.begin(), _imputed.begin() + (_size + 63) / 64, 0);
+  _size = 0;
+  _id_text.clear();
+}
+
+void iddt::variant_batch::swap(variant_batch &obj) {
+  std::swap(_capacity, obj._capacity);
+  std::swap(_size, obj._size);
+  _r2.swap(obj._r2);
+  _frequencies.swap(obj._frequencies);
+  _imputed.swap(obj._imputed);
+  _id_ends.swap(obj._id_ends);
+  _id_text.swap(obj._id_text);
+}
+
+unsigned iddt::variant_batch::size() const { return _size; }
+
+bool iddt::variant_batch::full() const { return _size >= _capacity; }
+
+bool iddt::variant_batch::is_imputed(unsigned i) const {
+  if (i >= _size) {
+    throw std::out_of_range("variant_batch::is_imputed: invalid index");
+  }
+  return (_imputed[i / 64] >> (i % 64)) & 1;
+}
+
+const float *iddt::variant_batch::get_r2() const { return _r2.data(); }
+
+const double *iddt::variant_batch::get_frequencies() const {
+  return _frequencies.data();
+}
+
+const std::uint64_t *iddt::variant_batch::get_imputed() const {
+  return _imputed.data();
+}
+
+bool iddt::variant_batch::has_ids() const { return !_id_text.empty(); }
+
+std::string_view iddt::variant_batch::get_id(unsigned i) const {
+  if (i >= _size) {
+    throw std::out_of_range("variant_batch::get_id: invalid index");
+  }
+  std::size_t begin = i ? _id_ends[i - 1] : 0;
+  return std::string_view(_id_text.data() + begin, _id_ends[i] - begin);
+}
@@ -0,0 +1,123 @@
+/*!
+  \file variant_batch.h
+  \brief fixed-size columnar batches of parsed variants
+  \copyright Released under the MIT License. Copyright
+  2023 Lightning Auriga
+ */
+
+#ifndef IMPUTED_DATA_DYNAMIC_THRESHOLD_VARIANT_BATCH_H_
+#define IMPUTED_DATA_DYNAMIC_THRESHOLD_VARIANT_BATCH_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace imputed_data_dynamic_threshold {
+/*!
+  \brief parsed variants stored column by column
+
+  readers fill a batch with the fields needed for binning, and
+  r2_bins::add_batch then filters, bins and stores the whole batch
+  with loops over each column. variant IDs are copied into a single
+  buffer owned by the batch, so a batch can span reads that reuse
+  the input buffer.
+ */
+class variant_batch {
+ public:
+  /*!
+    \brief constructor
+    @param capacity maximum number of variants held at once
+   */
+  explicit variant_batch(unsigned capacity);
+  /*!
+    \brief copy constructor
+    @param obj existing variant_batch object
+   */
+  variant_batch(const variant_batch &obj);
+  /*!
+    \brief destructor
+   */
+  ~variant_batch() throw();
+  /*!
+    \brief add an imputed variant
+    @param r2 estimated r2
+    @param frequency MAF, or allele frequency to be folded to MAF
+    @param id variant ID, or empty if IDs are not stored
+   */
+  void add_imputed(const float &r2, const double &frequency,
+                   const std::string_view &id);
+  /*!
+    \brief add a typed variant
+    @param id variant ID
+   */
+  void add_typed(const std::string_view &id);
+  /*!
+    \brief remove all variants
+   */
+  void clear();
+  /*!
+    \brief exchange contents with another batch
+    @param obj batch with which to exchange contents
+
+    this hands a filled batch to another thread without copying
+   */
+  void swap(variant_batch &obj);
+  /*!
+    \brief get number of variants held
+    \return number of variants held
+   */
+  unsigned size() const;
+  /*!
+    \brief test whether the batch has no more room
+    \return whether the batch is at capacity
+   */
+  bool full() const;
+  /*!
+    \brief test whether a variant is imputed
+    @param i index of variant
+    \return whether the variant is imputed, as opposed to typed
+   */
+  bool is_imputed(unsigned i) const;
+  /*!
+    \brief get r2 column
+    \return r2 of each of the size() variants; 0 for typed variants
+   */
+  const float *get_r2() const;
+  /*!
+    \brief get frequency column
+    \return frequency of each of the size() variants; 0 for typed
+    variants
+   */
+  const double *get_frequencies() const;
+  /*!
+    \brief get imputation indicator column
+    \return bitmap of imputed variants, 64 variants per word
+   */
+  const std::uint64_t *get_imputed() const;
+  /*!
+    \brief test whether any variant has a non-empty ID
+    \return whether any variant has a non-empty ID
+   */
+  bool has_ids() const;
+  /*!
+    \brief get the ID of a variant
+    @param i index of variant
+    \return view of variant ID, valid until the batch is cleared
+   */
+  std::string_view get_id(unsigned i) const;
+
+ private:
+  unsigned _capacity;                   //!< maximum number of variants
+  unsigned _size;                       //!< number of variants held
+  std::vector<float> _r2;               //!< r2 column
+  std::vector<double> _frequencies;     //!< frequency column
+  std::vector<std::uint64_t> _imputed;  //!< imputation indicator bitmap
+  std::vector<std::size_t> _id_ends;    //!< end of each ID in _id_text
+  std::string _id_text;                 //!< concatenated variant IDs
+};
+}  // namespace imputed_data_dynamic_threshold
+
+#endif  // IMPUTED_DATA_DYNAMIC_THRESHOLD_VARIANT_BATCH_H_
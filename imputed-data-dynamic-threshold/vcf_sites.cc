@@ -0,0 +1,404 @@
+/*!
+  \file vcf_sites.cc
+  \brief implementation of site-level text vcf reading
+  \copyright Released under the MIT License. Copyright
+  2023 Lightning Auriga
+ */
+
+#include "imputed-data-dynamic-threshold/vcf_sites.h"
+
+namespace iddt = imputed_data_dynamic_threshold;
+
+iddt::vcf_info_scanner::vcf_info_scanner(const std::string &r2_info_field,
+                                         const std::string &maf_info_field,
+                                         const std::string &imputed_info_field)
+    : _r2_info_field(r2_info_field),
+      _maf_info_field(maf_info_field),
+      _imputed_info_field(imputed_info_field) {}
+
+iddt::vcf_info_scanner::vcf_info_scanner(const vcf_info_scanner &obj)
+    : _r2_info_field(obj._r2_info_field),
+      _maf_info_field(obj._maf_info_field),
+      _imputed_info_field(obj._imputed_info_field) {}
+
+iddt::vcf_info_scanner::~vcf_info_scanner() throw() {}
+
+const char *iddt::vcf_info_scanner::find_info_end(const char *begin,
+                                                  const char *end) {
+  unsigned n_tabs = 0;
+  for (const char *ptr = begin; ptr < end; ++ptr) {
+    if (*ptr == '\n') return ptr;
+    if (*ptr == '\t' && ++n_tabs == 8) return ptr;
+  }
+  return NULL;
+}
+
+void iddt::vcf_info_scanner::scan(const char *begin, const char *info_end,
+                                  vcf_site *site) const {
+  if (!site) {
+    throw std::logic_error("vcf_info_scanner::scan: null pointer");
+  }
+  // locate ID (column 3) and INFO (column 8)
+  const char *columns[8] = {begin};
+  unsigned n_columns = 1;
+  for (const char *ptr = begin; ptr < info_end && n_columns < 8; ++ptr) {
+    if (*ptr == '\t') columns[n_columns++] = ptr + 1;
+  }
+  if (n_columns < 8) {
+    throw std::runtime_error("vcf_info_scanner::scan: record \"" +
+                             std::string(begin, info_end) +
+                             "\" has fewer than eight columns");
+  }
+  site->id = std::string_view(columns[2], columns[3] - columns[2] - 1);
+  site->has_r2 = site->has_af = site->imputed = false;
+  const char *info = columns[7];
+  if (info_end - info == 1 && *info == '.') return;
+  while (info < info_end) {
+    const char *tag_end = static_cast<const char *>(
+        memchr(info, ';', info_end - info));
+    if (!tag_end) tag_end = info_end;
+    const char *key_end = static_cast<const char *>(
+        memchr(info, '=', tag_end - info));
+    if (!key_end) key_end = tag_end;
+    std::string_view key(info, key_end - info);
+    if (!key.compare(_imputed_info_field)) {
+      site->imputed = true;
+    } else if (key_end != tag_end) {
+      if (!key.compare(_r2_info_field)) {
+        site->has_r2 = parse_first_float(key_end + 1, tag_end, &site->r2);
+      } else if (!key.compare(_maf_info_field)) {
+        site->has_af = parse_first_float(key_end + 1, tag_end, &site->af);
+      }
+    }
+    info = tag_end + 1;
+  }
+}
+
+bool iddt::vcf_info_scanner::parse_first_float(const char *begin,
+                                               const char *end,
+                                               float *value) const {
+  const char *comma =
+      static_cast<const char *>(memchr(begin, ',', end - begin));
+  if (comma) end = comma;
+  if (end - begin == 1 && *begin == '.') return false;
+  *value = from_string_view<float>(std::string_view(begin, end - begin));
+  return true;
+}
+
+iddt::vcf_site_reader::vcf_site_reader(const std::string &filename,
+                                       const vcf_info_scanner &scanner)
+    : vcf_site_reader(filename, scanner, 0) {}
+
+iddt::vcf_site_reader::vcf_site_reader(const std::string &filename,
+                                       const vcf_info_scanner &scanner,
+                                       const decompression_pool *pool)
+    : _filename(filename),
+      _scanner(scanner),
+      _input(0),
+      _buffer(1 << 20),
+      _begin(0),
+      _end(0),
+      _skip_pending(false) {
+  if (!pool && parallel_gzip_reader::detect_gzip(_filename)) {
+    _stream.reset(new gzip_stream_reader(_filename));
+    return;
+  }
+  _input = bgzf_open(_filename.c_str(), "r");
+  if (!_input) {
+    throw std::runtime_error("cannot read file \"" + _filename + "\"");
+  }
+  if (pool) {
+    try {
+      pool->attach(_input);
+    } catch (...) {
+      bgzf_close(_input);
+      throw;
+    }
+  }
+}
+
+iddt::vcf_site_reader::~vcf_site_reader() throw() {
+  if (_input) bgzf_close(_input);
+}
+
+bool iddt::vcf_site_reader::is_text_vcf(const std::string &filename) {
+  const std::string magic = "##fileformat=VCF";
+  char buffer[16];
+  gzFile input = gzopen(filename.c_str(), "rb");
+  if (!input) return false;
+  int n = gzread(input, buffer, magic.size());
+  gzclose(input);
+  return n == static_cast<int>(magic.size()) &&
+         !magic.compare(0, magic.size(), buffer, n);
+}
+
+bool iddt::vcf_site_reader::fill() {
+  if (_begin) {
+    std::copy(_buffer.begin() + _begin, _buffer.begin() + _end,
+              _buffer.begin());
+    _end -= _begin;
+    _begin = 0;
+  }
+  if (_end == _buffer.size()) _buffer.resize(_buffer.size() * 2);
+  ssize_t n =
+      _stream ? static_cast<ssize_t>(_stream->read(
+                    _buffer.data() + _end, _buffer.size() - _end))
+              : bgzf_read(_input, _buffer.data() + _end, _buffer.size() - _end);
+  if (n < 0) {
+    throw std::runtime_error("cannot read file \"" + _filename + "\"");
+  }
+  _end += n;
+  return n > 0;
+}
+
+void iddt::vcf_site_reader::skip_line() {
+  while (true) {
+    const char *data = _buffer.data();
+    const char *newline = static_cast<const char *>(
+        memchr(data + _begin, '\n', _end - _begin));
+    if (newline) {
+      _begin = newline - data + 1;
+      return;
+    }
+    // sample data are discarded without being kept in the buffer
+    _begin = _end;
+    if (!fill()) return;
+  }
+}
+
+bool iddt::vcf_site_reader::next_site(vcf_site *site) {
+  if (_skip_pending) {
+    skip_line();
+    _skip_pending = false;
+  }
+  while (true) {
+    if (_begin == _end && !fill()) return false;
+    const char *begin = _buffer.data() + _begin;
+    const char *end = _buffer.data() + _end;
+    if (*begin == '#' || *begin == '\n') {
+      skip_line();
+      continue;
+    }
+    const char *info_end = vcf_info_scanner::find_info_end(begin, end);
+    if (!info_end) {
+      if (fill()) continue;
+      // unterminated final record
+      info_end = end;
+    }
+    _scanner.scan(begin, info_end, site);
+    _begin = info_end - _buffer.data();
+    _skip_pending = true;
+    return true;
+  }
+}
+
+iddt::bcf_info_scanner::bcf_info_scanner(int r2_id, int maf_id,
+                                         int imputed_id)
+    : _r2_id(r2_id), _maf_id(maf_id), _imputed_id(imputed_id) {}
+
+iddt::bcf_info_scanner::bcf_info_scanner(const bcf_info_scanner &obj)
+    : _r2_id(obj._r2_id),
+      _maf_id(obj._maf_id),
+      _imputed_id(obj._imputed_id) {}
+
+iddt::bcf_info_scanner::~bcf_info_scanner() throw() {}
+
+void iddt::bcf_info_scanner::scan(const char *begin, const char *end,
+                                  unsigned n_allele, unsigned n_info,
+                                  vcf_site *site) const {
+  if (!site) {
+    throw std::logic_error("bcf_info_scanner::scan: null pointer");
+  }
+  int type = 0;
+  unsigned size = 0;
+  const char *ptr = read_type(begin, end, &type, &size);
+  if (type != BCF_BT_CHAR && size) {
+    throw std::runtime_error("bcf_info_scanner::scan: malformed variant ID");
+  }
+  // a missing ID is stored as an empty string
+  site->id = size ? std::string_view(ptr, size) : std::string_view(".");
+  ptr = skip_values(ptr, end, type, size);
+  // alleles, then filters
+  for (unsigned i = 0; i <= n_allele; ++i) {
+    ptr = read_type(ptr, end, &type, &size);
+    ptr = skip_values(ptr, end, type, size);
+  }
+  site->has_r2 = site->has_af = site->imputed = false;
+  std::int32_t key = 0;
+  for (unsigned i = 0; i < n_info; ++i) {
+    ptr = read_type(ptr, end, &type, &size);
+    if (size != 1) {
+      throw std::runtime_error("bcf_info_scanner::scan: malformed INFO key");
+    }
+    ptr = read_int(ptr, end, type, &key);
+    ptr = read_type(ptr, end, &type, &size);
+    const char *values = ptr;
+    ptr = skip_values(ptr, end, type, size);
+    if (key == _imputed_id) {
+      site->imputed = true;
+    } else if (key == _r2_id) {
+      site->has_r2 = first_float(values, type, size, &site->r2);
+    } else if (key == _maf_id) {
+      site->has_af = first_float(values, type, size, &site->af);
+    }
+  }
+}
+
+const char *iddt::bcf_info_scanner::read_type(const char *ptr,
+                                              const char *end, int *type,
+                                              unsigned *size) {
+  if (ptr >= end) {
+    throw std::runtime_error("bcf_info_scanner: truncated bcf record");
+  }
+  unsigned char descriptor = static_cast<unsigned char>(*ptr++);
+  *type = descriptor & 0x0f;
+  *size = descriptor >> 4;
+  // vectors of 15 or more values give their length as a typed integer
+  if (*size == 15) {
+    int size_type = 0;
+    unsigned n = 0;
+    std::int32_t value = 0;
+    ptr = read_type(ptr, end, &size_type, &n);
+    if (n != 1) {
+      throw std::runtime_error("bcf_info_scanner: malformed vector length");
+    }
+    ptr = read_int(ptr, end, size_type, &value);
+    if (value < 0) {
+      throw std::runtime_error("bcf_info_scanner: malformed vector length");
+    }
+    *size = static_cast<unsigned>(value);
+  }
+  return ptr;
+}
+
+const char *iddt::bcf_info_scanner::read_int(const char *ptr, const char *end,
+                                             int type, std::int32_t *value) {
+  if (type != BCF_BT_INT8 && type != BCF_BT_INT16 && type != BCF_BT_INT32) {
+    throw std::runtime_error("bcf_info_scanner: expected an integer");
+  }
+  unsigned width = type_width(type);
+  if (end - ptr < static_cast<std::ptrdiff_t>(width)) {
+    throw std::runtime_error("bcf_info_scanner: truncated bcf record");
+  }
+  // bcf is little-endian regardless of host
+  std::uint32_t bits = 0;
+  for (unsigned i = 0; i < width; ++i) {
+    bits |= static_cast<std::uint32_t>(static_cast<unsigned char>(ptr[i]))
+            << (8 * i);
+  }
+  if (width == 1) {
+    *value = static_cast<std::int8_t>(bits);
+  } else if (width == 2) {
+    *value = static_cast<std::int16_t>(bits);
+  } else {
+    *value = static_cast<std::int32_t>(bits);
+  }
+  return ptr + width;
+}
+
+unsigned iddt::bcf_info_scanner::type_width(int type) {
+  switch (type) {
+    case BCF_BT_NULL:
+      return 0;
+    case BCF_BT_INT8:
+    case BCF_BT_CHAR:
+      return 1;
+    case BCF_BT_INT16:
+      return 2;
+    case BCF_BT_INT32:
+    case BCF_BT_FLOAT:
+      return 4;
+    default:
+      throw std::runtime_error("bcf_info_scanner: unsupported value type");
+  }
+}
+
+const char *iddt::bcf_info_scanner::skip_values(const char *ptr,
+                                                const char *end, int type,
+                                                unsigned size) {
+  std::size_t n_bytes = static_cast<std::size_t>(size) * type_width(type);
+  if (static_cast<std::size_t>(end - ptr) < n_bytes) {
+    throw std::runtime_error("bcf_info_scanner: truncated bcf record");
+  }
+  return ptr + n_bytes;
+}
+
+bool iddt::bcf_info_scanner::first_float(const char *ptr, int type,
+                                         unsigned size, float *value) {
+  if (type != BCF_BT_FLOAT || !size) return false;
+  std::uint32_t bits = 0;
+  for (unsigned i = 0; i < 4; ++i) {
+    bits |= static_cast<std::uint32_t>(static_cast<unsigned char>(ptr[i]))
+            << (8 * i);
+  }
+  // missing and vector end are signalling NaNs, so compare bits
+  if (bits == bcf_float_missing || bits == bcf_float_vector_end) return false;
+  memcpy(value, &bits, sizeof(bits));
+  return true;
+}
+
+iddt::bcf_site_reader::bcf_site_reader(const std::string &filename,
+                                       const std::string &r2_info_field,
+                                       const std::string &maf_info_field,
+                                       const std::string &imputed_info_field,
+                                       const decompression_pool *pool)
+    : _filename(filename),
+      _input(0),
+      _header(0),
+      _record(0),
+      _scanner(-1, -1, -1) {
+  try {
+    hts_set_log_level(HTS_LOG_OFF);
+    _input = hts_open(_filename.c_str(), "r");
+    if (!_input) {
+      throw std::runtime_error("cannot read file \"" + _filename + "\"");
+    }
+    if (pool) pool->attach(_input);
+    _header = bcf_hdr_read(_input);
+    if (!_header) {
+      throw std::runtime_error("cannot read header of file \"" + _filename +
+                               "\"");
+    }
+    hts_set_log_level(HTS_LOG_WARNING);
+    _record = bcf_init();
+    if (!_record) throw std::bad_alloc();
+    _scanner = bcf_info_scanner(find_info_tag(r2_info_field),
+                                find_info_tag(maf_info_field),
+                                find_info_tag(imputed_info_field));
+  } catch (...) {
+    hts_set_log_level(HTS_LOG_WARNING);
+    close();
+    throw;
+  }
+}
+
+iddt::bcf_site_reader::~bcf_site_reader() throw() { close(); }
+
+void iddt::bcf_site_reader::close() {
+  if (_record) bcf_destroy(_record);
+  _record = 0;
+  if (_header) bcf_hdr_destroy(_header);
+  _header = 0;
+  if (_input) hts_close(_input);
+  _input = 0;
+}
+
+int iddt::bcf_site_reader::find_info_tag(const std::string &tag) const {
+  int id = bcf_hdr_id2int(_header, BCF_DT_ID, tag.c_str());
+  return bcf_hdr_idinfo_exists(_header, BCF_HL_INFO, id) ? id : -1;
+}
+
+bool iddt::bcf_site_reader::next_site(vcf_site *site) {
+  if (!site) {
+    throw std::logic_error("bcf_site_reader::next_site: null pointer");
+  }
+  int res = bcf_read(_input, _header, _record);
+  if (res == -1) return false;
+  if (res < -1) {
+    throw std::runtime_error("cannot read file \"" + _filename + "\"");
+  }
+  // the record is left packed; only its shared block is read
+  _scanner.scan(_record->shared.s, _record->shared.s + _record->shared.l,
+                _record->n_allele, _record->n_info, site);
+  return true;
+}
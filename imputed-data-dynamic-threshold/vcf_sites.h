@@ -0,0 +1,335 @@
+/*!
+  \file vcf_sites.h
+  \brief read site-level INFO data from text vcf without parsing samples
+  \copyright Released under the MIT License. Copyright
+  2023 Lightning Auriga
+ */
+
+#ifndef IMPUTED_DATA_DYNAMIC_THRESHOLD_VCF_SITES_H_
+#define IMPUTED_DATA_DYNAMIC_THRESHOLD_VCF_SITES_H_
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "htslib/bgzf.h"
+#include "htslib/hts.h"
+#include "htslib/vcf.h"
+#include "imputed-data-dynamic-threshold/decompression_pool.h"
+#include "imputed-data-dynamic-threshold/text_chunks.h"
+#include "imputed-data-dynamic-threshold/utilities.h"
+
+namespace imputed_data_dynamic_threshold {
+/*!
+  \brief the subset of a vcf record used for r2 binning
+ */
+struct vcf_site {
+  std::string_view id;  //!< contents of the ID column
+  float r2;             //!< first value of the r2 INFO tag
+  float af;             //!< first value of the allele frequency INFO tag
+  bool has_r2;          //!< whether the r2 INFO tag has a value
+  bool has_af;          //!< whether the allele frequency INFO tag has a value
+  bool imputed;         //!< whether the imputation INFO flag is present
+};
+
+/*!
+  \brief extract configured INFO tags from the first eight vcf columns
+
+  only the ID and INFO columns are inspected, and nothing past the
+  INFO column is ever read, so the cost of a record does not depend
+  on the number of samples.
+ */
+class vcf_info_scanner {
+ public:
+  /*!
+    \brief constructor
+    @param r2_info_field name of info field containing estimated r2
+    @param maf_info_field name of info field containing estimated allele
+    frequency
+    @param imputed_info_field name of info indicator of whether variant is
+    imputed
+   */
+  vcf_info_scanner(const std::string &r2_info_field,
+                   const std::string &maf_info_field,
+                   const std::string &imputed_info_field);
+  /*!
+    \brief copy constructor
+    @param obj existing vcf_info_scanner object
+   */
+  vcf_info_scanner(const vcf_info_scanner &obj);
+  /*!
+    \brief destructor
+   */
+  ~vcf_info_scanner() throw();
+  /*!
+    \brief find the end of the INFO column of a record
+    @param begin start of the record
+    @param end end of available data
+    \return pointer to the tab or newline ending the INFO column, or
+    NULL if the data ends first
+
+    a record with fewer than eight columns ends at its newline, and is
+    rejected by scan.
+   */
+  static const char *find_info_end(const char *begin, const char *end);
+  /*!
+    \brief extract site data from a record
+    @param begin start of the record
+    @param info_end end of the INFO column, from find_info_end
+    @param site destination for extracted data; its ID refers to
+    the input buffer
+   */
+  void scan(const char *begin, const char *info_end, vcf_site *site) const;
+
+ private:
+  /*!
+    \brief parse the first value of a numeric INFO tag
+    @param begin start of the tag value
+    @param end end of the tag value
+    @param value destination for parsed value
+    \return whether a non-missing value was present
+   */
+  bool parse_first_float(const char *begin, const char *end,
+                         float *value) const;
+  std::string _r2_info_field;       //!< name of r2 INFO tag
+  std::string _maf_info_field;      //!< name of allele frequency INFO tag
+  std::string _imputed_info_field;  //!< name of imputation INFO flag
+};
+
+/*!
+  \brief stream the sites of a text vcf, skipping header and sample data
+
+  the input may be flat, gzipped, or bgzipped. compressed input is
+  read ahead by a gzip_stream_reader, unless bgzf blocks are inflated
+  on a thread pool. sample columns are passed over with a newline
+  search and are never held in memory beyond a single read buffer.
+ */
+class vcf_site_reader {
+ public:
+  /*!
+    \brief constructor
+    @param filename name of text vcf file
+    @param scanner configured INFO scanner
+   */
+  vcf_site_reader(const std::string &filename,
+                  const vcf_info_scanner &scanner);
+  /*!
+    \brief constructor, inflating bgzipped input on a thread pool
+    @param filename name of text vcf file
+    @param scanner configured INFO scanner
+    @param pool shared decompression threads, or null to inflate on
+    the reading thread
+   */
+  vcf_site_reader(const std::string &filename,
+                  const vcf_info_scanner &scanner,
+                  const decompression_pool *pool);
+  /*!
+    \brief destructor
+   */
+  ~vcf_site_reader() throw();
+  /*!
+    \brief read the next record of the file
+    @param site destination for site data; its ID is only valid until
+    the next call
+    \return whether a record was read
+   */
+  bool next_site(vcf_site *site);
+  /*!
+    \brief test whether a file is text vcf, as opposed to bcf
+    @param filename name of file to test
+    \return whether the file starts with a text vcf fileformat line
+   */
+  static bool is_text_vcf(const std::string &filename);
+
+ private:
+  /*!
+    \brief copy constructor; disabled
+    @param obj existing vcf_site_reader object
+   */
+  vcf_site_reader(const vcf_site_reader &obj);
+  /*!
+    \brief move unread data to the front of the buffer and read more
+    \return whether any data were read
+   */
+  bool fill();
+  /*!
+    \brief discard data through the next newline
+   */
+  void skip_line();
+  std::string _filename;      //!< name of input file
+  vcf_info_scanner _scanner;  //!< INFO tag scanner
+  BGZF *_input;               //!< open read connection, if used
+  std::unique_ptr<gzip_stream_reader>
+      _stream;  //!< compressed input read ahead, if used
+  std::vector<char> _buffer;  //!< read buffer
+  std::size_t _begin;         //!< offset of first unread byte in buffer
+  std::size_t _end;           //!< offset past last read byte in buffer
+  bool _skip_pending;  //!< whether the rest of the last record is unread
+};
+
+/*!
+  \brief extract configured INFO tags from the shared block of a bcf
+  record
+
+  the block is walked in place: the ID is viewed where it lies, and
+  alleles, filters and unconfigured INFO values are skipped by their
+  encoded sizes without being decoded. the sample block is never
+  touched.
+ */
+class bcf_info_scanner {
+ public:
+  /*!
+    \brief constructor
+    @param r2_id header ID of r2 INFO tag, or -1 if undeclared
+    @param maf_id header ID of allele frequency INFO tag, or -1 if
+    undeclared
+    @param imputed_id header ID of imputation INFO flag, or -1 if
+    undeclared
+   */
+  bcf_info_scanner(int r2_id, int maf_id, int imputed_id);
+  /*!
+    \brief copy constructor
+    @param obj existing bcf_info_scanner object
+   */
+  bcf_info_scanner(const bcf_info_scanner &obj);
+  /*!
+    \brief destructor
+   */
+  ~bcf_info_scanner() throw();
+  /*!
+    \brief extract site data from a shared block
+    @param begin start of the shared block, just past the fixed fields
+    @param end end of the shared block
+    @param n_allele number of alleles in the record
+    @param n_info number of INFO tags in the record
+    @param site destination for extracted data; its ID refers to
+    the shared block
+   */
+  void scan(const char *begin, const char *end, unsigned n_allele,
+            unsigned n_info, vcf_site *site) const;
+
+ private:
+  /*!
+    \brief read the type descriptor of a typed value
+    @param ptr start of the descriptor
+    @param end end of the shared block
+    @param type destination for bcf type code
+    @param size destination for number of values
+    \return pointer to the first value
+   */
+  static const char *read_type(const char *ptr, const char *end, int *type,
+                               unsigned *size);
+  /*!
+    \brief read a single integer of a bcf integer type
+    @param ptr start of the integer
+    @param end end of the shared block
+    @param type bcf type code of the integer
+    @param value destination for the integer
+    \return pointer past the integer
+   */
+  static const char *read_int(const char *ptr, const char *end, int type,
+                              std::int32_t *value);
+  /*!
+    \brief get the number of bytes of a single value of a bcf type
+    @param type bcf type code
+    \return number of bytes of one value
+   */
+  static unsigned type_width(int type);
+  /*!
+    \brief skip the values of a typed vector
+    @param ptr start of the first value
+    @param end end of the shared block
+    @param type bcf type code of the vector
+    @param size number of values in the vector
+    \return pointer past the vector
+   */
+  static const char *skip_values(const char *ptr, const char *end, int type,
+                                 unsigned size);
+  /*!
+    \brief get the first value of a typed float vector
+    @param ptr start of the first value
+    @param type bcf type code of the vector
+    @param size number of values in the vector
+    @param value destination for the value
+    \return whether a non-missing float value was present
+   */
+  static bool first_float(const char *ptr, int type, unsigned size,
+                          float *value);
+  int _r2_id;       //!< header ID of r2 INFO tag, or -1
+  int _maf_id;      //!< header ID of allele frequency INFO tag, or -1
+  int _imputed_id;  //!< header ID of imputation INFO flag, or -1
+};
+
+/*!
+  \brief stream the sites of a bcf, reading INFO tags by header ID
+
+  tag names are resolved to header IDs once when the file is opened,
+  and each record's shared block is then walked by bcf_info_scanner,
+  so records are never unpacked and no per-record dictionary lookups
+  are made. text vcf is also accepted, though vcf_site_reader is
+  faster for it.
+ */
+class bcf_site_reader {
+ public:
+  /*!
+    \brief constructor
+    @param filename name of bcf or vcf file
+    @param r2_info_field name of info field containing estimated r2
+    @param maf_info_field name of info field containing estimated allele
+    frequency
+    @param imputed_info_field name of info indicator of whether variant is
+    imputed
+    @param pool shared decompression threads, or null to inflate on
+    the reading thread
+   */
+  bcf_site_reader(const std::string &filename,
+                  const std::string &r2_info_field,
+                  const std::string &maf_info_field,
+                  const std::string &imputed_info_field,
+                  const decompression_pool *pool);
+  /*!
+    \brief destructor
+   */
+  ~bcf_site_reader() throw();
+  /*!
+    \brief read the next record of the file
+    @param site destination for site data; its ID is only valid until
+    the next call
+    \return whether a record was read
+   */
+  bool next_site(vcf_site *site);
+
+ private:
+  /*!
+    \brief copy constructor; disabled
+    @param obj existing bcf_site_reader object
+   */
+  bcf_site_reader(const bcf_site_reader &obj);
+  /*!
+    \brief release all htslib resources
+   */
+  void close();
+  /*!
+    \brief find the header ID of an INFO tag
+    @param tag name of INFO tag
+    \return header ID of tag, or -1 if the header does not declare it
+   */
+  int find_info_tag(const std::string &tag) const;
+  std::string _filename;      //!< name of input file
+  htsFile *_input;            //!< open read connection
+  bcf_hdr_t *_header;         //!< file header
+  bcf1_t *_record;            //!< current record
+  bcf_info_scanner _scanner;  //!< INFO tag scanner, with resolved tag IDs
+};
+}  // namespace imputed_data_dynamic_threshold
+
+#endif  // IMPUTED_DATA_DYNAMIC_THRESHOLD_VCF_SITES_H_
@@ -153,7 +153,7 @@ TEST_F(integrationTest, infoInputOnePass) {
   std::string filter_info_files_dir = _out_tmpdir;
   ex.run(maf_bin_boundaries, info_files, vcf_files, target_r2, baseline_r2,
          output_table_filename, output_list_filename, second_pass,
-         filter_info_files_dir, "", "", "");
+         filter_info_files_dir, "", "", "", 1, false, "", false);
   EXPECT_TRUE(boost::filesystem::exists(output_table_filename));
   EXPECT_TRUE(boost::filesystem::is_regular_file(output_table_filename));
   EXPECT_TRUE(boost::filesystem::exists(output_list_filename));
@@ -205,7 +205,7 @@ TEST_F(integrationTest, infoInputTwoPasses) {
   std::string filter_info_files_dir = _out_tmpdir;
   ex.run(maf_bin_boundaries, info_files, vcf_files, target_r2, baseline_r2,
          output_table_filename, output_list_filename, second_pass,
-         filter_info_files_dir, "", "", "");
+         filter_info_files_dir, "", "", "", 1, false, "", false);
   EXPECT_TRUE(boost::filesystem::exists(output_table_filename));
   EXPECT_TRUE(boost::filesystem::is_regular_file(output_table_filename));
   EXPECT_TRUE(boost::filesystem::exists(output_list_filename));
@@ -266,7 +266,7 @@ TEST_F(integrationTest, vcfInputOnePass) {
   std::string filter_info_files_dir = "";
   ex.run(maf_bin_boundaries, info_files, vcf_files, target_r2, baseline_r2,
          output_table_filename, output_list_filename, second_pass,
-         filter_info_files_dir, "DR2", "AF", "IMP");
+         filter_info_files_dir, "DR2", "AF", "IMP", 1, false, "", false);
   EXPECT_TRUE(boost::filesystem::exists(output_table_filename));
   EXPECT_TRUE(boost::filesystem::is_regular_file(output_table_filename));
   EXPECT_TRUE(boost::filesystem::exists(output_list_filename));
@@ -323,7 +323,7 @@ TEST_F(integrationTest, vcfInputTwoPasses) {
   std::string filter_info_files_dir = "";
   ex.run(maf_bin_boundaries, info_files, vcf_files, target_r2, baseline_r2,
          output_table_filename, output_list_filename, second_pass,
-         filter_info_files_dir, "DR2", "AF", "IMP");
+         filter_info_files_dir, "DR2", "AF", "IMP", 1, false, "", false);
   EXPECT_TRUE(boost::filesystem::exists(output_table_filename));
   EXPECT_TRUE(boost::filesystem::is_regular_file(output_table_filename));
   EXPECT_TRUE(boost::filesystem::exists(output_list_filename));
@@ -360,3 +360,245 @@ TEST_F(integrationTest, vcfInputTwoPasses) {
     EXPECT_TRUE(iter->second);
   }
 }
+
+TEST_F(integrationTest, infoInputMultithreadedMatchesSerial) {
+  boost::filesystem::create_directory(_out_tmpdir);
+  std::vector<std::string> info_files, vcf_files;
+  for (unsigned i = 1; i <= 3; ++i) {
+    std::string content = get_info_content(), chr = "chr" + std::to_string(i);
+    for (std::string::size_type pos = content.find("chr1");
+         pos != std::string::npos; pos = content.find("chr1", pos + 1)) {
+      content.replace(pos, 4, chr);
+    }
+    info_files.push_back(
+        (boost::filesystem::path(_out_tmpdir) / (chr + ".info.gz")).string());
+    create_compressed_file(info_files.back(), content);
+  }
+  std::vector<double> maf_bin_boundaries;
+  maf_bin_boundaries.push_back(0.001);
+  maf_bin_boundaries.push_back(0.03);
+  maf_bin_boundaries.push_back(0.5);
+  iddt::executor ex;
+  ex.run(maf_bin_boundaries, info_files, vcf_files, 0.43, 0.3f,
+         _out_table_tmpfile, _out_list_tmpfile, false, "", "", "", "", 1,
+         false, "", false);
+  std::string serial_table = load_plaintext_file(_out_table_tmpfile);
+  std::string serial_list = load_plaintext_file(_out_list_tmpfile);
+  ex.run(maf_bin_boundaries, info_files, vcf_files, 0.43, 0.3f,
+         _out_table_tmpfile, _out_list_tmpfile, false, "", "", "", "", 3,
+         false, "", false);
+  EXPECT_EQ(serial_table, load_plaintext_file(_out_table_tmpfile));
+  EXPECT_EQ(serial_list, load_plaintext_file(_out_list_tmpfile));
+  EXPECT_NE(serial_list.find("chr3:7:A:C"), std::string::npos);
+  ex.run(maf_bin_boundaries, info_files, vcf_files, 0.43, 0.3f,
+         _out_table_tmpfile, _out_list_tmpfile, false, "", "", "", "", 1,
+         true, "", false);
+  EXPECT_EQ(serial_table, load_plaintext_file(_out_table_tmpfile));
+  EXPECT_EQ(serial_list, load_plaintext_file(_out_list_tmpfile));
+}
+
+TEST_F(integrationTest, infoInputTwoPassesMultithreadedMatchesSerial) {
+  boost::filesystem::create_directory(_out_tmpdir);
+  std::vector<std::string> info_files, vcf_files;
+  // the first file is large enough to be split into several chunks
+  std::ostringstream large;
+  large << get_info_content();
+  for (unsigned i = 0; i < 60000; ++i) {
+    large << "chr2:" << i + 1 << ":A:T\tA\tT\t0.1\t" << (i % 97) / 200.0
+          << "\t0.1\t" << (i % 101) / 100.0 << "\t"
+          << (i % 7 ? "Imputed" : "Genotyped") << "\t-\t-\t-\t-\t-\n";
+  }
+  info_files.push_back(
+      (boost::filesystem::path(_out_tmpdir) / "chr2.info.gz").string());
+  create_compressed_file(info_files.back(), large.str());
+  info_files.push_back(
+      (boost::filesystem::path(_out_tmpdir) / "chr1.info.gz").string());
+  create_compressed_file(info_files.back(), get_info_content());
+  std::vector<double> maf_bin_boundaries;
+  maf_bin_boundaries.push_back(0.001);
+  maf_bin_boundaries.push_back(0.03);
+  maf_bin_boundaries.push_back(0.5);
+  std::vector<std::string> filtered_files;
+  for (unsigned i = 0; i < info_files.size(); ++i) {
+    filtered_files.push_back(
+        (boost::filesystem::path(_out_tmpdir) / "filtered" /
+         boost::filesystem::path(info_files.at(i)).filename())
+            .string());
+  }
+  std::string filter_dir =
+      (boost::filesystem::path(_out_tmpdir) / "filtered").string();
+  iddt::executor ex;
+  ex.run(maf_bin_boundaries, info_files, vcf_files, 0.43, 0.3f,
+         _out_table_tmpfile, _out_list_tmpfile, true, filter_dir, "", "", "",
+         1, false, "", false);
+  std::string serial_list = load_plaintext_file(_out_list_tmpfile);
+  std::vector<std::string> serial_filtered;
+  for (unsigned i = 0; i < filtered_files.size(); ++i) {
+    serial_filtered.push_back(load_compressed_file(filtered_files.at(i)));
+  }
+  boost::filesystem::remove_all(filter_dir);
+  ex.run(maf_bin_boundaries, info_files, vcf_files, 0.43, 0.3f,
+         _out_table_tmpfile, _out_list_tmpfile, true, filter_dir, "", "", "",
+         3, false, "", false);
+  EXPECT_EQ(serial_list, load_plaintext_file(_out_list_tmpfile));
+  for (unsigned i = 0; i < filtered_files.size(); ++i) {
+    EXPECT_EQ(serial_filtered.at(i),
+              load_compressed_file(filtered_files.at(i)));
+  }
+  EXPECT_NE(serial_list.find("chr2:"), std::string::npos);
+}
+
+TEST_F(integrationTest, infoInputTwoPassesSummaryCache) {
+  boost::filesystem::create_directory(_out_tmpdir);
+  std::vector<std::string> info_files, vcf_files;
+  for (unsigned i = 1; i <= 2; ++i) {
+    std::string content = get_info_content(), chr = "chr" + std::to_string(i);
+    for (std::string::size_type pos = content.find("chr1");
+         pos != std::string::npos; pos = content.find("chr1", pos + 1)) {
+      content.replace(pos, 4, chr);
+    }
+    info_files.push_back(
+        (boost::filesystem::path(_out_tmpdir) / (chr + ".info.gz")).string());
+    create_compressed_file(info_files.back(), content);
+  }
+  std::vector<double> maf_bin_boundaries;
+  maf_bin_boundaries.push_back(0.001);
+  maf_bin_boundaries.push_back(0.03);
+  maf_bin_boundaries.push_back(0.5);
+  std::string cache_dir =
+      (boost::filesystem::path(_out_tmpdir) / "cache").string();
+  iddt::executor ex;
+  ex.run(maf_bin_boundaries, info_files, vcf_files, 0.43, 0.3f,
+         _out_table_tmpfile, _out_list_tmpfile, true, "", "", "", "", 1,
+         false, "", false);
+  std::string uncached_table = load_plaintext_file(_out_table_tmpfile);
+  std::string uncached_list = load_plaintext_file(_out_list_tmpfile);
+  ex.run(maf_bin_boundaries, info_files, vcf_files, 0.43, 0.3f,
+         _out_table_tmpfile, _out_list_tmpfile, true, "", "", "", "", 1,
+         false, cache_dir, false);
+  std::string first_table = load_plaintext_file(_out_table_tmpfile);
+  // the cache never changes the thresholds
+  EXPECT_EQ(uncached_table, first_table);
+  EXPECT_EQ(uncached_list, load_plaintext_file(_out_list_tmpfile));
+  unsigned n_entries = 0;
+  for (boost::filesystem::directory_iterator iter(cache_dir);
+       iter != boost::filesystem::directory_iterator(); ++iter) {
+    ++n_entries;
+  }
+  EXPECT_EQ(n_entries, 2u);
+  // every loading mode reads the same summaries back
+  for (unsigned mode = 0; mode < 3; ++mode) {
+    ex.run(maf_bin_boundaries, info_files, vcf_files, 0.43, 0.3f,
+           _out_table_tmpfile, _out_list_tmpfile, true, "", "", "", "",
+           mode == 1 ? 3 : 1, mode == 2, cache_dir, false);
+    EXPECT_EQ(first_table, load_plaintext_file(_out_table_tmpfile));
+    EXPECT_EQ(uncached_list, load_plaintext_file(_out_list_tmpfile));
+  }
+  // a different target reuses the summaries
+  ex.run(maf_bin_boundaries, info_files, vcf_files, 0.6, 0.3f,
+         _out_table_tmpfile, _out_list_tmpfile, true, "", "", "", "", 1,
+         false, cache_dir, false);
+  std::string new_target_table = load_plaintext_file(_out_table_tmpfile);
+  EXPECT_NE(first_table, new_target_table);
+  ex.run(maf_bin_boundaries, info_files, vcf_files, 0.6, 0.3f,
+         _out_table_tmpfile, _out_list_tmpfile, true, "", "", "", "", 1,
+         false, "", false);
+  EXPECT_EQ(new_target_table, load_plaintext_file(_out_table_tmpfile));
+  // other bins, or a changed input file, need new summaries
+  maf_bin_boundaries.push_back(0.05);
+  std::sort(maf_bin_boundaries.begin(), maf_bin_boundaries.end());
+  ex.run(maf_bin_boundaries, info_files, vcf_files, 0.43, 0.3f,
+         _out_table_tmpfile, _out_list_tmpfile, true, "", "", "", "", 1,
+         false, cache_dir, false);
+  create_compressed_file(info_files.at(1),
+                         get_info_content() +
+                             "chr2:99:A:T\tA\tT\t0.1\t0.1\t0.1\t0.9\t"
+                             "Imputed\t-\t-\t-\t-\t-\n");
+  ex.run(maf_bin_boundaries, info_files, vcf_files, 0.43, 0.3f,
+         _out_table_tmpfile, _out_list_tmpfile, true, "", "", "", "", 1,
+         false, cache_dir, false);
+  n_entries = 0;
+  for (boost::filesystem::directory_iterator iter(cache_dir);
+       iter != boost::filesystem::directory_iterator(); ++iter) {
+    ++n_entries;
+  }
+  EXPECT_EQ(n_entries, 5u);
+}
+
+TEST_F(integrationTest, twoPassesSiteCacheMatchesInput) {
+  boost::filesystem::create_directory(_out_tmpdir);
+  std::string info_file =
+      (boost::filesystem::path(_out_tmpdir) / "chr1.info.gz").string();
+  create_compressed_file(info_file, get_info_content());
+  std::vector<double> maf_bin_boundaries;
+  maf_bin_boundaries.push_back(0.001);
+  maf_bin_boundaries.push_back(0.03);
+  maf_bin_boundaries.push_back(0.5);
+  iddt::executor ex;
+  // info input first, then vcf input
+  for (unsigned format = 0; format < 2; ++format) {
+    std::vector<std::string> info_files, vcf_files;
+    std::string r2_tag = "", af_tag = "", imp_tag = "";
+    if (format) {
+      vcf_files.push_back("unit_tests/test.vcf.gz");
+      vcf_files.push_back("unit_tests/test2.vcf.gz");
+      r2_tag = "DR2";
+      af_tag = "AF";
+      imp_tag = "IMP";
+    } else {
+      info_files.push_back(info_file);
+    }
+    std::string cache_dir = (boost::filesystem::path(_out_tmpdir) /
+                             ("cache" + std::to_string(format)))
+                                .string();
+    ex.run(maf_bin_boundaries, info_files, vcf_files, 0.43, 0.3f,
+           _out_table_tmpfile, _out_list_tmpfile, true, "", r2_tag, af_tag,
+           imp_tag, 1, false, "", false);
+    std::string uncached_table = load_plaintext_file(_out_table_tmpfile);
+    std::string uncached_list = load_plaintext_file(_out_list_tmpfile);
+    EXPECT_FALSE(uncached_list.empty());
+    // the first run stores tables, and every loading mode reads them
+    for (unsigned mode = 0; mode < 4; ++mode) {
+      ex.run(maf_bin_boundaries, info_files, vcf_files, 0.43, 0.3f,
+             _out_table_tmpfile, _out_list_tmpfile, true, "", r2_tag, af_tag,
+             imp_tag, mode == 2 ? 3 : 1, mode == 3, cache_dir, true);
+      EXPECT_EQ(uncached_table, load_plaintext_file(_out_table_tmpfile));
+      EXPECT_EQ(uncached_list, load_plaintext_file(_out_list_tmpfile));
+    }
+    unsigned n_entries = 0;
+    for (boost::filesystem::directory_iterator iter(cache_dir);
+         iter != boost::filesystem::directory_iterator(); ++iter) {
+      n_entries += iter->path().extension() == ".sites";
+    }
+    EXPECT_EQ(n_entries, info_files.size() + vcf_files.size());
+    // a new target is applied to the stored sites
+    ex.run(maf_bin_boundaries, info_files, vcf_files, 0.6, 0.3f,
+           _out_table_tmpfile, _out_list_tmpfile, true, "", r2_tag, af_tag,
+           imp_tag, 1, false, "", false);
+    uncached_list = load_plaintext_file(_out_list_tmpfile);
+    ex.run(maf_bin_boundaries, info_files, vcf_files, 0.6, 0.3f,
+           _out_table_tmpfile, _out_list_tmpfile, true, "", r2_tag, af_tag,
+           imp_tag, 1, false, cache_dir, true);
+    EXPECT_EQ(uncached_list, load_plaintext_file(_out_list_tmpfile));
+  }
+}
+
+TEST_F(integrationTest, vcfInputTwoPassesMultithreadedMatchesSerial) {
+  std::vector<std::string> info_files, vcf_files;
+  vcf_files.push_back("unit_tests/test.vcf.gz");
+  vcf_files.push_back("unit_tests/test2.vcf.gz");
+  std::vector<double> maf_bin_boundaries;
+  maf_bin_boundaries.push_back(0.001);
+  maf_bin_boundaries.push_back(0.03);
+  maf_bin_boundaries.push_back(0.5);
+  iddt::executor ex;
+  ex.run(maf_bin_boundaries, info_files, vcf_files, 0.43, 0.3f,
+         _out_table_tmpfile, _out_list_tmpfile, true, "", "DR2", "AF", "IMP",
+         1, false, "", false);
+  std::string serial_list = load_plaintext_file(_out_list_tmpfile);
+  ex.run(maf_bin_boundaries, info_files, vcf_files, 0.43, 0.3f,
+         _out_table_tmpfile, _out_list_tmpfile, true, "", "DR2", "AF", "IMP",
+         3, false, "", false);
+  EXPECT_EQ(serial_list, load_plaintext_file(_out_list_tmpfile));
+  EXPECT_FALSE(serial_list.empty());
+}
@@ -0,0 +1,83 @@
+/*!
+  \file block_inflater_test.cc
+  \brief tests for gzip member inflation
+  \copyright Released under the MIT License. Copyright
+  2023 Lightning Auriga
+ */
+
+#include <zlib.h>
+
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "imputed-data-dynamic-threshold/block_inflater.h"
+
+namespace iddt = imputed_data_dynamic_threshold;
+
+namespace {
+std::string gzip_member(const std::string &text) {
+  z_stream strm = z_stream();
+  deflateInit2(&strm, 6, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY);
+  std::vector<char> out(deflateBound(&strm, text.size()) + 32);
+  strm.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(text.data()));
+  strm.avail_in = text.size();
+  strm.next_out = reinterpret_cast<Bytef *>(out.data());
+  strm.avail_out = out.size();
+  deflate(&strm, Z_FINISH);
+  std::string res(out.data(), out.size() - strm.avail_out);
+  deflateEnd(&strm);
+  return res;
+}
+}  // namespace
+
+TEST(blockInflaterTest, inflateMembers) {
+  iddt::block_inflater inflater;
+  std::string first = "", second = "";
+  for (unsigned i = 0; i < 2000; ++i) {
+    first += "chr1:" + std::to_string(i) + ":A:T\tA\tT\t0.1\n";
+    second += "chr2:" + std::to_string(i) + ":A:T\tA\tT\t0.2\n";
+  }
+  std::string buffer = "";
+  std::string member = gzip_member(first);
+  inflater.inflate_member(member.data(), member.size(), &buffer);
+  EXPECT_EQ(buffer, first);
+  // members are appended, and the inflater is reusable
+  member = gzip_member(second);
+  inflater.inflate_member(member.data(), member.size(), &buffer);
+  EXPECT_EQ(buffer, first + second);
+}
+
+TEST(blockInflaterTest, inflateEmptyBgzfBlock) {
+  // the standard bgzf end-of-file marker
+  const unsigned char eof[28] = {0x1f, 0x8b, 0x08, 0x04, 0x00, 0x00, 0x00,
+                                 0x00, 0x00, 0xff, 0x06, 0x00, 0x42, 0x43,
+                                 0x02, 0x00, 0x1b, 0x00, 0x03, 0x00, 0x00,
+                                 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+  iddt::block_inflater inflater;
+  std::string buffer = "text";
+  inflater.inflate_member(reinterpret_cast<const char *>(eof), 28, &buffer);
+  EXPECT_EQ(buffer, "text");
+}
+
+TEST(blockInflaterTest, rejectsInvalidMembers) {
+  iddt::block_inflater inflater;
+  std::string member = gzip_member("chr1:1:A:T\tA\tT\t0.1\n");
+  std::string buffer = "kept";
+  EXPECT_THROW(inflater.inflate_member(member.data(), 10, &buffer),
+               std::runtime_error);
+  std::string corrupt = member;
+  corrupt[corrupt.size() - 9] ^= 0x55;
+  corrupt[12] ^= 0x55;
+  EXPECT_THROW(
+      inflater.inflate_member(corrupt.data(), corrupt.size(), &buffer),
+      std::runtime_error);
+  EXPECT_EQ(buffer, "kept");
+  EXPECT_THROW(inflater.inflate_member(member.data(), member.size(), NULL),
+               std::logic_error);
+}
+
+TEST(blockInflaterTest, backend) {
+  std::string backend = iddt::block_inflater::backend();
+  EXPECT_TRUE(backend == "libdeflate" || backend == "zlib");
+}
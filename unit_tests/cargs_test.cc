@@ -28,14 +28,15 @@ cargsTest::cargsTest()
   std::string test2 =
       "progname -i " + _tmp_dir + "/file1.gz " + _tmp_dir +
       "/file2.gz -m 0.01 0.1 -r 0.75 --baseline-r2 0.4 "
-      "-s --filter-info-files targetdir -o summary.txt -l list.txt";
+      "-s --filter-info-files targetdir -o summary.txt -l list.txt "
+      "--pipeline --cache-dir cachedir --cache-sites";
   populate(test2, &_argvec2, &_argv2);
   std::string test3 = "progname -v " + _tmp_dir +
                       "/file1.vcf.gz "
                       "--vcf-info-r2-tag r2 "
                       "--vcf-info-af-tag af "
                       "--vcf-info-imputed-indicator imp "
-                      "-s";
+                      "-s -t 4";
   populate(test3, &_argvec3, &_argv3);
   std::string test4 = "progname -i " + _tmp_dir +
                       "/file1.gz -o summary.txt "
@@ -153,7 +154,10 @@ TEST_F(cargsTest, infoModeBasicAccessors) {
   output.open((_tmp_dir + "/file2.gz").c_str());
   output.close();
   EXPECT_TRUE(ap.second_pass());
+  EXPECT_TRUE(ap.pipeline());
   EXPECT_EQ(ap.get_filter_info_files_dir(), "targetdir");
+  EXPECT_EQ(ap.get_cache_dir(), "cachedir");
+  EXPECT_TRUE(ap.cache_sites());
   std::vector<double> expected_bins, observed_bins;
   expected_bins.push_back(0.01);
   expected_bins.push_back(0.1);
@@ -184,6 +188,14 @@ TEST_F(cargsTest, vcfModeBasicAccessors) {
   EXPECT_EQ(ap.get_vcf_info_r2_tag(), "r2");
   EXPECT_EQ(ap.get_vcf_info_af_tag(), "af");
   EXPECT_EQ(ap.get_vcf_info_imputed_indicator(), "imp");
+  EXPECT_EQ(ap.get_threads(), 4u);
+  EXPECT_FALSE(ap.pipeline());
+  EXPECT_FALSE(ap.cache_sites());
+}
+
+TEST_F(cargsTest, threadsDefaultsToOne) {
+  iddt::cargs ap(_argvec4.size(), _argv4);
+  EXPECT_EQ(ap.get_threads(), 1u);
 }
 
 TEST_F(cargsTest, defaultFrequencyBins) {
@@ -204,6 +216,11 @@ TEST_F(cargsTest, filterInfoFilesDirOptional) {
   EXPECT_EQ(ap.get_filter_info_files_dir(), "");
 }
 
+TEST_F(cargsTest, cacheDirOptional) {
+  iddt::cargs ap(_argvec5.size(), _argv5);
+  EXPECT_EQ(ap.get_cache_dir(), "");
+}
+
 TEST_F(cargsTest, mafBinBoundariesCheckedForValidity) {
   iddt::cargs ap1(_argvec6.size(), _argv6);
   EXPECT_THROW(ap1.get_maf_bin_boundaries(), std::runtime_error);
@@ -0,0 +1,26 @@
+/*!
+  \file decompression_pool_test.cc
+  \brief tests for the shared decompression thread pool
+  \copyright Released under the MIT License. Copyright
+  2023 Lightning Auriga
+ */
+
+#include "gtest/gtest.h"
+#include "imputed-data-dynamic-threshold/decompression_pool.h"
+
+namespace iddt = imputed_data_dynamic_threshold;
+
+TEST(decompressionPoolTest, size) {
+  iddt::decompression_pool pool(3);
+  EXPECT_EQ(pool.size(), 3u);
+}
+
+TEST(decompressionPoolTest, invalidThreadCount) {
+  EXPECT_THROW(iddt::decompression_pool(0), std::logic_error);
+}
+
+TEST(decompressionPoolTest, attachNullReaders) {
+  iddt::decompression_pool pool(2);
+  EXPECT_THROW(pool.attach(static_cast<BGZF *>(0)), std::logic_error);
+  EXPECT_THROW(pool.attach(static_cast<htsFile *>(0)), std::logic_error);
+}
@@ -20,6 +20,22 @@ TEST(utilitiesTest, fromString) {
   EXPECT_THROW(iddt::from_string<float>("Rsq"), std::runtime_error);
 }
 
+TEST(utilitiesTest, fromStringView) {
+  EXPECT_EQ(iddt::from_string_view<unsigned>("12"), 12u);
+  EXPECT_DOUBLE_EQ(iddt::from_string_view<double>("1.2345"), 1.2345);
+  EXPECT_FLOAT_EQ(iddt::from_string_view<float>("9.876"), 9.876f);
+  EXPECT_FLOAT_EQ(iddt::from_string_view<float>("1e-3"), 0.001f);
+  // test: agrees exactly with stream extraction
+  EXPECT_EQ(iddt::from_string_view<float>("0.44231"),
+            iddt::from_string<float>("0.44231"));
+  EXPECT_THROW(iddt::from_string_view<float>("-"), std::runtime_error);
+  EXPECT_THROW(iddt::from_string_view<float>("."), std::runtime_error);
+  EXPECT_THROW(iddt::from_string_view<float>("Rsq"), std::runtime_error);
+  EXPECT_THROW(iddt::from_string_view<float>(""), std::runtime_error);
+  // test: trailing characters are not silently ignored
+  EXPECT_THROW(iddt::from_string_view<float>("0.5x"), std::runtime_error);
+}
+
 TEST(utilitiesTest, stringFloatVectorEquals) {
   std::vector<std::pair<std::string, float> > a, b;
   a.push_back(std::pair<std::string, float>("a", 0.1f));
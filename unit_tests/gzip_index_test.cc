@@ -0,0 +1,166 @@
+/*!
+  \file gzip_index_test.cc
+  \brief tests for gzip seek points
+  \copyright Released under the MIT License. Copyright
+  2023 Lightning Auriga
+ */
+
+#include <zlib.h>
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "boost/filesystem.hpp"
+#include "gtest/gtest.h"
+#include "imputed-data-dynamic-threshold/gzip_index.h"
+#include "imputed-data-dynamic-threshold/parallel_gzip.h"
+
+namespace iddt = imputed_data_dynamic_threshold;
+
+namespace {
+std::string info_text(unsigned n_lines, unsigned seed) {
+  std::string res = "SNP\tREF(0)\tALT(1)\tALT_Frq\tMAF\tAvgCall\tRsq\n";
+  std::uint32_t state = seed;
+  for (unsigned i = 0; i < n_lines; ++i) {
+    state = state * 1664525u + 1013904223u;
+    unsigned frq = (state >> 8) % 100000;
+    res += "chr22:" + std::to_string(16000000 + i * 37) + ":A:G\tA\tG\t0." +
+           std::to_string(frq) + "\t0." + std::to_string(frq / 2) +
+           "\t0.99\t0." + std::to_string((state >> 4) % 100000) + "\n";
+  }
+  return res;
+}
+
+std::string gzip_text(const std::string &text) {
+  z_stream strm = z_stream();
+  deflateInit2(&strm, 6, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY);
+  std::string res(deflateBound(&strm, text.size()) + 32, '\0');
+  strm.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(text.data()));
+  strm.avail_in = text.size();
+  strm.next_out = reinterpret_cast<Bytef *>(&res[0]);
+  strm.avail_out = res.size();
+  deflate(&strm, Z_FINISH);
+  res.resize(res.size() - strm.avail_out);
+  deflateEnd(&strm);
+  return res;
+}
+
+void build_index(const std::string &filename, unsigned n_threads,
+                 iddt::gzip_index *index) {
+  iddt::parallel_gzip_reader reader(filename, n_threads, 20000, index);
+  std::string text = "";
+  while (reader.read(&text)) {
+    EXPECT_FALSE(index->is_complete());
+  }
+}
+
+std::string read_from(const std::string &filename,
+                      const iddt::gzip_index &index, unsigned checkpoint,
+                      std::size_t limit) {
+  iddt::indexed_gzip_reader reader(filename, index, checkpoint);
+  std::string res = "";
+  std::vector<char> buffer(7000);
+  unsigned n = 0;
+  while (res.size() < limit && (n = reader.read(buffer.data(), 7000))) {
+    res.append(buffer.data(), n);
+  }
+  return res.substr(0, limit);
+}
+}  // namespace
+
+TEST(gzipIndexTest, checkpointsResumeInflation) {
+  boost::filesystem::path tmp_dir = boost::filesystem::unique_path();
+  boost::filesystem::create_directory(tmp_dir);
+  std::string filename = (tmp_dir / "info.gz").native();
+  std::string text = info_text(60000, 12345);
+  std::ofstream output(filename.c_str(), std::ios::binary);
+  output << gzip_text(text);
+  output.close();
+  iddt::gzip_index serial(10000), parallel(10000);
+  build_index(filename, 1, &serial);
+  // speculatively decoded segments report the same block boundaries
+  build_index(filename, 3, &parallel);
+  ASSERT_TRUE(serial.is_complete());
+  ASSERT_TRUE(parallel.is_complete());
+  EXPECT_EQ(serial.get_inflated_size(), text.size());
+  EXPECT_EQ(parallel.get_inflated_size(), text.size());
+  ASSERT_GT(serial.size(), 3u);
+  ASSERT_EQ(parallel.size(), serial.size());
+  for (unsigned i = 0; i < serial.size(); ++i) {
+    const iddt::gzip_checkpoint &point = serial.at(i);
+    EXPECT_EQ(parallel.at(i).bit, point.bit);
+    EXPECT_EQ(parallel.at(i).offset, point.offset);
+    if (i) {
+      EXPECT_GE(point.bit, serial.at(i - 1).bit + 10000 * 8);
+    }
+    std::string window = "";
+    serial.get_window(i, &window);
+    EXPECT_EQ(window, text.substr(point.offset - window.size(),
+                                  window.size()));
+    EXPECT_EQ(read_from(filename, serial, i, 50000),
+              text.substr(point.offset, 50000));
+  }
+  unsigned last = serial.size() - 1;
+  EXPECT_EQ(read_from(filename, serial, last, text.size()),
+            text.substr(serial.at(last).offset));
+  boost::filesystem::remove_all(tmp_dir);
+}
+
+TEST(gzipIndexTest, concatenatedMembers) {
+  boost::filesystem::path tmp_dir = boost::filesystem::unique_path();
+  boost::filesystem::create_directory(tmp_dir);
+  std::string filename = (tmp_dir / "info.gz").native();
+  std::string first = info_text(20000, 1), second = info_text(20000, 2);
+  std::ofstream output(filename.c_str(), std::ios::binary);
+  // trailing data that is not a member is ignored
+  output << gzip_text(first) << gzip_text("") << gzip_text(second)
+         << std::string(5, '\0');
+  output.close();
+  iddt::gzip_index index(5000);
+  build_index(filename, 2, &index);
+  ASSERT_TRUE(index.is_complete());
+  std::string text = first + second;
+  EXPECT_EQ(index.get_inflated_size(), text.size());
+  bool in_second = false;
+  for (unsigned i = 0; i < index.size(); ++i) {
+    std::uint64_t offset = index.at(i).offset;
+    in_second = in_second || offset >= first.size();
+    EXPECT_EQ(read_from(filename, index, i, text.size()),
+              text.substr(offset));
+  }
+  EXPECT_TRUE(in_second);
+  boost::filesystem::remove_all(tmp_dir);
+}
+
+TEST(gzipIndexTest, invalidUse) {
+  boost::filesystem::path tmp_dir = boost::filesystem::unique_path();
+  boost::filesystem::create_directory(tmp_dir);
+  std::string filename = (tmp_dir / "info.gz").native();
+  std::string data = gzip_text(info_text(20000, 3));
+  std::ofstream output(filename.c_str(), std::ios::binary);
+  output << data;
+  output.close();
+  iddt::gzip_index index(0);
+  EXPECT_TRUE(index.wants_checkpoint(0));
+  EXPECT_THROW(iddt::indexed_gzip_reader(filename, index, 0),
+               std::logic_error);
+  build_index(filename, 1, &index);
+  ASSERT_GT(index.size(), 1u);
+  EXPECT_FALSE(index.wants_checkpoint(index.at(index.size() - 1).bit + 8));
+  EXPECT_THROW(index.get_window(0, 0), std::logic_error);
+  EXPECT_THROW(index.at(index.size()), std::out_of_range);
+  EXPECT_THROW(
+      iddt::indexed_gzip_reader((tmp_dir / "missing.gz").native(), index, 0),
+      std::runtime_error);
+  iddt::indexed_gzip_reader reader(filename, index, 1);
+  EXPECT_THROW(reader.read(0, 10), std::logic_error);
+  // a file that ends before the text the index describes
+  output.open(filename.c_str(), std::ios::binary);
+  output << data.substr(0, data.size() / 2);
+  output.close();
+  EXPECT_THROW(read_from(filename, index, 1, data.size() * 10),
+               std::runtime_error);
+  boost::filesystem::remove_all(tmp_dir);
+}
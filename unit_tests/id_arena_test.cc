@@ -0,0 +1,64 @@
+/*!
+  \file id_arena_test.cc
+  \brief tests for compact variant ID storage
+  \copyright Released under the MIT License. Copyright
+  2023 Lightning Auriga
+ */
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "imputed-data-dynamic-threshold/id_arena.h"
+
+namespace iddt = imputed_data_dynamic_threshold;
+
+TEST(idArenaTest, addAndGet) {
+  // a small chunk size forces strings to spread over several chunks
+  iddt::id_arena a(64);
+  std::vector<std::string> ids;
+  ids.push_back("chr1:1:A:T");
+  ids.push_back("");
+  ids.push_back(std::string(254, 'x'));
+  ids.push_back(std::string(255, 'y'));
+  ids.push_back(std::string(70000, 'z'));
+  ids.push_back("rs1234");
+  std::vector<std::uint64_t> handles;
+  char buffer[iddt::variant_id_codec::max_length];
+  for (unsigned i = 0; i < 1000; ++i) {
+    handles.push_back(a.add(ids.at(i % ids.size())));
+  }
+  for (unsigned i = 0; i < handles.size(); ++i) {
+    EXPECT_EQ(a.get(handles.at(i), buffer), ids.at(i % ids.size()));
+  }
+  // handles remain valid in copies of the arena, which can keep growing
+  iddt::id_arena b(a);
+  std::uint64_t extra = b.add("rs5");
+  for (unsigned i = 0; i < handles.size(); ++i) {
+    EXPECT_EQ(b.get(handles.at(i), buffer), ids.at(i % ids.size()));
+  }
+  EXPECT_EQ(b.get(extra, buffer), "rs5");
+  EXPECT_GT(b.bytes_used(), a.bytes_used());
+}
+
+TEST(idArenaTest, bytesUsed) {
+  iddt::id_arena a;
+  EXPECT_EQ(a.bytes_used(), 0u);
+  a.add("rs1234");
+  EXPECT_EQ(a.bytes_used(), 7u);
+  a.add(std::string(300, 'x'));
+  EXPECT_EQ(a.bytes_used(), 312u);
+  // packed IDs are kept entirely in their handles
+  std::uint64_t handle = a.add("chr1:1:A:T");
+  EXPECT_EQ(a.bytes_used(), 312u);
+  EXPECT_TRUE(iddt::variant_id_codec::is_key(handle));
+  char buffer[iddt::variant_id_codec::max_length];
+  EXPECT_EQ(a.get(handle, buffer), "chr1:1:A:T");
+  a.clear();
+  EXPECT_EQ(a.bytes_used(), 0u);
+}
+
+TEST(idArenaTest, invalidChunkSize) {
+  EXPECT_THROW(iddt::id_arena(0), std::logic_error);
+}
@@ -0,0 +1,94 @@
+/*!
+  \file id_codec_test.cc
+  \brief tests for chr:pos:ref:alt variant ID packing
+  \copyright Released under the MIT License. Copyright
+  2023 Lightning Auriga
+ */
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "imputed-data-dynamic-threshold/id_codec.h"
+
+namespace iddt = imputed_data_dynamic_threshold;
+
+TEST(variantIdCodecTest, roundTrip) {
+  std::vector<std::string> ids;
+  ids.push_back("chr1:12345:A:G");
+  ids.push_back("1:12345:A:G");
+  ids.push_back("chr22:1:C:T");
+  ids.push_back("chrX:155000000:G:A");
+  ids.push_back("Y:2781480:T:C");
+  ids.push_back("chrM:73:A:G");
+  ids.push_back("chrMT:73:A:G");
+  ids.push_back("chr10:536870911:ACGTACGT:TGA");
+  ids.push_back("chr2:0:A:C");
+  char buffer[iddt::variant_id_codec::max_length];
+  for (std::vector<std::string>::const_iterator iter = ids.begin();
+       iter != ids.end(); ++iter) {
+    std::uint64_t key = 0;
+    ASSERT_TRUE(iddt::variant_id_codec::encode(*iter, &key)) << *iter;
+    EXPECT_TRUE(iddt::variant_id_codec::is_key(key));
+    EXPECT_EQ(iddt::variant_id_codec::decode(key, buffer), *iter);
+  }
+}
+
+TEST(variantIdCodecTest, rejectsInexactIds) {
+  std::vector<std::string> ids;
+  ids.push_back("");
+  ids.push_back("rs12345");
+  ids.push_back("chr1:12345:A");
+  ids.push_back("chr1:12345:A:G:T");
+  ids.push_back("chr01:12345:A:G");
+  ids.push_back("chr1:012345:A:G");
+  ids.push_back("chr23:12345:A:G");
+  ids.push_back("chr0:12345:A:G");
+  ids.push_back("chrUn:12345:A:G");
+  ids.push_back("Chr1:12345:A:G");
+  ids.push_back("chr1:536870912:A:G");
+  ids.push_back("chr1:12345:a:G");
+  ids.push_back("chr1:12345:N:G");
+  ids.push_back("chr1:12345:A:<DEL>");
+  ids.push_back("chr1:12345::G");
+  ids.push_back("chr1:12345:A:");
+  ids.push_back("chr1:12345:ACGTACGTA:G");
+  ids.push_back("chr1:12345:ACGTAC:GTACGT");
+  ids.push_back("chr1:+12345:A:G");
+  for (std::vector<std::string>::const_iterator iter = ids.begin();
+       iter != ids.end(); ++iter) {
+    std::uint64_t key = 0;
+    EXPECT_FALSE(iddt::variant_id_codec::encode(*iter, &key)) << *iter;
+  }
+  EXPECT_FALSE(iddt::variant_id_codec::is_key(0x7fffffffffffffffULL));
+}
+
+TEST(variantIdCodecTest, randomRoundTrip) {
+  std::mt19937 generator(42);
+  std::uniform_int_distribution<unsigned> contig(0, 27), position(0, 600000000),
+      length(1, 9), base(0, 3);
+  const char *contigs[] = {"X", "Y", "M", "MT"};
+  const char bases[] = {'A', 'C', 'G', 'T'};
+  char buffer[iddt::variant_id_codec::max_length];
+  for (unsigned i = 0; i < 100000; ++i) {
+    std::string id = i % 2 ? "chr" : "";
+    unsigned c = contig(generator);
+    id += c < 4 ? std::string(contigs[c]) : std::to_string(c - 4);
+    unsigned pos = position(generator);
+    id += ":" + std::to_string(pos) + ":";
+    unsigned ref_length = length(generator), alt_length = length(generator);
+    for (unsigned j = 0; j < ref_length; ++j) id += bases[base(generator)];
+    id += ":";
+    for (unsigned j = 0; j < alt_length; ++j) id += bases[base(generator)];
+    // contigs 0 and 23, large positions and long alleles cannot be packed
+    bool packable = c != 4 && c != 27 && pos < (1u << 29) && ref_length <= 8 &&
+                    alt_length <= 8 && ref_length + alt_length <= 11;
+    std::uint64_t key = 0;
+    ASSERT_EQ(iddt::variant_id_codec::encode(id, &key), packable) << id;
+    if (packable) {
+      EXPECT_EQ(iddt::variant_id_codec::decode(key, buffer), id);
+    }
+  }
+}
@@ -0,0 +1,184 @@
+/*!
+  \file info_lines_test.cc
+  \brief tests for info file block splitting
+  \copyright Released under the MIT License. Copyright
+  2023 Lightning Auriga
+ */
+
+#include "unit_tests/info_lines_test.h"
+
+namespace iddt = imputed_data_dynamic_threshold;
+
+infoLinesTest::infoLinesTest()
+    : _tmp_dir(boost::filesystem::unique_path().native()) {
+  boost::filesystem::create_directory(_tmp_dir);
+}
+
+infoLinesTest::~infoLinesTest() throw() {
+  if (boost::filesystem::exists(_tmp_dir)) {
+    boost::filesystem::remove_all(_tmp_dir);
+  }
+}
+
+TEST_F(infoLinesTest, findDelimitersMethodsAgree) {
+  std::mt19937 generator(1234);
+  std::uniform_int_distribution<int> byte(0, 5);
+  const char alphabet[] = {'a', '\t', '\n', '.', '0', '\r'};
+  // lengths around and between the vector widths
+  for (unsigned length = 0; length < 200; ++length) {
+    std::string block(length, ' ');
+    for (unsigned i = 0; i < length; ++i) {
+      block.at(i) = alphabet[byte(generator)];
+    }
+    const char *begin = block.data(), *end = begin + block.size();
+    std::vector<std::uint32_t> scalar, sse2, avx2, best;
+    iddt::info_line_splitter::find_delimiters_scalar(begin, end, &scalar);
+    iddt::info_line_splitter::find_delimiters_sse2(begin, end, &sse2);
+    iddt::info_line_splitter::find_delimiters(begin, end, &best);
+    EXPECT_EQ(scalar, sse2);
+    EXPECT_EQ(scalar, best);
+    if (iddt::info_line_splitter::avx2_supported()) {
+      iddt::info_line_splitter::find_delimiters_avx2(begin, end, &avx2);
+      EXPECT_EQ(scalar, avx2);
+    }
+  }
+}
+
+TEST_F(infoLinesTest, splitRecords) {
+  iddt::info_line_splitter splitter;
+  std::vector<iddt::info_record> records;
+  std::string block =
+      "chr1:1:A:T\tA\tT\t0.1\t0.2\t0.3\t0.44231\tImputed\t-\t-\n"
+      "chr1:2:A:T\tA\tT\t0.1\t0.2\t0.3\t0.5\tGenotyped\r\n"
+      "\n"
+      "chr1:3:A:T\tA\tT\t0.1\t0.01\t0.3\t0.9\tImputed";
+  splitter.split(block.data(), block.data() + block.size(), &records);
+  ASSERT_EQ(records.size(), 4u);
+  EXPECT_EQ(records.at(0).snp, "chr1:1:A:T");
+  EXPECT_EQ(records.at(0).maf, "0.2");
+  EXPECT_EQ(records.at(0).rsq, "0.44231");
+  EXPECT_EQ(records.at(0).genotyped, "Imputed");
+  EXPECT_EQ(records.at(0).n_fields, 10u);
+  EXPECT_EQ(records.at(0).line, block.substr(0, block.find('\n') + 1));
+  EXPECT_EQ(records.at(1).genotyped, "Genotyped");
+  EXPECT_EQ(records.at(1).n_fields, 8u);
+  EXPECT_EQ(records.at(2).n_fields, 1u);
+  EXPECT_EQ(records.at(2).line, "\n");
+  EXPECT_EQ(records.at(3).maf, "0.01");
+  EXPECT_EQ(records.at(3).genotyped, "Imputed");
+  EXPECT_EQ(records.at(3).line.back(), 'd');
+  EXPECT_THROW(splitter.split(block.data(), block.data(), NULL),
+               std::logic_error);
+}
+
+TEST_F(infoLinesTest, readerHasNoLineLengthLimit) {
+  std::string filename = _tmp_dir + "/long.info.gz";
+  std::string long_id(3000000, 'x');
+  gzFile output = gzopen(filename.c_str(), "wb");
+  ASSERT_TRUE(output);
+  gzputs(output,
+         "SNP\tREF(0)\tALT(1)\tALT_Frq\tMAF\tAvgCall\tRsq\tGenotyped\n");
+  for (unsigned i = 0; i < 1000; ++i) {
+    gzputs(output, "chr1:1:A:T\tA\tT\t0.1\t0.1\t0.1\t0.5\tImputed\n");
+  }
+  gzputs(output, (long_id + "\tA\tT\t0.1\t0.1\t0.1\t0.5\tImputed\n").c_str());
+  gzputs(output, "chr1:3:A:T\tA\tT\t0.1\t0.1\t0.1\t0.5\tGenotyped");
+  gzclose(output);
+  iddt::info_file_reader reader(filename);
+  std::vector<iddt::info_record> records;
+  std::vector<std::string> ids;
+  while (reader.next_block(&records)) {
+    for (std::vector<iddt::info_record>::const_iterator iter =
+             records.begin();
+         iter != records.end(); ++iter) {
+      EXPECT_EQ(iter->n_fields, 8u);
+      ids.push_back(std::string(iter->snp));
+    }
+  }
+  ASSERT_EQ(ids.size(), 1002u);
+  EXPECT_EQ(ids.at(0), "chr1:1:A:T");
+  EXPECT_EQ(ids.at(1000), long_id);
+  EXPECT_EQ(ids.at(1001), "chr1:3:A:T");
+}
+
+TEST_F(infoLinesTest, readerMapsFlatFiles) {
+  std::string filename = _tmp_dir + "/long.info";
+  std::string long_id(3000000, 'x');
+  std::ofstream output(filename.c_str(), std::ios::binary);
+  output << "SNP\tREF(0)\tALT(1)\tALT_Frq\tMAF\tAvgCall\tRsq\tGenotyped\n";
+  for (unsigned i = 0; i < 40000; ++i) {
+    output << "chr1:" << i << ":A:T\tA\tT\t0.1\t0.1\t0.1\t0.5\tImputed\n";
+  }
+  output << long_id << "\tA\tT\t0.1\t0.1\t0.1\t0.5\tImputed\n";
+  output << "chr1:3:A:T\tA\tT\t0.1\t0.1\t0.1\t0.5\tGenotyped";
+  output.close();
+  iddt::info_file_reader reader(filename);
+  std::vector<iddt::info_record> records;
+  std::vector<std::string> ids;
+  unsigned n_blocks = 0;
+  while (reader.next_block(&records)) {
+    ++n_blocks;
+    for (std::vector<iddt::info_record>::const_iterator iter =
+             records.begin();
+         iter != records.end(); ++iter) {
+      EXPECT_EQ(iter->n_fields, 8u);
+      ids.push_back(std::string(iter->snp));
+    }
+  }
+  EXPECT_GT(n_blocks, 1u);
+  ASSERT_EQ(ids.size(), 40002u);
+  EXPECT_EQ(ids.at(0), "chr1:0:A:T");
+  EXPECT_EQ(ids.at(39999), "chr1:39999:A:T");
+  EXPECT_EQ(ids.at(40000), long_id);
+  EXPECT_EQ(ids.at(40001), "chr1:3:A:T");
+  // files holding no more than a header have no records
+  output.open(filename.c_str(), std::ios::binary);
+  output << "SNP\tREF(0)\tALT(1)";
+  output.close();
+  iddt::info_file_reader header_only(filename);
+  EXPECT_FALSE(header_only.next_block(&records));
+  output.open(filename.c_str(), std::ios::binary);
+  output.close();
+  iddt::info_file_reader empty(filename);
+  EXPECT_FALSE(empty.next_block(&records));
+}
+
+TEST_F(infoLinesTest, readerWithDecompressionPool) {
+  std::string header =
+      "SNP\tREF(0)\tALT(1)\tALT_Frq\tMAF\tAvgCall\tRsq\tGenotyped\n";
+  std::string body =
+      "chr1:1:A:T\tA\tT\t0.1\t0.1\t0.1\t0.5\tImputed\n"
+      "chr1:2:A:T\tA\tT\t0.1\t0.1\t0.1\t0.5\tGenotyped\n";
+  std::vector<std::string> filenames;
+  filenames.push_back(_tmp_dir + "/pooled.info.gz");
+  gzFile output = gzopen(filenames.back().c_str(), "wb");
+  ASSERT_TRUE(output);
+  gzputs(output, (header + body).c_str());
+  gzclose(output);
+  filenames.push_back(_tmp_dir + "/pooled.info");
+  std::ofstream flat(filenames.back().c_str());
+  flat << header << body;
+  flat.close();
+  iddt::decompression_pool pool(2);
+  for (std::vector<std::string>::const_iterator iter = filenames.begin();
+       iter != filenames.end(); ++iter) {
+    iddt::info_file_reader reader(*iter, &pool);
+    std::vector<iddt::info_record> records;
+    std::string lines = "";
+    while (reader.next_block(&records)) {
+      for (std::vector<iddt::info_record>::const_iterator record =
+               records.begin();
+           record != records.end(); ++record) {
+        lines += std::string(record->line);
+      }
+    }
+    EXPECT_EQ(lines, body);
+  }
+  EXPECT_THROW(iddt::info_file_reader(_tmp_dir + "/missing.info.gz", &pool),
+               std::runtime_error);
+}
+
+TEST_F(infoLinesTest, readerMissingFile) {
+  EXPECT_THROW(iddt::info_file_reader(_tmp_dir + "/missing.info.gz"),
+               std::runtime_error);
+}
@@ -0,0 +1,32 @@
+/*!
+  \file info_lines_test.h
+  \brief tests for info file block splitting
+  \copyright Released under the MIT License. Copyright
+  2023 Lightning Auriga
+ */
+
+#ifndef UNIT_TESTS_INFO_LINES_TEST_H_
+#define UNIT_TESTS_INFO_LINES_TEST_H_
+
+#include <zlib.h>
+
+#include <cstdint>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "boost/filesystem.hpp"
+#include "gtest/gtest.h"
+#include "imputed-data-dynamic-threshold/decompression_pool.h"
+#include "imputed-data-dynamic-threshold/info_lines.h"
+
+class infoLinesTest : public testing::Test {
+ protected:
+  infoLinesTest();
+  ~infoLinesTest() throw();
+  const std::string _tmp_dir;
+};
+
+#endif  // UNIT_TESTS_INFO_LINES_TEST_H_
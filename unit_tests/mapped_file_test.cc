@@ -0,0 +1,57 @@
+/*!
+  \file mapped_file_test.cc
+  \brief tests for read-only memory mapping
+  \copyright Released under the MIT License. Copyright
+  2023 Lightning Auriga
+ */
+
+#include <zlib.h>
+
+#include <fstream>
+#include <string>
+
+#include "boost/filesystem.hpp"
+#include "gtest/gtest.h"
+#include "imputed-data-dynamic-threshold/mapped_file.h"
+
+namespace iddt = imputed_data_dynamic_threshold;
+
+TEST(mappedFileTest, mapsFileContents) {
+  boost::filesystem::path tmp_dir = boost::filesystem::unique_path();
+  boost::filesystem::create_directory(tmp_dir);
+  std::string filename = (tmp_dir / "flat.info").native();
+  std::string content = "SNP\tREF(0)\tALT(1)\nchr1:1:A:T\tA\tT\n";
+  std::ofstream output(filename.c_str(), std::ios::binary);
+  output << content;
+  output.close();
+  EXPECT_TRUE(iddt::mapped_file::is_flat_file(filename));
+  iddt::mapped_file mapped(filename);
+  ASSERT_EQ(mapped.size(), content.size());
+  EXPECT_EQ(std::string(mapped.data(), mapped.size()), content);
+  // empty files need no mapping
+  output.open(filename.c_str(), std::ios::binary);
+  output.close();
+  EXPECT_TRUE(iddt::mapped_file::is_flat_file(filename));
+  iddt::mapped_file empty(filename);
+  EXPECT_EQ(empty.size(), 0u);
+  EXPECT_FALSE(empty.data());
+  boost::filesystem::remove_all(tmp_dir);
+}
+
+TEST(mappedFileTest, rejectsOtherInput) {
+  boost::filesystem::path tmp_dir = boost::filesystem::unique_path();
+  boost::filesystem::create_directory(tmp_dir);
+  std::string filename = (tmp_dir / "info.gz").native();
+  gzFile output = gzopen(filename.c_str(), "wb");
+  ASSERT_TRUE(output);
+  gzputs(output, "SNP\tREF(0)\tALT(1)\n");
+  gzclose(output);
+  EXPECT_FALSE(iddt::mapped_file::is_flat_file(filename));
+  EXPECT_FALSE(iddt::mapped_file::is_flat_file(tmp_dir.native()));
+  EXPECT_FALSE(
+      iddt::mapped_file::is_flat_file((tmp_dir / "missing").native()));
+  EXPECT_THROW(iddt::mapped_file(tmp_dir.native()), std::runtime_error);
+  EXPECT_THROW(iddt::mapped_file((tmp_dir / "missing").native()),
+               std::runtime_error);
+  boost::filesystem::remove_all(tmp_dir);
+}
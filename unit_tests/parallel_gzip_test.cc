@@ -0,0 +1,224 @@
+/*!
+  \file parallel_gzip_test.cc
+  \brief tests for multithreaded single-stream gzip inflation
+  \copyright Released under the MIT License. Copyright
+  2023 Lightning Auriga
+ */
+
+#include <zlib.h>
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "boost/filesystem.hpp"
+#include "gtest/gtest.h"
+#include "imputed-data-dynamic-threshold/parallel_gzip.h"
+
+namespace iddt = imputed_data_dynamic_threshold;
+
+namespace {
+std::string info_text(unsigned n_lines) {
+  std::string res = "SNP\tREF(0)\tALT(1)\tALT_Frq\tMAF\tAvgCall\tRsq\n";
+  std::uint32_t state = 12345;
+  for (unsigned i = 0; i < n_lines; ++i) {
+    state = state * 1664525u + 1013904223u;
+    unsigned frq = (state >> 8) % 100000;
+    unsigned rsq = (state >> 4) % 100000;
+    res += "chr22:" + std::to_string(16000000 + i * 37) + ":A:G\tA\tG\t0." +
+           std::to_string(frq) + "\t0." + std::to_string(frq / 2) +
+           "\t0.99\t0." + std::to_string(rsq) + "\n";
+  }
+  return res;
+}
+
+std::string deflate_text(const std::string &text, int window_bits) {
+  z_stream strm = z_stream();
+  deflateInit2(&strm, 6, Z_DEFLATED, window_bits, 8, Z_DEFAULT_STRATEGY);
+  std::string res(deflateBound(&strm, text.size()) + 32, '\0');
+  strm.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(text.data()));
+  strm.avail_in = text.size();
+  strm.next_out = reinterpret_cast<Bytef *>(&res[0]);
+  strm.avail_out = res.size();
+  deflate(&strm, Z_FINISH);
+  res.resize(res.size() - strm.avail_out);
+  deflateEnd(&strm);
+  return res;
+}
+
+/*!
+  \brief find deflate block boundaries by inflating with zlib
+  @param data raw deflate stream
+  @param bits destination for bit offsets of interior block boundaries
+  @param offsets destination for inflated offsets at each boundary
+ */
+void block_boundaries(const std::string &data,
+                      std::vector<std::uint64_t> *bits,
+                      std::vector<std::size_t> *offsets) {
+  z_stream strm = z_stream();
+  inflateInit2(&strm, -15);
+  std::vector<unsigned char> out(1 << 16);
+  strm.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.data()));
+  strm.avail_in = data.size();
+  std::size_t inflated = 0;
+  int ret = Z_OK;
+  while (ret != Z_STREAM_END) {
+    strm.next_out = out.data();
+    strm.avail_out = out.size();
+    ret = inflate(&strm, Z_BLOCK);
+    ASSERT_TRUE(ret == Z_OK || ret == Z_BUF_ERROR || ret == Z_STREAM_END);
+    inflated += out.size() - strm.avail_out;
+    if ((strm.data_type & 128) && !(strm.data_type & 64)) {
+      bits->push_back(
+          static_cast<std::uint64_t>(data.size() - strm.avail_in) * 8 -
+          (strm.data_type & 7));
+      offsets->push_back(inflated);
+    }
+  }
+  inflateEnd(&strm);
+}
+
+std::string read_all(iddt::parallel_gzip_reader *reader) {
+  std::string res = "", text = "";
+  while (reader->read(&text)) {
+    EXPECT_FALSE(text.empty());
+    res += text;
+  }
+  return res;
+}
+}  // namespace
+
+TEST(speculativeInflaterTest, decodeFromStart) {
+  std::string text = info_text(5000);
+  std::string data = deflate_text(text, -15);
+  data.append(iddt::speculative_inflater::input_padding, '\0');
+  const unsigned char *ptr = reinterpret_cast<const unsigned char *>(
+      data.data());
+  std::size_t size = data.size() - iddt::speculative_inflater::input_padding;
+  iddt::speculative_inflater inflater;
+  std::vector<std::uint16_t> symbols;
+  bool final_block = false;
+  std::uint64_t end =
+      inflater.decode(ptr, size, 0, size * 8, &symbols, &final_block, 0);
+  EXPECT_TRUE(final_block);
+  EXPECT_LE(end, size * 8);
+  EXPECT_GT(end + 8, size * 8);
+  std::string resolved = "";
+  iddt::speculative_inflater::resolve(
+      symbols.data() + iddt::speculative_inflater::window_size,
+      symbols.data() + symbols.size(), "", &resolved);
+  EXPECT_EQ(resolved, text);
+}
+
+TEST(speculativeInflaterTest, resumeAtGuessedBlock) {
+  std::string text = info_text(40000);
+  std::string data = deflate_text(text, -15);
+  std::vector<std::uint64_t> bits;
+  std::vector<std::size_t> offsets;
+  block_boundaries(data, &bits, &offsets);
+  ASSERT_GE(bits.size(), 3u);
+  data.append(iddt::speculative_inflater::input_padding, '\0');
+  const unsigned char *ptr = reinterpret_cast<const unsigned char *>(
+      data.data());
+  std::size_t size = data.size() - iddt::speculative_inflater::input_padding;
+  iddt::speculative_inflater inflater;
+  // a search starting just past one boundary finds the next one
+  std::uint64_t found = 0;
+  ASSERT_TRUE(inflater.find_block(ptr, size, bits.at(0) + 1, bits.at(1) + 1,
+                                  &found));
+  EXPECT_EQ(found, bits.at(1));
+  EXPECT_FALSE(inflater.find_block(ptr, size, bits.at(0) + 1, bits.at(0) + 64,
+                                   &found));
+  // decoding stops at the first boundary at or past the stop offset
+  std::vector<std::uint16_t> symbols;
+  bool final_block = true;
+  std::uint64_t end = inflater.decode(ptr, size, bits.at(1), bits.at(1) + 1,
+                                      &symbols, &final_block, 0);
+  EXPECT_FALSE(final_block);
+  EXPECT_EQ(end, bits.at(2));
+  std::size_t offset = offsets.at(1);
+  std::string window = text.substr(offset - 32768, 32768), resolved = "";
+  iddt::speculative_inflater::resolve(
+      symbols.data() + iddt::speculative_inflater::window_size,
+      symbols.data() + symbols.size(), window, &resolved);
+  EXPECT_EQ(resolved, text.substr(offset, offsets.at(2) - offset));
+  // text repeated from before the block cannot be resolved without it
+  EXPECT_THROW(iddt::speculative_inflater::resolve(
+                   symbols.data() + iddt::speculative_inflater::window_size,
+                   symbols.data() + symbols.size(), "", &resolved),
+               std::runtime_error);
+}
+
+TEST(parallelGzipReaderTest, matchesSerialInflation) {
+  boost::filesystem::path tmp_dir = boost::filesystem::unique_path();
+  boost::filesystem::create_directory(tmp_dir);
+  std::string filename = (tmp_dir / "info.gz").native();
+  std::string text = info_text(60000);
+  std::ofstream output(filename.c_str(), std::ios::binary);
+  output << deflate_text(text, 15 + 16);
+  output.close();
+  ASSERT_TRUE(iddt::parallel_gzip_reader::detect_gzip(filename));
+  for (unsigned n_threads = 1; n_threads <= 4; ++n_threads) {
+    // small segments give many rounds, each with several guesses
+    iddt::parallel_gzip_reader reader(filename, n_threads, 20000);
+    EXPECT_EQ(read_all(&reader), text);
+    if (n_threads > 1) {
+      EXPECT_GT(reader.confirmed_guesses(), 0u);
+    } else {
+      EXPECT_EQ(reader.confirmed_guesses(), 0u);
+    }
+  }
+  boost::filesystem::remove_all(tmp_dir);
+}
+
+TEST(parallelGzipReaderTest, concatenatedMembers) {
+  boost::filesystem::path tmp_dir = boost::filesystem::unique_path();
+  boost::filesystem::create_directory(tmp_dir);
+  std::string filename = (tmp_dir / "info.gz").native();
+  std::string first = info_text(20000), second = info_text(100);
+  std::ofstream output(filename.c_str(), std::ios::binary);
+  // an empty member, and trailing data that is not a member
+  output << deflate_text(first, 15 + 16) << deflate_text("", 15 + 16)
+         << deflate_text(second, 15 + 16) << std::string(5, '\0');
+  output.close();
+  iddt::parallel_gzip_reader reader(filename, 3, 10000);
+  EXPECT_EQ(read_all(&reader), first + second);
+  boost::filesystem::remove_all(tmp_dir);
+}
+
+TEST(parallelGzipReaderTest, invalidInput) {
+  boost::filesystem::path tmp_dir = boost::filesystem::unique_path();
+  boost::filesystem::create_directory(tmp_dir);
+  std::string filename = (tmp_dir / "info.gz").native();
+  std::string data = deflate_text(info_text(20000), 15 + 16);
+  std::string text = "";
+  // a corrupted CRC32 in the trailer
+  data[data.size() - 8] ^= 1;
+  std::ofstream output(filename.c_str(), std::ios::binary);
+  output << data;
+  output.close();
+  iddt::parallel_gzip_reader corrupt(filename, 2, 10000);
+  EXPECT_THROW(read_all(&corrupt), std::runtime_error);
+  // a truncated member
+  output.open(filename.c_str(), std::ios::binary);
+  output << data.substr(0, data.size() / 2);
+  output.close();
+  iddt::parallel_gzip_reader truncated(filename, 2, 10000);
+  EXPECT_THROW(read_all(&truncated), std::runtime_error);
+  // flat text
+  output.open(filename.c_str(), std::ios::binary);
+  output << "SNP\tREF(0)\tALT(1)\n";
+  output.close();
+  EXPECT_FALSE(iddt::parallel_gzip_reader::detect_gzip(filename));
+  iddt::parallel_gzip_reader flat(filename, 2, 10000);
+  EXPECT_THROW(flat.read(&text), std::runtime_error);
+  EXPECT_THROW(flat.read(0), std::logic_error);
+  EXPECT_THROW(iddt::parallel_gzip_reader(filename, 0, 10000),
+               std::logic_error);
+  EXPECT_THROW(iddt::parallel_gzip_reader(filename, 2, 0), std::logic_error);
+  EXPECT_THROW(
+      iddt::parallel_gzip_reader((tmp_dir / "missing.gz").native(), 2, 10000),
+      std::runtime_error);
+  boost::filesystem::remove_all(tmp_dir);
+}
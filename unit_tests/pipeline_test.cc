@@ -0,0 +1,87 @@
+/*!
+  \file pipeline_test.cc
+  \brief tests for staged input loading support
+  \copyright Released under the MIT License. Copyright
+  2023 Lightning Auriga
+ */
+
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "imputed-data-dynamic-threshold/pipeline.h"
+
+namespace iddt = imputed_data_dynamic_threshold;
+
+TEST(boundedQueueTest, pushAndPop) {
+  iddt::bounded_queue<unsigned> q(3);
+  unsigned value = 0;
+  // wrap around the ring more than once
+  for (unsigned i = 0; i < 10; ++i) {
+    EXPECT_TRUE(q.push(i, 0));
+    EXPECT_TRUE(q.push(i + 100, 0));
+    EXPECT_TRUE(q.pop(&value, 0));
+    EXPECT_EQ(value, i);
+    EXPECT_TRUE(q.pop(&value, 0));
+    EXPECT_EQ(value, i + 100);
+  }
+  EXPECT_THROW(q.pop(0, 0), std::logic_error);
+}
+
+TEST(boundedQueueTest, producerConsumer) {
+  // a tiny queue forces both sides to wait on each other
+  iddt::bounded_queue<unsigned> q(2);
+  double producer_waited = 0.0, consumer_waited = 0.0;
+  std::thread producer([&]() {
+    for (unsigned i = 1; i <= 100000; ++i) q.push(i, &producer_waited);
+    q.push(0, &producer_waited);
+  });
+  std::vector<unsigned> received;
+  unsigned value = 0;
+  while (q.pop(&value, &consumer_waited) && value) received.push_back(value);
+  producer.join();
+  ASSERT_EQ(received.size(), 100000u);
+  for (unsigned i = 0; i < received.size(); ++i) {
+    EXPECT_EQ(received.at(i), i + 1);
+  }
+  EXPECT_GE(producer_waited, 0.0);
+  EXPECT_GE(consumer_waited, 0.0);
+}
+
+TEST(boundedQueueTest, cancel) {
+  iddt::bounded_queue<unsigned> q(1);
+  unsigned value = 0;
+  EXPECT_TRUE(q.push(1, 0));
+  // cancelling releases a thread waiting on a full queue
+  std::thread producer([&]() { EXPECT_FALSE(q.push(2, 0)); });
+  q.cancel();
+  producer.join();
+  EXPECT_FALSE(q.pop(&value, 0));
+  EXPECT_FALSE(q.push(3, 0));
+}
+
+TEST(boundedQueueTest, invalidCapacity) {
+  EXPECT_THROW(iddt::bounded_queue<unsigned>(0), std::logic_error);
+}
+
+TEST(pipelineWaitTimesTest, mergeAndReport) {
+  iddt::pipeline_wait_times a, b;
+  EXPECT_DOUBLE_EQ(a.parse.starved, 0.0);
+  b.decompress.blocked = 1.5;
+  b.parse.starved = 0.25;
+  b.parse.blocked = 0.5;
+  b.aggregate.starved = 2.0;
+  a.merge(b);
+  a.merge(b);
+  EXPECT_DOUBLE_EQ(a.decompress.blocked, 3.0);
+  EXPECT_DOUBLE_EQ(a.parse.starved, 0.5);
+  EXPECT_DOUBLE_EQ(a.parse.blocked, 1.0);
+  EXPECT_DOUBLE_EQ(a.aggregate.starved, 4.0);
+  std::ostringstream out;
+  a.report(out);
+  EXPECT_EQ(out.str(),
+            "\tdecompress: blocked 3s\n"
+            "\tparse: starved 0.5s, blocked 1s\n"
+            "\taggregate: starved 4s\n");
+}
@@ -5,6 +5,14 @@
   2023 Lightning Auriga
  */
 
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
 #include "gtest/gtest.h"
 #include "imputed-data-dynamic-threshold/r2_bins.h"
 
@@ -58,6 +66,29 @@ TEST(r2BinTest, addValue) {
   EXPECT_EQ(a.get_filtered_count(), 2u);
 }
 
+TEST(r2BinTest, idsStoredOnlyWhenPresent) {
+  iddt::r2_bin a;
+  a.add_value("", 0.4f);
+  a.add_value("", 0.5f);
+  std::vector<float> values;
+  values.push_back(0.4f);
+  values.push_back(0.5f);
+  EXPECT_EQ(a.get_values(), values);
+  std::vector<std::pair<std::string, float> > vec;
+  vec.push_back(std::pair<std::string, float>("", 0.4f));
+  vec.push_back(std::pair<std::string, float>("", 0.5f));
+  EXPECT_TRUE(iddt::string_float_vector_equals(a.get_data(), vec));
+  // earlier values get empty IDs once an ID is seen
+  a.add_value("c", 0.3f);
+  vec.push_back(std::pair<std::string, float>("c", 0.3f));
+  EXPECT_TRUE(iddt::string_float_vector_equals(a.get_data(), vec));
+  a.compute_threshold(0.1);
+  std::ostringstream o1, o2;
+  a.report_threshold(o1);
+  a.report_passing_variants(o2);
+  EXPECT_EQ(o2.str(), "c\n\n\n");
+}
+
 TEST(r2BinTest, computeThreshold) {
   iddt::r2_bin a;
   a.add_value("a", 0.4f);
@@ -89,6 +120,106 @@ TEST(r2BinTest, computeThreshold) {
   EXPECT_EQ(c.get_filtered_count(), 0u);
 }
 
+TEST(r2BinTest, computeThresholdMatchesFullSort) {
+  std::mt19937 generator(7);
+  std::uniform_real_distribution<float> r2(0.3f, 1.0f);
+  std::uniform_int_distribution<int> coarse(30, 100);
+  for (unsigned rep = 0; rep < 40; ++rep) {
+    iddt::r2_bin a;
+    std::vector<std::pair<std::string, float> > reference;
+    unsigned n = 1 + rep * 250;
+    for (unsigned i = 0; i < n; ++i) {
+      // alternate between mostly distinct and heavily tied values
+      float val = rep % 2 ? r2(generator) : coarse(generator) / 100.0f;
+      std::string id = rep % 4 < 2 ? "" : "v" + std::to_string(i);
+      a.add_value(id, val);
+      reference.push_back(std::make_pair(id, val));
+    }
+    // the full sort and removal loop this replaces
+    double target = 0.5 + rep * 0.01, total = a.get_total();
+    double target_sum = n * target;
+    unsigned filtered = n;
+    std::sort(reference.begin(), reference.end(), iddt::string_float_less_than);
+    while (filtered && total < target_sum) {
+      total -= reference.at(n - filtered).second;
+      --filtered;
+      target_sum -= target;
+    }
+    if (filtered < n && filtered) {
+      while (fabs(reference.at(n - filtered).second -
+                  reference.at(n - filtered - 1).second) < DBL_EPSILON) {
+        total -= reference.at(n - filtered).second;
+        --filtered;
+      }
+    }
+    a.compute_threshold(target);
+    EXPECT_EQ(a.get_total(), total);
+    EXPECT_EQ(a.get_filtered_count(), filtered);
+    if (rep % 4 >= 2) {
+      // with IDs, passing values are fully ordered
+      for (unsigned i = 1; i < n; ++i) {
+        EXPECT_LE(a.get_values().at(i - 1), a.get_values().at(i));
+      }
+    }
+  }
+}
+
+TEST(r2BinTest, histogramMatchesSortedThreshold) {
+  std::mt19937 generator(42);
+  std::uniform_int_distribution<int> cell(0, 100);
+  std::vector<double> targets;
+  targets.push_back(0.3);
+  targets.push_back(0.55);
+  targets.push_back(0.7);
+  targets.push_back(0.99);
+  for (std::vector<double>::const_iterator target = targets.begin();
+       target != targets.end(); ++target) {
+    iddt::r2_bin a, b;
+    b.set_histogram_scale(100);
+    EXPECT_EQ(b.get_histogram_scale(), 100u);
+    // coarse values so that there are many ties
+    for (unsigned i = 0; i < 5000; ++i) {
+      float val = iddt::from_string<float>(std::to_string(cell(generator)) +
+                                           "e-2");
+      a.add_value("", val);
+      b.add_value("", val);
+    }
+    a.compute_threshold(*target);
+    b.compute_threshold(*target);
+    EXPECT_EQ(a.get_total(), b.get_total());
+    EXPECT_EQ(a.get_filtered_count(), b.get_filtered_count());
+    EXPECT_TRUE(b.get_data().empty());
+    std::ostringstream oa, ob;
+    a.report_threshold(oa);
+    b.report_threshold(ob);
+    EXPECT_EQ(oa.str(), ob.str());
+    EXPECT_EQ(a.report_stored_threshold(), b.report_stored_threshold());
+  }
+}
+
+TEST(r2BinTest, histogramSpillsOffGridValues) {
+  iddt::r2_bin a, b;
+  b.set_histogram_scale(100);
+  a.add_value("", 0.5f);
+  b.add_value("", 0.5f);
+  a.add_value("", 0.125f);
+  b.add_value("", 0.125f);
+  EXPECT_EQ(b.get_histogram_scale(), 0u);
+  EXPECT_EQ(b.get_data().size(), 2u);
+  a.add_value("", 0.2f);
+  b.add_value("", 0.2f);
+  a.compute_threshold(0.4);
+  b.compute_threshold(0.4);
+  EXPECT_EQ(a.get_total(), b.get_total());
+  EXPECT_EQ(a.get_filtered_count(), b.get_filtered_count());
+  // variant IDs cannot be counted
+  iddt::r2_bin c;
+  c.set_histogram_scale(100);
+  c.add_value("a", 0.5f);
+  EXPECT_EQ(c.get_histogram_scale(), 0u);
+  EXPECT_THROW(c.set_histogram_scale(100), std::logic_error);
+}
+
 TEST(r2BinTest, reportThreshold) {
   iddt::r2_bin a;
   a.set_bin_bounds(0.1, 0.2);
@@ -191,3 +322,99 @@ TEST(r2BinTest, getFilteredCount) {
   a.add_value("b", 0.25f);
   EXPECT_EQ(a.get_filtered_count(), 2u);
 }
+
+TEST(r2BinTest, merge) {
+  iddt::r2_bin a, b, c;
+  a.set_bin_bounds(0.1, 0.2);
+  b.set_bin_bounds(0.1, 0.2);
+  c.set_bin_bounds(0.1, 0.2);
+  a.add_value("a", 0.4f);
+  b.add_value("b", 0.5f);
+  b.add_value("c", 0.6f);
+  c.add_value("a", 0.4f);
+  c.add_value("b", 0.5f);
+  c.add_value("c", 0.6f);
+  a.merge(b);
+  EXPECT_EQ(a, c);
+  iddt::r2_bin d;
+  d.set_bin_bounds(0.2, 0.3);
+  EXPECT_THROW(a.merge(d), std::logic_error);
+}
+
+TEST(r2BinTest, mergeSummary) {
+  // counted values on the same grid are added cell by cell
+  iddt::r2_bin a, b, c;
+  a.set_histogram_scale(100);
+  b.set_histogram_scale(100);
+  c.set_histogram_scale(100);
+  a.add_value("", 0.5f);
+  b.add_value("", 0.5f);
+  b.add_value("", 0.75f);
+  c.add_value("", 0.5f);
+  c.add_value("", 0.5f);
+  c.add_value("", 0.75f);
+  a.merge_summary(b);
+  EXPECT_EQ(a, c);
+  // stored values, and counts from another grid, are added one by one
+  iddt::r2_bin d, e;
+  d.add_value("", 0.25f);
+  d.add_value("", 0.125f);
+  a.merge_summary(d);
+  e.set_histogram_scale(1000);
+  e.add_value("", 0.5f);
+  a.merge_summary(e);
+  EXPECT_EQ(a.get_histogram_scale(), 0u);
+  EXPECT_EQ(a.get_total_count(), 6u);
+  EXPECT_EQ(a.get_filtered_count(), 6u);
+  EXPECT_FLOAT_EQ(a.get_total(), 2.625f);
+  a.compute_threshold(0.5);
+  c.merge_summary(d);
+  c.merge_summary(e);
+  c.compute_threshold(0.5);
+  EXPECT_EQ(a.get_filtered_count(), c.get_filtered_count());
+  EXPECT_DOUBLE_EQ(a.get_total(), c.get_total());
+  iddt::r2_bin f, g;
+  f.set_bin_bounds(0.2, 0.3);
+  EXPECT_THROW(a.merge_summary(f), std::logic_error);
+  g.add_value("a", 0.5f);
+  EXPECT_THROW(b.merge_summary(g), std::logic_error);
+}
+
+TEST(r2BinTest, saveAndLoadSummary) {
+  iddt::r2_bin a, b, loaded_a, loaded_b;
+  a.set_bin_bounds(0.1, 0.2);
+  b.set_bin_bounds(0.1, 0.2);
+  loaded_a.set_bin_bounds(0.1, 0.2);
+  loaded_b.set_bin_bounds(0.1, 0.2);
+  a.set_histogram_scale(100000);
+  loaded_b.set_histogram_scale(100000);
+  for (unsigned i = 0; i < 1000; ++i) {
+    a.add_value("", (i % 71) / 100.0f);
+    b.add_value("", (i % 13) / 8.0f);
+  }
+  std::stringstream summaries;
+  a.save_summary(summaries);
+  b.save_summary(summaries);
+  loaded_a.load_summary(summaries);
+  loaded_b.load_summary(summaries);
+  EXPECT_EQ(loaded_a, a);
+  EXPECT_EQ(loaded_b, b);
+  EXPECT_EQ(summaries.peek(), EOF);
+  EXPECT_THROW(a.load_summary(summaries), std::logic_error);
+  // damaged input and other bin bounds leave the bin unchanged
+  std::stringstream saved;
+  a.save_summary(saved);
+  std::string text = saved.str();
+  iddt::r2_bin c, d;
+  c.set_bin_bounds(0.1, 0.2);
+  std::istringstream truncated(text.substr(0, text.size() - 1));
+  EXPECT_THROW(c.load_summary(truncated), std::runtime_error);
+  EXPECT_EQ(c.get_total_count(), 0u);
+  d.set_bin_bounds(0.2, 0.3);
+  std::istringstream other_bounds(text);
+  EXPECT_THROW(d.load_summary(other_bounds), std::runtime_error);
+  EXPECT_EQ(d.get_total_count(), 0u);
+  iddt::r2_bin e;
+  e.add_value("a", 0.5f);
+  EXPECT_THROW(e.save_summary(saved), std::logic_error);
+}
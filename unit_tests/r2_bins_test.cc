@@ -19,6 +19,25 @@ r2BinsTest::~r2BinsTest() throw() {
   }
 }
 
+void r2BinsTest::create_long_info_file(const std::string &filename,
+                                       unsigned n_lines) const {
+  gzFile output = gzopen(filename.c_str(), "wb");
+  if (!output) {
+    throw std::runtime_error("cannot write info test file");
+  }
+  gzputs(output,
+         "SNP\tREF(0)\tALT(1)\tALT_Frq\tMAF\tAvgCall\tRsq\tGenotyped\t"
+         "LooRsq\tEmpR\tEmpRsq\tDose0\tDose1\n");
+  for (unsigned i = 0; i < n_lines; ++i) {
+    std::ostringstream line;
+    line << "chr1:" << i + 1 << ":A:T\tA\tT\t0.1\t" << (i % 97) / 200.0
+         << "\t0.1\t" << (i % 101) / 100.0 << "\t"
+         << (i % 7 ? "Imputed" : "Genotyped") << "\t-\t-\t-\t-\t-\n";
+    gzputs(output, line.str().c_str());
+  }
+  gzclose(output);
+}
+
 TEST_F(r2BinsTest, r2BinsDefaultConstructor) {
   iddt::r2_bins a;
   std::vector<iddt::r2_bin> vec;
@@ -90,6 +109,75 @@ TEST_F(r2BinsTest, r2BinsFindMafBin) {
   EXPECT_EQ(a.find_maf_bin(0.55), 2u);
 }
 
+TEST_F(r2BinsTest, r2BinsFindMafBinMatchesMapSearch) {
+  std::mt19937 generator(2023);
+  std::uniform_real_distribution<double> uniform(0.0, 0.6);
+  std::uniform_int_distribution<unsigned> n_bins(1, 12);
+  for (unsigned trial = 0; trial < 200; ++trial) {
+    std::vector<double> bounds;
+    for (unsigned i = 0; i <= n_bins(generator); ++i) {
+      bounds.push_back(uniform(generator));
+    }
+    std::sort(bounds.begin(), bounds.end());
+    bounds.erase(std::unique(bounds.begin(), bounds.end()), bounds.end());
+    if (bounds.size() < 2) continue;
+    iddt::r2_bins a;
+    a.set_bin_boundaries(bounds);
+    // probe the bounds themselves and their closest neighbors, where
+    // the epsilon adjustments apply, as well as arbitrary values
+    std::vector<double> queries;
+    for (std::vector<double>::const_iterator iter = bounds.begin();
+         iter != bounds.end(); ++iter) {
+      queries.push_back(*iter);
+      queries.push_back(nextafter(*iter, -1.0));
+      queries.push_back(nextafter(*iter, 1.0));
+      queries.push_back(*iter - DBL_EPSILON);
+      queries.push_back(*iter + DBL_EPSILON);
+    }
+    for (unsigned i = 0; i < 1000; ++i) queries.push_back(uniform(generator));
+    queries.push_back(-1.0);
+    queries.push_back(0.0);
+    queries.push_back(1.0);
+    queries.push_back(NAN);
+    for (std::vector<double>::const_iterator iter = queries.begin();
+         iter != queries.end(); ++iter) {
+      EXPECT_EQ(a.find_maf_bin(*iter), a.find_maf_bin_by_map(*iter))
+          << "maf " << *iter << " with " << bounds.size() << " bounds";
+    }
+  }
+}
+
+TEST_F(r2BinsTest, r2BinsAddBatch) {
+  iddt::r2_bins a, b;
+  std::vector<double> bounds;
+  bounds.push_back(0.001);
+  bounds.push_back(0.03);
+  bounds.push_back(0.5);
+  a.set_bin_boundaries(bounds);
+  b.set_bin_boundaries(bounds);
+  iddt::variant_batch batch(10);
+  batch.add_imputed(0.44231f, 0.2, "chr1:1:A:T");
+  batch.add_typed("chr1:2:A:T");
+  // below the baseline
+  batch.add_imputed(0.1f, 0.2, "chr1:3:A:T");
+  // folded to 0.01
+  batch.add_imputed(0.99991f, 0.99, "chr1:4:A:T");
+  // outside all bins
+  batch.add_imputed(0.9f, 0.0001, "chr1:5:A:T");
+  batch.add_imputed(0.34113f, 0.03, "chr1:6:A:T");
+  a.add_batch(&batch, true);
+  EXPECT_EQ(batch.size(), 0u);
+  b.get_bins().at(1).add_value("chr1:1:A:T", 0.44231f);
+  b.get_bins().at(0).add_value("chr1:4:A:T", 0.99991f);
+  b.get_bins().at(0).add_value("chr1:6:A:T", 0.34113f);
+  EXPECT_EQ(a, b);
+  EXPECT_EQ(a.get_typed_variants(), std::vector<std::string>(1, "chr1:2:A:T"));
+  // without folding, the frequency 0.99 is out of range
+  batch.add_imputed(0.99991f, 0.99, "chr1:4:A:T");
+  a.add_batch(&batch, false);
+  EXPECT_EQ(a, b);
+}
+
 TEST_F(r2BinsTest, r2BinsLoadInfoFiles) {
   iddt::r2_bins a, b, c, d;
   std::vector<double> bounds;
@@ -145,8 +233,8 @@ TEST_F(r2BinsTest, r2BinsLoadInfoFiles) {
   b.get_bins().at(1).add_value("chr1:1:A:T", 0.44231f);
   b.get_bins().at(0).add_value("chr1:3:G:A", 0.99991f);
   b.get_bins().at(1).add_value("chr1:4:T:A", 0.34113f);
-  b.get_typed_variants().push_back("chr1:6:A:C");
-  b.get_typed_variants().push_back("chr1:7:A:C");
+  b.add_typed_variant("chr1:6:A:C");
+  b.add_typed_variant("chr1:7:A:C");
   EXPECT_TRUE(a == b);
   EXPECT_THROW(a.load_info_file(bad_file.string().c_str(), true),
                std::runtime_error);
@@ -160,6 +248,75 @@ TEST_F(r2BinsTest, r2BinsLoadInfoFiles) {
   EXPECT_FALSE(a == c);
 }
 
+TEST_F(r2BinsTest, r2BinsLoadInfoFilesMultithreaded) {
+  iddt::r2_bins a, b, c, d;
+  std::vector<double> bounds;
+  bounds.push_back(0.001);
+  bounds.push_back(0.03);
+  bounds.push_back(0.5);
+  boost::filesystem::path filename =
+      boost::filesystem::path(std::string(_tmp_dir)) /
+      "r2_bins_test_multithreaded.info.gz";
+  // enough lines to be split over several chunks
+  create_long_info_file(filename.string(), 60000);
+  a.set_bin_boundaries(bounds);
+  b.set_bin_boundaries(bounds);
+  c.set_bin_boundaries(bounds);
+  d.set_bin_boundaries(bounds);
+  a.load_info_file(filename.string(), true);
+  b.load_info_file(filename.string(), true, 3);
+  EXPECT_EQ(a, b);
+  EXPECT_EQ(a.get_typed_variants(), b.get_typed_variants());
+  c.load_info_file(filename.string(), false);
+  d.load_info_file(filename.string(), false, 4);
+  EXPECT_EQ(c, d);
+}
+
+TEST_F(r2BinsTest, r2BinsLoadInfoFilesPipelined) {
+  iddt::r2_bins a, b, c;
+  std::vector<double> bounds;
+  bounds.push_back(0.001);
+  bounds.push_back(0.03);
+  bounds.push_back(0.5);
+  boost::filesystem::path filename =
+      boost::filesystem::path(std::string(_tmp_dir)) /
+      "r2_bins_test_pipelined.info.gz";
+  // enough lines to fill several chunks and batches
+  create_long_info_file(filename.string(), 60000);
+  a.set_bin_boundaries(bounds);
+  b.set_bin_boundaries(bounds);
+  c.set_bin_boundaries(bounds);
+  iddt::pipeline_wait_times times;
+  a.load_info_file(filename.string(), true);
+  b.load_info_file_pipelined(filename.string(), true, &times);
+  EXPECT_EQ(a, b);
+  EXPECT_EQ(a.get_typed_variants(), b.get_typed_variants());
+  // a second file is appended after the first
+  a.load_info_file(filename.string(), true);
+  b.load_info_file_pipelined(filename.string(), true, &times);
+  EXPECT_EQ(a, b);
+  EXPECT_GE(times.parse.starved, 0.0);
+  // errors from any stage are reported on the calling thread
+  EXPECT_THROW(c.load_info_file_pipelined(
+                   (boost::filesystem::path(std::string(_tmp_dir)) / "missing")
+                       .string(),
+                   true, &times),
+               std::runtime_error);
+  boost::filesystem::path bad_file =
+      boost::filesystem::path(std::string(_tmp_dir)) /
+      "r2_bins_test_pipelined_bad.info.gz";
+  gzFile output = gzopen(bad_file.string().c_str(), "wb");
+  ASSERT_TRUE(output);
+  gzputs(output, "SNP\tREF(0)\n");
+  for (unsigned i = 0; i < 20000; ++i) {
+    gzputs(output, "chr1:1:A:T\tA\tT\t0.1\t0.1\t0.1\t0.5\tImputed\n");
+  }
+  gzputs(output, "chr1:2:A:T\tA\n");
+  gzclose(output);
+  EXPECT_THROW(c.load_info_file_pipelined(bad_file.string(), true, &times),
+               std::runtime_error);
+}
+
 TEST_F(r2BinsTest, r2BinsLoadVcfFiles) {
   iddt::r2_bins a, b, c, d;
   std::vector<double> bounds;
@@ -174,8 +331,8 @@ TEST_F(r2BinsTest, r2BinsLoadVcfFiles) {
   b.get_bins().at(1).add_value("chr1:1:A:T", 0.44231f);
   b.get_bins().at(0).add_value("chr1:3:G:A", 0.99991f);
   b.get_bins().at(1).add_value("chr1:4:T:A", 0.34113f);
-  b.get_typed_variants().push_back("chr1:6:A:C");
-  b.get_typed_variants().push_back("chr1:7:A:C");
+  b.add_typed_variant("chr1:6:A:C");
+  b.add_typed_variant("chr1:7:A:C");
   EXPECT_TRUE(a == b);
   c.set_bin_boundaries(bounds);
   c.load_vcf_file(good_file.string().c_str(), "DR2", "AF", "IMP", false);
@@ -187,6 +344,94 @@ TEST_F(r2BinsTest, r2BinsLoadVcfFiles) {
   EXPECT_FALSE(a == c);
 }
 
+TEST_F(r2BinsTest, r2BinsLoadVcfFilesMultithreaded) {
+  iddt::r2_bins a, b;
+  std::vector<double> bounds;
+  bounds.push_back(0.001);
+  bounds.push_back(0.03);
+  bounds.push_back(0.5);
+  a.set_bin_boundaries(bounds);
+  b.set_bin_boundaries(bounds);
+  a.load_vcf_file("unit_tests/test.vcf.gz", "DR2", "AF", "IMP", true);
+  b.load_vcf_file("unit_tests/test.vcf.gz", "DR2", "AF", "IMP", true, 3);
+  EXPECT_EQ(a, b);
+  EXPECT_EQ(a.get_typed_variants(), b.get_typed_variants());
+  iddt::r2_bins c;
+  iddt::pipeline_wait_times times;
+  c.set_bin_boundaries(bounds);
+  c.load_vcf_file_pipelined("unit_tests/test.vcf.gz", "DR2", "AF", "IMP", true,
+                            &times);
+  EXPECT_EQ(a, c);
+  EXPECT_EQ(a.get_typed_variants(), c.get_typed_variants());
+  // imputed variants must carry both r2 and frequency
+  EXPECT_THROW(
+      a.load_vcf_file("unit_tests/test.vcf.gz", "R2", "AF", "IMP", true),
+      std::runtime_error);
+}
+
+TEST_F(r2BinsTest, r2BinsMerge) {
+  iddt::r2_bins a, b, c, d;
+  std::vector<double> bounds;
+  bounds.push_back(0.001);
+  bounds.push_back(0.03);
+  bounds.push_back(0.5);
+  a.set_bin_boundaries(bounds);
+  b.set_bin_boundaries(bounds);
+  c.set_bin_boundaries(bounds);
+  a.get_bins().at(1).add_value("chr1:1:A:T", 0.44231f);
+  a.add_typed_variant("chr1:6:A:C");
+  b.get_bins().at(0).add_value("chr2:3:G:A", 0.99991f);
+  b.get_bins().at(1).add_value("chr2:4:T:A", 0.34113f);
+  b.add_typed_variant("chr2:6:A:C");
+  c.get_bins().at(1).add_value("chr1:1:A:T", 0.44231f);
+  c.get_bins().at(0).add_value("chr2:3:G:A", 0.99991f);
+  c.get_bins().at(1).add_value("chr2:4:T:A", 0.34113f);
+  c.add_typed_variant("chr1:6:A:C");
+  c.add_typed_variant("chr2:6:A:C");
+  a.merge(b);
+  EXPECT_EQ(a, c);
+  EXPECT_EQ(a.get_typed_variants(), c.get_typed_variants());
+  EXPECT_THROW(a.merge(d), std::logic_error);
+}
+
+TEST_F(r2BinsTest, r2BinsSummaries) {
+  iddt::r2_bins a;
+  std::vector<double> bounds;
+  bounds.push_back(0.001);
+  bounds.push_back(0.03);
+  bounds.push_back(0.5);
+  a.set_bin_boundaries(bounds);
+  a.set_histogram_scale(100000);
+  iddt::r2_bins b = a.empty_copy(), c = a.empty_copy();
+  a.get_bins().at(0).add_value("", 0.99991f);
+  a.get_bins().at(1).add_value("", 0.44231f);
+  a.get_bins().at(1).add_value("", 0.34113f);
+  std::stringstream summary;
+  a.save_summary(summary);
+  b.load_summary(summary);
+  EXPECT_EQ(a, b);
+  // summaries merge into bins that count their values
+  c.set_histogram_scale(100000);
+  c.merge_summary(b);
+  c.merge_summary(b);
+  EXPECT_EQ(c.get_bins().at(1).get_total_count(), 4u);
+  EXPECT_DOUBLE_EQ(c.get_bins().at(1).get_total(),
+                   2 * a.get_bins().at(1).get_total());
+  // bins must match
+  std::vector<double> other_bounds;
+  other_bounds.push_back(0.001);
+  other_bounds.push_back(0.5);
+  iddt::r2_bins d;
+  d.set_bin_boundaries(other_bounds);
+  std::istringstream saved(summary.str());
+  EXPECT_THROW(d.load_summary(saved), std::runtime_error);
+  EXPECT_THROW(d.merge_summary(a), std::logic_error);
+  // typed variants are only kept with IDs, and are not summarized
+  a.add_typed_variant("chr1:6:A:C");
+  EXPECT_THROW(a.save_summary(summary), std::logic_error);
+  EXPECT_THROW(c.merge_summary(a), std::logic_error);
+}
+
 TEST_F(r2BinsTest, r2BinsComputeThresholds) {
   iddt::r2_bins a, b;
   iddt::r2_bin bin1, bin2;
@@ -312,6 +557,50 @@ TEST_F(r2BinsTest, r2BinsReportPassingVariantsFromVcfFile) {
             o2.str());
 }
 
+TEST_F(r2BinsTest, r2BinsReportPassingVariantsFromSites) {
+  iddt::r2_bins a;
+  std::vector<double> bounds;
+  bounds.push_back(0.001);
+  bounds.push_back(0.03);
+  bounds.push_back(0.5);
+  a.set_bin_boundaries(bounds);
+  a.set_site_recording(true);
+  iddt::r2_bins b = a.empty_copy();
+  // use pre-existing test vcf
+  std::string good_file = "unit_tests/test.vcf.gz";
+  a.load_vcf_file(good_file, "DR2", "AF", "IMP", false);
+  // chunked loads record the same rows
+  b.load_vcf_file(good_file, "DR2", "AF", "IMP", false, 3);
+  ASSERT_EQ(a.get_sites().size(), b.get_sites().size());
+  EXPECT_GT(a.get_sites().size(), 0u);
+  for (unsigned i = 0; i < a.get_sites().size(); ++i) {
+    EXPECT_EQ(a.get_sites().get_id(i), b.get_sites().get_id(i));
+    EXPECT_EQ(a.get_sites().get_bin(i), b.get_sites().get_bin(i));
+  }
+  // the bins themselves keep no IDs
+  EXPECT_TRUE(a.get_typed_variants().empty());
+  a.compute_thresholds(0.42f);
+  std::ostringstream o1, o2, o3;
+  a.report_thresholds(o1);
+  std::string table_file =
+      (boost::filesystem::path(std::string(_tmp_dir)) / "test.sites")
+          .string();
+  std::ofstream output(table_file.c_str(), std::ios::binary);
+  a.get_sites().save(output, "key", a.get_bins().size());
+  output.close();
+  iddt::mapped_site_table table(table_file, "key");
+  a.report_passing_sites(table, o2);
+  a.report_passing_vcf_variants(good_file, "DR2", "AF", "IMP", o3);
+  EXPECT_EQ(o2.str(), o3.str());
+  // tables are only used with the bins they were recorded with
+  std::vector<double> other_bounds;
+  other_bounds.push_back(0.001);
+  other_bounds.push_back(0.5);
+  iddt::r2_bins c;
+  c.set_bin_boundaries(other_bounds);
+  EXPECT_THROW(c.report_passing_sites(table, o2), std::runtime_error);
+}
+
 TEST_F(r2BinsTest, r2BinsReportPassingVariantsFromInfoFile) {
   iddt::r2_bins a;
   std::vector<double> bounds;
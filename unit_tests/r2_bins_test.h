@@ -10,10 +10,15 @@
 
 #include <zlib.h>
 
+#include <algorithm>
 #include <cfloat>
 #include <cmath>
 #include <filesystem>
+#include <fstream>
 #include <map>
+#include <random>
+#include <sstream>
+#include <stdexcept>
 #include <string>
 #include <vector>
 
@@ -25,6 +30,16 @@ class r2BinsTest : public testing::Test {
  protected:
   r2BinsTest();
   ~r2BinsTest() throw();
+  /*!
+    \brief write a gzipped minimac4 info file with many varied lines
+    @param filename name of file to write
+    @param n_lines number of variant lines after the header
+
+    MAF, r2 and imputation status cycle with different periods, so
+    that every bin and the baseline filter see a mix of variants
+   */
+  void create_long_info_file(const std::string &filename,
+                             unsigned n_lines) const;
   const std::string _tmp_dir;
 };
 
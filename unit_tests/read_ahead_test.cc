@@ -0,0 +1,117 @@
+/*!
+  \file read_ahead_test.cc
+  \brief tests for sequential input with reads in flight
+  \copyright Released under the MIT License. Copyright
+  2023 Lightning Auriga
+ */
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "boost/filesystem.hpp"
+#include "gtest/gtest.h"
+#include "imputed-data-dynamic-threshold/read_ahead.h"
+
+namespace iddt = imputed_data_dynamic_threshold;
+
+TEST(readAheadFileTest, readsWholeFile) {
+  boost::filesystem::path tmp_dir = boost::filesystem::unique_path();
+  boost::filesystem::create_directory(tmp_dir);
+  std::string filename = (tmp_dir / "input.gz").native();
+  std::string content = "";
+  for (unsigned i = 0; i < 20000; ++i) content += std::to_string(i) + "\n";
+  std::ofstream output(filename.c_str(), std::ios::binary);
+  output << content;
+  output.close();
+  // reads that straddle buffers, match them, and span several
+  for (unsigned piece = 1; piece < 5000; piece = piece * 3 + 1) {
+    iddt::read_ahead_file input(filename, 1000, 3);
+    EXPECT_TRUE(input.backend() == "io_uring" || input.backend() == "thread");
+    std::string res = "";
+    std::vector<char> buffer(piece);
+    std::size_t n = 0;
+    while ((n = input.read(buffer.data(), piece))) {
+      res.append(buffer.data(), n);
+      if (res.size() < content.size()) {
+        EXPECT_EQ(n, piece);
+      }
+    }
+    EXPECT_EQ(res, content);
+    EXPECT_EQ(input.read(buffer.data(), piece), 0u);
+  }
+  // a file that ends on a buffer boundary
+  output.open(filename.c_str(), std::ios::binary);
+  output << content.substr(0, 3000);
+  output.close();
+  iddt::read_ahead_file exact(filename, 1000, 2);
+  std::vector<char> buffer(5000);
+  EXPECT_EQ(exact.read(buffer.data(), buffer.size()), 3000u);
+  EXPECT_EQ(std::string(buffer.data(), 3000), content.substr(0, 3000));
+  EXPECT_EQ(exact.read(buffer.data(), buffer.size()), 0u);
+  boost::filesystem::remove_all(tmp_dir);
+}
+
+TEST(readAheadFileTest, emptyAndAbandonedFiles) {
+  boost::filesystem::path tmp_dir = boost::filesystem::unique_path();
+  boost::filesystem::create_directory(tmp_dir);
+  std::string filename = (tmp_dir / "input.gz").native();
+  std::ofstream output(filename.c_str(), std::ios::binary);
+  output.close();
+  std::vector<char> buffer(100);
+  iddt::read_ahead_file empty(filename, 1000, 3);
+  EXPECT_EQ(empty.read(buffer.data(), buffer.size()), 0u);
+  // outstanding reads are finished when an unread file is destroyed
+  output.open(filename.c_str(), std::ios::binary);
+  output << std::string(100000, 'x');
+  output.close();
+  {
+    iddt::read_ahead_file abandoned(filename, 1000, 4);
+    EXPECT_EQ(abandoned.read(buffer.data(), buffer.size()), 100u);
+  }
+  iddt::read_ahead_file::prefetch(filename);
+  iddt::read_ahead_file::prefetch((tmp_dir / "missing.gz").native());
+  boost::filesystem::remove_all(tmp_dir);
+}
+
+TEST(readAheadFileTest, fallsBackToThread) {
+  boost::filesystem::path tmp_dir = boost::filesystem::unique_path();
+  boost::filesystem::create_directory(tmp_dir);
+  std::string filename = (tmp_dir / "input.gz").native();
+  std::string content = "";
+  for (unsigned i = 0; i < 5000; ++i) content += std::to_string(i) + "\n";
+  std::ofstream output(filename.c_str(), std::ios::binary);
+  output << content;
+  output.close();
+  // reads in flight are discarded, and the file is read from the start
+  iddt::read_ahead_file input(filename, 1000, 4);
+  EXPECT_TRUE(input.fall_back_to_thread());
+  EXPECT_EQ(input.backend(), "thread");
+  std::vector<char> buffer(content.size() + 1);
+  EXPECT_EQ(input.read(buffer.data(), buffer.size()), content.size());
+  EXPECT_EQ(std::string(buffer.data(), content.size()), content);
+  EXPECT_TRUE(input.fall_back_to_thread());
+  // once io_uring has delivered data, reads stay with it
+  iddt::read_ahead_file started(filename, 1000, 4);
+  EXPECT_EQ(started.read(buffer.data(), 10), 10u);
+  EXPECT_EQ(started.fall_back_to_thread(), started.backend() == "thread");
+  EXPECT_EQ(started.read(buffer.data() + 10, buffer.size() - 10),
+            content.size() - 10);
+  EXPECT_EQ(std::string(buffer.data(), content.size()), content);
+  boost::filesystem::remove_all(tmp_dir);
+}
+
+TEST(readAheadFileTest, invalidArguments) {
+  boost::filesystem::path tmp_dir = boost::filesystem::unique_path();
+  boost::filesystem::create_directory(tmp_dir);
+  std::string filename = (tmp_dir / "input.gz").native();
+  std::ofstream output(filename.c_str(), std::ios::binary);
+  output << "text\n";
+  output.close();
+  EXPECT_THROW(iddt::read_ahead_file(filename, 0, 2), std::logic_error);
+  EXPECT_THROW(iddt::read_ahead_file((tmp_dir / "missing.gz").native(), 10, 2),
+               std::runtime_error);
+  iddt::read_ahead_file input(filename, 10, 2);
+  EXPECT_THROW(input.read(0, 10), std::logic_error);
+  boost::filesystem::remove_all(tmp_dir);
+}
@@ -0,0 +1,79 @@
+/*!
+  \file site_table_test.cc
+  \brief tests for columnar tables of parsed sites
+  \copyright Released under the MIT License. Copyright
+  2023 Lightning Auriga
+ */
+
+#include <fstream>
+#include <limits>
+#include <string>
+
+#include "boost/filesystem.hpp"
+#include "gtest/gtest.h"
+#include "imputed-data-dynamic-threshold/site_table.h"
+
+namespace iddt = imputed_data_dynamic_threshold;
+
+TEST(siteTableTest, addsAndAppendsRows) {
+  iddt::site_table a, b;
+  a.add(0.5f, 0, true, "chr1:1:A:T");
+  a.add(0.0f, 2, false, "chr1:2:G:C");
+  b.add(std::numeric_limits<float>::quiet_NaN(), 1, true, "");
+  b.add(0.75f, 1, true, "chr1:4:T:A");
+  a.append(b);
+  EXPECT_EQ(a.size(), 4u);
+  EXPECT_FLOAT_EQ(a.get_r2(0), 0.5f);
+  EXPECT_EQ(a.get_bin(1), 2u);
+  EXPECT_FALSE(a.is_imputed(1));
+  EXPECT_TRUE(a.is_imputed(2));
+  EXPECT_EQ(a.get_id(1), "chr1:2:G:C");
+  EXPECT_EQ(a.get_id(2), "");
+  EXPECT_EQ(a.get_id(3), "chr1:4:T:A");
+  EXPECT_THROW(a.get_id(4), std::out_of_range);
+  EXPECT_THROW(a.add(0.5f, 1u << 16, true, "x"), std::logic_error);
+  a.clear();
+  EXPECT_EQ(a.size(), 0u);
+}
+
+TEST(siteTableTest, savesAndMapsTables) {
+  boost::filesystem::path tmp_dir = boost::filesystem::unique_path();
+  boost::filesystem::create_directory(tmp_dir);
+  std::string filename = (tmp_dir / "table.sites").native();
+  iddt::site_table a;
+  // an odd number of rows and key bytes puts padding before each column
+  a.add(0.5f, 0, true, "chr1:1:A:T");
+  a.add(0.0f, 3, false, "chr1:2:G:C");
+  a.add(0.25f, 1, true, "chr1:3:G:A");
+  std::ofstream output(filename.c_str(), std::ios::binary);
+  a.save(output, "key", 3);
+  output.close();
+  iddt::mapped_site_table b(filename, "key");
+  EXPECT_EQ(b.size(), 3u);
+  EXPECT_EQ(b.get_bin_count(), 3u);
+  for (unsigned i = 0; i < 3; ++i) {
+    EXPECT_EQ(b.get_r2()[i], a.get_r2(i));
+    EXPECT_EQ(b.get_bins()[i], a.get_bin(i));
+    EXPECT_EQ(b.get_imputed()[i] != 0, a.is_imputed(i));
+    EXPECT_EQ(b.get_id(i), a.get_id(i));
+  }
+  EXPECT_THROW(b.get_id(3), std::out_of_range);
+  // a table saved with another key is rejected
+  EXPECT_THROW(iddt::mapped_site_table c(filename, "other"),
+               std::runtime_error);
+  // as are truncated tables and other files
+  boost::filesystem::resize_file(filename,
+                                 boost::filesystem::file_size(filename) - 1);
+  EXPECT_THROW(iddt::mapped_site_table d(filename, "key"), std::runtime_error);
+  output.open(filename.c_str(), std::ios::binary);
+  output << "not a table";
+  output.close();
+  EXPECT_THROW(iddt::mapped_site_table e(filename, "key"), std::runtime_error);
+  // empty tables are valid
+  output.open(filename.c_str(), std::ios::binary);
+  iddt::site_table().save(output, "", 1);
+  output.close();
+  iddt::mapped_site_table f(filename, "");
+  EXPECT_EQ(f.size(), 0u);
+  boost::filesystem::remove_all(tmp_dir);
+}
@@ -0,0 +1,148 @@
+/*!
+  \file summary_cache_test.cc
+  \brief tests for per-file r2 summaries kept between runs
+  \copyright Released under the MIT License. Copyright
+  2023 Lightning Auriga
+ */
+
+#include "imputed-data-dynamic-threshold/summary_cache.h"
+
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "boost/filesystem.hpp"
+#include "gtest/gtest.h"
+
+namespace iddt = imputed_data_dynamic_threshold;
+
+namespace {
+iddt::r2_bins make_bins(const std::vector<double> &bounds) {
+  iddt::r2_bins res;
+  res.set_bin_boundaries(bounds);
+  res.set_histogram_scale(100000);
+  return res;
+}
+}  // namespace
+
+TEST(summaryCacheTest, storesAndLoadsSummaries) {
+  boost::filesystem::path tmp_dir = boost::filesystem::unique_path();
+  std::string input = (tmp_dir / "input.info").native();
+  iddt::summary_cache cache((tmp_dir / "cache" / "nested").native());
+  EXPECT_TRUE(boost::filesystem::is_directory(tmp_dir / "cache" / "nested"));
+  std::ofstream output(input.c_str());
+  output << "SNP\tREF(0)\tALT(1)\n";
+  output.close();
+  std::vector<double> bounds;
+  bounds.push_back(0.01);
+  bounds.push_back(0.5);
+  iddt::r2_bins bins = make_bins(bounds), loaded = make_bins(bounds);
+  bins.get_bins().at(0).add_value("", 0.5f);
+  bins.get_bins().at(0).add_value("", 0.75f);
+  std::string settings = iddt::summary_cache::describe_settings(bins, "info");
+  EXPECT_FALSE(cache.load(input, settings, &loaded));
+  cache.store(input, settings, bins);
+  EXPECT_TRUE(boost::filesystem::is_regular_file(
+      cache.get_entry_path(cache.get_key(input, settings), ".summary")));
+  EXPECT_TRUE(cache.load(input, settings, &loaded));
+  EXPECT_EQ(loaded, bins);
+  // entries are kept apart by settings and by the state of the file
+  iddt::r2_bins other = make_bins(bounds);
+  EXPECT_FALSE(cache.load(
+      input, iddt::summary_cache::describe_settings(bins, "vcf"), &other));
+  std::vector<double> more_bounds(bounds);
+  more_bounds.insert(more_bounds.begin() + 1, 0.05);
+  EXPECT_NE(settings, iddt::summary_cache::describe_settings(
+                          make_bins(more_bounds), "info"));
+  iddt::r2_bins baseline = make_bins(bounds);
+  baseline.set_baseline_r2(0.5f);
+  EXPECT_NE(settings,
+            iddt::summary_cache::describe_settings(baseline, "info"));
+  std::string old_key = cache.get_key(input, settings);
+  output.open(input.c_str(), std::ios::app);
+  output << "chr1:1:A:T\tA\tT\n";
+  output.close();
+  EXPECT_NE(cache.get_key(input, settings), old_key);
+  EXPECT_FALSE(cache.load(input, settings, &other));
+  EXPECT_EQ(other, make_bins(bounds));
+  EXPECT_THROW(cache.get_key((tmp_dir / "missing").native(), settings),
+               std::runtime_error);
+  boost::filesystem::remove_all(tmp_dir);
+}
+
+TEST(summaryCacheTest, damagedEntriesAreMisses) {
+  boost::filesystem::path tmp_dir = boost::filesystem::unique_path();
+  std::string input = (tmp_dir / "input.info").native();
+  iddt::summary_cache cache((tmp_dir / "cache").native());
+  std::ofstream output(input.c_str());
+  output << "SNP\tREF(0)\tALT(1)\n";
+  output.close();
+  std::vector<double> bounds;
+  bounds.push_back(0.01);
+  bounds.push_back(0.5);
+  iddt::r2_bins bins = make_bins(bounds), loaded = make_bins(bounds);
+  bins.get_bins().at(0).add_value("", 0.5f);
+  std::string settings = iddt::summary_cache::describe_settings(bins, "info");
+  cache.store(input, settings, bins);
+  std::string entry =
+      cache.get_entry_path(cache.get_key(input, settings), ".summary");
+  boost::filesystem::resize_file(entry,
+                                 boost::filesystem::file_size(entry) - 1);
+  EXPECT_FALSE(cache.load(input, settings, &loaded));
+  EXPECT_EQ(loaded, make_bins(bounds));
+  output.open(entry.c_str(), std::ios::binary);
+  output << "not a summary";
+  output.close();
+  EXPECT_FALSE(cache.load(input, settings, &loaded));
+  // only the finished entry is left in the directory
+  cache.store(input, settings, bins);
+  EXPECT_TRUE(cache.load(input, settings, &loaded));
+  unsigned n_entries = 0;
+  for (boost::filesystem::directory_iterator iter(tmp_dir / "cache");
+       iter != boost::filesystem::directory_iterator(); ++iter) {
+    ++n_entries;
+  }
+  EXPECT_EQ(n_entries, 1u);
+  EXPECT_THROW(cache.load(input, settings, 0), std::logic_error);
+  // a directory cannot be created over a file
+  EXPECT_THROW(iddt::summary_cache cache_over_file(input), std::runtime_error);
+  boost::filesystem::remove_all(tmp_dir);
+}
+
+TEST(summaryCacheTest, storesAndLoadsSiteTables) {
+  boost::filesystem::path tmp_dir = boost::filesystem::unique_path();
+  std::string input = (tmp_dir / "input.info").native();
+  iddt::summary_cache cache((tmp_dir / "cache").native());
+  std::ofstream output(input.c_str());
+  output << "SNP\tREF(0)\tALT(1)\n";
+  output.close();
+  std::vector<double> bounds;
+  bounds.push_back(0.01);
+  bounds.push_back(0.5);
+  std::string settings =
+      iddt::summary_cache::describe_settings(make_bins(bounds), "info");
+  EXPECT_FALSE(cache.load_sites(input, settings));
+  iddt::site_table sites;
+  sites.add(0.5f, 0, true, "chr1:1:A:T");
+  sites.add(0.0f, 1, false, "chr1:2:G:C");
+  cache.store_sites(input, settings, sites, 1);
+  std::unique_ptr<iddt::mapped_site_table> table =
+      cache.load_sites(input, settings);
+  ASSERT_TRUE(table);
+  EXPECT_EQ(table->size(), 2u);
+  EXPECT_EQ(table->get_id(1), "chr1:2:G:C");
+  // tables sit beside summaries of the same key
+  std::string key = cache.get_key(input, settings);
+  EXPECT_NE(cache.get_entry_path(key, ".sites"),
+            cache.get_entry_path(key, ".summary"));
+  EXPECT_FALSE(cache.load_sites(
+      input, iddt::summary_cache::describe_settings(make_bins(bounds), "vcf")));
+  // damaged tables are misses
+  std::string entry = cache.get_entry_path(key, ".sites");
+  table.reset();
+  boost::filesystem::resize_file(entry,
+                                 boost::filesystem::file_size(entry) - 1);
+  EXPECT_FALSE(cache.load_sites(input, settings));
+  boost::filesystem::remove_all(tmp_dir);
+}
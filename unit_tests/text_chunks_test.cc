@@ -0,0 +1,492 @@
+/*!
+  \file text_chunks_test.cc
+  \brief tests for line-aligned chunked text input
+  \copyright Released under the MIT License. Copyright
+  2023 Lightning Auriga
+ */
+
+#include "unit_tests/text_chunks_test.h"
+
+namespace iddt = imputed_data_dynamic_threshold;
+
+textChunksTest::textChunksTest()
+    : _tmp_dir(boost::filesystem::unique_path().native()),
+      _content(
+          "SNP\tREF(0)\tALT(1)\tALT_Frq\tMAF\tAvgCall\tRsq\tGenotyped\n"
+          "chr1:1:A:T\tA\tT\t0.1\t0.1\t0.1\t0.44231\tImputed\n"
+          "chr1:2:A:T\tA\tT\t0.1\t0.1\t0.1\t0.1\tImputed\n"
+          "chr1:3:G:A\tG\tA\t0.02\t0.02\t0.02\t0.99991\tImputed\n"
+          "\n"
+          "chr1:4:T:A\tT\tA\t0.4\t0.4\t0.4\t0.34113\tImputed\n"
+          "chr1:5:A:T\tA\tT\t0.1\t0.1\t0.1\t0.1\tImputed\n"
+          "chr1:6:A:C\tA\tC\t0.1\t0.1\t1.0\t1.0\tGenotyped\n"
+          "chr1:7:A:C\tA\tC\t0.1\t0.1\t1.0\t1.0\tGenotyped\n") {
+  boost::filesystem::create_directory(_tmp_dir);
+}
+
+textChunksTest::~textChunksTest() throw() {
+  if (boost::filesystem::exists(_tmp_dir)) {
+    boost::filesystem::remove_all(_tmp_dir);
+  }
+}
+
+void textChunksTest::create_bgzf_file(const std::string &filename,
+                                      const std::string &content,
+                                      unsigned block_size) const {
+  std::ofstream output(filename.c_str(), std::ios::binary);
+  if (!output.is_open()) {
+    throw std::runtime_error("cannot write bgzf test file");
+  }
+  // the final, empty block is the standard BGZF end-of-file marker
+  for (std::string::size_type start = 0; start <= content.size();
+       start += block_size) {
+    std::string text = content.substr(start, block_size);
+    std::vector<unsigned char> deflated(compressBound(text.size()) + 64);
+    z_stream strm = z_stream();
+    if (deflateInit2(&strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8,
+                     Z_DEFAULT_STRATEGY) != Z_OK) {
+      throw std::runtime_error("cannot initialize deflate");
+    }
+    strm.next_in =
+        reinterpret_cast<Bytef *>(const_cast<char *>(text.data()));
+    strm.avail_in = text.size();
+    strm.next_out = deflated.data();
+    strm.avail_out = deflated.size();
+    deflate(&strm, Z_FINISH);
+    unsigned n_deflated = deflated.size() - strm.avail_out;
+    deflateEnd(&strm);
+    unsigned bsize = n_deflated + 25;
+    unsigned long crc =
+        crc32(0, reinterpret_cast<const Bytef *>(text.data()), text.size());
+    unsigned char header[18] = {31, 139, 8, 4, 0, 0, 0, 0, 0, 255,
+                                6, 0, 'B', 'C', 2, 0, 0, 0};
+    header[16] = bsize & 0xff;
+    header[17] = (bsize >> 8) & 0xff;
+    unsigned char footer[8] = {0};
+    for (unsigned i = 0; i < 4; ++i) {
+      footer[i] = (crc >> (8 * i)) & 0xff;
+      footer[4 + i] = (text.size() >> (8 * i)) & 0xff;
+    }
+    output.write(reinterpret_cast<const char *>(header), 18);
+    output.write(reinterpret_cast<const char *>(deflated.data()), n_deflated);
+    output.write(reinterpret_cast<const char *>(footer), 8);
+    if (text.empty()) break;
+  }
+  output.close();
+}
+
+void textChunksTest::create_gzip_file(const std::string &filename,
+                                      const std::string &content) const {
+  gzFile output = gzopen(filename.c_str(), "wb");
+  if (!output) {
+    throw std::runtime_error("cannot write gzip test file");
+  }
+  gzwrite(output, content.data(), content.size());
+  gzclose(output);
+}
+
+std::string textChunksTest::read_all_chunks(iddt::text_chunk_reader *reader,
+                                            std::vector<unsigned> *ordinals)
+    const {
+  std::string res = "";
+  iddt::text_chunk chunk;
+  while (reader->next_chunk(&chunk)) {
+    reader->fill_chunk(&chunk);
+    ordinals->push_back(chunk.ordinal);
+    EXPECT_EQ(chunk.starts_file, ordinals->size() == 1);
+    res += chunk.get_text();
+  }
+  return res;
+}
+
+TEST_F(textChunksTest, detectBgzf) {
+  std::string bgzf_file = _tmp_dir + "/detect.txt.gz";
+  std::string gzip_file = _tmp_dir + "/detect.txt.gz2";
+  create_bgzf_file(bgzf_file, _content, 100);
+  create_gzip_file(gzip_file, _content);
+  EXPECT_TRUE(iddt::text_chunk_reader::detect_bgzf(bgzf_file));
+  EXPECT_TRUE(iddt::text_chunk_reader::detect_bgzf("unit_tests/test.vcf.gz"));
+  EXPECT_FALSE(iddt::text_chunk_reader::detect_bgzf(gzip_file));
+  EXPECT_FALSE(iddt::text_chunk_reader::detect_bgzf(_tmp_dir + "/missing"));
+}
+
+TEST_F(textChunksTest, sequentialChunksReconstructInput) {
+  std::string filename = _tmp_dir + "/sequential.txt.gz";
+  create_gzip_file(filename, _content);
+  for (unsigned chunk_size = 1; chunk_size < 200; chunk_size += 13) {
+    iddt::text_chunk_reader reader(filename, chunk_size);
+    std::vector<unsigned> ordinals;
+    EXPECT_FALSE(reader.is_bgzf());
+    EXPECT_EQ(read_all_chunks(&reader, &ordinals), _content);
+    for (unsigned i = 0; i < ordinals.size(); ++i) {
+      EXPECT_EQ(ordinals.at(i), i);
+    }
+  }
+}
+
+TEST_F(textChunksTest, sequentialChunksInflatedInParallel) {
+  std::string filename = _tmp_dir + "/parallel.txt.gz";
+  std::string content = "";
+  for (unsigned i = 0; i < 40000; ++i) {
+    content += "chr1:" + std::to_string(i * 7919 % 100003) + ":A:T\tA\tT\t0." +
+               std::to_string(i * 104729 % 99991) + "\tImputed\n";
+  }
+  create_gzip_file(filename, content);
+  for (unsigned n_threads = 1; n_threads <= 4; n_threads += 3) {
+    iddt::text_chunk_reader reader(filename, 2000, n_threads);
+    std::vector<unsigned> ordinals;
+    EXPECT_FALSE(reader.is_bgzf());
+    EXPECT_EQ(read_all_chunks(&reader, &ordinals), content);
+  }
+}
+
+TEST_F(textChunksTest, indexedChunksReconstructInput) {
+  std::string filename = _tmp_dir + "/indexed.txt.gz";
+  std::string content = "";
+  for (unsigned i = 0; i < 40000; ++i) {
+    content += "chr1:" + std::to_string(i * 7919 % 100003) + ":A:T\tA\tT\t0." +
+               std::to_string(i * 104729 % 99991) + "\tImputed\n";
+  }
+  create_gzip_file(filename, content);
+  iddt::gzip_index index(3000);
+  std::vector<unsigned> ordinals;
+  // the first pass reads sequentially and records checkpoints
+  iddt::text_chunk_reader first(filename, 2000, 1, &index);
+  EXPECT_EQ(read_all_chunks(&first, &ordinals), content);
+  ASSERT_TRUE(index.is_complete());
+  ASSERT_GT(index.size(), 2u);
+  // later passes claim one checkpoint per chunk
+  iddt::text_chunk_reader second(filename, 2000, 1, &index);
+  ordinals.clear();
+  EXPECT_EQ(read_all_chunks(&second, &ordinals), content);
+  EXPECT_EQ(ordinals.size(), index.size());
+}
+
+TEST_F(textChunksTest, mappedChunksReconstructInput) {
+  std::string filename = _tmp_dir + "/mapped.txt";
+  std::string content = _content + "chr1:8:A:C";
+  std::ofstream output(filename.c_str(), std::ios::binary);
+  output << content;
+  output.close();
+  for (unsigned chunk_size = 1; chunk_size < 200; chunk_size += 13) {
+    iddt::text_chunk_reader reader(filename, chunk_size);
+    std::vector<unsigned> ordinals;
+    EXPECT_FALSE(reader.is_bgzf());
+    EXPECT_EQ(read_all_chunks(&reader, &ordinals), content);
+    for (unsigned i = 0; i < ordinals.size(); ++i) {
+      EXPECT_EQ(ordinals.at(i), i);
+    }
+  }
+  // a claimed chunk keeps the mapping alive after its reader is gone
+  iddt::text_chunk chunk;
+  {
+    iddt::text_chunk_reader reader(filename, 10);
+    ASSERT_TRUE(reader.next_chunk(&chunk));
+  }
+  EXPECT_TRUE(chunk.text.empty());
+  EXPECT_EQ(chunk.get_text(), content.substr(0, chunk.get_text().size()));
+  EXPECT_EQ(chunk.get_text().back(), '\n');
+  output.open(filename.c_str(), std::ios::binary);
+  output.close();
+  iddt::text_chunk_reader empty(filename, 10);
+  EXPECT_FALSE(empty.next_chunk(&chunk));
+}
+
+TEST_F(textChunksTest, bgzfChunksReconstructInput) {
+  // tiny blocks put line breaks at every position relative to block
+  // and chunk boundaries, including lines spanning several chunks
+  for (unsigned block_size = 1; block_size < 70; block_size += 3) {
+    std::string filename =
+        _tmp_dir + "/bgzf" + std::to_string(block_size) + ".txt.gz";
+    create_bgzf_file(filename, _content, block_size);
+    for (unsigned chunk_size = 1; chunk_size < 150; chunk_size += 17) {
+      iddt::text_chunk_reader reader(filename, chunk_size);
+      std::vector<unsigned> ordinals;
+      EXPECT_TRUE(reader.is_bgzf());
+      EXPECT_EQ(read_all_chunks(&reader, &ordinals), _content);
+    }
+  }
+}
+
+TEST_F(textChunksTest, bgzfUnterminatedFinalLine) {
+  std::string filename = _tmp_dir + "/unterminated.txt.gz";
+  std::string content = _content + "chr1:8:A:C";
+  create_bgzf_file(filename, content, 20);
+  iddt::text_chunk_reader reader(filename, 30);
+  std::vector<unsigned> ordinals;
+  EXPECT_EQ(read_all_chunks(&reader, &ordinals), content);
+}
+
+TEST_F(textChunksTest, nullChunkPointer) {
+  std::string filename = _tmp_dir + "/null.txt.gz";
+  create_gzip_file(filename, _content);
+  iddt::text_chunk_reader reader(filename, 100);
+  EXPECT_THROW(reader.next_chunk(NULL), std::logic_error);
+  EXPECT_THROW(reader.fill_chunk(NULL), std::logic_error);
+}
+
+TEST_F(textChunksTest, missingFile) {
+  EXPECT_THROW(iddt::text_chunk_reader(_tmp_dir + "/missing.txt.gz", 100),
+               std::runtime_error);
+}
+
+TEST_F(textChunksTest, gzipStreamReaderReadsGzipAndBgzf) {
+  std::string content = "";
+  for (unsigned i = 0; i < 20; ++i) content += _content;
+  std::string gzip_name = _tmp_dir + "/stream.txt.gz";
+  std::string bgzf_name = _tmp_dir + "/stream.txt.bgz";
+  create_gzip_file(gzip_name, content);
+  create_bgzf_file(bgzf_name, content, 100);
+  for (unsigned i = 0; i < 2; ++i) {
+    iddt::gzip_stream_reader reader(i ? bgzf_name : gzip_name);
+    std::string observed = "";
+    char buffer[77];
+    std::size_t n = 0;
+    while ((n = reader.read(buffer, 77)) > 0) observed.append(buffer, n);
+    EXPECT_EQ(observed, content);
+    EXPECT_EQ(reader.read(buffer, 77), 0u);
+  }
+  // a bgzf file cut off inside a block is an error
+  std::ifstream input(bgzf_name.c_str(), std::ios::binary);
+  std::string compressed((std::istreambuf_iterator<char>(input)),
+                         std::istreambuf_iterator<char>());
+  input.close();
+  std::ofstream output(bgzf_name.c_str(), std::ios::binary);
+  output << compressed.substr(0, compressed.size() - 5);
+  output.close();
+  iddt::gzip_stream_reader reader(bgzf_name);
+  std::vector<char> buffer(content.size());
+  EXPECT_THROW(reader.read(buffer.data(), buffer.size()), std::runtime_error);
+}
+
+TEST_F(textChunksTest, schedulerCoversEveryChunk) {
+  std::vector<std::string> filenames;
+  std::vector<char> splittable;
+  std::string long_content = "";
+  for (unsigned i = 0; i < 20; ++i) long_content += _content;
+  filenames.push_back(_tmp_dir + "/scheduled1.txt.gz");
+  create_bgzf_file(filenames.back(), long_content, 50);
+  splittable.push_back(1);
+  filenames.push_back(_tmp_dir + "/scheduled2.txt.gz");
+  create_gzip_file(filenames.back(), _content);
+  splittable.push_back(1);
+  // unsplittable files are never opened by the scheduler
+  filenames.push_back(_tmp_dir + "/whole.bcf");
+  splittable.push_back(0);
+  filenames.push_back(_tmp_dir + "/empty.txt.gz");
+  create_gzip_file(filenames.back(), "");
+  splittable.push_back(1);
+  iddt::chunk_scheduler scheduler(filenames, splittable, 3, 100);
+  std::vector<std::map<unsigned, std::string> > text(filenames.size());
+  std::vector<unsigned> whole_files;
+  iddt::scheduled_chunk task;
+  unsigned count = 0;
+  EXPECT_FALSE(scheduler.get_chunk_count(0, &count));
+  // workers take turns, so each runs out of its own files at a
+  // different point and has to steal or share
+  for (unsigned t = 0, n_done = 0; n_done < 3; t = (t + 1) % 3) {
+    if (!scheduler.next(t, &task)) {
+      ++n_done;
+      continue;
+    }
+    n_done = 0;
+    if (task.whole_file) {
+      whole_files.push_back(task.file);
+    } else {
+      std::string chunk_text(task.chunk.get_text());
+      EXPECT_TRUE(text.at(task.file)
+                      .insert(std::make_pair(task.chunk.ordinal, chunk_text))
+                      .second);
+    }
+  }
+  ASSERT_EQ(whole_files.size(), 1u);
+  EXPECT_EQ(whole_files.at(0), 2u);
+  std::vector<std::string> expected;
+  expected.push_back(long_content);
+  expected.push_back(_content);
+  expected.push_back("");
+  expected.push_back("");
+  for (unsigned i = 0; i < filenames.size(); ++i) {
+    ASSERT_TRUE(scheduler.get_chunk_count(i, &count));
+    if (i == 2) {
+      EXPECT_EQ(count, 1u);
+      continue;
+    }
+    EXPECT_EQ(count, text.at(i).size());
+    std::string observed = "";
+    for (std::map<unsigned, std::string>::const_iterator iter =
+             text.at(i).begin();
+         iter != text.at(i).end(); ++iter) {
+      observed += iter->second;
+    }
+    EXPECT_EQ(observed, expected.at(i));
+  }
+  EXPECT_GT(text.at(0).size(), 3u);
+}
+
+TEST_F(textChunksTest, schedulerIdleWorkersSteal) {
+  std::vector<std::string> filenames;
+  std::vector<char> splittable;
+  std::string long_content = "";
+  for (unsigned i = 0; i < 10; ++i) long_content += _content;
+  for (unsigned i = 0; i < 2; ++i) {
+    filenames.push_back(_tmp_dir + "/steal" + std::to_string(i) + ".txt.gz");
+    create_bgzf_file(filenames.back(), long_content, 50);
+    splittable.push_back(1);
+  }
+  // both files are dealt to worker 0 of 3
+  iddt::chunk_scheduler scheduler(filenames, splittable, 3, 100);
+  iddt::scheduled_chunk task;
+  // worker 1 has no files of its own, and steals worker 0's last file
+  ASSERT_TRUE(scheduler.next(1, &task));
+  EXPECT_EQ(task.file, 1u);
+  EXPECT_EQ(task.chunk.ordinal, 0u);
+  ASSERT_TRUE(scheduler.next(0, &task));
+  EXPECT_EQ(task.file, 0u);
+  // with no file left unstarted, worker 2 shares the earliest one
+  ASSERT_TRUE(scheduler.next(2, &task));
+  EXPECT_EQ(task.file, 0u);
+  EXPECT_EQ(task.chunk.ordinal, 1u);
+}
+
+TEST_F(textChunksTest, schedulerMultithreaded) {
+  std::vector<std::string> filenames;
+  std::vector<char> splittable;
+  std::string content = "";
+  for (unsigned i = 0; i < 50; ++i) content += _content;
+  for (unsigned i = 0; i < 7; ++i) {
+    filenames.push_back(_tmp_dir + "/threaded" + std::to_string(i) +
+                        ".txt.gz");
+    // files of very different sizes
+    std::string file_content = content.substr(0, content.size() >> i);
+    if (i % 2) {
+      create_gzip_file(filenames.back(), file_content);
+    } else {
+      create_bgzf_file(filenames.back(), file_content, 200);
+    }
+    splittable.push_back(1);
+  }
+  iddt::chunk_scheduler scheduler(filenames, splittable, 4, 500);
+  std::mutex lock;
+  std::map<std::pair<unsigned, unsigned>, std::string> text;
+  std::vector<std::thread> workers;
+  for (unsigned t = 0; t < 4; ++t) {
+    workers.push_back(std::thread([&, t]() {
+      iddt::scheduled_chunk task;
+      while (scheduler.next(t, &task)) {
+        std::lock_guard<std::mutex> guard(lock);
+        text[std::make_pair(task.file, task.chunk.ordinal)] =
+            task.chunk.get_text();
+      }
+    }));
+  }
+  for (unsigned t = 0; t < workers.size(); ++t) workers.at(t).join();
+  for (unsigned i = 0; i < filenames.size(); ++i) {
+    unsigned count = 0;
+    ASSERT_TRUE(scheduler.get_chunk_count(i, &count));
+    std::string observed = "";
+    for (unsigned j = 0; j < count; ++j) {
+      observed += text[std::make_pair(i, j)];
+    }
+    EXPECT_EQ(observed, content.substr(0, content.size() >> i));
+  }
+}
+
+TEST_F(textChunksTest, schedulerRunBoundsPendingResults) {
+  std::vector<std::string> filenames;
+  std::vector<char> splittable;
+  std::string content = "";
+  for (unsigned i = 0; i < 20; ++i) content += _content;
+  for (unsigned i = 0; i < 5; ++i) {
+    filenames.push_back(_tmp_dir + "/bounded" + std::to_string(i) +
+                        ".txt.gz");
+    create_bgzf_file(filenames.back(), content, 100);
+    splittable.push_back(1);
+  }
+  iddt::chunk_scheduler scheduler(filenames, splittable, 3, 100);
+  std::mutex lock;
+  unsigned n_ready = 0, max_ready = 0;
+  std::vector<std::string> observed(filenames.size());
+  std::vector<unsigned> finished;
+  std::thread::id caller = std::this_thread::get_id();
+  // the first file is slow, so without a bound the other workers would
+  // finish every later chunk while the consumer waits for it
+  scheduler.run<std::string>(
+      [&](const iddt::scheduled_chunk &task, std::string *result) {
+        if (!task.file) {
+          std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+        *result = task.chunk.get_text();
+        std::lock_guard<std::mutex> guard(lock);
+        ++n_ready;
+        if (n_ready > max_ready) max_ready = n_ready;
+      },
+      [&](unsigned file, std::string *result) {
+        EXPECT_EQ(std::this_thread::get_id(), caller);
+        observed.at(file) += *result;
+        std::lock_guard<std::mutex> guard(lock);
+        --n_ready;
+      },
+      [&](unsigned file) {
+        EXPECT_EQ(std::this_thread::get_id(), caller);
+        finished.push_back(file);
+      });
+  for (unsigned i = 0; i < filenames.size(); ++i) {
+    EXPECT_EQ(observed.at(i), content);
+  }
+  ASSERT_EQ(finished.size(), filenames.size());
+  for (unsigned i = 0; i < finished.size(); ++i) {
+    EXPECT_EQ(finished.at(i), i);
+  }
+  // twice the workers, plus the chunk being waited for
+  EXPECT_LE(max_ready, 7u);
+}
+
+TEST_F(textChunksTest, schedulerRunStopsOnError) {
+  std::vector<std::string> filenames;
+  std::vector<char> splittable;
+  std::string content = "";
+  for (unsigned i = 0; i < 20; ++i) content += _content;
+  for (unsigned i = 0; i < 3; ++i) {
+    filenames.push_back(_tmp_dir + "/failing" + std::to_string(i) +
+                        ".txt.gz");
+    create_bgzf_file(filenames.back(), content, 100);
+    splittable.push_back(1);
+  }
+  iddt::chunk_scheduler scheduler(filenames, splittable, 2, 100);
+  EXPECT_THROW(scheduler.run<std::string>(
+                   [](const iddt::scheduled_chunk &, std::string *) {},
+                   [](unsigned file, std::string *) {
+                     if (file) throw std::runtime_error("consumer failed");
+                   },
+                   [](unsigned) {}),
+               std::runtime_error);
+  iddt::chunk_scheduler scheduler2(filenames, splittable, 2, 100);
+  EXPECT_THROW(scheduler2.run<std::string>(
+                   [](const iddt::scheduled_chunk &task, std::string *) {
+                     if (task.file == 2) {
+                       throw std::runtime_error("worker failed");
+                     }
+                   },
+                   [](unsigned, std::string *) {}, [](unsigned) {}),
+               std::runtime_error);
+}
+
+TEST_F(textChunksTest, schedulerInvalidArguments) {
+  std::vector<std::string> filenames(1, _tmp_dir + "/missing.txt.gz");
+  std::vector<char> splittable(1, 1);
+  EXPECT_THROW(iddt::chunk_scheduler(filenames, splittable, 0, 100),
+               std::logic_error);
+  EXPECT_THROW(
+      iddt::chunk_scheduler(filenames, std::vector<char>(), 1, 100),
+      std::logic_error);
+  EXPECT_THROW(iddt::chunk_scheduler(filenames, splittable, 1, 100,
+                                     std::vector<iddt::gzip_index *>(2)),
+               std::logic_error);
+  iddt::chunk_scheduler scheduler(filenames, splittable, 2, 100);
+  iddt::scheduled_chunk task;
+  EXPECT_THROW(scheduler.next(0, NULL), std::logic_error);
+  EXPECT_THROW(scheduler.next(2, &task), std::logic_error);
+  EXPECT_THROW(scheduler.get_chunk_count(0, NULL), std::logic_error);
+  EXPECT_THROW(scheduler.next(0, &task), std::runtime_error);
+}
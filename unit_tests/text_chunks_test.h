@@ -0,0 +1,61 @@
+/*!
+  \file text_chunks_test.h
+  \brief tests for line-aligned chunked text input
+  \copyright Released under the MIT License. Copyright
+  2023 Lightning Auriga
+ */
+
+#ifndef UNIT_TESTS_TEXT_CHUNKS_TEST_H_
+#define UNIT_TESTS_TEXT_CHUNKS_TEST_H_
+
+#include <zlib.h>
+
+#include <chrono>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "boost/filesystem.hpp"
+#include "gtest/gtest.h"
+#include "imputed-data-dynamic-threshold/text_chunks.h"
+
+class textChunksTest : public testing::Test {
+ protected:
+  textChunksTest();
+  ~textChunksTest() throw();
+  /*!
+    \brief write text to a bgzipped file with small blocks
+    @param filename name of file to write
+    @param content text to compress
+    @param block_size number of text bytes per BGZF block
+   */
+  void create_bgzf_file(const std::string &filename,
+                        const std::string &content,
+                        unsigned block_size) const;
+  /*!
+    \brief write text to a plain gzipped file
+    @param filename name of file to write
+    @param content text to compress
+   */
+  void create_gzip_file(const std::string &filename,
+                        const std::string &content) const;
+  /*!
+    \brief read every chunk of a file and concatenate their text
+    @param reader reader for the target file
+    @param ordinals destination for chunk ordinals in claimed order
+    \return concatenated text of all chunks
+   */
+  std::string read_all_chunks(
+      imputed_data_dynamic_threshold::text_chunk_reader *reader,
+      std::vector<unsigned> *ordinals) const;
+  const std::string _tmp_dir;
+  const std::string _content;
+};
+
+#endif  // UNIT_TESTS_TEXT_CHUNKS_TEST_H_
@@ -0,0 +1,76 @@
+/*!
+  \file variant_batch_test.cc
+  \brief tests for columnar variant batches
+  \copyright Released under the MIT License. Copyright
+  2023 Lightning Auriga
+ */
+
+#include <string>
+
+#include "gtest/gtest.h"
+#include "imputed-data-dynamic-threshold/variant_batch.h"
+
+namespace iddt = imputed_data_dynamic_threshold;
+
+TEST(variantBatchTest, addAndClear) {
+  iddt::variant_batch a(70);
+  EXPECT_EQ(a.size(), 0u);
+  // cross a bitmap word boundary
+  for (unsigned i = 0; i < 70; ++i) {
+    std::string id = "chr1:" + std::to_string(i + 1) + ":A:T";
+    if (i % 3) {
+      a.add_imputed(i / 100.0f, i / 200.0, id);
+    } else {
+      a.add_typed(id);
+    }
+  }
+  EXPECT_TRUE(a.full());
+  ASSERT_EQ(a.size(), 70u);
+  EXPECT_EQ(a.get_imputed()[1], 0x1bULL);
+  for (unsigned i = 0; i < 70; ++i) {
+    EXPECT_EQ(a.is_imputed(i), i % 3 != 0);
+    EXPECT_EQ(a.get_id(i), "chr1:" + std::to_string(i + 1) + ":A:T");
+    if (i % 3) {
+      EXPECT_FLOAT_EQ(a.get_r2()[i], i / 100.0f);
+      EXPECT_DOUBLE_EQ(a.get_frequencies()[i], i / 200.0);
+    }
+  }
+  EXPECT_THROW(a.add_typed("x"), std::logic_error);
+  iddt::variant_batch b(a);
+  EXPECT_EQ(b.get_id(69), a.get_id(69));
+  a.clear();
+  EXPECT_EQ(a.size(), 0u);
+  EXPECT_FALSE(a.full());
+  EXPECT_FALSE(a.has_ids());
+  a.add_typed("");
+  a.add_imputed(0.5f, 0.1, "");
+  EXPECT_EQ(a.get_id(1), "");
+  EXPECT_FALSE(a.is_imputed(0));
+  EXPECT_TRUE(a.is_imputed(1));
+  EXPECT_FALSE(a.has_ids());
+  EXPECT_THROW(a.get_id(2), std::out_of_range);
+}
+
+TEST(variantBatchTest, swap) {
+  iddt::variant_batch a(4), b(2);
+  a.add_imputed(0.5f, 0.1, "rs1");
+  a.add_typed("rs2");
+  b.swap(a);
+  EXPECT_EQ(a.size(), 0u);
+  EXPECT_FALSE(a.has_ids());
+  ASSERT_EQ(b.size(), 2u);
+  EXPECT_TRUE(b.is_imputed(0));
+  EXPECT_FALSE(b.is_imputed(1));
+  EXPECT_EQ(b.get_id(1), "rs2");
+  // capacity moves with the contents
+  b.add_typed("rs3");
+  b.add_typed("rs4");
+  EXPECT_TRUE(b.full());
+  a.add_typed("rs5");
+  a.add_typed("rs6");
+  EXPECT_TRUE(a.full());
+}
+
+TEST(variantBatchTest, invalidCapacity) {
+  EXPECT_THROW(iddt::variant_batch(0), std::logic_error);
+}
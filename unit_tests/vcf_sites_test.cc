@@ -0,0 +1,271 @@
+/*!
+  \file vcf_sites_test.cc
+  \brief tests for site-level text vcf reading
+  \copyright Released under the MIT License. Copyright
+  2023 Lightning Auriga
+ */
+
+#include "unit_tests/vcf_sites_test.h"
+
+namespace iddt = imputed_data_dynamic_threshold;
+
+vcfSitesTest::vcfSitesTest()
+    : _tmp_dir(boost::filesystem::unique_path().native()) {
+  boost::filesystem::create_directory(_tmp_dir);
+}
+
+vcfSitesTest::~vcfSitesTest() throw() {
+  if (boost::filesystem::exists(_tmp_dir)) {
+    boost::filesystem::remove_all(_tmp_dir);
+  }
+}
+
+TEST_F(vcfSitesTest, findInfoEnd) {
+  std::string line = "chr1\t1\tid\tA\tT\t.\tPASS\tAF=0.1\tGT\t0/0\n";
+  const char *begin = line.data(), *end = begin + line.size();
+  EXPECT_EQ(iddt::vcf_info_scanner::find_info_end(begin, end),
+            begin + line.find("\tGT"));
+  line = "chr1\t1\tid\tA\tT\t.\tPASS\tAF=0.1\n";
+  begin = line.data();
+  end = begin + line.size();
+  EXPECT_EQ(iddt::vcf_info_scanner::find_info_end(begin, end), end - 1);
+  EXPECT_EQ(iddt::vcf_info_scanner::find_info_end(begin, end - 1), nullptr);
+}
+
+TEST_F(vcfSitesTest, scanInfoTags) {
+  iddt::vcf_info_scanner scanner("DR2", "AF", "IMP");
+  iddt::vcf_site site;
+  std::string line =
+      "chr1\t1\tchr1:1:A:T\tA\tT,G\t.\tPASS\tAF=0.25,0.5;DR2=0.44;IMP\tGT";
+  const char *begin = line.data(), *end = begin + line.size();
+  scanner.scan(begin, iddt::vcf_info_scanner::find_info_end(begin, end),
+               &site);
+  EXPECT_EQ(site.id, "chr1:1:A:T");
+  EXPECT_TRUE(site.has_af);
+  EXPECT_FLOAT_EQ(site.af, 0.25f);
+  EXPECT_TRUE(site.has_r2);
+  EXPECT_FLOAT_EQ(site.r2, 0.44f);
+  EXPECT_TRUE(site.imputed);
+  // tags are matched on the complete key
+  line = "chr1\t2\t.\tA\tT\t.\tPASS\tDR2X=0.9;XAF=0.1;IMPUTED;DR2=.\t";
+  begin = line.data();
+  end = begin + line.size();
+  scanner.scan(begin, iddt::vcf_info_scanner::find_info_end(begin, end),
+               &site);
+  EXPECT_EQ(site.id, ".");
+  EXPECT_FALSE(site.has_af);
+  EXPECT_FALSE(site.has_r2);
+  EXPECT_FALSE(site.imputed);
+  line = "chr1\t3\tx\tA\tT\t.\tPASS\t.";
+  begin = line.data();
+  end = begin + line.size();
+  scanner.scan(begin, end, &site);
+  EXPECT_EQ(site.id, "x");
+  EXPECT_FALSE(site.imputed);
+}
+
+TEST_F(vcfSitesTest, scanRejectsMalformedRecords) {
+  iddt::vcf_info_scanner scanner("DR2", "AF", "IMP");
+  iddt::vcf_site site;
+  std::string line = "chr1\t1\tid\tA\tT\t.\tPASS\n";
+  const char *begin = line.data(), *end = begin + line.size();
+  EXPECT_THROW(
+      scanner.scan(begin, iddt::vcf_info_scanner::find_info_end(begin, end),
+                   &site),
+      std::runtime_error);
+  line = "chr1\t1\tid\tA\tT\t.\tPASS\tDR2=high\n";
+  begin = line.data();
+  end = begin + line.size();
+  EXPECT_THROW(
+      scanner.scan(begin, iddt::vcf_info_scanner::find_info_end(begin, end),
+                   &site),
+      std::runtime_error);
+  EXPECT_THROW(scanner.scan(begin, end, NULL), std::logic_error);
+}
+
+TEST_F(vcfSitesTest, scanBcfSharedBlock) {
+  // header IDs: AF 2, DR2 3, IMP 4
+  iddt::bcf_info_scanner scanner(3, 2, 4);
+  const float af = 0.25f, r2 = 0.8f;
+  std::string block = "";
+  block += std::string("\x37rs1", 4);
+  // REF, then two ALT alleles
+  block += std::string("\x17" "A\x17" "T\x17" "C", 6);
+  block += std::string("\x11\x00", 2);
+  block += std::string("\x11\x02\x15", 3);
+  block += std::string(reinterpret_cast<const char *>(&af), 4);
+  // an unconfigured tag with a vector of 20 int8 values
+  block += std::string("\x11\x06\xf1\x11\x14", 5) + std::string(20, '\x01');
+  block += std::string("\x11\x03\x25", 3);
+  block += std::string(reinterpret_cast<const char *>(&r2), 4);
+  block += std::string(4, '\x00');
+  block += std::string("\x11\x04\x00", 3);
+  iddt::vcf_site site;
+  scanner.scan(block.data(), block.data() + block.size(), 3, 4, &site);
+  EXPECT_EQ(site.id, "rs1");
+  EXPECT_TRUE(site.has_af);
+  EXPECT_FLOAT_EQ(site.af, af);
+  EXPECT_TRUE(site.has_r2);
+  EXPECT_FLOAT_EQ(site.r2, r2);
+  EXPECT_TRUE(site.imputed);
+  // the same record without its last two tags
+  std::string truncated = block.substr(0, block.size() - 14);
+  scanner.scan(truncated.data(), truncated.data() + truncated.size(), 3, 2,
+               &site);
+  EXPECT_FALSE(site.has_r2);
+  EXPECT_FALSE(site.imputed);
+  EXPECT_THROW(scanner.scan(truncated.data(),
+                            truncated.data() + truncated.size(), 3, 3, &site),
+               std::runtime_error);
+  EXPECT_THROW(scanner.scan(block.data(), block.data() + block.size(), 3, 4,
+                            NULL),
+               std::logic_error);
+}
+
+TEST_F(vcfSitesTest, scanBcfMissingValues) {
+  iddt::bcf_info_scanner scanner(3, 2, -1);
+  const std::uint32_t missing = 0x7f800001;
+  std::string block = "";
+  // missing ID, one allele, no filters
+  block += std::string("\x07\x17" "A\x00", 4);
+  block += std::string("\x11\x03\x15", 3);
+  block += std::string(reinterpret_cast<const char *>(&missing), 4);
+  // allele frequency of an integer type is not a usable value
+  block += std::string("\x11\x02\x11\x01", 4);
+  iddt::vcf_site site;
+  scanner.scan(block.data(), block.data() + block.size(), 1, 2, &site);
+  EXPECT_EQ(site.id, ".");
+  EXPECT_FALSE(site.has_r2);
+  EXPECT_FALSE(site.has_af);
+  EXPECT_FALSE(site.imputed);
+}
+
+TEST_F(vcfSitesTest, isTextVcf) {
+  std::string info_file = _tmp_dir + "/test.info.gz";
+  gzFile output = gzopen(info_file.c_str(), "wb");
+  ASSERT_TRUE(output);
+  gzputs(output, "SNP\tREF(0)\tALT(1)\n");
+  gzclose(output);
+  EXPECT_TRUE(iddt::vcf_site_reader::is_text_vcf("unit_tests/test.vcf.gz"));
+  EXPECT_FALSE(iddt::vcf_site_reader::is_text_vcf(info_file));
+  EXPECT_FALSE(iddt::vcf_site_reader::is_text_vcf(_tmp_dir + "/missing"));
+}
+
+TEST_F(vcfSitesTest, readCommittedVcf) {
+  iddt::vcf_site_reader reader("unit_tests/test.vcf.gz",
+                               iddt::vcf_info_scanner("DR2", "AF", "IMP"));
+  iddt::vcf_site site;
+  std::vector<std::string> ids;
+  std::vector<bool> imputed;
+  while (reader.next_site(&site)) {
+    ids.push_back(std::string(site.id));
+    imputed.push_back(site.imputed);
+  }
+  ASSERT_EQ(ids.size(), 7u);
+  EXPECT_EQ(ids.at(0), "chr1:1:A:T");
+  EXPECT_EQ(ids.at(6), "chr1:7:A:C");
+  EXPECT_TRUE(imputed.at(4));
+  EXPECT_FALSE(imputed.at(5));
+}
+
+TEST_F(vcfSitesTest, readCommittedVcfWithDecompressionPool) {
+  iddt::decompression_pool pool(2);
+  iddt::vcf_site_reader reader("unit_tests/test.vcf.gz",
+                               iddt::vcf_info_scanner("DR2", "AF", "IMP"),
+                               &pool);
+  iddt::vcf_site site;
+  std::vector<std::string> ids;
+  while (reader.next_site(&site)) ids.push_back(std::string(site.id));
+  ASSERT_EQ(ids.size(), 7u);
+  EXPECT_EQ(ids.at(0), "chr1:1:A:T");
+  EXPECT_EQ(ids.at(6), "chr1:7:A:C");
+}
+
+TEST_F(vcfSitesTest, readSkipsLongSampleData) {
+  // sample columns much larger than the read buffer
+  std::string filename = _tmp_dir + "/wide.vcf.gz";
+  std::string samples = "";
+  for (unsigned i = 0; i < 600000; ++i) {
+    samples += "\t0|1";
+  }
+  gzFile output = gzopen(filename.c_str(), "wb");
+  ASSERT_TRUE(output);
+  gzputs(output, "##fileformat=VCFv4.2\n");
+  gzputs(output, "#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\tFORMAT");
+  gzputs(output, samples.c_str());
+  gzputs(output, "\n");
+  for (unsigned i = 0; i < 5; ++i) {
+    std::string line = "chr1\t" + std::to_string(i + 1) + "\tv" +
+                       std::to_string(i) +
+                       "\tA\tT\t.\tPASS\tAF=0.1;DR2=0.5;IMP\tGT" + samples;
+    // final record is left unterminated
+    if (i < 4) line += "\n";
+    gzputs(output, line.c_str());
+  }
+  gzclose(output);
+  iddt::vcf_site_reader reader(filename,
+                               iddt::vcf_info_scanner("DR2", "AF", "IMP"));
+  iddt::vcf_site site;
+  for (unsigned i = 0; i < 5; ++i) {
+    ASSERT_TRUE(reader.next_site(&site));
+    EXPECT_EQ(site.id, "v" + std::to_string(i));
+    EXPECT_FLOAT_EQ(site.r2, 0.5f);
+  }
+  EXPECT_FALSE(reader.next_site(&site));
+}
+
+TEST_F(vcfSitesTest, bcfReaderMatchesTextReader) {
+  iddt::vcf_site_reader text_reader(
+      "unit_tests/test.vcf.gz", iddt::vcf_info_scanner("DR2", "AF", "IMP"));
+  iddt::bcf_site_reader hts_reader("unit_tests/test.vcf.gz", "DR2", "AF",
+                                   "IMP", 0);
+  iddt::vcf_site text_site, hts_site;
+  unsigned n_sites = 0;
+  while (text_reader.next_site(&text_site)) {
+    ASSERT_TRUE(hts_reader.next_site(&hts_site));
+    EXPECT_EQ(hts_site.id, text_site.id);
+    EXPECT_EQ(hts_site.imputed, text_site.imputed);
+    EXPECT_EQ(hts_site.has_r2, text_site.has_r2);
+    EXPECT_EQ(hts_site.has_af, text_site.has_af);
+    if (text_site.has_r2) {
+      EXPECT_FLOAT_EQ(hts_site.r2, text_site.r2);
+    }
+    if (text_site.has_af) {
+      EXPECT_FLOAT_EQ(hts_site.af, text_site.af);
+    }
+    ++n_sites;
+  }
+  EXPECT_FALSE(hts_reader.next_site(&hts_site));
+  EXPECT_EQ(n_sites, 7u);
+}
+
+TEST_F(vcfSitesTest, bcfReaderUndeclaredAndMissingTags) {
+  std::string filename = _tmp_dir + "/tags.vcf.gz";
+  gzFile output = gzopen(filename.c_str(), "wb");
+  ASSERT_TRUE(output);
+  gzputs(output, "##fileformat=VCFv4.2\n");
+  gzputs(output,
+         "##INFO=<ID=AF,Number=A,Type=Float,Description=\"frequency\">\n");
+  gzputs(output,
+         "##INFO=<ID=DR2,Number=A,Type=Float,Description=\"r2\">\n");
+  gzputs(output, "#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\n");
+  gzputs(output, "chr1\t1\tv1\tA\tT\t.\tPASS\tAF=0.1;DR2=.\n");
+  gzclose(output);
+  // IMP is not declared in the header, so no variant is imputed
+  iddt::bcf_site_reader reader(filename, "DR2", "AF", "IMP", 0);
+  iddt::vcf_site site;
+  ASSERT_TRUE(reader.next_site(&site));
+  EXPECT_EQ(site.id, "v1");
+  EXPECT_FALSE(site.imputed);
+  EXPECT_FALSE(site.has_r2);
+  EXPECT_TRUE(site.has_af);
+  EXPECT_FLOAT_EQ(site.af, 0.1f);
+  EXPECT_FALSE(reader.next_site(&site));
+  EXPECT_THROW(reader.next_site(0), std::logic_error);
+}
+
+TEST_F(vcfSitesTest, bcfReaderMissingFile) {
+  EXPECT_THROW(iddt::bcf_site_reader(_tmp_dir + "/missing.bcf", "DR2", "AF",
+                                     "IMP", 0),
+               std::runtime_error);
+}
@@ -0,0 +1,30 @@
+/*!
+  \file vcf_sites_test.h
+  \brief tests for site-level text vcf reading
+  \copyright Released under the MIT License. Copyright
+  2023 Lightning Auriga
+ */
+
+#ifndef UNIT_TESTS_VCF_SITES_TEST_H_
+#define UNIT_TESTS_VCF_SITES_TEST_H_
+
+#include <zlib.h>
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "boost/filesystem.hpp"
+#include "gtest/gtest.h"
+#include "imputed-data-dynamic-threshold/decompression_pool.h"
+#include "imputed-data-dynamic-threshold/vcf_sites.h"
+
+class vcfSitesTest : public testing::Test {
+ protected:
+  vcfSitesTest();
+  ~vcfSitesTest() throw();
+  const std::string _tmp_dir;
+};
+
+#endif  // UNIT_TESTS_VCF_SITES_TEST_H_